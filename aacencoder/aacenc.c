@@ -13,132 +13,396 @@
 
 #include <fdk-aac/aacenc_lib.h>
 
-/* XXX:WARNING the pcm period buf length should be the common factor of
- * the aac input pcm frame length, or the aac timestamp will be wrong
- * here the pcm period buf length == 1024 bytes,
- * and the aac input pcm frame length == 2048
- */
+#include "aacenc.h"
+
+/* access units one call could hold before au_buf has to grow */
+#define AAC_AU_INIT_NUM		4
+
 
+/* grow au_buf/aus so one more access unit surely fits,
+ * pointers into au_buf are only set when the call returns */
+static int __reserve_au(struct aac_encoder *aac_enc)
+{
+	uint8_t *au_buf = NULL;
+	struct aac_au *aus = NULL;
+	int size;
+
+	if (aac_enc->au_buf_len + aac_enc->max_au_size >
+						aac_enc->au_buf_size) {
+		size = aac_enc->au_buf_size * 2;
+		au_buf = (uint8_t *)realloc(aac_enc->au_buf, size);
+		if (au_buf == NULL)
+			return -1;
+		aac_enc->au_buf = au_buf;
+		aac_enc->au_buf_size = size;
+	}
 
-/* get from aac encoder */
-static uint8_t *aac_out_buf;
-static int aac_out_buf_size;
-static int aac_out_payload_len;
-static uint8_t *aac_in_buf;
-static int aac_in_buf_size;
-static int aac_in_payload_len;
+	if (aac_enc->au_num == aac_enc->au_cap) {
+		size = aac_enc->au_cap * 2;
+		aus = (struct aac_au *)realloc(aac_enc->aus,
+					size * sizeof(struct aac_au));
+		if (aus == NULL)
+			return -1;
+		aac_enc->aus = aus;
+		aac_enc->au_cap = size;
+	}
 
+	return 0;
+}
 
-/* @caution: only when the sum of input pcm_buf len >
- * aac encoder minimum input buf len will aac encoder
- * generate out aac buf
- * @here the pcm_buf_len is fix to 1024 bytes
- * (which is half of the aac encoder minimum input buf len)
- * @return: aac frame length
+/* hand @samples(per channel) at @pcm to fdk-aac, @samples < 0 drains it
+ * @pts: pts of the first of them, queued until their access unit is out,
+ * fdk-aac gives exactly one access unit per input frame after its delay
+ * @out/@out_size: where the access unit goes, @au->len is 0 if none
+ * @return: 0, 1 if the encoder is drained, < 0 on error
  */
-static int __aac_encode_a_frame(HANDLE_AACENCODER aac_enc_hd)
+static int __encode_frame(struct aac_encoder *aac_enc,
+				const uint8_t *pcm, int samples, int64_t pts,
+				uint8_t *out, int out_size, struct aac_au *au)
 {
 	AACENC_BufDesc in_buf = {0}, out_buf = {0};
 	AACENC_InArgs in_args = {0};
 	AACENC_OutArgs out_args = {0};
 	int in_identifier = IN_AUDIO_DATA;
 	int in_elem_size;
+	int in_size;
 	int out_identifier = OUT_BITSTREAM_DATA;
 	int out_elem_size;
+	void *in_ptr = NULL;
+	void *out_ptr = NULL;
 	int ret = 0;
 
+	au->len = 0;
+
 	in_elem_size = 2;	//bitfmt 16 bits width
 	out_elem_size = 1;
 
-	in_args.numInSamples = aac_in_buf_size / 2;		//bitfmt 16 bits width
+	if (samples > 0) {
+		if (aac_enc->pts_tail - aac_enc->pts_head ==
+						AAC_PTS_QUEUE_SIZE) {
+			printf("AAC pts queue overflow\n");
+			return -1;
+		}
+		aac_enc->pts_queue[aac_enc->pts_tail++ %
+					AAC_PTS_QUEUE_SIZE] = pts;
+	}
+
+	/* fdk-aac counts samples of all channels */
+	in_args.numInSamples = samples > 0 ? samples * aac_enc->channels : -1;
+	in_ptr = (void *)pcm;
+	in_size = samples > 0 ? samples * aac_enc->channels * 2 : 0;
 	in_buf.numBufs = 1;
-	in_buf.bufs = (void **)&aac_in_buf;
+	in_buf.bufs = &in_ptr;
 	in_buf.bufferIdentifiers = &in_identifier;
-	in_buf.bufSizes = &aac_in_buf_size;
+	in_buf.bufSizes = &in_size;
 	in_buf.bufElSizes = &in_elem_size;
 
+	out_ptr = out;
 	out_buf.numBufs = 1;
-	out_buf.bufs = (void **)&aac_out_buf;
+	out_buf.bufs = &out_ptr;
 	out_buf.bufferIdentifiers = &out_identifier;
-	out_buf.bufSizes = &aac_out_buf_size;
+	out_buf.bufSizes = &out_size;
 	out_buf.bufElSizes = &out_elem_size;
 
-	ret = aacEncEncode(aac_enc_hd, &in_buf, &out_buf, &in_args, &out_args);
+	ret = aacEncEncode(aac_enc->handle, &in_buf, &out_buf,
+						&in_args, &out_args);
 	if (ret != AACENC_OK) {
-		if (ret == AACENC_ENCODE_EOF) {
-			printf("AAC encode EOF...\n");
-			return 0;
-		}
+		if (ret == AACENC_ENCODE_EOF)
+			return 1;
 
 		printf("AAC encode a frame fail\n");
+		return -1;
+	}
+
+	if (out_args.numOutBytes <= 0)
 		return 0;
+
+	au->data = out;
+	au->len = out_args.numOutBytes;
+	if (aac_enc->pts_head != aac_enc->pts_tail)
+		au->pts = aac_enc->pts_queue[aac_enc->pts_head++ %
+						AAC_PTS_QUEUE_SIZE];
+	else	/* drained frames past the last input, keep counting */
+		au->pts = aac_enc->base_pts + (aac_enc->in_samples -
+				aac_enc->base_sample) * 1000000LL /
+						aac_enc->samplerate;
+
+	return 0;
+}
+
+/* [__encode_frame] appending to au_buf */
+static int __aac_encode_a_frame(struct aac_encoder *aac_enc,
+				const uint8_t *pcm, int samples, int64_t pts)
+{
+	struct aac_au *au = NULL;
+	int ret = 0;
+
+	if (__reserve_au(aac_enc) < 0) {
+		printf("Malloc aac access unit buf fail\n");
+		return -1;
 	}
 
-	return out_args.numOutBytes;
+	au = &aac_enc->aus[aac_enc->au_num];
+	ret = __encode_frame(aac_enc, pcm, samples, pts,
+			aac_enc->au_buf + aac_enc->au_buf_len,
+					aac_enc->max_au_size, au);
+	if (ret != 0 || au->len == 0)
+		return ret;
+
+	/* data is filled in when the call returns, au_buf may still move */
+	au->data = NULL;
+	aac_enc->au_num++;
+	aac_enc->au_buf_len += au->len;
+
+	return 0;
+}
+
+static int __finish_aus(struct aac_encoder *aac_enc, struct aac_au **aus)
+{
+	uint8_t *data = aac_enc->au_buf;
+	int i;
+
+	for (i = 0; i < aac_enc->au_num; i++) {
+		aac_enc->aus[i].data = data;
+		data += aac_enc->aus[i].len;
+	}
+
+	*aus = aac_enc->aus;
+
+	return aac_enc->au_num;
+}
+
+/* pts of sample number @sample(per channel, counted from the first call) */
+static int64_t __sample_pts(struct aac_encoder *aac_enc, int64_t sample)
+{
+	return aac_enc->base_pts + (sample - aac_enc->base_sample) *
+					1000000LL / aac_enc->samplerate;
 }
 
 /*
- * @aac_buf: output param
- * @return: length of aac output buffer on success, '0' on error
+ * @aus: output param
+ * @return: number of access units in @aus, < 0 on error
  */
-int aac_encode(HANDLE_AACENCODER aac_enc_hd,
-				const void *pcm_buf, int pcm_buf_len,
-				uint8_t **aac_buf)
+int aac_encode(struct aac_encoder *aac_enc,
+			const void *pcm_buf, int pcm_buf_len, int64_t pts,
+			struct aac_au **aus)
 {
-	int buf_over_len = 0;
-	int pcm_payload_len = 0;
+	const uint8_t *pcm = (const uint8_t *)pcm_buf;
+	int sample_size = aac_enc->channels * 2;
+	int frame_size = aac_enc->in_buf_size;
+	int64_t expect;
 	int append_pcm_len = 0;
+	int ret = 0;
 
-	*aac_buf = aac_out_buf;
+	aac_enc->au_num = 0;
+	aac_enc->au_buf_len = 0;
 
-	aac_out_payload_len = 0;
+	if (pcm_buf_len % sample_size) {
+		printf("AAC input is not whole samples, drop %d bytes\n",
+					pcm_buf_len % sample_size);
+		pcm_buf_len -= pcm_buf_len % sample_size;
+	}
 
-	pcm_payload_len = aac_in_payload_len + pcm_buf_len;
+	/* follow the input clock only if it leaves ours by a frame */
+	expect = __sample_pts(aac_enc, aac_enc->in_samples);
+	if (!aac_enc->base_valid || expect - pts > aac_enc->frame_samples *
+				1000000LL / aac_enc->samplerate ||
+			pts - expect > aac_enc->frame_samples *
+				1000000LL / aac_enc->samplerate) {
+		if (aac_enc->base_valid)
+			printf("AAC input pts jumps %lld us, resync\n",
+					(long long)(pts - expect));
+		aac_enc->base_pts = pts;
+		aac_enc->base_sample = aac_enc->in_samples;
+		aac_enc->base_valid = 1;
+	}
 
-	if (pcm_payload_len > aac_in_buf_size) {
-		buf_over_len = pcm_payload_len - aac_in_buf_size;
-		if (buf_over_len >  aac_in_buf_size) {
-			printf("!!!!!!Audio input pcm frame is too huge "
-				"so crop to aac_in_buf_size!!!!!!\n");
-			buf_over_len = aac_in_buf_size;
+	/* top up the frame left over from the last call */
+	if (aac_enc->in_payload_len > 0) {
+		append_pcm_len = frame_size - aac_enc->in_payload_len;
+		if (append_pcm_len > pcm_buf_len)
+			append_pcm_len = pcm_buf_len;
+
+		memcpy(aac_enc->in_buf + aac_enc->in_payload_len, pcm,
+							append_pcm_len);
+		aac_enc->in_payload_len += append_pcm_len;
+		aac_enc->in_samples += append_pcm_len / sample_size;
+		pcm += append_pcm_len;
+		pcm_buf_len -= append_pcm_len;
+
+		if (aac_enc->in_payload_len == frame_size) {
+			ret = __aac_encode_a_frame(aac_enc, aac_enc->in_buf,
+					aac_enc->frame_samples, aac_enc->in_pts);
+			if (ret < 0)
+				return ret;
+			aac_enc->in_payload_len = 0;
 		}
-		append_pcm_len = aac_in_buf_size - aac_in_payload_len;
-	} else
-		append_pcm_len = pcm_buf_len;
+	}
 
-	memcpy(aac_in_buf + aac_in_payload_len, pcm_buf, append_pcm_len);
+	/* whole frames go to the encoder straight from the caller */
+	while (pcm_buf_len >= frame_size) {
+		ret = __aac_encode_a_frame(aac_enc, pcm, aac_enc->frame_samples,
+				__sample_pts(aac_enc, aac_enc->in_samples));
+		if (ret < 0)
+			return ret;
+		aac_enc->in_samples += aac_enc->frame_samples;
+		pcm += frame_size;
+		pcm_buf_len -= frame_size;
+	}
 
-	if (pcm_payload_len < aac_in_buf_size) {
-		printf("AAC Skip once cause input buf not full\n");
-		aac_in_payload_len = aac_in_payload_len + append_pcm_len;
+	/* keep the tail for the next call */
+	if (pcm_buf_len > 0) {
+		memcpy(aac_enc->in_buf, pcm, pcm_buf_len);
+		aac_enc->in_payload_len = pcm_buf_len;
+		aac_enc->in_pts = __sample_pts(aac_enc, aac_enc->in_samples);
+		aac_enc->in_samples += pcm_buf_len / sample_size;
+	}
 
-		return 0;
+	return __finish_aus(aac_enc, aus);
+}
+
+int aac_encode_flush(struct aac_encoder *aac_enc, struct aac_au **aus)
+{
+	int ret = 0;
+
+	aac_enc->au_num = 0;
+	aac_enc->au_buf_len = 0;
+
+	if (aac_enc->in_payload_len > 0) {
+		ret = __aac_encode_a_frame(aac_enc, aac_enc->in_buf,
+			aac_enc->in_payload_len / (aac_enc->channels * 2),
+							aac_enc->in_pts);
+		if (ret < 0)
+			return ret;
+		aac_enc->in_payload_len = 0;
+	}
+
+	while (ret == 0) {
+		ret = __aac_encode_a_frame(aac_enc, NULL, -1, 0);
+		if (ret < 0)
+			return ret;
 	}
 
-	aac_out_payload_len = __aac_encode_a_frame(aac_enc_hd);
+	return __finish_aus(aac_enc, aus);
+}
+
+int aac_encode_frame(struct aac_encoder *aac_enc, const void *pcm_buf,
+			int64_t pts, uint8_t *out, int out_size,
+			struct aac_au *au)
+{
+	int ret = 0;
+
+	if (out_size < aac_enc->max_au_size) {
+		printf("AAC output buf too small %d < %d\n",
+					out_size, aac_enc->max_au_size);
+		return -1;
+	}
+
+	if (pcm_buf == NULL) {
+		ret = __encode_frame(aac_enc, NULL, -1, 0, out, out_size, au);
+		if (ret < 0)
+			return ret;
+
+		return au->len > 0 ? 1 : 0;
+	}
+
+	/* the caller keeps the clock here, one frame never jumps */
+	if (!aac_enc->base_valid) {
+		aac_enc->base_pts = pts;
+		aac_enc->base_sample = aac_enc->in_samples;
+		aac_enc->base_valid = 1;
+	}
+	aac_enc->in_samples += aac_enc->frame_samples;
+
+	ret = __encode_frame(aac_enc, (const uint8_t *)pcm_buf,
+			aac_enc->frame_samples, pts, out, out_size, au);
+	if (ret < 0)
+		return ret;
+
+	return au->len > 0 ? 1 : 0;
+}
+
+/* samplingFrequencyIndex of ISO/IEC 14496-3 1.6.3.4 */
+static const int g_aac_samplerates[] = {
+	96000, 88200, 64000, 48000, 44100, 32000,
+	24000, 22050, 16000, 12000, 11025, 8000, 7350,
+};
+
+/* 2 bytes AudioSpecificConfig:
+ * audioObjectType(5)|samplingFrequencyIndex(4)|channelConfiguration(4)|0(3)
+ */
+static int __make_asc(int aot, int samplerate, int channels, uint8_t *asc)
+{
+	int sfi;
+
+	for (sfi = 0; sfi < (int)(sizeof(g_aac_samplerates) /
+				sizeof(g_aac_samplerates[0])); sfi++)
+		if (g_aac_samplerates[sfi] == samplerate)
+			break;
+
+	if (sfi == sizeof(g_aac_samplerates) / sizeof(g_aac_samplerates[0]))
+		return -1;
+
+	asc[0] = (aot << 3) | (sfi >> 1);
+	asc[1] = ((sfi & 0x01) << 7) | (channels << 3);
+
+	return 2;
+}
 
-	if (buf_over_len) {
-		memcpy(aac_in_buf, pcm_buf + append_pcm_len, buf_over_len);
-		aac_in_payload_len = buf_over_len;
-	} else
-		aac_in_payload_len = 0;
+static const TRANSPORT_TYPE g_aac_transport[AAC_TT_NUM] = {
+	[AAC_TT_ADTS] = TT_MP4_ADTS,
+	[AAC_TT_RAW] = TT_MP4_RAW,
+	[AAC_TT_LATM] = TT_MP4_LATM_MCP1,
+};
 
-	return aac_out_payload_len;
+int create_aac_encoder(struct aac_encoder **aac_enc, int channels, int samplerate, int bitrate,
+		uint8_t *aac_decoder_conf, int *aac_decoder_conf_len)
+{
+	struct aac_enc_attr attr = {
+		.channels = channels,
+		.samplerate = samplerate,
+		.bitrate = bitrate,
+		.transport = AAC_TT_ADTS,
+	};
+
+	return create_aac_encoder_ex(aac_enc, &attr,
+				aac_decoder_conf, aac_decoder_conf_len);
 }
 
 /*
- * @[aac_decoder_conf]&[aac_decoder_conf_len] are output value and they are used
- * only by mp4muxer [MP4SetTrackESConfiguration], aac_decoder_conf should be
+ * @[aac_decoder_conf]&[aac_decoder_conf_len] are output value, the
+ * AudioSpecificConfig of the stream for every transport(what mp4 esds and
+ * the flv/rtmp aac sequence header carry), aac_decoder_conf should be
  * an [array] type [uint8_t] size [64]
  */
-int create_aac_encoder(HANDLE_AACENCODER *aac_enc_hd, int channels, int samplerate, int bitrate,
+int create_aac_encoder_ex(struct aac_encoder **aac_enc,
+		const struct aac_enc_attr *attr,
 		uint8_t *aac_decoder_conf, int *aac_decoder_conf_len)
 {
+	int channels = attr->channels;
+	int samplerate = attr->samplerate;
+	int bitrate = attr->bitrate;
 	int ret = 0;
 	int i;
 	int enc_modules = 0x01;//AAC_LC low complexity
 	AACENC_InfoStruct aac_enc_info = {0};
+	HANDLE_AACENCODER *aac_enc_hd = NULL;
+	struct aac_encoder *enc = NULL;
+
+	enc = (struct aac_encoder *)calloc(1, sizeof(struct aac_encoder));
+	if (enc == NULL) {
+		printf("Malloc aac encoder fail\n");
+		return -1;
+	}
+	enc->channels = channels;
+	enc->samplerate = samplerate;
+	aac_enc_hd = &enc->handle;
 
+	if (attr->transport < 0 || attr->transport >= AAC_TT_NUM) {
+		printf("Invalid AAC encoder attr\n");
+		goto exit;
+	}
+	enc->transport = attr->transport;
 
 	ret = aacEncOpen(aac_enc_hd, enc_modules, channels);
 	if (ret != AACENC_OK) {
@@ -158,7 +422,8 @@ int create_aac_encoder(HANDLE_AACENCODER *aac_enc_hd, int channels, int samplera
 		goto exit;
 	}
 
-	ret = aacEncoder_SetParam(*aac_enc_hd, AACENC_CHANNELMODE, MODE_1);
+	ret = aacEncoder_SetParam(*aac_enc_hd, AACENC_CHANNELMODE,
+					channels == 2 ? MODE_2 : MODE_1);
 	if (ret != AACENC_OK) {
 		printf( "Set AAC CHANNELMODE fail\n");
 		goto exit;
@@ -188,7 +453,8 @@ int create_aac_encoder(HANDLE_AACENCODER *aac_enc_hd, int channels, int samplera
 		goto exit;
 	}
 
-	ret = aacEncoder_SetParam(*aac_enc_hd, AACENC_TRANSMUX, TT_MP4_ADTS);
+	ret = aacEncoder_SetParam(*aac_enc_hd, AACENC_TRANSMUX,
+					g_aac_transport[enc->transport]);
 	if (ret != AACENC_OK) {
 		printf( "Set AAC TRANSPORT TYPE fail\n");
 		goto exit;
@@ -217,59 +483,83 @@ int create_aac_encoder(HANDLE_AACENCODER *aac_enc_hd, int channels, int samplera
 		printf("AAC max_out_buffer_len[%d], input_pcm_frame_len[%d]\n",
 				aac_enc_info.maxOutBufBytes,
 				aac_enc_info.frameLength * channels * 2);
-		aac_out_buf_size = aac_enc_info.maxOutBufBytes;
-		aac_out_buf = calloc(1, aac_out_buf_size);
-		if (aac_out_buf == NULL) {
+		enc->max_au_size = aac_enc_info.maxOutBufBytes;
+		enc->au_buf_size = enc->max_au_size * AAC_AU_INIT_NUM;
+		enc->au_buf = calloc(1, enc->au_buf_size);
+		enc->au_cap = AAC_AU_INIT_NUM;
+		enc->aus = calloc(enc->au_cap, sizeof(struct aac_au));
+		if (enc->au_buf == NULL || enc->aus == NULL) {
 			printf("Malloc aac_out_buf fail\n");
 			goto exit;
 		}
 
-		aac_in_buf_size = aac_enc_info.frameLength * channels * 2;
-		aac_in_buf = calloc(1, aac_in_buf_size);
-		if (aac_in_buf == NULL) {
+		enc->frame_samples = aac_enc_info.frameLength;
+		enc->in_buf_size = aac_enc_info.frameLength * channels * 2;
+		enc->in_buf = calloc(1, enc->in_buf_size);
+		if (enc->in_buf == NULL) {
 			printf("Malloc aac_in_buf fail\n");
 			goto exit;
 		}
 
-		for (i = 0; i < aac_enc_info.confSize; i++) {
-			aac_decoder_conf[i] = aac_enc_info.confBuf[i];
-			printf(".....AAC encoder conf [0x%x]\n",
-					aac_enc_info.confBuf[i]);
+		/* with LATM confBuf is the StreamMuxConfig, not the ASC */
+		if (enc->transport == AAC_TT_LATM) {
+			ret = __make_asc(AOT_AAC_LC, samplerate, channels,
+							aac_decoder_conf);
+			if (ret < 0) {
+				printf("No AAC ASC for samplerate %d\n",
+							samplerate);
+				goto exit;
+			}
+			*aac_decoder_conf_len = ret;
+		} else {
+			for (i = 0; i < (int)aac_enc_info.confSize; i++)
+				aac_decoder_conf[i] = aac_enc_info.confBuf[i];
+			*aac_decoder_conf_len = aac_enc_info.confSize;
 		}
-		*aac_decoder_conf_len = aac_enc_info.confSize;
+
+		for (i = 0; i < *aac_decoder_conf_len; i++)
+			printf(".....AAC encoder conf [0x%x]\n",
+						aac_decoder_conf[i]);
 	}
 
 	printf("Init AAC encoder success...\n");
 
+	*aac_enc = enc;
+
 	return 0;
 
 exit:
 	printf("Init AAC encoder fail\n");
+	destroy_aac_encoder(&enc);
 	return -1;
 }
 
-int destroy_aac_encoder(HANDLE_AACENCODER *aac_enc_hd)
+int destroy_aac_encoder(struct aac_encoder **aac_enc)
 {
+	struct aac_encoder *enc = *aac_enc;
 	int ret = 0;
 
-	ret = aacEncClose(aac_enc_hd);
-	if (ret != AACENC_OK) {
-		printf("Destroy AAC encoder fail...\n");
-		ret = -1;
-	} else
-		printf("Destroy AAC encoder success...\n");
-
-	if (aac_out_buf != NULL) {
-		free(aac_out_buf);
-		aac_out_buf = NULL;
-		aac_out_buf_size = 0;
-	}
-	if (aac_in_buf != NULL) {
-		free(aac_in_buf);
-		aac_in_buf = NULL;
-		aac_in_buf_size = 0;
+	if (enc == NULL)
+		return 0;
+
+	if (enc->handle != NULL) {
+		ret = aacEncClose(&enc->handle);
+		if (ret != AACENC_OK) {
+			printf("Destroy AAC encoder fail...\n");
+			ret = -1;
+		} else
+			printf("Destroy AAC encoder success...\n");
 	}
 
+	if (enc->au_buf != NULL)
+		free(enc->au_buf);
+	if (enc->aus != NULL)
+		free(enc->aus);
+	if (enc->in_buf != NULL)
+		free(enc->in_buf);
+
+	free(enc);
+	*aac_enc = NULL;
+
 	return ret;
 }
-
@@ -12,24 +12,123 @@
 #include <fdk-aac/aacenc_lib.h>
 
 
+/* one aac access unit(raw frame plus transport header if any)
+ * @pts: microseconds, time of the first pcm sample coded in this unit
+ */
+struct aac_au {
+	uint8_t *data;
+	int len;
+	int64_t pts;
+};
+
+/* how access units are framed */
+enum aac_transport {
+	AAC_TT_ADTS = 0,	/* 7 bytes ADTS header in front of every unit */
+	AAC_TT_RAW,		/* raw_data_block only, what flv/rtmp/mp4 carry */
+	AAC_TT_LATM,		/* AudioMuxElement, StreamMuxConfig in band */
+	AAC_TT_NUM,
+};
+
+/* @transport: [enum aac_transport] */
+struct aac_enc_attr {
+	int channels;
+	int samplerate;
+	int bitrate;
+	int transport;
+};
+
+/* input pts of frames handed to fdk-aac whose access unit is not out yet,
+ * the encoder delay is a few frames, this is plenty */
+#define AAC_PTS_QUEUE_SIZE	16
+
+/*
+ * one encoder instance, everything [aac_encode] touches lives here,
+ * so every audio channel could own an encoder and run on its own thread
+ * @in_buf: the tail of the last pcm chunk that did not fill a frame
+ * @in_pts: pts of the first sample in in_buf
+ * @base_pts/@base_sample: pts of sample number base_sample, the pts of
+ * every later sample is counted from here, input pts only resync it
+ * @au_buf/@aus: access units of the current call, reused every call
+ */
+struct aac_encoder {
+	HANDLE_AACENCODER handle;
+	int channels;
+	int samplerate;
+	int frame_samples; /* per channel */
+	int max_au_size;
+	int transport;
+
+	uint8_t *in_buf;
+	int in_buf_size; /* one frame */
+	int in_payload_len;
+	int64_t in_pts;
+
+	int64_t base_pts;
+	int64_t base_sample;
+	int64_t in_samples; /* total samples per channel taken in */
+	int base_valid;
+
+	int64_t pts_queue[AAC_PTS_QUEUE_SIZE];
+	unsigned int pts_head;
+	unsigned int pts_tail;
+
+	uint8_t *au_buf;
+	int au_buf_size;
+	int au_buf_len;
+	struct aac_au *aus;
+	int au_cap;
+	int au_num;
+};
+
 /*
- * @[aac_decoder_conf]&[aac_decoder_conf_len] are output value and they are used
- * only by mp4muxer [MP4SetTrackESConfiguration], aac_decoder_conf should be
- * an [array] type [uint8_t] size [64]
+ * @aac_enc: output param, release it with [destroy_aac_encoder]
+ * @[aac_decoder_conf]&[aac_decoder_conf_len] are output value, the
+ * AudioSpecificConfig for mp4 esds and the flv/rtmp aac sequence header,
+ * aac_decoder_conf should be an [array] type [uint8_t] size [64]
+ * @[create_aac_encoder] is [create_aac_encoder_ex] with ADTS
  */
-int create_aac_encoder(HANDLE_AACENCODER *aac_enc_hd,
+int create_aac_encoder(struct aac_encoder **aac_enc,
 		int channels, int samplerate, int bitrate,
 		uint8_t *aac_decoder_conf, int *aac_decoder_conf_len);
+int create_aac_encoder_ex(struct aac_encoder **aac_enc,
+		const struct aac_enc_attr *attr,
+		uint8_t *aac_decoder_conf, int *aac_decoder_conf_len);
+
+/*
+ * feed a pcm chunk of any length(interleaved s16, whole samples),
+ * nothing is cropped, the part that does not fill a frame is kept
+ * for the next call
+ * @pts: microseconds, time of the first sample in @pcm_buf, pts of the
+ * access units are counted in samples from the first call and only
+ * follow @pts again when it jumps more than a frame(lost pcm)
+ * @aus: output param, every access unit finished by this call,
+ * valid until the next call on @aac_enc
+ * @return: number of access units in @aus, < 0 on error
+ */
+int aac_encode(struct aac_encoder *aac_enc,
+			const void *pcm_buf, int pcm_buf_len, int64_t pts,
+			struct aac_au **aus);
+
+/* end of stream, encode what is left and drain the encoder delay
+ * @return: as [aac_encode]
+ */
+int aac_encode_flush(struct aac_encoder *aac_enc, struct aac_au **aus);
 
 /*
- * @aac_buf: output param
- * @return: length of aac output buffer on success, '0' on error
+ * encode exactly one frame(in_buf_size bytes of pcm) straight into the
+ * caller's @out
+ * @pcm_buf NULL drains the encoder delay one unit per call
+ * don't mix with a pending partial frame of [aac_encode]
+ * @out_size: at least max_au_size
+ * @au: output param, @au->data == @out
+ * @return: 1 if @au is filled, 0 if the encoder holds it back(or is drained),
+ * < 0 on error
  */
-int aac_encode(HANDLE_AACENCODER aac_enc_hd,
-				const void *pcm_buf, int pcm_buf_len,
-				uint8_t **aac_buf);
+int aac_encode_frame(struct aac_encoder *aac_enc, const void *pcm_buf,
+			int64_t pts, uint8_t *out, int out_size,
+			struct aac_au *au);
 
-int destroy_aac_encoder(HANDLE_AACENCODER *aac_enc_hd);
+int destroy_aac_encoder(struct aac_encoder **aac_enc);
 
 #endif
 
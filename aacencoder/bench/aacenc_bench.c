@@ -0,0 +1,160 @@
+/*
+ * aacenc_bench.c
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ *
+ * encode M independent pcm streams on M threads, one encoder each,
+ * and print how the throughput scales with M
+ *
+ * build:
+ * gcc -O2 -I. bench/aacenc_bench.c aacenc.c -lfdk-aac -lpthread -lm \
+ *		-o aacenc_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "aacenc.h"
+
+
+#define SAMPLERATE		48000
+#define CHANNELS		2
+#define BITRATE			128000
+#define AUDIO_SECONDS		60
+#define PCM_PERIOD_LEN		4096 /* bytes per aac_encode call */
+
+static int16_t *g_pcm;
+static int g_pcm_len;
+
+static uint64_t __now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* two tones plus a little noise, so the encoder has real work */
+static int __gen_pcm(void)
+{
+	int samples = SAMPLERATE * AUDIO_SECONDS;
+	int i;
+
+	g_pcm_len = samples * CHANNELS * 2;
+	g_pcm = (int16_t *)malloc(g_pcm_len);
+	if (g_pcm == NULL)
+		return -1;
+
+	for (i = 0; i < samples; i++) {
+		double t = (double)i / SAMPLERATE;
+		int16_t s = (int16_t)(8000 * sin(2 * M_PI * 440 * t) +
+				4000 * sin(2 * M_PI * 3000 * t) +
+				(rand() % 512) - 256);
+
+		g_pcm[CHANNELS * i] = s;
+		if (CHANNELS == 2)
+			g_pcm[CHANNELS * i + 1] = -s;
+	}
+
+	return 0;
+}
+
+static void *encode_thread(void *data)
+{
+	struct aac_encoder *aac_enc = NULL;
+	uint8_t aac_decoder_conf[64];
+	int aac_decoder_conf_len = 0;
+	struct aac_au *aus = NULL;
+	int64_t pts = 0;
+	long frames = 0;
+	int off;
+	int ret;
+
+	if (create_aac_encoder(&aac_enc, CHANNELS, SAMPLERATE, BITRATE,
+				aac_decoder_conf, &aac_decoder_conf_len) < 0)
+		return (void *)-1L;
+
+	for (off = 0; off + PCM_PERIOD_LEN <= g_pcm_len; off += PCM_PERIOD_LEN) {
+		ret = aac_encode(aac_enc, (uint8_t *)g_pcm + off,
+					PCM_PERIOD_LEN, pts, &aus);
+		if (ret < 0)
+			break;
+		frames += ret;
+		pts += PCM_PERIOD_LEN / (CHANNELS * 2) * 1000000LL / SAMPLERATE;
+	}
+
+	ret = aac_encode_flush(aac_enc, &aus);
+	if (ret > 0)
+		frames += ret;
+
+	destroy_aac_encoder(&aac_enc);
+
+	return (void *)frames;
+}
+
+/* @return: seconds of wall clock to encode @streams streams */
+static double __run(int streams)
+{
+	pthread_t *threads = NULL;
+	uint64_t begin;
+	void *frames = NULL;
+	int i;
+
+	threads = (pthread_t *)calloc(streams, sizeof(pthread_t));
+	if (threads == NULL)
+		return -1;
+
+	begin = __now_ns();
+	for (i = 0; i < streams; i++)
+		pthread_create(&threads[i], NULL, encode_thread, NULL);
+	for (i = 0; i < streams; i++) {
+		pthread_join(threads[i], &frames);
+		if ((long)frames <= 0)
+			printf("stream %d encoded nothing\n", i);
+	}
+
+	free(threads);
+
+	return (double)(__now_ns() - begin) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	double base = 0;
+	double sec;
+	int streams;
+
+	if (__gen_pcm() < 0)
+		return 1;
+
+	/* the library prints a lot on create/skip, keep it out of the table */
+	if (freopen("/dev/null", "w", stdout) == NULL)
+		return 1;
+
+	/* 1, 2, 4 ... streams and finally one per cpu,
+	 * linear scaling keeps the wall clock of 1 stream */
+	streams = 1;
+	while (1) {
+		sec = __run(streams);
+		if (streams == 1)
+			base = sec;
+		fprintf(stderr, "%2d streams: %6.2f s, %7.1fx realtime total, "
+				"scaling %5.1f%%\n", streams, sec,
+				streams * AUDIO_SECONDS / sec,
+				100.0 * base / sec);
+		if (streams >= cpus)
+			break;
+		streams = (streams * 2 < cpus) ? streams * 2 : cpus;
+	}
+
+	free(g_pcm);
+
+	return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * flv_bench.c
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ *
+ * mux a long synthetic h264(30fps, gop 60) + aac(48k, fed ahead of the
+ * video) stream into a flv file, print tags/sec and syscalls per tag,
+ * then walk the tag chain of the result to check every PreviousTagSize
+ * and that timestamps never go back
+ *
+ * build:
+ * gcc -O2 -I. bench/flv_bench.c flvmuxer.c -o flv_bench
+ * ./flv_bench [out.flv] [seconds of stream]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "flvmuxer.h"
+
+
+#define VIDEO_FPS		30
+#define VIDEO_GOP		60
+#define VIDEO_I_SIZE		(80 * 1024)
+#define VIDEO_P_SIZE		(8 * 1024)
+#define AUDIO_SAMPLERATE	48000
+#define AUDIO_FRAME_SAMPLES	1024
+#define AUDIO_AU_SIZE		372
+#define AUDIO_AHEAD_MS		200
+/* wall clock ms, far beyond 32 bits */
+#define CLOCK_ORIGIN_MS		1546000000000LL
+
+static const uint8_t sps[] = {0x67, 0x64, 0x00, 0x29, 0xac, 0x1a, 0xd0, 0x0a};
+static const uint8_t pps[] = {0x68, 0xee, 0x01, 0x34};
+static const uint8_t asc[] = {0x11, 0x90};
+
+static uint64_t __now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t __be24(const uint8_t *p)
+{
+	return (p[0] << 16) | (p[1] << 8) | p[2];
+}
+
+static uint32_t __be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/* @return: number of tags, < 0 if the chain is broken */
+static long __check_file(const char *name)
+{
+	uint8_t hdr[FLV_TAG_HDR_SIZE];
+	uint8_t prev[4];
+	uint32_t size;
+	uint32_t ts;
+	uint32_t last_ts = 0;
+	long tags = 0;
+	FILE *fp = NULL;
+
+	fp = fopen(name, "rb");
+	if (fp == NULL)
+		return -1;
+
+	if (fread(hdr, 1, 9, fp) != 9 || memcmp(hdr, "FLV", 3) ||
+				fread(prev, 1, 4, fp) != 4 || __be32(prev)) {
+		fclose(fp);
+		return -1;
+	}
+
+	while (fread(hdr, 1, FLV_TAG_HDR_SIZE, fp) == FLV_TAG_HDR_SIZE) {
+		size = __be24(hdr + 1);
+		ts = __be24(hdr + 4) | ((uint32_t)hdr[7] << 24);
+		if (ts < last_ts) {
+			printf("tag %ld: timestamp goes back %u < %u\n",
+						tags, ts, last_ts);
+			fclose(fp);
+			return -1;
+		}
+		last_ts = ts;
+		if (fseek(fp, size, SEEK_CUR) < 0 ||
+				fread(prev, 1, 4, fp) != 4 ||
+				__be32(prev) != size + FLV_TAG_HDR_SIZE) {
+			printf("tag %ld: bad PreviousTagSize\n", tags);
+			fclose(fp);
+			return -1;
+		}
+		tags++;
+	}
+
+	fclose(fp);
+
+	return tags;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = argc > 1 ? argv[1] : "flv_bench.flv";
+	int seconds = argc > 2 ? atoi(argv[2]) : 3600;
+	struct FLVProfile profile = {
+		.has_video = true,
+		.has_audio = true,
+		.sample_rate = AUDIO_SAMPLERATE,
+		.channels = 2,
+		.sps = (uint8_t *)sps,
+		.pps = (uint8_t *)pps,
+		.sps_len = sizeof(sps),
+		.pps_len = sizeof(pps),
+		.aac_decoder_conf = (uint8_t *)asc,
+		.aac_decoder_conf_len = sizeof(asc),
+		.width = 1920,
+		.height = 1080,
+		.framerate = VIDEO_FPS,
+	};
+	struct flv_muxer *flv = NULL;
+	struct flv_muxer_stat stat;
+	uint8_t *video = NULL;
+	uint8_t *audio = NULL;
+	long frames = (long)seconds * VIDEO_FPS;
+	long frame;
+	long au = 0;
+	uint64_t begin;
+	double sec;
+	long tags;
+	int ret = 0;
+
+	snprintf(profile.name, sizeof(profile.name), "%s", name);
+
+	video = (uint8_t *)malloc(VIDEO_I_SIZE);
+	audio = (uint8_t *)malloc(AUDIO_AU_SIZE);
+	if (video == NULL || audio == NULL)
+		return 1;
+	memset(video, 0x5a, VIDEO_I_SIZE);
+	memset(audio, 0x21, AUDIO_AU_SIZE);
+
+	if (create_flv_muxer(&flv, &profile) < 0)
+		return 1;
+
+	begin = __now_ns();
+	for (frame = 0; frame < frames && ret == 0; frame++) {
+		int64_t ms = frame * 1000 / VIDEO_FPS;
+		int key = (frame % VIDEO_GOP) == 0;
+
+		ret = flv_write_avc_data_tag(flv, video,
+			key ? VIDEO_I_SIZE : VIDEO_P_SIZE - (frame & 255),
+						CLOCK_ORIGIN_MS + ms, key);
+
+		/* audio arrives up to AUDIO_AHEAD_MS early, the muxer sorts */
+		while ((int64_t)au * AUDIO_FRAME_SAMPLES * 1000 /
+				AUDIO_SAMPLERATE <= ms + AUDIO_AHEAD_MS &&
+								ret == 0) {
+			ret = flv_write_aac_data_tag(flv, audio,
+				AUDIO_AU_SIZE - (au & 15), CLOCK_ORIGIN_MS +
+				au * AUDIO_FRAME_SAMPLES * 1000 /
+						AUDIO_SAMPLERATE);
+			au++;
+		}
+	}
+	sec = (double)(__now_ns() - begin) / 1e9;
+
+	flv_muxer_get_stat(flv, &stat);
+	destroy_flv_muxer(flv);
+
+	if (ret) {
+		printf("write fail\n");
+		return 1;
+	}
+
+	printf("%llu tags %.1f MB in %.3fs: %.0f tags/sec, %.1f MB/s, "
+		"%.2f syscalls/tag\n",
+		(unsigned long long)stat.tags, stat.bytes / 1e6, sec,
+		stat.tags / sec, stat.bytes / 1e6 / sec,
+		(double)stat.syscalls / stat.tags);
+
+	/* onMetaData and the sequence headers, the tags still waiting when
+	 * the stat was taken are written on destroy */
+	tags = __check_file(name);
+	printf("tag chain %s(%ld tags)\n",
+		tags == frames + au + 3 ? "ok" : "BROKEN", tags);
+
+	free(video);
+	free(audio);
+
+	return tags == frames + au + 3 ? 0 : 1;
+}
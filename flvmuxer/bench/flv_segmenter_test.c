@@ -0,0 +1,325 @@
+/*
+ * flv_segmenter_test.c
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ *
+ * record a synthetic h264(30fps, gop 30) + aac stream through the
+ * segmenter and check: segments are cut on keyframes at the configured
+ * length, the open segment is a .part file and every finished one is
+ * renamed, retention by count and by bytes keeps only the newest ones,
+ * and every segment carries the sps/pps/AudioSpecificConfig given at
+ * create time even though the caller's buffers were wiped right after
+ *
+ * build:
+ * gcc -O2 -I. bench/flv_segmenter_test.c flvsegmenter.c flvmuxer.c \
+ *		-lpthread -o flv_segmenter_test
+ * ./flv_segmenter_test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "flvsegmenter.h"
+
+
+#define VIDEO_FPS		30
+#define VIDEO_GOP		30
+#define VIDEO_I_SIZE		(16 * 1024)
+#define VIDEO_P_SIZE		(2 * 1024)
+#define AUDIO_SAMPLERATE	48000
+#define AUDIO_FRAME_SAMPLES	1024
+#define AUDIO_AU_SIZE		372
+#define STREAM_SECONDS		10
+#define SEGMENT_MS		2000
+#define SEGMENT_NUM		(STREAM_SECONDS * 1000 / SEGMENT_MS)
+#define CLOCK_ORIGIN_MS		1546000000000LL
+
+static const uint8_t sps[] = {0x67, 0x64, 0x00, 0x29, 0xac, 0x1a, 0xd0, 0x0a};
+static const uint8_t pps[] = {0x68, 0xee, 0x01, 0x34};
+static const uint8_t asc[] = {0x11, 0x90};
+
+static int g_errors;
+
+static void __error(const char *msg, const char *name)
+{
+	g_errors++;
+	printf("ERROR %s: %s\n", msg, name);
+}
+
+static uint32_t __be24(const uint8_t *p)
+{
+	return (p[0] << 16) | (p[1] << 8) | p[2];
+}
+
+static uint32_t __be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/* the tag chain is intact, the first video data tag is a keyframe and
+ * the sequence headers match the profile */
+static void __check_segment(const char *name)
+{
+	uint8_t hdr[FLV_TAG_HDR_SIZE];
+	uint8_t body[64];
+	uint8_t prev[4];
+	uint32_t size;
+	int video_seen = 0;
+	int avc_ok = 0;
+	int aac_ok = 0;
+	FILE *fp = NULL;
+
+	fp = fopen(name, "rb");
+	if (fp == NULL || fread(hdr, 1, 9, fp) != 9 ||
+			memcmp(hdr, "FLV", 3) || fread(prev, 1, 4, fp) != 4) {
+		__error("not a flv file", name);
+		if (fp != NULL)
+			fclose(fp);
+		return;
+	}
+
+	while (fread(hdr, 1, FLV_TAG_HDR_SIZE, fp) == FLV_TAG_HDR_SIZE) {
+		size = __be24(hdr + 1);
+		memset(body, 0, sizeof(body));
+		if (fread(body, 1, size < sizeof(body) ? size : sizeof(body),
+								fp) == 0)
+			break;
+
+		if (hdr[0] == FLV_TAG_TYPE_VIDEO && body[1] == 0) {
+			/* 5 bytes body header, 6 bytes avcc, sps length */
+			avc_ok = size == 5 + 11 + sizeof(sps) + sizeof(pps) &&
+				!memcmp(body + 13, sps, sizeof(sps)) &&
+				!memcmp(body + 13 + sizeof(sps) + 3, pps,
+								sizeof(pps));
+		} else if (hdr[0] == FLV_TAG_TYPE_VIDEO && !video_seen) {
+			video_seen = 1;
+			if (body[0] != 0x17)
+				__error("segment does not start on a keyframe",
+									name);
+		} else if (hdr[0] == FLV_TAG_TYPE_AUDIO && body[1] == 0) {
+			aac_ok = size == 2 + sizeof(asc) &&
+					!memcmp(body + 2, asc, sizeof(asc));
+		}
+
+		if (fseek(fp, (long)size - (long)(size < sizeof(body) ?
+				size : sizeof(body)), SEEK_CUR) < 0 ||
+				fread(prev, 1, 4, fp) != 4 ||
+				__be32(prev) != size + FLV_TAG_HDR_SIZE) {
+			__error("bad PreviousTagSize", name);
+			break;
+		}
+	}
+
+	if (!avc_ok || !aac_ok)
+		__error("sequence headers do not match the profile", name);
+
+	fclose(fp);
+}
+
+/* @return: finished segments in @dir, checks each and flags .part
+ * files, @newest is the highest sequence number found */
+static int __check_dir(const char *dir, uint64_t *bytes, unsigned int *newest)
+{
+	char name[FLV_SEG_PATH_LEN + 256];
+	struct dirent *ent = NULL;
+	struct stat st;
+	unsigned int seq;
+	DIR *dp = NULL;
+	int num = 0;
+
+	*bytes = 0;
+	*newest = 0;
+
+	dp = opendir(dir);
+	if (dp == NULL)
+		return -1;
+
+	while ((ent = readdir(dp)) != NULL) {
+		if (ent->d_name[0] == '.')
+			continue;
+		snprintf(name, sizeof(name), "%s/%s", dir, ent->d_name);
+		if (strstr(ent->d_name, ".part") != NULL) {
+			__error("segment left as .part", name);
+			continue;
+		}
+		if (sscanf(ent->d_name, "cam-%08u.flv", &seq) != 1) {
+			__error("unexpected file", name);
+			continue;
+		}
+		if (seq > *newest)
+			*newest = seq;
+		if (stat(name, &st) == 0)
+			*bytes += st.st_size;
+		__check_segment(name);
+		num++;
+	}
+
+	closedir(dp);
+
+	return num;
+}
+
+static void __clean_dir(const char *dir)
+{
+	char name[FLV_SEG_PATH_LEN + 256];
+	struct dirent *ent = NULL;
+	DIR *dp = NULL;
+
+	dp = opendir(dir);
+	if (dp == NULL)
+		return;
+
+	while ((ent = readdir(dp)) != NULL) {
+		if (ent->d_name[0] == '.')
+			continue;
+		snprintf(name, sizeof(name), "%s/%s", dir, ent->d_name);
+		unlink(name);
+	}
+
+	closedir(dp);
+	rmdir(dir);
+}
+
+/* @return: segments closed before the last one, as counted by the
+ * segmenter */
+static int __record(const char *dir, int keep_segments, uint64_t keep_bytes)
+{
+	struct flv_segmenter_stat seg_stat;
+	struct flv_segmenter_attr attr;
+	struct flv_segmenter *seg = NULL;
+	uint8_t conf[sizeof(sps) + sizeof(pps) + sizeof(asc)];
+	uint8_t *video = NULL;
+	uint8_t audio[AUDIO_AU_SIZE];
+	struct stat st;
+	long frames = (long)STREAM_SECONDS * VIDEO_FPS;
+	long frame;
+	long au = 0;
+	int64_t dts;
+
+	video = (uint8_t *)malloc(VIDEO_I_SIZE);
+	if (video == NULL)
+		return -1;
+	memset(video, 0x5a, VIDEO_I_SIZE);
+	memset(audio, 0xa5, sizeof(audio));
+
+	memset(&attr, 0, sizeof(attr));
+	memcpy(conf, sps, sizeof(sps));
+	memcpy(conf + sizeof(sps), pps, sizeof(pps));
+	memcpy(conf + sizeof(sps) + sizeof(pps), asc, sizeof(asc));
+	attr.profile.has_video = true;
+	attr.profile.has_audio = true;
+	attr.profile.sample_rate = AUDIO_SAMPLERATE;
+	attr.profile.channels = 2;
+	attr.profile.sps = conf;
+	attr.profile.sps_len = sizeof(sps);
+	attr.profile.pps = conf + sizeof(sps);
+	attr.profile.pps_len = sizeof(pps);
+	attr.profile.aac_decoder_conf = conf + sizeof(sps) + sizeof(pps);
+	attr.profile.aac_decoder_conf_len = sizeof(asc);
+	attr.profile.width = 1280;
+	attr.profile.height = 720;
+	attr.profile.framerate = VIDEO_FPS;
+	snprintf(attr.dir, sizeof(attr.dir), "%s", dir);
+	snprintf(attr.prefix, sizeof(attr.prefix), "cam");
+	attr.segment_ms = SEGMENT_MS;
+	attr.keep_segments = keep_segments;
+	attr.keep_bytes = keep_bytes;
+
+	if (create_flv_segmenter(&seg, &attr) < 0) {
+		__error("create segmenter fail", dir);
+		free(video);
+		return -1;
+	}
+
+	/* the segmenter must not keep pointing at these */
+	memset(conf, 0, sizeof(conf));
+
+	for (frame = 0; frame < frames; frame++) {
+		dts = CLOCK_ORIGIN_MS + frame * 1000 / VIDEO_FPS;
+
+		for (; CLOCK_ORIGIN_MS + au * AUDIO_FRAME_SAMPLES * 1000 /
+				AUDIO_SAMPLERATE <= dts; au++)
+			flv_segmenter_write_aac(seg, audio, sizeof(audio),
+				CLOCK_ORIGIN_MS + au * AUDIO_FRAME_SAMPLES *
+						1000 / AUDIO_SAMPLERATE);
+
+		flv_segmenter_write_avc(seg, video, frame % VIDEO_GOP ?
+				VIDEO_P_SIZE : VIDEO_I_SIZE, dts,
+						!(frame % VIDEO_GOP));
+	}
+
+	/* the open segment is still a .part file */
+	pthread_mutex_lock(&seg->mutex);
+	if (stat(seg->part, &st) < 0 || stat(seg->path, &st) == 0)
+		__error("open segment is not a .part file", seg->part);
+	pthread_mutex_unlock(&seg->mutex);
+
+	flv_segmenter_get_stat(seg, &seg_stat);
+
+	destroy_flv_segmenter(seg);
+	free(video);
+
+	return seg_stat.segments + seg_stat.pending;
+}
+
+static void __run(const char *name, int keep_segments, uint64_t keep_bytes)
+{
+	char dir[] = "/tmp/flv_segmenter_XXXXXX";
+	uint64_t bytes = 0;
+	unsigned int newest = 0;
+	int closed;
+	int expect;
+	int num;
+
+	if (mkdtemp(dir) == NULL) {
+		__error("mkdtemp fail", dir);
+		return;
+	}
+
+	closed = __record(dir, keep_segments, keep_bytes);
+	if (closed < 0) {
+		__clean_dir(dir);
+		return;
+	}
+
+	/* a cut on every SEGMENT_MS worth of keyframes */
+	if (closed != SEGMENT_NUM - 1) {
+		printf("ERROR %s: %d segments closed, expected %d\n",
+						name, closed, SEGMENT_NUM - 1);
+		g_errors++;
+	}
+
+	num = __check_dir(dir, &bytes, &newest);
+
+	expect = SEGMENT_NUM;
+	if (keep_segments > 0 && expect > keep_segments)
+		expect = keep_segments;
+	if ((keep_bytes == 0 && num != expect) || num < 1 ||
+		(keep_bytes > 0 && num > 1 && bytes > keep_bytes)) {
+		printf("ERROR %s: %d segments, %llu bytes kept\n", name,
+					num, (unsigned long long)bytes);
+		g_errors++;
+	}
+	if (newest != SEGMENT_NUM - 1)
+		__error("newest segment was pruned", name);
+
+	printf("%s: %d segments, %llu bytes\n", name, num,
+					(unsigned long long)bytes);
+
+	__clean_dir(dir);
+}
+
+int main(int argc, char *argv[])
+{
+	__run("keep all", 0, 0);
+	__run("keep 2", 2, 0);
+	__run("keep 500KB", 0, 500 * 1024);
+
+	printf("%d errors\n", g_errors);
+
+	return g_errors ? 1 : 0;
+}
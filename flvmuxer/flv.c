@@ -13,13 +13,6 @@
 #include <my_video_input.h>
 
 
-/* XXX:WARNING the pcm period buf length should be the common factor of
- * the aac input pcm frame length, or the aac timestamp will be wrong
- * here the pcm period buf length == 1024 bytes,
- * and the aac input pcm frame length == 2048
- */
-
-
 #define SPS_LEN		28
 #define PPS_LEN		6
 #define OUTFILE		"my.flv"
@@ -58,10 +51,10 @@ static const uint8_t pps_buf[PPS_LEN + 4] = {0x00, 0x00, 0x00, 0x06, 0x28, 0xee,
 			0x01, 0x04, 0x92, 0x24};
 			*/
 static int g_exit;
-static HANDLE_AACENCODER aac_enc_hd;
+static struct aac_encoder *aac_enc_hd;
 static uint8_t aac_decoder_conf[64];
 static int aac_decoder_conf_len;
-static FILE *flv_hd;
+static struct flv_muxer *flv_hd;
 
 
 void sig_handle(int sig)
@@ -74,10 +67,10 @@ void h264_cb(const struct timeval *tv, const void *data,
 {
 	uint8_t *buf = NULL;
 	int buf_len = 0;
-	uint32_t timestamp = 0;
+	int64_t timestamp = 0;
 	int buf_payload_len = 0;
 
-	timestamp = (tv->tv_sec * 1000) + (tv->tv_usec / 1000);
+	timestamp = ((int64_t)tv->tv_sec * 1000) + (tv->tv_usec / 1000);
 
 	/* strip sps/pps from I frame and
 	 * replace NALU start flag '0x00/0x00/0x00/0x01' with
@@ -101,17 +94,17 @@ void h264_cb(const struct timeval *tv, const void *data,
 void audio_cb(const struct timeval *tv, const void *pcm_buf,
 	const int pcm_len, const void *spk_buf)
 {
-	uint8_t *aac_buf = NULL;
-	int aac_buf_len = 0;
-	uint32_t timestamp = 0;
+	struct aac_au *aus = NULL;
+	int64_t pts = 0;
+	int au_num = 0;
+	int i;
 
-	timestamp = (tv->tv_sec * 1000) + (tv->tv_usec / 1000);
+	pts = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
 
-	aac_buf_len = aac_encode(aac_enc_hd, pcm_buf, pcm_len, &aac_buf);
-	if (aac_buf_len == 0)
-		return;
-
-	flv_write_aac_data_tag(flv_hd, aac_buf, aac_buf_len, timestamp);
+	au_num = aac_encode(aac_enc_hd, pcm_buf, pcm_len, pts, &aus);
+	for (i = 0; i < au_num; i++)
+		flv_write_aac_data_tag(flv_hd, aus[i].data, aus[i].len,
+							aus[i].pts / 1000);
 }
 
 int main(int argc, char *argv[])
@@ -127,7 +120,17 @@ int main(int argc, char *argv[])
 		.sps = sps_buf,
 		.pps = pps_buf,
 		.sps_len = SPS_LEN,
-		.pps_len = PPS_LEN
+		.pps_len = PPS_LEN,
+		.width = RES_WIDTH,
+		.height = RES_HEIGHT,
+		.framerate = VIDEO_FPS,
+	};
+
+	struct aac_enc_attr aac_attr = {
+		.channels = AUDIO_CHANNELS,
+		.samplerate = AUDIO_SAMPLERATE,
+		.bitrate = AAC_BITRATE,
+		.transport = AAC_TT_RAW,
 	};
 
 	MYVideoInputChannel chn = {
@@ -160,12 +163,14 @@ int main(int argc, char *argv[])
 	signal(SIGTERM, sig_handle);
 	signal(SIGINT, sig_handle);
 
-	ret = create_aac_encoder(&aac_enc_hd,
-				AUDIO_CHANNELS, AUDIO_SAMPLERATE, AAC_BITRATE,
+	ret = create_aac_encoder_ex(&aac_enc_hd, &aac_attr,
 				aac_decoder_conf, &aac_decoder_conf_len);
 	if (ret < 0)
 		goto exit;
 
+	flv_profile.aac_decoder_conf = aac_decoder_conf;
+	flv_profile.aac_decoder_conf_len = aac_decoder_conf_len;
+
 	ret = create_flv_muxer(&flv_hd, &flv_profile);
 	if (ret < 0)
 		goto exit;
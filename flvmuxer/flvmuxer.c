@@ -11,11 +11,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
 
 #include "flvmuxer.h"
 
-static uint32_t g_time_begin;
-static uint32_t g_time_now;
+/* tag header + body header + payload pieces + PreviousTagSize */
+#define FLV_IOV_MAX		8
+
+/* first size of the interleave queues, they only grow if a stream
+ * runs ahead more than that */
+#define FLV_FIFO_INIT_TAGS	64
+#define FLV_FIFO_INIT_SIZE	(256 * 1024)
 
 static uint8_t *ui08_to_bytes(uint8_t *buf, uint8_t val) {
 	buf[0] = (val) & 0xff;
@@ -152,6 +162,33 @@ static uint8_t *amf_ecmaarray_add_double(uint8_t *buf, double value)
 	return pbuf;
 }
 
+static uint8_t *amf_object_to_bytes(uint8_t *buf)
+{
+	return ui08_to_bytes(buf, AMF_DATA_TYPE_OBJECT);
+}
+
+static uint8_t *amf_strictarray_to_bytes(uint8_t *buf, uint32_t size)
+{
+	uint8_t *pbuf = buf;
+
+	pbuf = ui08_to_bytes(pbuf, AMF_DATA_TYPE_ARRAY);
+	pbuf = ui32_to_bytes(pbuf, size);
+
+	return pbuf;
+}
+
+/* long string of @len filler bytes */
+static uint8_t *amf_padding_to_bytes(uint8_t *buf, uint32_t len)
+{
+	uint8_t *pbuf = buf;
+
+	pbuf = ui08_to_bytes(pbuf, AMF_DATA_TYPE_LONG_STRING);
+	pbuf = ui32_to_bytes(pbuf, len);
+	memset(pbuf, ' ', len);
+
+	return pbuf + len;
+}
+
 static uint8_t *amf_objend(uint8_t *buf)
 {
 	uint8_t *pbuf = buf;
@@ -163,27 +200,196 @@ static uint8_t *amf_objend(uint8_t *buf)
 	return pbuf;
 }
 
-FILE *flv_file_open(const char *filename)
+static int flv_fifo_init(struct flv_fifo *fifo)
+{
+	fifo->cap = FLV_FIFO_INIT_TAGS;
+	fifo->tags = (struct flv_pending *)calloc(fifo->cap,
+						sizeof(struct flv_pending));
+	fifo->size = FLV_FIFO_INIT_SIZE;
+	fifo->buf = (uint8_t *)malloc(fifo->size);
+	if (fifo->tags == NULL || fifo->buf == NULL)
+		return -1;
+
+	return 0;
+}
+
+static void flv_fifo_destroy(struct flv_fifo *fifo)
+{
+	free(fifo->tags);
+	free(fifo->buf);
+	fifo->tags = NULL;
+	fifo->buf = NULL;
+}
+
+static inline int flv_fifo_empty(struct flv_fifo *fifo)
+{
+	return fifo->head == fifo->tail;
+}
+
+static inline struct flv_pending *flv_fifo_at(struct flv_fifo *fifo,
+							unsigned int i)
+{
+	return &fifo->tags[i & (fifo->cap - 1)];
+}
+
+/* move every pending payload to the front of a buffer of @size */
+static int flv_fifo_repack(struct flv_fifo *fifo, uint32_t size)
+{
+	struct flv_pending *tag = NULL;
+	uint8_t *buf = NULL;
+	uint32_t wr = 0;
+	unsigned int i;
+
+	buf = (uint8_t *)malloc(size);
+	if (buf == NULL)
+		return -1;
+
+	for (i = fifo->head; i != fifo->tail; i++) {
+		tag = flv_fifo_at(fifo, i);
+		memcpy(buf + wr, fifo->buf + tag->off, tag->len);
+		tag->off = wr;
+		wr += tag->len;
+	}
+
+	free(fifo->buf);
+	fifo->buf = buf;
+	fifo->size = size;
+	fifo->rd = 0;
+	fifo->wr = wr;
+
+	return 0;
+}
+
+/*
+ * payloads are a byte ring: a payload never straddles the end, it goes
+ * to the front instead, and wr never catches up with rd from behind
+ * @return: offset of @len free bytes, < 0 if the ring has to grow
+ */
+static int64_t flv_fifo_alloc(struct flv_fifo *fifo, uint32_t len)
+{
+	if (flv_fifo_empty(fifo))
+		fifo->rd = fifo->wr = 0;
+
+	if (fifo->wr >= fifo->rd) {
+		if (fifo->size - fifo->wr >= len)
+			return fifo->wr;
+		if (fifo->rd > len)
+			return 0;
+	} else if (fifo->rd - fifo->wr > len) {
+		return fifo->wr;
+	}
+
+	return -1;
+}
+
+static int flv_fifo_push(struct flv_fifo *fifo, const uint8_t *data,
+				uint32_t len, int64_t dts, int keyframe,
+				int seq_hdr)
+{
+	struct flv_pending *tags = NULL;
+	struct flv_pending *tag = NULL;
+	uint64_t used = 0;
+	uint32_t size;
+	int64_t off;
+	unsigned int i;
+
+	if (fifo->tail - fifo->head == fifo->cap) {
+		tags = (struct flv_pending *)calloc(fifo->cap * 2,
+						sizeof(struct flv_pending));
+		if (tags == NULL)
+			return -1;
+		for (i = 0; i < fifo->cap; i++)
+			tags[i] = *flv_fifo_at(fifo, fifo->head + i);
+		free(fifo->tags);
+		fifo->tags = tags;
+		fifo->head = 0;
+		fifo->tail = fifo->cap;
+		fifo->cap *= 2;
+	}
+
+	off = flv_fifo_alloc(fifo, len);
+	if (off < 0) {
+		for (i = fifo->head; i != fifo->tail; i++)
+			used += flv_fifo_at(fifo, i)->len;
+		for (size = fifo->size * 2; size <= used + len; size *= 2)
+			;
+		if (flv_fifo_repack(fifo, size) < 0)
+			return -1;
+		off = fifo->wr;
+	}
+
+	memcpy(fifo->buf + off, data, len);
+	fifo->wr = off + len;
+
+	tag = flv_fifo_at(fifo, fifo->tail++);
+	tag->dts = dts;
+	tag->off = off;
+	tag->len = len;
+	tag->keyframe = keyframe;
+	tag->seq_hdr = seq_hdr;
+
+	return 0;
+}
+
+static void flv_fifo_pop(struct flv_fifo *fifo)
 {
-	FILE *file_hd = NULL;
+	struct flv_pending *tag = flv_fifo_at(fifo, fifo->head++);
+
+	fifo->rd = tag->off + tag->len;
+}
 
+static int flv_file_open(struct flv_muxer *flv, const char *filename)
+{
 	if (NULL == filename)
 		goto exit;
 
-	file_hd = fopen(filename, "wb");
-	if (file_hd == NULL)
+	flv->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (flv->fd < 0)
 		goto exit;
 
-	return file_hd;
+	return 0;
 
 exit:
 	printf("FLV file open failed\n");
-	return file_hd;
+	return -1;
 }
 
-void flv_write_file_header(FILE *file_hd, bool is_have_audio, bool is_have_video)
+/* one writev, again only for what a short write left */
+static int flv_writev(struct flv_muxer *flv, struct iovec *iov, int iovcnt)
+{
+	ssize_t ret = 0;
+
+	while (iovcnt > 0) {
+		ret = writev(flv->fd, iov, iovcnt);
+		flv->stat.syscalls++;
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			printf("FLV write fail: %s\n", strerror(errno));
+			return -1;
+		}
+
+		flv->stat.bytes += ret;
+		flv->offset += ret;
+		while (iovcnt > 0 && (size_t)ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (uint8_t *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return 0;
+}
+
+static int flv_write_file_header(struct flv_muxer *flv,
+				bool is_have_audio, bool is_have_video)
 {
 	char flv_file_header[] = "FLV\x1\x5\0\0\0\x9\0\0\0\0"; // have audio and have video
+	struct iovec iov;
 
 	if (is_have_audio && is_have_video)
 		flv_file_header[4] = 0x05;
@@ -194,206 +400,434 @@ void flv_write_file_header(FILE *file_hd, bool is_have_audio, bool is_have_video
 	else
 		flv_file_header[4] = 0x00;
 
-	fwrite(flv_file_header, 13, 1, file_hd);
+	iov.iov_base = flv_file_header;
+	iov.iov_len = 13;
 
-	return;
+	return flv_writev(flv, &iov, 1);
 }
 
 /*
- * @brief write flv tag
- * @param[in] buf:
- * @param[in] buf_len: flv tag body size
+ * @brief write flv tag: tag header, body header, payload and
+ * PreviousTagSize with a single writev
+ * @param[in] body_hdr_len: bytes of body header already in
+ * flv->hdr + FLV_TAG_HDR_SIZE
+ * @param[in] payload/payload_num: the rest of the tag body
  * @param[in] timestamp: flv tag timestamp
  */
-static void flv_write_flv_tag(FILE *file_hd,
-					uint8_t *buf, uint32_t buf_len,
-					uint32_t timestamp, int tag_type)
+static int flv_write_flv_tag(struct flv_muxer *flv, uint32_t body_hdr_len,
+				const struct iovec *payload, int payload_num,
+				uint32_t timestamp, int tag_type)
 {
-	uint8_t prev_size[4] = {0};
+	struct iovec iov[FLV_IOV_MAX];
+	uint32_t data_size = body_hdr_len;
+	struct FLVTag *flvtag = (struct FLVTag *)flv->hdr;
+	int i;
 
-	struct FLVTag flvtag;
+	if (payload_num > FLV_IOV_MAX - 2)
+		return -1;
 
-	memset(&flvtag, 0, sizeof(flvtag));
+	for (i = 0; i < payload_num; i++) {
+		iov[i + 1] = payload[i];
+		data_size += payload[i].iov_len;
+	}
 
-	flvtag.type = tag_type;
-	ui24_to_bytes(flvtag.data_size, buf_len);
-	flvtag.timestamp_ex = (uint8_t) ((timestamp >> 24) & 0xff);
-	flvtag.timestamp[0] = (uint8_t) ((timestamp >> 16) & 0xff);
-	flvtag.timestamp[1] = (uint8_t) ((timestamp >> 8) & 0xff);
-	flvtag.timestamp[2] = (uint8_t) ((timestamp) & 0xff);
+	flvtag->type = tag_type;
+	ui24_to_bytes(flvtag->data_size, data_size);
+	flvtag->timestamp_ex = (uint8_t) ((timestamp >> 24) & 0xff);
+	flvtag->timestamp[0] = (uint8_t) ((timestamp >> 16) & 0xff);
+	flvtag->timestamp[1] = (uint8_t) ((timestamp >> 8) & 0xff);
+	flvtag->timestamp[2] = (uint8_t) ((timestamp) & 0xff);
+	memset(flvtag->streamid, 0, sizeof(flvtag->streamid));
 
-	fwrite(&flvtag, sizeof(flvtag), 1, file_hd);
-	fwrite(buf, 1, buf_len, file_hd);
+	iov[0].iov_base = flv->hdr;
+	iov[0].iov_len = FLV_TAG_HDR_SIZE + body_hdr_len;
 
-	ui32_to_bytes(prev_size, buf_len + (uint32_t) sizeof(flvtag));
-	fwrite(prev_size, 4, 1, file_hd);
+	ui32_to_bytes(flv->prev_size, data_size + FLV_TAG_HDR_SIZE);
+	iov[payload_num + 1].iov_base = flv->prev_size;
+	iov[payload_num + 1].iov_len = 4;
 
-	return;
+	flv->stat.tags++;
+
+	return flv_writev(flv, iov, payload_num + 2);
 }
 
-/*TODO*/
-static void flv_write_onmetadata_tag(FILE *file_hd, double value)
+/* "_pad" key + long string header */
+#define FLV_META_PAD_OVERHEAD	(2 + 4 + 1 + 4)
+/* AMF number in a strict array */
+#define FLV_META_INDEX_ENTRY	9
+
+/*
+ * @brief build onMetaData into flv->meta, exactly flv->meta_size bytes:
+ * the properties, the keyframe index, then a padding string taking up
+ * what is left, so the tag could be rewritten in place later
+ * @param[in] pad: 0 to get the length without padding
+ * @return: bytes built
+ */
+/* a top level onMetaData property, counted into the ECMAARRAY size */
+static uint8_t *flv_meta_add_key(uint8_t *buf, const char *key,
+							uint32_t *count)
 {
-	uint8_t *buf = NULL;
-	uint8_t *pbuf = NULL;
+	(*count)++;
 
-	buf = (uint8_t *)malloc(1024);
-	pbuf = buf;
+	return amf_ecmaarray_add_key(buf, key);
+}
 
-	pbuf = amf_string_to_bytes(pbuf, "onMetadata");//SCRIPTDATA tag name
-	pbuf = amf_ecmaarray_to_bytes(pbuf, 1);//ECMAARRAY size
+static uint32_t flv_build_onmetadata(struct flv_muxer *flv, int pad)
+{
+	uint8_t *pbuf = flv->meta;
+	uint8_t *array = NULL;
+	uint32_t count = 0;
+	double duration = 0;
+	uint32_t used = 0;
+	int i;
+
+	duration = (double)flv->time_now / 1000;
+
+	pbuf = amf_string_to_bytes(pbuf, "onMetaData");//SCRIPTDATA tag name
+	array = pbuf;
+	pbuf = amf_ecmaarray_to_bytes(pbuf, 0);//ECMAARRAY size, set below
 	/* ECMAARRAY properties */
-	pbuf = amf_ecmaarray_add_key(pbuf, "duration");
-	pbuf = amf_ecmaarray_add_double(pbuf, value);
+	pbuf = flv_meta_add_key(pbuf, "duration", &count);
+	pbuf = amf_ecmaarray_add_double(pbuf, duration);
+	pbuf = flv_meta_add_key(pbuf, "filesize", &count);
+	pbuf = amf_ecmaarray_add_double(pbuf, (double)flv->offset);
+
+	if (flv->profile.has_video) {
+		pbuf = flv_meta_add_key(pbuf, "width", &count);
+		pbuf = amf_ecmaarray_add_double(pbuf, flv->profile.width);
+		pbuf = flv_meta_add_key(pbuf, "height", &count);
+		pbuf = amf_ecmaarray_add_double(pbuf, flv->profile.height);
+		pbuf = flv_meta_add_key(pbuf, "framerate", &count);
+		pbuf = amf_ecmaarray_add_double(pbuf,
+						flv->profile.framerate);
+		pbuf = flv_meta_add_key(pbuf, "videocodecid", &count);
+		pbuf = amf_ecmaarray_add_double(pbuf, 7);// AVC
+	}
 
-	pbuf= amf_objend(pbuf);
+	if (flv->profile.has_audio) {
+		pbuf = flv_meta_add_key(pbuf, "audiocodecid", &count);
+		pbuf = amf_ecmaarray_add_double(pbuf, 10);// AAC
+		pbuf = flv_meta_add_key(pbuf, "audiosamplerate", &count);
+		pbuf = amf_ecmaarray_add_double(pbuf,
+						flv->profile.sample_rate);
+		pbuf = flv_meta_add_key(pbuf, "audiosamplesize", &count);
+		pbuf = amf_ecmaarray_add_double(pbuf, 16);
+		pbuf = flv_meta_add_key(pbuf, "stereo", &count);
+		pbuf = amf_bool_to_bytes(pbuf, flv->profile.channels == 2);
+	}
 
-	flv_write_flv_tag(file_hd, buf, (uint32_t)(pbuf - buf),
-				0, FLV_TAG_TYPE_META);
+	/* keyframes: {filepositions: [], times: []} */
+	pbuf = flv_meta_add_key(pbuf, "keyframes", &count);
+	pbuf = amf_object_to_bytes(pbuf);
+	pbuf = amf_ecmaarray_add_key(pbuf, "filepositions");
+	pbuf = amf_strictarray_to_bytes(pbuf, flv->kf_num);
+	for (i = 0; i < flv->kf_num; i++)
+		pbuf = amf_double_to_bytes(pbuf, (double)flv->kf_pos[i]);
+	pbuf = amf_ecmaarray_add_key(pbuf, "times");
+	pbuf = amf_strictarray_to_bytes(pbuf, flv->kf_num);
+	for (i = 0; i < flv->kf_num; i++)
+		pbuf = amf_double_to_bytes(pbuf, flv->kf_time[i]);
+	pbuf = amf_objend(pbuf);
+
+	if (pad) {
+		used = (pbuf - flv->meta) + FLV_META_PAD_OVERHEAD + 3;
+		pbuf = flv_meta_add_key(pbuf, "_pad", &count);
+		pbuf = amf_padding_to_bytes(pbuf, flv->meta_size - used);
+	}
 
-	free(buf);
+	pbuf = amf_objend(pbuf);
+	amf_ecmaarray_to_bytes(array, count);
 
-	return;
+	return (uint32_t)(pbuf - flv->meta);
 }
 
-/*
- * @brief write video tag
- * @param[in] buf:
- * @param[in] buf_len: flv tag body size
- * @param[in] timestamp: flv tag timestamp
- */
-static void flv_write_video_tag(FILE *file_hd,
-					uint8_t *buf, uint32_t buf_len,
-					uint32_t timestamp)
+/* write the reserved onMetaData, right after the file header */
+static int flv_write_onmetadata_tag(struct flv_muxer *flv)
 {
-	flv_write_flv_tag(file_hd, buf, buf_len, timestamp, FLV_TAG_TYPE_VIDEO);
+	struct iovec iov;
+
+	flv->meta_offset = flv->offset;
+
+	iov.iov_base = flv->meta;
+	iov.iov_len = flv_build_onmetadata(flv, 1);
+
+	return flv_write_flv_tag(flv, 0, &iov, 1, 0, FLV_TAG_TYPE_META);
+}
+
+/* rewrite the onMetaData body in place with the final values */
+static int flv_update_onmetadata_tag(struct flv_muxer *flv)
+{
+	uint32_t len = flv_build_onmetadata(flv, 1);
+	off_t off = flv->meta_offset + FLV_TAG_HDR_SIZE;
+	ssize_t ret = 0;
+	uint32_t done = 0;
+
+	while (done < len) {
+		ret = pwrite(flv->fd, flv->meta + done, len - done, off + done);
+		flv->stat.syscalls++;
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			printf("FLV update onMetaData fail: %s\n",
+							strerror(errno));
+			return -1;
+		}
+		done += ret;
+	}
+
+	return 0;
 }
 
 /*
- * @brief write audio tag
- * @param[in] buf:
- * @param[in] buf_len: flv tag body size
- * @param[in] timestamp: flv tag timestamp
+ * remember where the keyframe tag about to be written starts,
+ * a full index keeps every other entry and from then on only every
+ * 2^n-th keyframe, so the reserved metadata never overflows
  */
-static void flv_write_audio_tag(FILE *file_hd,
-					uint8_t *buf, uint32_t buf_len,
-					uint32_t timestamp)
+static void flv_index_keyframe(struct flv_muxer *flv, int64_t timestamp)
 {
-	flv_write_flv_tag(file_hd, buf, buf_len, timestamp, FLV_TAG_TYPE_AUDIO);
+	int i;
+
+	if (flv->kf_cap == 0 || (flv->kf_seen++ & (flv->kf_stride - 1)))
+		return;
+
+	if (flv->kf_num == flv->kf_cap) {
+		for (i = 0; i < (flv->kf_num + 1) / 2; i++) {
+			flv->kf_pos[i] = flv->kf_pos[2 * i];
+			flv->kf_time[i] = flv->kf_time[2 * i];
+		}
+		flv->kf_num = (flv->kf_num + 1) / 2;
+		flv->kf_stride *= 2;
+
+		/* this one was counted with the old stride */
+		if ((flv->kf_seen - 1) & (flv->kf_stride - 1))
+			return;
+	}
+
+	flv->kf_pos[flv->kf_num] = flv->offset;
+	flv->kf_time[flv->kf_num] = (double)timestamp / 1000;
+	flv->kf_num++;
 }
 
 /*
- * @brief write video(H264/AVC) tag data
- *
+ * @brief write one audio/video tag to the file
+ * @param[in] dts: caller's clock(ms), the first tag out is time 0
+ * the file time only moves forward, the tag carries its low 32 bits
+ * (24 bits + 8 bits extended), wrapping after ~49.7 days as flv does
+ * @param[in] seq_hdr: @data is the AVCDecoderConfigurationRecord or
+ * AudioSpecificConfig, it goes out at the current file time, @dts unused
  */
-void flv_write_avc_data_tag(FILE *file_hd,
-					const uint8_t *data, uint32_t data_len,
-					uint32_t timestamp, int keyframe)
+static int flv_emit_tag(struct flv_muxer *flv, int stream,
+				const uint8_t *data, uint32_t data_len,
+				int64_t dts, int keyframe, int seq_hdr)
 {
-	uint8_t *buf = (uint8_t *) malloc(data_len + 5);
-	uint8_t *pbuf = buf;
+	uint8_t *pbuf = flv->hdr + FLV_TAG_HDR_SIZE;
+	struct iovec iov;
+	int64_t timestamp;
+
+	iov.iov_base = (void *)data;
+	iov.iov_len = data_len;
+
+	if (seq_hdr) {
+		if (stream == FLV_STREAM_AUDIO) {
+			pbuf = ui08_to_bytes(pbuf, 0xaf);
+			pbuf = ui08_to_bytes(pbuf, 0); // AACPacketType: 0x00 - AAC sequence header
+			return flv_write_flv_tag(flv, 2, &iov, 1,
+					(uint32_t)flv->time_now,
+							FLV_TAG_TYPE_AUDIO);
+		}
+
+		pbuf = ui08_to_bytes(pbuf, 0x17); // keyframe, AVC
+		pbuf = ui08_to_bytes(pbuf, 0); // AVCPacketType: 0x00 - AVC sequence header
+		pbuf = ui24_to_bytes(pbuf, 0); // composition time
+		return flv_write_flv_tag(flv, 5, &iov, 1,
+				(uint32_t)flv->time_now, FLV_TAG_TYPE_VIDEO);
+	}
 
-	uint8_t flag = 0;
-	// (FrameType << 4) | CodecID, 1 - keyframe, 2 - inner frame, 7 - AVC(h264)
-	if (keyframe)
-		flag = 0x17;
-	else
-		flag = 0x27;
+	if (!flv->time_valid) {
+		flv->time_begin = dts;
+		flv->time_valid = 1;
+	}
 
-	pbuf = ui08_to_bytes(pbuf, flag);
+	timestamp = dts - flv->time_begin;
+	if (timestamp < flv->time_now)
+		timestamp = flv->time_now;
+	flv->time_now = timestamp;
+
+	if (stream == FLV_STREAM_AUDIO) {
+		/* SoundFormat|SoundRate|SoundSize|SoundType:0xa0|0x0c|0x02|0x01*/
+		pbuf = ui08_to_bytes(pbuf, 0xaf);
+		pbuf = ui08_to_bytes(pbuf, 1); // AACPacketType: 0x01 - AAC frame data
+
+		return flv_write_flv_tag(flv, 2, &iov, 1,
+				(uint32_t)timestamp, FLV_TAG_TYPE_AUDIO);
+	}
+
+	// (FrameType << 4) | CodecID, 1 - keyframe, 2 - inner frame, 7 - AVC(h264)
+	pbuf = ui08_to_bytes(pbuf, keyframe ? 0x17 : 0x27);
 
 	pbuf = ui08_to_bytes(pbuf, 1);	  // AVCPacketType: 0x00 - AVC sequence header; 0x01 - AVC NALU
 	pbuf = ui24_to_bytes(pbuf, 0);	  // composition time
 
-	memcpy(pbuf, data, data_len);
-	pbuf += data_len;
-
-	if (g_time_begin == 0)
-		g_time_begin = timestamp;
+	if (keyframe)
+		flv_index_keyframe(flv, timestamp);
 
-	g_time_now = timestamp;
+	return flv_write_flv_tag(flv, 5, &iov, 1,
+				(uint32_t)timestamp, FLV_TAG_TYPE_VIDEO);
+}
 
-	flv_write_video_tag(file_hd, buf, (uint32_t)(pbuf - buf), (timestamp - g_time_begin));
+static int flv_emit_pending(struct flv_muxer *flv, int stream)
+{
+	struct flv_fifo *fifo = &flv->fifo[stream];
+	struct flv_pending *tag = flv_fifo_at(fifo, fifo->head);
+	int ret = 0;
 
-	free(buf);
+	ret = flv_emit_tag(flv, stream, fifo->buf + tag->off, tag->len,
+					tag->dts, tag->keyframe, tag->seq_hdr);
+	flv_fifo_pop(fifo);
 
-	return;
+	return ret;
 }
 
 /*
- * @brief write audio(AAC) tag data
- *
+ * write out pending tags in dts order: the smaller head while both
+ * streams have one, a lone stream only once it is more than
+ * max_interleave ahead(the other one stalled) or on @flush
  */
-void flv_write_aac_data_tag(FILE *file_hd,
-					const uint8_t *data, uint32_t data_len,
-					uint32_t timestamp)
+static int flv_interleave(struct flv_muxer *flv, int flush)
 {
-	uint8_t *buf = NULL;
-	uint8_t *pbuf = NULL;
-	uint32_t payload_len = 0;
-	uint8_t *payload = NULL;
+	struct flv_fifo *video = &flv->fifo[FLV_STREAM_VIDEO];
+	struct flv_fifo *audio = &flv->fifo[FLV_STREAM_AUDIO];
+	struct flv_fifo *fifo = NULL;
+	int stream;
+	int ret = 0;
+
+	while (ret == 0) {
+		if (!flv_fifo_empty(video) && !flv_fifo_empty(audio)) {
+			stream = flv_fifo_at(audio, audio->head)->dts <
+				flv_fifo_at(video, video->head)->dts ?
+				FLV_STREAM_AUDIO : FLV_STREAM_VIDEO;
+		} else {
+			stream = flv_fifo_empty(video) ?
+				FLV_STREAM_AUDIO : FLV_STREAM_VIDEO;
+			fifo = &flv->fifo[stream];
+			if (flv_fifo_empty(fifo))
+				break;
+			if (!flush && flv_fifo_at(fifo, fifo->tail - 1)->dts -
+					flv_fifo_at(fifo, fifo->head)->dts <=
+							flv->max_interleave)
+				break;
+		}
+
+		ret = flv_emit_pending(flv, stream);
+	}
 
-	/* strip ADTS from frame */
-	payload = (uint8_t *)(data + 7);
-	payload_len = data_len - 7;
+	return ret;
+}
 
-	buf = (uint8_t *)malloc(payload_len + 2);
-	pbuf = buf;
+static int flv_write_data_tag(struct flv_muxer *flv, int stream,
+				const uint8_t *data, uint32_t data_len,
+				int64_t dts, int keyframe)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&flv->mutex);
+
+	/* each stream on its own never goes back in time */
+	if (flv->has_last[stream] && dts < flv->last_dts[stream])
+		dts = flv->last_dts[stream];
+	flv->last_dts[stream] = dts;
+	flv->has_last[stream] = 1;
+
+	if (flv->max_interleave < 0) {
+		ret = flv_emit_tag(flv, stream, data, data_len, dts,
+								keyframe, 0);
+	} else {
+		ret = flv_fifo_push(&flv->fifo[stream], data, data_len,
+							dts, keyframe, 0);
+		if (ret < 0)
+			printf("Malloc FLV interleave queue fail\n");
+		else
+			ret = flv_interleave(flv, 0);
+	}
 
-	/* SoundFormat|SoundRate|SoundSize|SoundType:0xa0|0x0c|0x02|0x01*/
-	pbuf = ui08_to_bytes(pbuf, 0xaf);
-	pbuf = ui08_to_bytes(pbuf, 1); // AACPacketType: 0x01 - AAC frame data
+	pthread_mutex_unlock(&flv->mutex);
 
-	memcpy(pbuf, payload, payload_len);
-	pbuf += payload_len;
+	return ret;
+}
 
-	if (g_time_begin == 0)
-		g_time_begin = timestamp;
+/*
+ * @brief write video(H264/AVC) tag data
+ *
+ */
+int flv_write_avc_data_tag(struct flv_muxer *flv,
+					const uint8_t *data, uint32_t data_len,
+					int64_t dts, int keyframe)
+{
+	return flv_write_data_tag(flv, FLV_STREAM_VIDEO, data, data_len,
+							dts, keyframe);
+}
 
-	g_time_now = timestamp;
+/*
+ * @brief write audio(AAC) tag data
+ *
+ */
+int flv_write_aac_data_tag(struct flv_muxer *flv,
+					const uint8_t *data, uint32_t data_len,
+					int64_t dts)
+{
+	return flv_write_data_tag(flv, FLV_STREAM_AUDIO, data, data_len,
+								dts, 0);
+}
 
-	flv_write_audio_tag(file_hd, buf, (uint32_t)(pbuf - buf), (timestamp - g_time_begin));
+/*
+ * a sequence header applies from the stream's next data tag on, so it
+ * queues behind the tags of its stream still waiting to be interleaved,
+ * where it falls among the other stream's tags does not matter
+ */
+static int flv_write_seq_hdr_tag(struct flv_muxer *flv, int stream,
+				const uint8_t *data, uint32_t data_len)
+{
+	struct flv_fifo *fifo = &flv->fifo[stream];
+	int ret = 0;
+
+	pthread_mutex_lock(&flv->mutex);
+
+	if (flv->max_interleave < 0 || flv_fifo_empty(fifo)) {
+		ret = flv_emit_tag(flv, stream, data, data_len, 0, 0, 1);
+	} else {
+		ret = flv_fifo_push(fifo, data, data_len,
+				flv_fifo_at(fifo, fifo->tail - 1)->dts, 0, 1);
+		if (ret < 0)
+			printf("Malloc FLV interleave queue fail\n");
+	}
 
-	free(buf);
+	pthread_mutex_unlock(&flv->mutex);
 
-	return;
+	return ret;
 }
 
-//void flv_write_video_data_tag(FILE *file_hd,
-//					const uint8_t *data, uint32_t data_len,
-//					uint32_t timestamp)
-//{
-//	  if (g_time_begin == 0)
-//		g_time_begin = timestamp;
-//
-//	g_time_now = timestamp;
-//
-//	  flv_write_video_tag(file_hd, (uint8_t *) data, data_len, (timestamp - g_time_begin));
-//}
-
 /*
  * @brief write AVC sequence header in header of video tag data part, the first video tag
  * AVCDecoderConfigurationRecord
  */
-void flv_write_avc_sequence_header_tag(FILE *file_hd,
+int flv_write_avc_sequence_header_tag(struct flv_muxer *flv,
 					const uint8_t *sps, uint32_t sps_len,
 					const uint8_t *pps, uint32_t pps_len)
 {
-	uint8_t *buf = (uint8_t *) malloc(sps_len + pps_len + 16);
-	uint8_t *pbuf = buf;
-
-	uint8_t flag = 0;
-
-	flag = (1 << 4) // frametype "1 == keyframe"
-		| 7; // codecid "7 == AVC"
+	uint8_t *avcc = NULL;
+	uint8_t *pbuf = NULL;
+	uint32_t avcc_len = 11 + sps_len + pps_len;
+	int ret = 0;
 
-	pbuf = ui08_to_bytes(pbuf, flag);
+	if (sps_len < 4 || sps_len > 0xffff || pps_len > 0xffff)
+		return -1;
 
-	pbuf = ui08_to_bytes(pbuf, 0); // AVCPacketType: 0x00 - AVC sequence header
-	pbuf = ui24_to_bytes(pbuf, 0); // composition time
+	avcc = (uint8_t *)malloc(avcc_len);
+	if (avcc == NULL)
+		return -1;
 
 	// generate AVCC with sps and pps, AVCDecoderConfigurationRecord
-
+	pbuf = avcc;
 	pbuf = ui08_to_bytes(pbuf, 1); // configurationVersion
 	pbuf = ui08_to_bytes(pbuf, sps[1]); // AVCProfileIndication
 	pbuf = ui08_to_bytes(pbuf, sps[2]); // profile_compatibility
@@ -414,45 +848,30 @@ void flv_write_avc_sequence_header_tag(FILE *file_hd,
 	pbuf = ui08_to_bytes(pbuf, 1); // number of pps
 	pbuf = ui16_to_bytes(pbuf, (uint16_t)pps_len);
 	memcpy(pbuf, pps, pps_len);
-	pbuf += pps_len;
 
-	flv_write_video_tag(file_hd, buf, (uint32_t)(pbuf - buf), 0);
+	ret = flv_write_seq_hdr_tag(flv, FLV_STREAM_VIDEO, avcc, avcc_len);
 
-	free(buf);
+	free(avcc);
 
-	return;
+	return ret;
 }
 
 /*
  * @brief write AAC pcm profile in header of audio tag data part, the first audio tag
  * AudioSpecificConfig
  */
-void flv_write_aac_sequence_header_tag(FILE *file_hd,
-						int sample_rate, int channels)
+int flv_write_aac_sequence_header_tag(struct flv_muxer *flv,
+					const uint8_t *asc, uint32_t asc_len)
 {
-	uint8_t *buf = (uint8_t *) malloc(4);
-	uint8_t *pbuf = buf;
-
-	/* SoundFormat|SoundRate|SoundSize|SoundType:0xa0|0x0c|0x02|0x01*/
-	pbuf = ui08_to_bytes(pbuf, 0xaf);
-	pbuf = ui08_to_bytes(pbuf, 0); // AACPacketType: 0x00 - AAC sequence header
-
-	pbuf = ui16_to_bytes(pbuf, 0x1590); // AudioSpecificConfig: 0x1590 //TODO confirm
-
-	flv_write_audio_tag(file_hd, buf, (uint32_t)(pbuf - buf), 0);
-
-	free(buf);
-
-	return;
+	return flv_write_seq_hdr_tag(flv, FLV_STREAM_AUDIO, asc, asc_len);
 }
 
 /*
  * it sames dosen't work */
 /*
-void flv_write_avc_stop_tag(FILE *file_hd)
+void flv_write_avc_stop_tag(struct flv_muxer *flv)
 {
-	uint8_t *buf = (uint8_t *) malloc(6);
-	uint8_t *pbuf = buf;
+	uint8_t *pbuf = flv->hdr + FLV_TAG_HDR_SIZE;
 
 	uint8_t flag = 0;
 	// (FrameType << 4) | CodecID, 1 - keyframe, 2 - inner frame, 5 info/command frame, 7 - AVC(h264)
@@ -466,59 +885,159 @@ void flv_write_avc_stop_tag(FILE *file_hd)
 
 	pbuf = ui08_to_bytes(pbuf, 1);	  // VideoTagBody: 0x00 - Start of client-side seeking video frame sequence; 0x01 - End of ...
 
-	flv_write_video_tag(file_hd, buf, (uint32_t)(pbuf - buf), 0);
-
-	free(buf);
+	flv_write_flv_tag(flv, 6, NULL, 0, 0, FLV_TAG_TYPE_VIDEO);
 
 	return;
 }*/
 
-int create_flv_muxer(FILE **flv_hd, struct FLVProfile *flv_profile)
+int create_flv_muxer(struct flv_muxer **flv_hd, struct FLVProfile *flv_profile)
 {
-	FILE *file_hd = NULL;
+	struct flv_muxer *flv = NULL;
+	int ret = 0;
 
-	file_hd = flv_file_open(flv_profile->name);
-	if (file_hd == NULL)
+	flv = (struct flv_muxer *)calloc(1, sizeof(struct flv_muxer));
+	if (flv == NULL) {
+		printf("Malloc FLV muxer fail\n");
 		return -1;
+	}
+	flv->fd = -1;
+	flv->profile = *flv_profile;
+	pthread_mutex_init(&flv->mutex, NULL);
+
+	/* a lone stream has nothing to be interleaved with */
+	flv->max_interleave = flv_profile->max_interleave_ms ?
+		flv_profile->max_interleave_ms : FLV_DEFAULT_INTERLEAVE_MS;
+	if (!flv_profile->has_audio || !flv_profile->has_video)
+		flv->max_interleave = -1;
+	if (flv->max_interleave >= 0 &&
+			(flv_fifo_init(&flv->fifo[FLV_STREAM_VIDEO]) < 0 ||
+			flv_fifo_init(&flv->fifo[FLV_STREAM_AUDIO]) < 0)) {
+		printf("Malloc FLV interleave queue fail\n");
+		goto exit;
+	}
 
-	flv_write_file_header(file_hd,
+	/* index and metadata are sized once, nothing grows while muxing */
+	flv->kf_cap = flv_profile->max_keyframes > 0 ?
+			flv_profile->max_keyframes : FLV_DEFAULT_MAX_KEYFRAMES;
+	if (flv->kf_cap < 2)
+		flv->kf_cap = 2;
+	if (!flv_profile->has_video)
+		flv->kf_cap = 0;
+	flv->kf_stride = 1;
+	flv->meta_size = FLV_META_FIXED_MAX + FLV_META_PAD_OVERHEAD +
+				2 * flv->kf_cap * FLV_META_INDEX_ENTRY;
+	flv->meta = (uint8_t *)malloc(flv->meta_size);
+	flv->kf_pos = (uint64_t *)calloc(flv->kf_cap + 1, sizeof(uint64_t));
+	flv->kf_time = (double *)calloc(flv->kf_cap + 1, sizeof(double));
+	if (flv->meta == NULL || flv->kf_pos == NULL || flv->kf_time == NULL) {
+		printf("Malloc FLV keyframe index fail\n");
+		goto exit;
+	}
+
+	ret = flv_file_open(flv, flv_profile->name);
+	if (ret < 0)
+		goto exit;
+
+	ret = flv_write_file_header(flv,
 				flv_profile->has_audio, flv_profile->has_video);
+	if (ret < 0)
+		goto exit;
 
-	flv_write_avc_sequence_header_tag(file_hd,
+	ret = flv_write_onmetadata_tag(flv);
+	if (ret < 0)
+		goto exit;
+
+	if (flv_profile->has_video) {
+		ret = flv_write_avc_sequence_header_tag(flv,
 				flv_profile->sps, flv_profile->sps_len,
 				flv_profile->pps, flv_profile->pps_len);
+		if (ret < 0)
+			goto exit;
+	}
 
-	flv_write_aac_sequence_header_tag(file_hd,
-				flv_profile->sample_rate, flv_profile->channels);
+	if (flv_profile->has_audio) {
+		if (flv_profile->aac_decoder_conf_len <= 0) {
+			printf("FLV muxer needs the aac AudioSpecificConfig\n");
+			goto exit;
+		}
+
+		ret = flv_write_aac_sequence_header_tag(flv,
+				flv_profile->aac_decoder_conf,
+				flv_profile->aac_decoder_conf_len);
+		if (ret < 0)
+			goto exit;
+	}
 
-	*flv_hd = file_hd;
+	*flv_hd = flv;
 
 	printf("Create FLV muxer\n");
 
 	return 0;
+
+exit:
+	if (flv->fd >= 0)
+		close(flv->fd);
+	flv_fifo_destroy(&flv->fifo[FLV_STREAM_VIDEO]);
+	flv_fifo_destroy(&flv->fifo[FLV_STREAM_AUDIO]);
+	pthread_mutex_destroy(&flv->mutex);
+	free(flv->meta);
+	free(flv->kf_pos);
+	free(flv->kf_time);
+	free(flv);
+	return -1;
 }
 
-void flv_file_close(FILE *file_hd)
+static int flv_file_close(struct flv_muxer *flv, int sync)
 {
-	double duration = 0;
+	int ret = 0;
 
-	if (file_hd == NULL)
-		return;
+	if (flv->fd < 0)
+		return 0;
 
-	duration = (double)(g_time_now - g_time_begin) / 1000;
-	flv_write_onmetadata_tag(file_hd, duration);
+	ret = flv_interleave(flv, 1);
+	ret |= flv_update_onmetadata_tag(flv);
 
-	fclose(file_hd);
-	file_hd = NULL;
+	if (sync && fdatasync(flv->fd) < 0) {
+		printf("FLV sync fail: %s\n", strerror(errno));
+		ret = -1;
+	}
 
-	return;
+	close(flv->fd);
+	flv->fd = -1;
+
+	return ret;
+}
+
+int flv_muxer_close(struct flv_muxer *flv, int sync)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&flv->mutex);
+	ret = flv_file_close(flv, sync);
+	pthread_mutex_unlock(&flv->mutex);
+
+	return ret;
+}
+
+void flv_muxer_get_stat(struct flv_muxer *flv, struct flv_muxer_stat *stat)
+{
+	pthread_mutex_lock(&flv->mutex);
+	*stat = flv->stat;
+	pthread_mutex_unlock(&flv->mutex);
 }
 
-void destroy_flv_muxer(FILE *flv_hd)
+void destroy_flv_muxer(struct flv_muxer *flv)
 {
-	if (flv_hd != NULL) {
-//		flv_write_avc_stop_tag(flv_hd);
-		flv_file_close(flv_hd);
+	if (flv != NULL) {
+//		flv_write_avc_stop_tag(flv);
+		flv_file_close(flv, 0);
+		flv_fifo_destroy(&flv->fifo[FLV_STREAM_VIDEO]);
+		flv_fifo_destroy(&flv->fifo[FLV_STREAM_AUDIO]);
+		pthread_mutex_destroy(&flv->mutex);
+		free(flv->meta);
+		free(flv->kf_pos);
+		free(flv->kf_time);
+		free(flv);
 		printf("Destroy FLV muxer\n");
 	}
 }
@@ -12,6 +12,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <pthread.h>
 
 struct FLVTag {
 	uint8_t type;
@@ -21,8 +22,11 @@ struct FLVTag {
 	uint8_t streamid[3];
 } __attribute__((__packed__));
 
+/* file path, with room for a directory */
+#define FLV_NAME_LEN	256
+
 struct FLVProfile {
-	char name[64];
+	char name[FLV_NAME_LEN];
 	bool has_video;
 	bool has_audio;
 	int sample_rate;
@@ -31,6 +35,20 @@ struct FLVProfile {
 	uint8_t *pps;
 	int sps_len;
 	int pps_len;
+	/* AudioSpecificConfig generated by [create_aac_encoder] */
+	uint8_t *aac_decoder_conf;
+	int aac_decoder_conf_len;
+	/* for onMetaData only */
+	int width;
+	int height;
+	int framerate;
+	/* keyframe index entries reserved in onMetaData, 0 for the default,
+	 * longer recordings keep a coarser index */
+	int max_keyframes;
+	/* how far(ms) one stream may run ahead of the other before its tags
+	 * go out without waiting, 0 for the default, < 0 writes every tag
+	 * as it comes */
+	int max_interleave_ms;
 };
 
 enum {
@@ -55,33 +73,130 @@ enum {
     FLV_TAG_TYPE_META = 0x12,
 };
 
-/* @[create_flv_muxer] is the wrapper of [flv_file_open][flv_write_file_header]
- * [flv_write_aac_sequence_header_tag][flv_write_avc_sequence_header_tag]
- * @[destroy_flv_muxer] is the wrapper of [flv_file_close]
+/* sizeof(struct FLVTag) */
+#define FLV_TAG_HDR_SIZE	11
+/* longest tag body header the muxer builds(AVC data tag) */
+#define FLV_BODY_HDR_MAX	16
+
+/* 2048 keyframes, ~37KB of onMetaData, an hour at a 2s gop */
+#define FLV_DEFAULT_MAX_KEYFRAMES	2048
+/* onMetaData without the keyframe index and padding */
+#define FLV_META_FIXED_MAX		512
+
+#define FLV_DEFAULT_INTERLEAVE_MS	1000
+
+enum {
+	FLV_STREAM_VIDEO = 0,
+	FLV_STREAM_AUDIO,
+	FLV_STREAM_NUM,
+};
+
+/* a tag waiting to be interleaved, payload at @off of its fifo buf */
+struct flv_pending {
+	int64_t dts;
+	uint32_t off;
+	uint32_t len;
+	int keyframe;
+	int seq_hdr; /* AVC/AAC sequence header instead of data */
+};
+
+/* pending tags of one stream, payloads copied into a byte ring @buf,
+ * both grow only when a stream runs further ahead than ever before */
+struct flv_fifo {
+	struct flv_pending *tags;
+	unsigned int cap; /* power of two */
+	unsigned int head;
+	unsigned int tail;
+	uint8_t *buf;
+	uint32_t size;
+	uint32_t rd;
+	uint32_t wr;
+};
+
+struct flv_muxer_stat {
+	uint64_t tags;
+	uint64_t syscalls;
+	uint64_t bytes;
+};
+
+/*
+ * one flv file, every tag goes out with a single writev of
+ * [tag header + body header][payload][PreviousTagSize], the headers are
+ * built in @hdr
+ * onMetaData is reserved at the head with room for the keyframe index
+ * (@kf_pos/@kf_time) and rewritten in place on close, so the file is
+ * seekable without a scan
+ * audio and video tags are interleaved by dts through @fifo, the file
+ * timeline is 64 bits ms from the first tag out(@time_begin on the
+ * caller's clock), tags carry its low 32 bits
+ * every muxer has its own state and lock, the audio and video writers
+ * could be called from different threads
  */
-int create_flv_muxer(FILE **flv_hd, struct FLVProfile *flv_profile);
-void destroy_flv_muxer(FILE *flv_hd);
+struct flv_muxer {
+	pthread_mutex_t mutex;
+	int fd;
+	uint64_t offset; /* file position of the next tag */
+	int64_t time_begin;
+	int64_t time_now; /* file time of the last tag */
+	int time_valid;
+	int64_t last_dts[FLV_STREAM_NUM];
+	int has_last[FLV_STREAM_NUM];
+	int64_t max_interleave; /* < 0 no interleaving */
+	struct flv_fifo fifo[FLV_STREAM_NUM];
+	uint8_t hdr[FLV_TAG_HDR_SIZE + FLV_BODY_HDR_MAX];
+	uint8_t prev_size[4];
+	struct FLVProfile profile;
 
-FILE *flv_file_open(const char *filename);
+	uint8_t *meta;
+	uint32_t meta_size;
+	uint64_t meta_offset;
 
-void flv_file_close(FILE *file_hd);
+	uint64_t *kf_pos;
+	double *kf_time;
+	int kf_num;
+	int kf_cap;
+	unsigned int kf_stride; /* index every kf_stride-th keyframe */
+	unsigned int kf_seen;
 
-void flv_write_file_header(FILE *file_hd,
-				bool is_have_audio, bool is_have_video);
+	struct flv_muxer_stat stat;
+};
 
-void flv_write_aac_sequence_header_tag(FILE *file_hd,
-						int sample_rate, int channel);
+/* @[create_flv_muxer] opens the file and writes the file header, the
+ * reserved onMetaData and the avc/aac sequence header tags
+ * @[destroy_flv_muxer] fills in onMetaData and closes the file
+ */
+int create_flv_muxer(struct flv_muxer **flv_hd, struct FLVProfile *flv_profile);
+void destroy_flv_muxer(struct flv_muxer *flv);
 
-void flv_write_avc_sequence_header_tag(FILE *file_hd,
+/* finish the file(pending tags, onMetaData) and close it ahead of
+ * [destroy_flv_muxer], @sync: fdatasync before the close
+ * @return: 0, -1 if any of it failed
+ */
+int flv_muxer_close(struct flv_muxer *flv, int sync);
+
+/* all the tag writers return 0 on success, -1 on write error
+ * a new sequence header takes effect from the next data tag of its
+ * stream, the data is copied
+ */
+int flv_write_aac_sequence_header_tag(struct flv_muxer *flv,
+					const uint8_t *asc, uint32_t asc_len);
+
+int flv_write_avc_sequence_header_tag(struct flv_muxer *flv,
 					const uint8_t *sps, uint32_t sps_len,
 					const uint8_t *pps, uint32_t pps_len);
 
-void flv_write_aac_data_tag(FILE *file_hd,
+/* @data: raw aac access unit, no ADTS([AAC_TT_RAW] of the encoder)
+ * @dts: ms on any clock shared by audio and video, the data is copied
+ * if the tag has to wait for the other stream
+ */
+int flv_write_aac_data_tag(struct flv_muxer *flv,
 					const uint8_t *data, uint32_t data_len,
-					uint32_t timestamp);
+					int64_t dts);
 
-void flv_write_avc_data_tag(FILE *file_hd,
+int flv_write_avc_data_tag(struct flv_muxer *flv,
 					const uint8_t *data, uint32_t data_len,
-					uint32_t timestamp, int keyframe);
+					int64_t dts, int keyframe);
+
+void flv_muxer_get_stat(struct flv_muxer *flv, struct flv_muxer_stat *stat);
 
 #endif // FLV_MUXER_H_
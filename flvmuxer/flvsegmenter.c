@@ -0,0 +1,427 @@
+/*
+ * @file flvsegmenter.c
+ * rolling segmented flv recording on top of [flvmuxer]
+ *
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "flvsegmenter.h"
+
+/* first size of the retention ring when only @keep_bytes bounds it */
+#define FLV_SEG_FILES_INIT	64
+
+static void flv_seg_make_path(struct flv_segmenter *seg, unsigned int seq)
+{
+	snprintf(seg->path, sizeof(seg->path), "%s/%s-%08u.flv",
+				seg->attr.dir, seg->attr.prefix, seq);
+	snprintf(seg->part, sizeof(seg->part), "%s/%s-%08u.flv.part",
+				seg->attr.dir, seg->attr.prefix, seq);
+}
+
+/* start the next segment, called with @mutex held */
+static int flv_seg_open(struct flv_segmenter *seg)
+{
+	struct FLVProfile profile = seg->attr.profile;
+	int ret = 0;
+
+	flv_seg_make_path(seg, seg->seq++);
+	snprintf(profile.name, sizeof(profile.name), "%s", seg->part);
+	if (strlen(seg->part) >= sizeof(profile.name)) {
+		printf("FLV segment path too long: %s\n", seg->part);
+		return -1;
+	}
+
+	ret = create_flv_muxer(&seg->flv, &profile);
+	if (ret < 0) {
+		seg->flv = NULL;
+		return -1;
+	}
+	seg->seg_valid = 0;
+
+	return 0;
+}
+
+/* own copies of the profile's sps/pps/AudioSpecificConfig,
+ * every segment is opened with them */
+static int flv_seg_copy_conf(struct flv_segmenter *seg)
+{
+	struct FLVProfile *profile = &seg->attr.profile;
+	uint8_t *pbuf = NULL;
+	int len = 0;
+
+	if (profile->sps_len < 0 || profile->pps_len < 0 ||
+				profile->aac_decoder_conf_len < 0)
+		return -1;
+
+	len = profile->sps_len + profile->pps_len +
+				profile->aac_decoder_conf_len;
+	seg->conf = (uint8_t *)malloc(len > 0 ? len : 1);
+	if (seg->conf == NULL)
+		return -1;
+
+	pbuf = seg->conf;
+	if (profile->sps_len > 0)
+		memcpy(pbuf, profile->sps, profile->sps_len);
+	profile->sps = pbuf;
+	pbuf += profile->sps_len;
+
+	if (profile->pps_len > 0)
+		memcpy(pbuf, profile->pps, profile->pps_len);
+	profile->pps = pbuf;
+	pbuf += profile->pps_len;
+
+	if (profile->aac_decoder_conf_len > 0)
+		memcpy(pbuf, profile->aac_decoder_conf,
+				profile->aac_decoder_conf_len);
+	profile->aac_decoder_conf = pbuf;
+
+	return 0;
+}
+
+/* hand the current segment over to the io thread, with @mutex held,
+ * the muxer is finished there, the writers never wait for the disk */
+static int flv_seg_close(struct flv_segmenter *seg)
+{
+	struct flv_seg_job *job = NULL;
+
+	if (seg->flv == NULL)
+		return 0;
+
+	job = (struct flv_seg_job *)calloc(1, sizeof(struct flv_seg_job));
+	if (job == NULL) {
+		/* finish it here rather than lose it */
+		printf("Malloc FLV segment job fail\n");
+		flv_muxer_close(seg->flv, 0);
+		destroy_flv_muxer(seg->flv);
+		seg->flv = NULL;
+		rename(seg->part, seg->path);
+		return -1;
+	}
+	job->flv = seg->flv;
+	memcpy(job->part, seg->part, sizeof(job->part));
+	memcpy(job->path, seg->path, sizeof(job->path));
+	seg->flv = NULL;
+
+	pthread_mutex_lock(&seg->io_mutex);
+	*seg->jobs_tail = job;
+	seg->jobs_tail = &job->next;
+	seg->stat.pending++;
+	pthread_cond_signal(&seg->io_cond);
+	pthread_mutex_unlock(&seg->io_mutex);
+
+	return 0;
+}
+
+static int flv_seg_sync_dir(const char *dir)
+{
+	int fd = -1;
+	int ret = 0;
+
+	fd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		return -1;
+	ret = fsync(fd);
+	close(fd);
+
+	return ret;
+}
+
+/* remember a finished segment, the ring is only touched by the io thread */
+static int flv_seg_track(struct flv_segmenter *seg,
+				const char *path, uint64_t size)
+{
+	struct flv_seg_file *files = NULL;
+	int cap = 0;
+	int i = 0;
+
+	if (seg->file_num == seg->file_cap) {
+		cap = seg->file_cap ? seg->file_cap * 2 : FLV_SEG_FILES_INIT;
+		files = (struct flv_seg_file *)malloc(cap * sizeof(*files));
+		if (files == NULL)
+			return -1;
+		for (i = 0; i < seg->file_num; i++)
+			files[i] = seg->files[(seg->file_head + i) %
+							seg->file_cap];
+		free(seg->files);
+		seg->files = files;
+		seg->file_cap = cap;
+		seg->file_head = 0;
+	}
+
+	i = (seg->file_head + seg->file_num) % seg->file_cap;
+	snprintf(seg->files[i].path, sizeof(seg->files[i].path), "%s", path);
+	seg->files[i].size = size;
+	seg->file_num++;
+	seg->file_bytes += size;
+
+	return 0;
+}
+
+/* drop the oldest segments beyond @keep_segments/@keep_bytes, the
+ * newest one always stays */
+static unsigned int flv_seg_prune(struct flv_segmenter *seg)
+{
+	struct flv_seg_file *file = NULL;
+	unsigned int pruned = 0;
+
+	while (seg->file_num > 1 &&
+		((seg->attr.keep_segments > 0 &&
+			seg->file_num > seg->attr.keep_segments) ||
+		(seg->attr.keep_bytes > 0 &&
+			seg->file_bytes > seg->attr.keep_bytes))) {
+		file = &seg->files[seg->file_head];
+		if (unlink(file->path) < 0 && errno != ENOENT)
+			printf("FLV segment %s unlink fail: %s\n",
+						file->path, strerror(errno));
+		else
+			pruned++;
+		seg->file_bytes -= file->size;
+		seg->file_head = (seg->file_head + 1) % seg->file_cap;
+		seg->file_num--;
+	}
+
+	return pruned;
+}
+
+/* make one closed segment durable: data, name, directory entry */
+static int flv_seg_finish(struct flv_segmenter *seg, struct flv_seg_job *job)
+{
+	struct stat st;
+	int ret = 0;
+
+	if (flv_muxer_close(job->flv, 1) < 0)
+		ret = -1;
+	destroy_flv_muxer(job->flv);
+	job->flv = NULL;
+
+	if (rename(job->part, job->path) < 0) {
+		printf("FLV segment %s rename fail: %s\n",
+					job->part, strerror(errno));
+		return -1;
+	}
+	if (flv_seg_sync_dir(seg->attr.dir) < 0)
+		ret = -1;
+
+	if (seg->attr.keep_segments > 0 || seg->attr.keep_bytes > 0) {
+		if (stat(job->path, &st) < 0)
+			st.st_size = 0;
+		if (flv_seg_track(seg, job->path, st.st_size) < 0)
+			ret = -1;
+	}
+
+	return ret;
+}
+
+static void *flv_seg_io_thread(void *arg)
+{
+	struct flv_segmenter *seg = (struct flv_segmenter *)arg;
+	struct flv_seg_job *job = NULL;
+	unsigned int pruned = 0;
+	int ret = 0;
+
+	pthread_mutex_lock(&seg->io_mutex);
+	for (;;) {
+		while (seg->jobs == NULL && !seg->io_exit)
+			pthread_cond_wait(&seg->io_cond, &seg->io_mutex);
+		if (seg->jobs == NULL)
+			break;
+
+		job = seg->jobs;
+		seg->jobs = job->next;
+		if (seg->jobs == NULL)
+			seg->jobs_tail = &seg->jobs;
+		pthread_mutex_unlock(&seg->io_mutex);
+
+		ret = flv_seg_finish(seg, job);
+		pruned = flv_seg_prune(seg);
+		free(job);
+
+		pthread_mutex_lock(&seg->io_mutex);
+		seg->stat.pending--;
+		seg->stat.segments++;
+		seg->stat.pruned += pruned;
+		if (ret < 0)
+			seg->stat.io_errors++;
+	}
+	pthread_mutex_unlock(&seg->io_mutex);
+
+	return NULL;
+}
+
+int create_flv_segmenter(struct flv_segmenter **seg_hd,
+				const struct flv_segmenter_attr *attr)
+{
+	struct flv_segmenter *seg = NULL;
+	int ret = 0;
+
+	seg = (struct flv_segmenter *)calloc(1, sizeof(struct flv_segmenter));
+	if (seg == NULL) {
+		printf("Malloc FLV segmenter fail\n");
+		return -1;
+	}
+	seg->attr = *attr;
+	if (seg->attr.dir[0] == '\0')
+		strcpy(seg->attr.dir, ".");
+	if (seg->attr.prefix[0] == '\0')
+		strcpy(seg->attr.prefix, "record");
+	seg->jobs_tail = &seg->jobs;
+	pthread_mutex_init(&seg->mutex, NULL);
+	pthread_mutex_init(&seg->io_mutex, NULL);
+	pthread_cond_init(&seg->io_cond, NULL);
+
+	if (flv_seg_copy_conf(seg) < 0) {
+		printf("Malloc FLV segment profile fail\n");
+		goto exit;
+	}
+
+	if (seg->attr.keep_segments > 0) {
+		seg->file_cap = seg->attr.keep_segments + 1;
+		seg->files = (struct flv_seg_file *)malloc(seg->file_cap *
+						sizeof(struct flv_seg_file));
+		if (seg->files == NULL) {
+			printf("Malloc FLV segment list fail\n");
+			goto exit;
+		}
+	}
+
+	ret = pthread_create(&seg->io_thread, NULL, flv_seg_io_thread, seg);
+	if (ret) {
+		printf("Create FLV segment io thread fail: %s\n",
+							strerror(ret));
+		goto exit;
+	}
+
+	ret = flv_seg_open(seg);
+	if (ret < 0) {
+		destroy_flv_segmenter(seg);
+		return -1;
+	}
+
+	*seg_hd = seg;
+
+	return 0;
+
+exit:
+	pthread_cond_destroy(&seg->io_cond);
+	pthread_mutex_destroy(&seg->io_mutex);
+	pthread_mutex_destroy(&seg->mutex);
+	free(seg->files);
+	free(seg->conf);
+	free(seg);
+
+	return -1;
+}
+
+void destroy_flv_segmenter(struct flv_segmenter *seg)
+{
+	if (seg == NULL)
+		return;
+
+	pthread_mutex_lock(&seg->mutex);
+	flv_seg_close(seg);
+	pthread_mutex_unlock(&seg->mutex);
+
+	pthread_mutex_lock(&seg->io_mutex);
+	seg->io_exit = 1;
+	pthread_cond_signal(&seg->io_cond);
+	pthread_mutex_unlock(&seg->io_mutex);
+	pthread_join(seg->io_thread, NULL);
+
+	pthread_cond_destroy(&seg->io_cond);
+	pthread_mutex_destroy(&seg->io_mutex);
+	pthread_mutex_destroy(&seg->mutex);
+	free(seg->files);
+	free(seg->conf);
+	free(seg);
+}
+
+/* rotate ahead of a tag that can start a segment, with @mutex held */
+static int flv_seg_cut(struct flv_segmenter *seg, int64_t dts)
+{
+	struct flv_muxer_stat stat;
+	int cut = 0;
+
+	if (seg->flv == NULL)
+		return flv_seg_open(seg);
+
+	if (!seg->seg_valid)
+		return 0;
+
+	if (seg->attr.segment_ms > 0 &&
+			dts - seg->seg_begin >= seg->attr.segment_ms)
+		cut = 1;
+	if (seg->attr.segment_bytes > 0) {
+		flv_muxer_get_stat(seg->flv, &stat);
+		if (stat.bytes >= seg->attr.segment_bytes)
+			cut = 1;
+	}
+	if (!cut)
+		return 0;
+
+	flv_seg_close(seg);
+
+	return flv_seg_open(seg);
+}
+
+int flv_segmenter_write_avc(struct flv_segmenter *seg,
+				const uint8_t *data, uint32_t data_len,
+				int64_t dts, int keyframe)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&seg->mutex);
+	/* a segment only starts on a keyframe */
+	if (keyframe)
+		ret = flv_seg_cut(seg, dts);
+	if (ret == 0 && seg->flv != NULL) {
+		if (!seg->seg_valid) {
+			seg->seg_begin = dts;
+			seg->seg_valid = 1;
+		}
+		ret = flv_write_avc_data_tag(seg->flv,
+					data, data_len, dts, keyframe);
+	}
+	pthread_mutex_unlock(&seg->mutex);
+
+	return ret;
+}
+
+int flv_segmenter_write_aac(struct flv_segmenter *seg,
+				const uint8_t *data, uint32_t data_len,
+				int64_t dts)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&seg->mutex);
+	/* without video any access unit can start a segment */
+	if (!seg->attr.profile.has_video)
+		ret = flv_seg_cut(seg, dts);
+	if (ret == 0 && seg->flv != NULL) {
+		if (!seg->seg_valid && !seg->attr.profile.has_video) {
+			seg->seg_begin = dts;
+			seg->seg_valid = 1;
+		}
+		ret = flv_write_aac_data_tag(seg->flv, data, data_len, dts);
+	}
+	pthread_mutex_unlock(&seg->mutex);
+
+	return ret;
+}
+
+void flv_segmenter_get_stat(struct flv_segmenter *seg,
+				struct flv_segmenter_stat *stat)
+{
+	pthread_mutex_lock(&seg->io_mutex);
+	*stat = seg->stat;
+	pthread_mutex_unlock(&seg->io_mutex);
+}
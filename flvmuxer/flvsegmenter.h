@@ -0,0 +1,108 @@
+/*
+ * @file flvsegmenter.h
+ * rolling segmented flv recording on top of [flvmuxer]
+ *
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ */
+
+#ifndef FLV_SEGMENTER_H_
+#define FLV_SEGMENTER_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "flvmuxer.h"
+
+#define FLV_SEG_PATH_LEN	FLV_NAME_LEN
+
+/*
+ * @profile: as for [create_flv_muxer], name is ignored, every segment
+ * starts with its own onMetaData and avc/aac sequence headers, sps/pps
+ * and aac_decoder_conf are copied by [create_flv_segmenter], the
+ * caller's buffers may go away right after it
+ * @dir/@prefix: segments are <dir>/<prefix>-<seq>.flv, named
+ * <...>.flv.part until they are closed and synced
+ * @segment_ms/@segment_bytes: cut on the first keyframe(any audio tag
+ * without video) once a segment is that long or that big, 0 disables
+ * @keep_segments/@keep_bytes: retention, older finished segments are
+ * deleted, 0 keeps everything
+ */
+struct flv_segmenter_attr {
+	struct FLVProfile profile;
+	char dir[FLV_SEG_PATH_LEN - 64];
+	char prefix[32];
+	int64_t segment_ms;
+	uint64_t segment_bytes;
+	int keep_segments;
+	uint64_t keep_bytes;
+};
+
+/* a closed segment on its way to the io thread */
+struct flv_seg_job {
+	struct flv_muxer *flv;
+	char part[FLV_SEG_PATH_LEN];
+	char path[FLV_SEG_PATH_LEN];
+	struct flv_seg_job *next;
+};
+
+/* a finished segment kept for retention */
+struct flv_seg_file {
+	char path[FLV_SEG_PATH_LEN];
+	uint64_t size;
+};
+
+struct flv_segmenter_stat {
+	unsigned int segments;	/* finished: synced and renamed */
+	unsigned int pruned;
+	unsigned int io_errors;
+	unsigned int pending;	/* closed, waiting for the io thread */
+};
+
+/*
+ * the writers only write to the page cache, and rotating opens the next
+ * segment; fdatasync, rename, directory sync and pruning of closed
+ * segments all happen on @io_thread, so a stalled disk never blocks the
+ * capture callbacks
+ */
+struct flv_segmenter {
+	struct flv_segmenter_attr attr; /* profile points into @conf */
+	uint8_t *conf; /* sps, pps, AudioSpecificConfig */
+	pthread_mutex_t mutex;	/* current segment, writers */
+	struct flv_muxer *flv;
+	char part[FLV_SEG_PATH_LEN];
+	char path[FLV_SEG_PATH_LEN];
+	unsigned int seq;
+	int64_t seg_begin;
+	int seg_valid;
+
+	pthread_mutex_t io_mutex; /* everything below */
+	pthread_cond_t io_cond;
+	pthread_t io_thread;
+	int io_exit;
+	struct flv_seg_job *jobs;
+	struct flv_seg_job **jobs_tail;
+	struct flv_seg_file *files; /* ring of finished segments */
+	int file_cap;
+	int file_head;
+	int file_num;
+	uint64_t file_bytes;
+	struct flv_segmenter_stat stat;
+};
+
+int create_flv_segmenter(struct flv_segmenter **seg,
+				const struct flv_segmenter_attr *attr);
+/* closes the current segment and waits until every segment is synced */
+void destroy_flv_segmenter(struct flv_segmenter *seg);
+
+/* as [flv_write_avc_data_tag]/[flv_write_aac_data_tag] */
+int flv_segmenter_write_avc(struct flv_segmenter *seg,
+				const uint8_t *data, uint32_t data_len,
+				int64_t dts, int keyframe);
+int flv_segmenter_write_aac(struct flv_segmenter *seg,
+				const uint8_t *data, uint32_t data_len,
+				int64_t dts);
+
+void flv_segmenter_get_stat(struct flv_segmenter *seg,
+				struct flv_segmenter_stat *stat);
+
+#endif // FLV_SEGMENTER_H_
@@ -0,0 +1,236 @@
+/*
+ * h264nalu_bench.c
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ *
+ * build synthetic annexb access units(aud, sps/pps on keyframes, several
+ * slices behind mixed 3/4 bytes start codes, emulation prevented
+ * payload), convert them with [h264_annexb_to_avcc], check every NALU
+ * against what was built and print MB/s next to a byte by byte scanner
+ *
+ * build:
+ * gcc -O2 -I. bench/h264nalu_bench.c -o h264nalu_bench
+ * ./h264nalu_bench [frames]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "h264nalu.h"
+
+
+#define FRAME_MAX		(512 * 1024)
+#define SLICES			4
+#define I_SLICE_SIZE		(32 * 1024)
+#define P_SLICE_SIZE		(2 * 1024)
+#define GOP			30
+#define NALU_MAX		16
+
+struct frame {
+	uint8_t *data;
+	uint32_t len;
+	/* the NALUs that must come out, in order */
+	const uint8_t *nalu[NALU_MAX];
+	uint32_t nalu_len[NALU_MAX];
+	int nalu_num;
+};
+
+static const uint8_t sps[] = {0x67, 0x64, 0x00, 0x29, 0xac, 0x1a, 0xd0, 0x0a};
+static const uint8_t pps[] = {0x68, 0xee, 0x01, 0x34};
+static const uint8_t aud[] = {0x09, 0xf0};
+
+static uint64_t __now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint8_t *__put(struct frame *f, uint8_t *p, const uint8_t *nalu,
+				uint32_t len, int sc4, int keep)
+{
+	if (sc4)
+		*p++ = 0;
+	*p++ = 0;
+	*p++ = 0;
+	*p++ = 1;
+	memcpy(p, nalu, len);
+	if (keep) {
+		f->nalu[f->nalu_num] = p;
+		f->nalu_len[f->nalu_num++] = len;
+	}
+
+	return p + len;
+}
+
+/* a slice with random payload, 0x000000-0x000003 escaped as in a real
+ * stream, plenty of 0x00/0x01 so the scanner has work to do */
+static uint8_t *__put_slice(struct frame *f, uint8_t *p, int idr,
+				uint32_t len, int sc4)
+{
+	uint8_t *nalu = NULL;
+	uint32_t i = 0;
+	int zeros = 0;
+	uint8_t b = 0;
+
+	if (sc4)
+		*p++ = 0;
+	*p++ = 0;
+	*p++ = 0;
+	*p++ = 1;
+	nalu = p;
+	*p++ = idr ? 0x65 : 0x41;
+	for (i = 1; i < len; i++) {
+		b = rand() & 7 ? rand() : rand() & 1;
+		if (zeros >= 2 && b <= 3) {
+			*p++ = 0x03;
+			zeros = 0;
+		}
+		*p++ = b;
+		zeros = b == 0 ? zeros + 1 : 0;
+	}
+	/* rbsp trailing bits */
+	*p++ = 0x80;
+	f->nalu[f->nalu_num] = nalu;
+	f->nalu_len[f->nalu_num++] = p - nalu;
+
+	return p;
+}
+
+static void __build(struct frame *f, int key)
+{
+	uint8_t *p = f->data;
+	int i = 0;
+
+	f->nalu_num = 0;
+	p = __put(f, p, aud, sizeof(aud), 1, 0);
+	if (key) {
+		p = __put(f, p, sps, sizeof(sps), 1, 0);
+		p = __put(f, p, pps, sizeof(pps), 1, 0);
+	}
+	for (i = 0; i < SLICES; i++)
+		p = __put_slice(f, p, key, key ? I_SLICE_SIZE : P_SLICE_SIZE,
+							i == 0);
+	f->len = p - f->data;
+}
+
+static int __check(const struct frame *f, const uint8_t *out, uint32_t len)
+{
+	const uint8_t *p = out;
+	uint32_t nalu_len = 0;
+	int i = 0;
+
+	for (i = 0; i < f->nalu_num; i++) {
+		if (p + 4 > out + len)
+			return -1;
+		nalu_len = ((uint32_t)p[0] << 24) | (p[1] << 16) |
+							(p[2] << 8) | p[3];
+		if (nalu_len != f->nalu_len[i] ||
+				memcmp(p + 4, f->nalu[i], nalu_len))
+			return -1;
+		p += 4 + nalu_len;
+	}
+
+	return p == out + len ? 0 : -1;
+}
+
+/* the scan it replaces: every byte looked at */
+static uint32_t __bytewise(uint8_t *out, const uint8_t *data, uint32_t len)
+{
+	const uint8_t *nalu = h264_skip_start_code(data, data + len);
+	uint32_t i = nalu - data;
+	uint32_t begin = i;
+	uint32_t end = 0;
+	uint8_t *p = out;
+
+	for (;;) {
+		while (i + 3 <= len && !(data[i] == 0 && data[i + 1] == 0 &&
+							data[i + 2] == 1))
+			i++;
+		end = i + 3 <= len ? i : len;
+		while (end > begin && data[end - 1] == 0)
+			end--;
+		if (end > begin &&
+			!(NALU_SKIP_DEFAULT & NALU_MASK(data[begin] & 0x1f))) {
+			p[0] = (end - begin) >> 24;
+			p[1] = (end - begin) >> 16;
+			p[2] = (end - begin) >> 8;
+			p[3] = end - begin;
+			memcpy(p + 4, data + begin, end - begin);
+			p += 4 + end - begin;
+		}
+		if (i + 3 > len)
+			break;
+		i += 3;
+		begin = i;
+	}
+
+	return p - out;
+}
+
+int main(int argc, char *argv[])
+{
+	long frames = argc > 1 ? atol(argv[1]) : 3000;
+	struct frame f[GOP];
+	uint8_t *out = NULL;
+	uint64_t bytes = 0;
+	uint64_t begin = 0;
+	double sec[2];
+	uint32_t len = 0;
+	long i = 0;
+	int pass = 0;
+
+	srand(1);
+	for (i = 0; i < GOP; i++) {
+		f[i].data = (uint8_t *)malloc(FRAME_MAX);
+		if (f[i].data == NULL)
+			return 1;
+		__build(&f[i], i == 0);
+	}
+	out = (uint8_t *)malloc(H264_AVCC_MAX_LEN(FRAME_MAX));
+	if (out == NULL)
+		return 1;
+
+	for (i = 0; i < GOP; i++) {
+		len = h264_annexb_to_avcc(out, f[i].data, f[i].len,
+							NALU_SKIP_DEFAULT);
+		if (__check(&f[i], out, len) < 0) {
+			printf("frame %ld: NALUs differ\n", i);
+			return 1;
+		}
+		len = __bytewise(out, f[i].data, f[i].len);
+		if (__check(&f[i], out, len) < 0) {
+			printf("frame %ld: bytewise NALUs differ\n", i);
+			return 1;
+		}
+	}
+
+	for (pass = 0; pass < 2; pass++) {
+		bytes = 0;
+		begin = __now_ns();
+		for (i = 0; i < frames; i++) {
+			const struct frame *fr = &f[i % GOP];
+
+			len = pass ? __bytewise(out, fr->data, fr->len) :
+				h264_annexb_to_avcc(out, fr->data, fr->len,
+							NALU_SKIP_DEFAULT);
+			bytes += fr->len;
+		}
+		sec[pass] = (double)(__now_ns() - begin) / 1e9;
+		printf("%-9s %ld frames %.1f MB in %.3fs: %.0f MB/s\n",
+			pass ? "bytewise" : "memchr", frames, bytes / 1e6,
+			sec[pass], bytes / 1e6 / sec[pass]);
+	}
+
+	printf("NALUs ok, %.2fx\n", sec[1] / sec[0]);
+
+	for (i = 0; i < GOP; i++)
+		free(f[i].data);
+	free(out);
+
+	return 0;
+}
@@ -0,0 +1,891 @@
+/*
+ * fmp4muxer.c fragmented mp4(ISO BMFF) writer, no mp4v2 needed
+ *
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "fmp4muxer.h"
+#include "h264nalu.h"
+
+
+/* moof, mfhd, and per traf: traf, tfhd, tfdt, trun header */
+#define FMP4_MOOF_FIXED		(8 + 16 + FMP4_TRACK_NUM * (8 + 16 + 20 + 20))
+/* trun entry: duration, size, flags */
+#define FMP4_TRUN_ENTRY		12
+/* ftyp + moov without the codec configs */
+#define FMP4_INIT_FIXED		2048
+
+#define FMP4_SAMPLES_INIT	64
+#define FMP4_DATA_INIT		(256 * 1024)
+
+/* sample_flags: sample_depends_on and sample_is_non_sync_sample */
+#define FMP4_FLAGS_SYNC		0x02000000
+#define FMP4_FLAGS_NON_SYNC	0x01010000
+
+static const int aac_sample_rates[16] = {
+	96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050,
+	16000, 12000, 11025, 8000, 7350, 0, 0, 0,
+};
+
+static uint8_t *__w8(uint8_t *p, uint8_t val)
+{
+	p[0] = val;
+	return p + 1;
+}
+
+static uint8_t *__w16(uint8_t *p, uint16_t val)
+{
+	p[0] = val >> 8;
+	p[1] = val;
+	return p + 2;
+}
+
+static uint8_t *__w24(uint8_t *p, uint32_t val)
+{
+	p[0] = val >> 16;
+	p[1] = val >> 8;
+	p[2] = val;
+	return p + 3;
+}
+
+static uint8_t *__w32(uint8_t *p, uint32_t val)
+{
+	p[0] = val >> 24;
+	p[1] = val >> 16;
+	p[2] = val >> 8;
+	p[3] = val;
+	return p + 4;
+}
+
+static uint8_t *__w64(uint8_t *p, uint64_t val)
+{
+	p = __w32(p, val >> 32);
+	return __w32(p, val);
+}
+
+static uint8_t *__wbytes(uint8_t *p, const void *data, uint32_t len)
+{
+	memcpy(p, data, len);
+	return p + len;
+}
+
+static uint8_t *__wzero(uint8_t *p, uint32_t len)
+{
+	memset(p, 0, len);
+	return p + len;
+}
+
+/* open a box, its size is filled in by [__box_end] */
+static uint8_t *__box(uint8_t *p, const char *type)
+{
+	p = __w32(p, 0);
+	return __wbytes(p, type, 4);
+}
+
+static uint8_t *__full_box(uint8_t *p, const char *type,
+				uint8_t version, uint32_t flags)
+{
+	p = __box(p, type);
+	p = __w8(p, version);
+	return __w24(p, flags);
+}
+
+static void __box_end(uint8_t *box, uint8_t *end)
+{
+	__w32(box, end - box);
+}
+
+static int fmp4_writev(struct fmp4_muxer *mp4, struct iovec *iov, int iovcnt)
+{
+	ssize_t ret = 0;
+
+	while (iovcnt > 0) {
+		ret = writev(mp4->fd, iov, iovcnt);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			printf("MP4 write fail: %s\n", strerror(errno));
+			return -1;
+		}
+
+		mp4->stat.bytes += ret;
+		mp4->offset += ret;
+		while (iovcnt > 0 && (size_t)ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (uint8_t *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return 0;
+}
+
+/* 3x3 unity matrix of mvhd/tkhd */
+static uint8_t *__matrix(uint8_t *p)
+{
+	p = __w32(p, 0x00010000);
+	p = __wzero(p, 12);
+	p = __w32(p, 0x00010000);
+	p = __wzero(p, 12);
+	return __w32(p, 0x40000000);
+}
+
+static uint8_t *__avcc(uint8_t *p, const struct FMP4Profile *profile)
+{
+	uint8_t *box = p;
+	uint8_t profile_idc = profile->sps[1];
+
+	p = __box(p, "avcC");
+	p = __w8(p, 1);
+	p = __w8(p, profile_idc);
+	p = __w8(p, profile->sps[2]);
+	p = __w8(p, profile->sps[3]);
+	p = __w8(p, 0xff); /* 4 bytes NALU length */
+	p = __w8(p, 0xe1);
+	p = __w16(p, profile->sps_len);
+	p = __wbytes(p, profile->sps, profile->sps_len);
+	p = __w8(p, 1);
+	p = __w16(p, profile->pps_len);
+	p = __wbytes(p, profile->pps, profile->pps_len);
+	/* high profiles carry the chroma format, 4:2:0 8 bits */
+	if (profile_idc == 100 || profile_idc == 110 ||
+			profile_idc == 122 || profile_idc == 144) {
+		p = __w8(p, 0xfc | 1);
+		p = __w8(p, 0xf8);
+		p = __w8(p, 0xf8);
+		p = __w8(p, 0);
+	}
+	__box_end(box, p);
+
+	return p;
+}
+
+static uint8_t *__esds(uint8_t *p, const struct FMP4Profile *profile)
+{
+	uint8_t *box = p;
+	uint32_t asc_len = profile->aac_decoder_conf_len;
+
+	p = __full_box(p, "esds", 0, 0);
+	/* ES_Descriptor */
+	p = __w8(p, 0x03);
+	p = __w8(p, 3 + 2 + 13 + 2 + asc_len + 3);
+	p = __w16(p, 0); /* ES_ID */
+	p = __w8(p, 0);
+	/* DecoderConfigDescriptor: mpeg-4 audio, audio stream */
+	p = __w8(p, 0x04);
+	p = __w8(p, 13 + 2 + asc_len);
+	p = __w8(p, 0x40);
+	p = __w8(p, (0x05 << 2) | 1);
+	p = __w24(p, 0); /* bufferSizeDB */
+	p = __w32(p, 0); /* maxBitrate */
+	p = __w32(p, 0); /* avgBitrate */
+	/* DecoderSpecificInfo */
+	p = __w8(p, 0x05);
+	p = __w8(p, asc_len);
+	p = __wbytes(p, profile->aac_decoder_conf, asc_len);
+	/* SLConfigDescriptor */
+	p = __w8(p, 0x06);
+	p = __w8(p, 1);
+	p = __w8(p, 0x02);
+	__box_end(box, p);
+
+	return p;
+}
+
+static uint8_t *__sample_entry(uint8_t *p, const struct fmp4_muxer *mp4,
+				int type)
+{
+	const struct FMP4Profile *profile = &mp4->profile;
+	const uint8_t *asc = profile->aac_decoder_conf;
+	uint8_t *box = p;
+	int channels = 0;
+	int rate = 0;
+
+	if (type == FMP4_TRACK_VIDEO) {
+		p = __box(p, "avc1");
+		p = __wzero(p, 6);
+		p = __w16(p, 1); /* data_reference_index */
+		p = __wzero(p, 16);
+		p = __w16(p, profile->width);
+		p = __w16(p, profile->height);
+		p = __w32(p, 0x00480000); /* 72 dpi */
+		p = __w32(p, 0x00480000);
+		p = __w32(p, 0);
+		p = __w16(p, 1); /* frame_count */
+		p = __wzero(p, 32); /* compressorname */
+		p = __w16(p, 0x0018);
+		p = __w16(p, 0xffff);
+		p = __avcc(p, profile);
+	} else {
+		/* AudioSpecificConfig: 5 bits object type, 4 bits
+		 * sampling frequency index, 4 bits channel configuration */
+		rate = aac_sample_rates[((asc[0] & 0x07) << 1) | (asc[1] >> 7)];
+		channels = (asc[1] >> 3) & 0x0f;
+		p = __box(p, "mp4a");
+		p = __wzero(p, 6);
+		p = __w16(p, 1);
+		p = __wzero(p, 8);
+		p = __w16(p, channels);
+		p = __w16(p, 16);
+		p = __w32(p, 0);
+		p = __w32(p, (uint32_t)rate << 16);
+		p = __esds(p, profile);
+	}
+	__box_end(box, p);
+
+	return p;
+}
+
+static uint8_t *__trak(uint8_t *p, const struct fmp4_muxer *mp4, int type)
+{
+	const struct fmp4_track *track = &mp4->track[type];
+	const int video = type == FMP4_TRACK_VIDEO;
+	uint8_t *trak = p;
+	uint8_t *mdia = NULL;
+	uint8_t *minf = NULL;
+	uint8_t *box = NULL;
+	uint8_t *stbl = NULL;
+
+	p = __box(p, "trak");
+
+	box = p;
+	p = __full_box(p, "tkhd", 0, 0x03); /* enabled, in movie */
+	p = __w32(p, 0);
+	p = __w32(p, 0);
+	p = __w32(p, track->id);
+	p = __w32(p, 0);
+	p = __w32(p, 0); /* duration, from the fragments */
+	p = __wzero(p, 8);
+	p = __w16(p, 0); /* layer */
+	p = __w16(p, 0); /* alternate_group */
+	p = __w16(p, video ? 0 : 0x0100); /* volume */
+	p = __w16(p, 0);
+	p = __matrix(p);
+	p = __w32(p, video ? (uint32_t)mp4->profile.width << 16 : 0);
+	p = __w32(p, video ? (uint32_t)mp4->profile.height << 16 : 0);
+	__box_end(box, p);
+
+	mdia = p;
+	p = __box(p, "mdia");
+	box = p;
+	p = __full_box(p, "mdhd", 0, 0);
+	p = __w32(p, 0);
+	p = __w32(p, 0);
+	p = __w32(p, track->timescale);
+	p = __w32(p, 0);
+	p = __w16(p, 0x55c4); /* 'und' */
+	p = __w16(p, 0);
+	__box_end(box, p);
+
+	box = p;
+	p = __full_box(p, "hdlr", 0, 0);
+	p = __w32(p, 0);
+	p = __wbytes(p, video ? "vide" : "soun", 4);
+	p = __wzero(p, 12);
+	p = __wbytes(p, video ? "VideoHandler" : "SoundHandler", 13);
+	__box_end(box, p);
+
+	minf = p;
+	p = __box(p, "minf");
+	box = p;
+	if (video) {
+		p = __full_box(p, "vmhd", 0, 1);
+		p = __wzero(p, 8);
+	} else {
+		p = __full_box(p, "smhd", 0, 0);
+		p = __wzero(p, 4);
+	}
+	__box_end(box, p);
+
+	box = p;
+	p = __box(p, "dinf");
+	p = __full_box(p, "dref", 0, 0);
+	p = __w32(p, 1);
+	p = __full_box(p, "url ", 0, 1); /* in this file */
+	__box_end(p - 12, p);
+	__box_end(box + 8, p);
+	__box_end(box, p);
+
+	/* every sample is in the fragments, the tables stay empty */
+	stbl = p;
+	p = __box(p, "stbl");
+	box = p;
+	p = __full_box(p, "stsd", 0, 0);
+	p = __w32(p, 1);
+	p = __sample_entry(p, mp4, type);
+	__box_end(box, p);
+	box = p;
+	p = __full_box(p, "stts", 0, 0);
+	p = __w32(p, 0);
+	__box_end(box, p);
+	box = p;
+	p = __full_box(p, "stsc", 0, 0);
+	p = __w32(p, 0);
+	__box_end(box, p);
+	box = p;
+	p = __full_box(p, "stsz", 0, 0);
+	p = __w32(p, 0);
+	p = __w32(p, 0);
+	__box_end(box, p);
+	box = p;
+	p = __full_box(p, "stco", 0, 0);
+	p = __w32(p, 0);
+	__box_end(box, p);
+	__box_end(stbl, p);
+
+	__box_end(minf, p);
+	__box_end(mdia, p);
+	__box_end(trak, p);
+
+	return p;
+}
+
+static int fmp4_write_init_segment(struct fmp4_muxer *mp4)
+{
+	const struct FMP4Profile *profile = &mp4->profile;
+	struct iovec iov;
+	uint8_t *buf = NULL;
+	uint8_t *p = NULL;
+	uint8_t *box = NULL;
+	uint8_t *moov = NULL;
+	int i = 0;
+	int ret = 0;
+
+	buf = (uint8_t *)malloc(FMP4_INIT_FIXED + profile->sps_len +
+			profile->pps_len + profile->aac_decoder_conf_len);
+	if (buf == NULL) {
+		printf("Malloc MP4 init segment fail\n");
+		return -1;
+	}
+
+	p = __box(buf, "ftyp");
+	p = __wbytes(p, "iso6", 4);
+	p = __w32(p, 0);
+	p = __wbytes(p, "iso6isommp41", 12);
+	__box_end(buf, p);
+
+	moov = p;
+	p = __box(p, "moov");
+	box = p;
+	p = __full_box(p, "mvhd", 0, 0);
+	p = __w32(p, 0);
+	p = __w32(p, 0);
+	p = __w32(p, 1000);
+	p = __w32(p, 0);
+	p = __w32(p, 0x00010000); /* rate */
+	p = __w16(p, 0x0100); /* volume */
+	p = __wzero(p, 10);
+	p = __matrix(p);
+	p = __wzero(p, 24);
+	p = __w32(p, FMP4_TRACK_NUM + 1); /* next_track_ID */
+	__box_end(box, p);
+
+	for (i = 0; i < FMP4_TRACK_NUM; i++)
+		if (mp4->track[i].enabled)
+			p = __trak(p, mp4, i);
+
+	box = p;
+	p = __box(p, "mvex");
+	for (i = 0; i < FMP4_TRACK_NUM; i++) {
+		if (!mp4->track[i].enabled)
+			continue;
+		p = __full_box(p, "trex", 0, 0);
+		p = __w32(p, mp4->track[i].id);
+		p = __w32(p, 1); /* sample_description_index */
+		p = __w32(p, 0);
+		p = __w32(p, 0);
+		p = __w32(p, 0);
+		__box_end(p - 32, p);
+	}
+	__box_end(box, p);
+	__box_end(moov, p);
+
+	iov.iov_base = buf;
+	iov.iov_len = p - buf;
+	ret = fmp4_writev(mp4, &iov, 1);
+	mp4->stat.init_size = p - buf;
+	free(buf);
+
+	return ret;
+}
+
+/* samples of @track that go into the fragment: closed(their duration is
+ * known) and starting before @upto_us, @all takes the open last one too */
+static unsigned int __ready_samples(const struct fmp4_track *track,
+				int64_t upto_us, int all)
+{
+	unsigned int n = 0;
+
+	if (!track->enabled || track->num == 0)
+		return 0;
+
+	if (all)
+		return track->num;
+
+	while (n < track->num && track->samples[n].duration != 0 &&
+					track->samples[n].us < upto_us)
+		n++;
+
+	return n;
+}
+
+static int fmp4_grow_moof(struct fmp4_muxer *mp4, unsigned int samples)
+{
+	uint32_t size = FMP4_MOOF_FIXED + samples * FMP4_TRUN_ENTRY;
+	uint8_t *moof = NULL;
+
+	if (size <= mp4->moof_size)
+		return 0;
+
+	moof = (uint8_t *)realloc(mp4->moof, size);
+	if (moof == NULL) {
+		printf("Malloc MP4 moof fail\n");
+		return -1;
+	}
+	mp4->moof = moof;
+	mp4->moof_size = size;
+
+	return 0;
+}
+
+/*
+ * write one moof + mdat of the ready samples of every track and keep the
+ * rest for the next fragment
+ */
+static int fmp4_write_fragment(struct fmp4_muxer *mp4, int64_t upto_us,
+				int all)
+{
+	struct fmp4_track *track = NULL;
+	struct fmp4_sample *s = NULL;
+	unsigned int n[FMP4_TRACK_NUM];
+	uint32_t bytes[FMP4_TRACK_NUM];
+	uint8_t *data_offset[FMP4_TRACK_NUM];
+	struct iovec iov[2 + FMP4_TRACK_NUM];
+	uint8_t mdat_hdr[8];
+	uint8_t *p = NULL;
+	uint8_t *box = NULL;
+	uint8_t *traf = NULL;
+	uint64_t offset = mp4->offset;
+	uint32_t mdat_size = 8;
+	uint32_t moof_len = 0;
+	uint32_t data_pos = 0;
+	unsigned int total = 0;
+	int64_t start_us = INT64_MAX;
+	int64_t end_us = INT64_MIN;
+	int64_t t = 0;
+	int iovcnt = 0;
+	unsigned int i = 0;
+	int k = 0;
+	int ret = 0;
+
+	for (k = 0; k < FMP4_TRACK_NUM; k++) {
+		track = &mp4->track[k];
+		n[k] = __ready_samples(track, upto_us, all);
+		bytes[k] = 0;
+		for (i = 0; i < n[k]; i++) {
+			if (all && i == track->num - 1 &&
+					track->samples[i].duration == 0)
+				track->samples[i].duration =
+					track->last_duration ?
+					track->last_duration : 1;
+			bytes[k] += track->samples[i].size;
+		}
+		total += n[k];
+		mdat_size += bytes[k];
+		if (n[k] == 0)
+			continue;
+		/* fragment span on the capture clock */
+		s = &track->samples[0];
+		if (s->us < start_us)
+			start_us = s->us;
+		s = &track->samples[n[k] - 1];
+		t = s->us + (int64_t)s->duration * 1000000 / track->timescale;
+		if (t > end_us)
+			end_us = t;
+	}
+	if (total == 0)
+		return 0;
+
+	if (fmp4_grow_moof(mp4, total) < 0)
+		return -1;
+
+	p = __box(mp4->moof, "moof");
+	box = p;
+	p = __full_box(p, "mfhd", 0, 0);
+	p = __w32(p, ++mp4->seq);
+	__box_end(box, p);
+
+	for (k = 0; k < FMP4_TRACK_NUM; k++) {
+		track = &mp4->track[k];
+		data_offset[k] = NULL;
+		if (n[k] == 0)
+			continue;
+
+		traf = p;
+		p = __box(p, "traf");
+		box = p;
+		p = __full_box(p, "tfhd", 0, 0x020000); /* default-base-is-moof */
+		p = __w32(p, track->id);
+		__box_end(box, p);
+
+		box = p;
+		p = __full_box(p, "tfdt", 1, 0);
+		p = __w64(p, track->samples[0].dts);
+		__box_end(box, p);
+
+		/* data-offset, sample duration, size and flags present */
+		box = p;
+		p = __full_box(p, "trun", 0, 0x000701);
+		p = __w32(p, n[k]);
+		data_offset[k] = p;
+		p = __w32(p, 0);
+		for (i = 0; i < n[k]; i++) {
+			s = &track->samples[i];
+			p = __w32(p, s->duration);
+			p = __w32(p, s->size);
+			p = __w32(p, s->flags);
+		}
+		__box_end(box, p);
+		__box_end(traf, p);
+	}
+	__box_end(mp4->moof, p);
+	moof_len = p - mp4->moof;
+
+	/* mdat: the tracks' data one after the other */
+	__w32(mdat_hdr, mdat_size);
+	memcpy(mdat_hdr + 4, "mdat", 4);
+	iov[iovcnt].iov_base = mp4->moof;
+	iov[iovcnt++].iov_len = moof_len;
+	iov[iovcnt].iov_base = mdat_hdr;
+	iov[iovcnt++].iov_len = sizeof(mdat_hdr);
+	data_pos = moof_len + sizeof(mdat_hdr);
+	for (k = 0; k < FMP4_TRACK_NUM; k++) {
+		if (n[k] == 0)
+			continue;
+		__w32(data_offset[k], data_pos);
+		iov[iovcnt].iov_base = mp4->track[k].data;
+		iov[iovcnt++].iov_len = bytes[k];
+		data_pos += bytes[k];
+	}
+
+	ret = fmp4_writev(mp4, iov, iovcnt);
+	if (ret < 0)
+		return -1;
+	mp4->stat.fragments++;
+
+	if (mp4->profile.fragment_cb)
+		mp4->profile.fragment_cb(mp4->profile.opaque, offset,
+				moof_len + mdat_size, start_us,
+				end_us - start_us, n[FMP4_TRACK_VIDEO] == 0 ||
+				mp4->track[FMP4_TRACK_VIDEO].samples[0].flags ==
+							FMP4_FLAGS_SYNC);
+
+	/* keep what did not go out, at most the open sample and the part
+	 * of one track that runs ahead of the other */
+	for (k = 0; k < FMP4_TRACK_NUM; k++) {
+		track = &mp4->track[k];
+		if (n[k] == 0)
+			continue;
+		track->num -= n[k];
+		memmove(track->samples, track->samples + n[k],
+				track->num * sizeof(struct fmp4_sample));
+		track->len -= bytes[k];
+		memmove(track->data, track->data + bytes[k], track->len);
+	}
+
+	return 0;
+}
+
+static int fmp4_track_reserve(struct fmp4_track *track, uint32_t len)
+{
+	struct fmp4_sample *samples = NULL;
+	uint8_t *data = NULL;
+	unsigned int cap = 0;
+	uint32_t size = 0;
+
+	if (track->num == track->cap) {
+		cap = track->cap ? track->cap * 2 : FMP4_SAMPLES_INIT;
+		samples = (struct fmp4_sample *)realloc(track->samples,
+					cap * sizeof(struct fmp4_sample));
+		if (samples == NULL)
+			return -1;
+		track->samples = samples;
+		track->cap = cap;
+	}
+
+	if (track->len + len > track->size) {
+		size = track->size ? track->size : FMP4_DATA_INIT;
+		while (track->len + len > size)
+			size *= 2;
+		data = (uint8_t *)realloc(track->data, size);
+		if (data == NULL)
+			return -1;
+		track->data = data;
+		track->size = size;
+	}
+
+	return 0;
+}
+
+/* dts of a new sample on the track timescale, also closes the open one:
+ * its duration runs up to this sample */
+static int64_t fmp4_track_next_dts(struct fmp4_muxer *mp4,
+				struct fmp4_track *track, int64_t us)
+{
+	struct fmp4_sample *last = NULL;
+	int64_t dts = 0;
+
+	if (!mp4->origin_valid) {
+		mp4->origin_us = us;
+		mp4->origin_valid = 1;
+	}
+	if (us > mp4->origin_us)
+		dts = (us - mp4->origin_us) * track->timescale / 1000000;
+
+	if (track->num == 0)
+		return dts;
+
+	/* a track never goes back, a late sample just gets the next tick */
+	last = &track->samples[track->num - 1];
+	if (dts <= last->dts)
+		dts = last->dts + 1;
+	last->duration = dts - last->dts;
+	track->last_duration = last->duration;
+
+	return dts;
+}
+
+static struct fmp4_sample *fmp4_track_add(struct fmp4_track *track,
+				int64_t us, int64_t dts, uint32_t flags)
+{
+	struct fmp4_sample *s = &track->samples[track->num++];
+
+	s->us = us;
+	s->dts = dts;
+	s->size = 0;
+	s->duration = 0;
+	s->flags = flags;
+
+	return s;
+}
+
+int create_fmp4_muxer(struct fmp4_muxer **mp4_hd,
+			struct FMP4Profile *mp4_profile)
+{
+	struct fmp4_muxer *mp4 = NULL;
+	struct fmp4_track *track = NULL;
+	uint32_t id = 1;
+
+	*mp4_hd = NULL;
+
+	mp4 = (struct fmp4_muxer *)calloc(1, sizeof(struct fmp4_muxer));
+	if (mp4 == NULL) {
+		printf("Malloc MP4 muxer fail\n");
+		return -1;
+	}
+	mp4->fd = -1;
+	mp4->profile = *mp4_profile;
+	if (mp4->profile.skip_nalu == 0)
+		mp4->profile.skip_nalu = NALU_SKIP_DEFAULT;
+	pthread_mutex_init(&mp4->mutex, NULL);
+
+	track = &mp4->track[FMP4_TRACK_VIDEO];
+	if (mp4_profile->sps_len >= 4 && mp4_profile->pps_len > 0) {
+		track->enabled = 1;
+		track->id = id++;
+		track->timescale = mp4_profile->video_time_scale > 0 ?
+					mp4_profile->video_time_scale : 90000;
+		track->last_duration = mp4_profile->video_sample_duration;
+	}
+
+	track = &mp4->track[FMP4_TRACK_AUDIO];
+	if (mp4_profile->aac_decoder_conf_len >= 2) {
+		const uint8_t *asc = mp4_profile->aac_decoder_conf;
+
+		track->enabled = 1;
+		track->id = id++;
+		track->timescale = mp4_profile->audio_time_scale > 0 ?
+			mp4_profile->audio_time_scale : aac_sample_rates[
+			((asc[0] & 0x07) << 1) | (asc[1] >> 7)];
+		track->last_duration = mp4_profile->audio_sample_duration;
+		if (track->timescale == 0) {
+			printf("Unsupported aac sample rate\n");
+			goto exit;
+		}
+	}
+
+	if (id == 1) {
+		printf("MP4 muxer needs sps/pps or aac decoder conf\n");
+		goto exit;
+	}
+
+	mp4->frag_ms = mp4_profile->fragment_ms;
+	if (mp4->frag_ms <= 0 && !mp4->track[FMP4_TRACK_VIDEO].enabled)
+		mp4->frag_ms = FMP4_DEFAULT_FRAGMENT_MS;
+
+	mp4->fd = open(mp4_profile->name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (mp4->fd < 0) {
+		printf("Open %s fail: %s\n", mp4_profile->name,
+							strerror(errno));
+		goto exit;
+	}
+
+	if (fmp4_write_init_segment(mp4) < 0)
+		goto exit;
+
+	*mp4_hd = mp4;
+	printf("Create MP4 muxer success...\n");
+
+	return 0;
+
+exit:
+	printf("Init mp4 fail\n");
+	if (mp4->fd >= 0)
+		close(mp4->fd);
+	pthread_mutex_destroy(&mp4->mutex);
+	free(mp4);
+
+	return -1;
+}
+
+void destroy_fmp4_muxer(struct fmp4_muxer *mp4)
+{
+	int i = 0;
+
+	if (mp4 == NULL)
+		return;
+
+	pthread_mutex_lock(&mp4->mutex);
+	fmp4_write_fragment(mp4, INT64_MAX, 1);
+	pthread_mutex_unlock(&mp4->mutex);
+
+	close(mp4->fd);
+	for (i = 0; i < FMP4_TRACK_NUM; i++) {
+		free(mp4->track[i].samples);
+		free(mp4->track[i].data);
+	}
+	free(mp4->moof);
+	pthread_mutex_destroy(&mp4->mutex);
+	free(mp4);
+
+	printf("Destroy MP4 muxer success...\n");
+}
+
+/* a track that waits too long for the other one forces the fragment */
+static int __fragment_overdue(const struct fmp4_track *track, int64_t us)
+{
+	return track->num > 0 &&
+		us - track->samples[0].us >= FMP4_MAX_FRAGMENT_MS * 1000LL;
+}
+
+int fmp4_pack_aac(struct fmp4_muxer *mp4, void *buf, int buf_len,
+				const struct timeval *tv)
+{
+	struct fmp4_track *track = &mp4->track[FMP4_TRACK_AUDIO];
+	struct fmp4_sample *s = NULL;
+	int64_t us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+	int64_t dts = 0;
+	int ret = 0;
+
+	if (!track->enabled || buf_len <= 0)
+		return 0;
+
+	pthread_mutex_lock(&mp4->mutex);
+
+	dts = fmp4_track_next_dts(mp4, track, us);
+
+	/* audio paces the fragments only when it is alone */
+	if ((!mp4->track[FMP4_TRACK_VIDEO].enabled && track->num > 0 &&
+		us - track->samples[0].us >= mp4->frag_ms * 1000LL) ||
+					__fragment_overdue(track, us))
+		ret = fmp4_write_fragment(mp4, us, 0);
+
+	if (ret == 0 && fmp4_track_reserve(track, buf_len) < 0) {
+		printf("Malloc MP4 audio fragment fail\n");
+		ret = -1;
+	}
+	if (ret == 0) {
+		s = fmp4_track_add(track, us, dts, FMP4_FLAGS_SYNC);
+		memcpy(track->data + track->len, buf, buf_len);
+		s->size = buf_len;
+		track->len += buf_len;
+	}
+
+	pthread_mutex_unlock(&mp4->mutex);
+
+	return ret;
+}
+
+int fmp4_pack_h264(struct fmp4_muxer *mp4, const struct timeval *tv,
+				const uint8_t *h264_data, int h264_data_len,
+				int keyframe)
+{
+	struct fmp4_track *track = &mp4->track[FMP4_TRACK_VIDEO];
+	struct fmp4_sample *s = NULL;
+	int64_t us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+	int64_t dts = 0;
+	int cut = 0;
+	int ret = 0;
+
+	if (!track->enabled || h264_data_len <= 0)
+		return 0;
+
+	pthread_mutex_lock(&mp4->mutex);
+
+	/* a track starts on a keyframe */
+	if (!track->started && !keyframe)
+		goto exit;
+	track->started = 1;
+
+	dts = fmp4_track_next_dts(mp4, track, us);
+
+	if (track->num > 0) {
+		if (keyframe)
+			cut = 1;
+		else if (mp4->frag_ms > 0 &&
+			us - track->samples[0].us >= mp4->frag_ms * 1000LL)
+			cut = 1;
+	}
+	if (cut || __fragment_overdue(&mp4->track[FMP4_TRACK_AUDIO], us))
+		ret = fmp4_write_fragment(mp4, us, 0);
+	if (ret < 0)
+		goto exit;
+
+	if (fmp4_track_reserve(track, H264_AVCC_MAX_LEN(h264_data_len)) < 0) {
+		printf("Malloc MP4 video fragment fail\n");
+		ret = -1;
+		goto exit;
+	}
+	s = fmp4_track_add(track, us, dts,
+			keyframe ? FMP4_FLAGS_SYNC : FMP4_FLAGS_NON_SYNC);
+	s->size = h264_annexb_to_avcc(track->data + track->len,
+			h264_data, h264_data_len, mp4->profile.skip_nalu);
+	track->len += s->size;
+
+exit:
+	pthread_mutex_unlock(&mp4->mutex);
+
+	return ret;
+}
+
+void fmp4_muxer_get_stat(struct fmp4_muxer *mp4, struct fmp4_muxer_stat *stat)
+{
+	pthread_mutex_lock(&mp4->mutex);
+	*stat = mp4->stat;
+	pthread_mutex_unlock(&mp4->mutex);
+}
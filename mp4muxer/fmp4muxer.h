@@ -0,0 +1,145 @@
+/*
+ * fmp4muxer.h fragmented mp4(ISO BMFF) writer, no mp4v2 needed
+ *
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ */
+
+
+#ifndef __FMP4_MUXER_H
+#define __FMP4_MUXER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+/* fragment cut on every keyframe when no duration is given and there is
+ * no video */
+#define FMP4_DEFAULT_FRAGMENT_MS	1000
+/* a track waiting for the other one never holds more than that */
+#define FMP4_MAX_FRAGMENT_MS		10000
+
+/*
+ * called after each fragment is on disk, e.g. to list it as a
+ * LL-HLS part(EXT-X-PART with BYTERANGE, EXT-X-MAP is the init segment
+ * at offset 0 of [fmp4_muxer_stat])
+ * @offset/@size: moof + mdat in the file
+ * @start_us/@duration_us: on the clock of the pack calls
+ * @independent: starts with a video keyframe(always 1 without video)
+ */
+typedef void (*fmp4_fragment_cb)(void *opaque, uint64_t offset,
+				uint32_t size, int64_t start_us,
+				int64_t duration_us, int independent);
+
+/* as struct MP4Profile, a track without sps/aac_decoder_conf is left out */
+struct FMP4Profile {
+	char name[64];
+	int video_time_scale;
+	int video_sample_duration; /* of the last sample only */
+	int audio_time_scale; /* 0 for the sample rate */
+	int audio_sample_duration;
+	int width;
+	int height;
+	uint8_t *sps; /* no start code */
+	uint8_t *pps;
+	int sps_len;
+	int pps_len;
+	/* AudioSpecificConfig generated by [create_aac_encoder] */
+	uint8_t *aac_decoder_conf;
+	int aac_decoder_conf_len;
+	/* NALU_MASK() of the NALU types dropped, 0 for sps/pps/aud */
+	uint32_t skip_nalu;
+	/* 0: a fragment per gop, > 0: also cut inside a gop once a fragment
+	 * is that long(LL-HLS parts) */
+	int fragment_ms;
+	fmp4_fragment_cb fragment_cb;
+	void *opaque;
+};
+
+enum {
+	FMP4_TRACK_VIDEO = 0,
+	FMP4_TRACK_AUDIO,
+	FMP4_TRACK_NUM,
+};
+
+/* @us: capture time, @dts: on the track timescale, @duration is known
+ * once the next sample arrives */
+struct fmp4_sample {
+	int64_t us;
+	int64_t dts;
+	uint32_t size;
+	uint32_t duration;
+	uint32_t flags;
+};
+
+/* samples of the fragment being built, payloads back to back in @data,
+ * both are reused and only grow up to the longest fragment */
+struct fmp4_track {
+	int enabled;
+	int started;
+	uint32_t id;
+	uint32_t timescale;
+	uint32_t last_duration;
+	struct fmp4_sample *samples;
+	unsigned int num;
+	unsigned int cap;
+	uint8_t *data;
+	uint32_t len;
+	uint32_t size;
+};
+
+struct fmp4_muxer_stat {
+	uint64_t fragments;
+	uint64_t bytes;
+	uint32_t init_size; /* ftyp + moov at offset 0 */
+};
+
+/*
+ * ftyp + moov(empty sample tables, mvex) go out on create, then every
+ * fragment is a moof + mdat written with one writev, so the file is
+ * playable while it grows, a crash loses at most the fragment being
+ * built, and memory is bounded by the fragment length
+ * the pack calls take a lock, audio and video could come from different
+ * threads
+ */
+struct fmp4_muxer {
+	pthread_mutex_t mutex;
+	int fd;
+	uint64_t offset;
+	int64_t origin_us; /* time 0 of every track */
+	int origin_valid;
+	int frag_ms;
+	uint32_t seq;
+	struct fmp4_track track[FMP4_TRACK_NUM];
+	uint8_t *moof;
+	uint32_t moof_size;
+	struct FMP4Profile profile;
+	struct fmp4_muxer_stat stat;
+};
+
+/*
+ * @[mp4_hd] output param
+ * @return: '0' on success, '-1' on fail
+ */
+int create_fmp4_muxer(struct fmp4_muxer **mp4_hd,
+			struct FMP4Profile *mp4_profile);
+/* writes what is still buffered and closes the file */
+void destroy_fmp4_muxer(struct fmp4_muxer *mp4);
+
+/* @buf: one raw aac access unit([AAC_TT_RAW])
+ * @tv: its own pts, unlike [mp4_pack_aac] the duration is taken from the
+ * next call
+ */
+int fmp4_pack_aac(struct fmp4_muxer *mp4, void *buf, int buf_len,
+				const struct timeval *tv);
+
+/* @h264_data: one annexb access unit, any number of NALUs behind 3 or 4
+ * byte start codes, the types in @skip_nalu are dropped
+ * frames before the first keyframe are dropped
+ */
+int fmp4_pack_h264(struct fmp4_muxer *mp4, const struct timeval *tv,
+				const uint8_t *h264_data, int h264_data_len,
+				int keyframe);
+
+void fmp4_muxer_get_stat(struct fmp4_muxer *mp4, struct fmp4_muxer_stat *stat);
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ * h264nalu.h annexb to avcc(length prefixed) NALUs for the mp4 muxers
+ *
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ */
+
+
+#ifndef __H264_NALU_H
+#define __H264_NALU_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define NALU_TYPE_SEI		6
+#define NALU_TYPE_SPS		7
+#define NALU_TYPE_PPS		8
+#define NALU_TYPE_AUD		9
+
+#define NALU_MASK(type)		(1U << (type))
+/* sps/pps live in avcC, aud means nothing in mp4 */
+#define NALU_SKIP_DEFAULT	(NALU_MASK(NALU_TYPE_SPS) | \
+				NALU_MASK(NALU_TYPE_PPS) | \
+				NALU_MASK(NALU_TYPE_AUD))
+
+/* worst case of [h264_annexb_to_avcc]: every NALU behind a 3 bytes start
+ * code grows by one byte, a leading one without start code by four */
+#define H264_AVCC_MAX_LEN(len)	((len) + (len) / 3 + 4)
+
+/* skip the start code at @p if there is one */
+static inline const uint8_t *h264_skip_start_code(const uint8_t *p,
+						const uint8_t *end)
+{
+	if (end - p >= 3 && p[0] == 0 && p[1] == 0 && p[2] == 1)
+		return p + 3;
+	if (end - p >= 4 && p[0] == 0 && p[1] == 0 && p[2] == 0 && p[3] == 1)
+		return p + 4;
+
+	return p;
+}
+
+/*
+ * the NALU behind the next 0x000001 after @p, @sc: where that start code
+ * begins, both @end if there is none
+ * memchr(vectorized by libc) jumps to each 0x01, only those are checked
+ * for the two zeros in front, slice data is never walked byte by byte
+ */
+static inline const uint8_t *h264_next_nalu(const uint8_t *p,
+				const uint8_t *end, const uint8_t **sc)
+{
+	const uint8_t *one = NULL;
+
+	p += 2;
+	while (p < end) {
+		one = (const uint8_t *)memchr(p, 0x01, end - p);
+		if (one == NULL)
+			break;
+		if (one[-1] == 0 && one[-2] == 0) {
+			*sc = one - 2;
+			return one + 1;
+		}
+		/* neither this 0x01 nor the next two bytes can end a
+		 * start code */
+		p = one + 3;
+	}
+	*sc = end;
+
+	return end;
+}
+
+/*
+ * one annexb access unit(3 or 4 bytes start codes, any number of slices)
+ * into 4 bytes length prefixed NALUs at @out, in a single pass
+ * @skip: NALU_MASK() of the types to drop
+ * @return: bytes written, at most H264_AVCC_MAX_LEN(@len)
+ */
+static inline uint32_t h264_annexb_to_avcc(uint8_t *out,
+				const uint8_t *data, uint32_t len,
+				uint32_t skip)
+{
+	const uint8_t *end = data + len;
+	const uint8_t *nalu = h264_skip_start_code(data, end);
+	const uint8_t *next = NULL;
+	const uint8_t *sc = NULL;
+	uint32_t nalu_len = 0;
+	uint8_t *p = out;
+
+	while (nalu < end) {
+		next = h264_next_nalu(nalu, end, &sc);
+		/* the leading zero of a 4 bytes start code */
+		while (sc > nalu && sc[-1] == 0)
+			sc--;
+		nalu_len = sc - nalu;
+		if (nalu_len > 0 && !(skip & NALU_MASK(nalu[0] & 0x1f))) {
+			p[0] = nalu_len >> 24;
+			p[1] = nalu_len >> 16;
+			p[2] = nalu_len >> 8;
+			p[3] = nalu_len;
+			memcpy(p + 4, nalu, nalu_len);
+			p += 4 + nalu_len;
+		}
+		nalu = next;
+	}
+
+	return p - out;
+}
+
+#endif
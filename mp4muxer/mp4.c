@@ -7,23 +7,22 @@
 #include <pthread.h>
 #include <errno.h>
 
+#ifdef FMP4
+#include "fmp4muxer.h"
+#else
 #include "mp4muxer.h"
+#endif
 #include "aacenc.h"
 
 #include "my_middle_media.h"
 #include <my_video_input.h>
 
 
-/* XXX:WARNING the pcm period buf length should be the common factor of
- * the aac input pcm frame length, or the aac timestamp will be wrong
- * here the pcm period buf length == 1024 bytes,
- * and the aac input pcm frame length == 2048
- */
-
-
 #define SPS_LEN		28
 #define PPS_LEN		6
 #define OUTFILE		"my.mp4"
+/* -DFMP4: fragmented mp4, 0 for a fragment per gop */
+#define FRAGMENT_MS		0
 
 #define RES_720P
 #ifdef RES_720P
@@ -59,10 +58,12 @@ static const uint8_t pps_buf[PPS_LEN + 4] = {0x00, 0x00, 0x00, 0x06, 0x28, 0xee,
 			0x01, 0x04, 0x92, 0x24};
 			*/
 static int g_exit;
-static MP4FileHandle mp4_hd;
-static MP4TrackId video_tk;
-static MP4TrackId audio_tk;
-static HANDLE_AACENCODER aac_enc_hd;
+#ifdef FMP4
+static struct fmp4_muxer *fmp4_hd;
+#else
+static struct mp4_muxer *mp4_hd;
+#endif
+static struct aac_encoder *aac_enc_hd;
 static uint8_t aac_decoder_conf[64];
 static int aac_decoder_conf_len;
 
@@ -75,25 +76,44 @@ void sig_handle(int sig)
 void h264_cb(const struct timeval *tv, const void *data,
 	const int len, const int keyframe)
 {
-	mp4_pack_h264(mp4_hd, video_tk, tv, (uint8_t *)data, len, keyframe);
+#ifdef FMP4
+	fmp4_pack_h264(fmp4_hd, tv, (const uint8_t *)data, len, keyframe);
+#else
+	mp4_pack_h264(mp4_hd, tv, (const uint8_t *)data, len, keyframe);
+#endif
 }
 
 void audio_cb(const struct timeval *tv, const void *pcm_buf,
 	const int pcm_len, const void *spk_buf)
 {
-	static uint8_t *aac_buf = NULL;
-	static int aac_buf_len = 0;
-
-	mp4_pack_aac(mp4_hd, audio_tk, aac_buf, aac_buf_len, tv);
-
-	aac_buf_len = aac_encode(aac_enc_hd, pcm_buf, pcm_len, &aac_buf);
+	/* every access unit goes with its own pts */
+	struct aac_au *aus = NULL;
+	struct timeval au_tv;
+	int au_num = 0;
+	int i;
+
+	au_num = aac_encode(aac_enc_hd, pcm_buf, pcm_len,
+		(int64_t)tv->tv_sec * 1000000 + tv->tv_usec, &aus);
+	for (i = 0; i < au_num; i++) {
+		au_tv.tv_sec = aus[i].pts / 1000000;
+		au_tv.tv_usec = aus[i].pts % 1000000;
+#ifdef FMP4
+		fmp4_pack_aac(fmp4_hd, aus[i].data, aus[i].len, &au_tv);
+#else
+		mp4_pack_aac(mp4_hd, aus[i].data, aus[i].len, &au_tv);
+#endif
+	}
 }
 
 int main(int argc, char *argv[])
 {
 	int ret = 0;
 
+#ifdef FMP4
+	struct FMP4Profile mp4_profile = {
+#else
 	struct MP4Profile mp4_profile = {
+#endif
 		.name = OUTFILE,
 		.video_time_scale = VIDEO_TIME_SCALE,
 		.video_sample_duration = VIDEO_SAMPLE_DURATION,
@@ -105,6 +125,16 @@ int main(int argc, char *argv[])
 		.pps = pps_buf,
 		.sps_len = SPS_LEN,
 		.pps_len = PPS_LEN,
+#ifdef FMP4
+		.fragment_ms = FRAGMENT_MS,
+#endif
+	};
+
+	struct aac_enc_attr aac_attr = {
+		.channels = AUDIO_CHANNELS,
+		.samplerate = AUDIO_SAMPLERATE,
+		.bitrate = AAC_BITRATE,
+		.transport = AAC_TT_RAW,
 	};
 
 	MYVideoInputChannel chn = {
@@ -137,15 +167,18 @@ int main(int argc, char *argv[])
 	signal(SIGTERM, sig_handle);
 	signal(SIGINT, sig_handle);
 
-	ret = create_aac_encoder(&aac_enc_hd,
-				AUDIO_CHANNELS, AUDIO_SAMPLERATE, AAC_BITRATE,
+	ret = create_aac_encoder_ex(&aac_enc_hd, &aac_attr,
 				aac_decoder_conf, &aac_decoder_conf_len);
 	if (ret < 0)
 		goto exit;
 
 	mp4_profile.aac_decoder_conf = aac_decoder_conf;
 	mp4_profile.aac_decoder_conf_len = aac_decoder_conf_len;
-	ret = create_mp4_muxer(&mp4_hd, &video_tk, &audio_tk, &mp4_profile);
+#ifdef FMP4
+	ret = create_fmp4_muxer(&fmp4_hd, &mp4_profile);
+#else
+	ret = create_mp4_muxer(&mp4_hd, &mp4_profile);
+#endif
 	if (ret < 0)
 		goto exit;
 
@@ -187,7 +220,11 @@ out:
 
 exit:
 	destroy_aac_encoder(&aac_enc_hd);
+#ifdef FMP4
+	destroy_fmp4_muxer(fmp4_hd);
+#else
 	destroy_mp4_muxer(mp4_hd);
+#endif
 	return ret;
 
 }
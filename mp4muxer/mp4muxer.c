@@ -10,74 +10,346 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include <mp4v2/mp4v2.h>
 #include "mp4muxer.h"
+#include "h264nalu.h"
 
 
-/* h264_buf has stripped sps/pps and
- * it's length has been changed to bigendian
+/* first size of the interleave queues, they only grow if a track
+ * runs ahead more than that */
+#define MP4_QUEUE_INIT_SAMPLES	64
+#define MP4_QUEUE_INIT_SIZE	(512 * 1024)
+
+
+static int mp4_queue_init(struct mp4_queue *queue)
+{
+	queue->cap = MP4_QUEUE_INIT_SAMPLES;
+	queue->samples = (struct mp4_pending *)calloc(queue->cap,
+						sizeof(struct mp4_pending));
+	queue->size = MP4_QUEUE_INIT_SIZE;
+	queue->buf = (uint8_t *)malloc(queue->size);
+	if (queue->samples == NULL || queue->buf == NULL)
+		return -1;
+
+	return 0;
+}
+
+static void mp4_queue_destroy(struct mp4_queue *queue)
+{
+	free(queue->samples);
+	free(queue->buf);
+	queue->samples = NULL;
+	queue->buf = NULL;
+}
+
+static inline unsigned int mp4_queue_num(struct mp4_queue *queue)
+{
+	return queue->tail - queue->head;
+}
+
+static inline struct mp4_pending *mp4_queue_at(struct mp4_queue *queue,
+							unsigned int i)
+{
+	return &queue->samples[i & (queue->cap - 1)];
+}
+
+/* move every pending payload to the front of a buffer of @size */
+static int mp4_queue_repack(struct mp4_queue *queue, uint32_t size)
+{
+	struct mp4_pending *sample = NULL;
+	uint8_t *buf = NULL;
+	uint32_t wr = 0;
+	unsigned int i;
+
+	buf = (uint8_t *)malloc(size);
+	if (buf == NULL)
+		return -1;
+
+	for (i = queue->head; i != queue->tail; i++) {
+		sample = mp4_queue_at(queue, i);
+		memcpy(buf + wr, queue->buf + sample->off, sample->len);
+		sample->off = wr;
+		wr += sample->len;
+	}
+
+	free(queue->buf);
+	queue->buf = buf;
+	queue->size = size;
+	queue->rd = 0;
+	queue->wr = wr;
+
+	return 0;
+}
+
+/*
+ * payloads are a byte ring: a payload never straddles the end, it goes
+ * to the front instead, and wr never catches up with rd from behind
+ * @return: offset of @len free bytes, < 0 if the ring has to grow
+ */
+static int64_t mp4_queue_alloc(struct mp4_queue *queue, uint32_t len)
+{
+	if (mp4_queue_num(queue) == 0)
+		queue->rd = queue->wr = 0;
+
+	if (queue->wr >= queue->rd) {
+		if (queue->size - queue->wr >= len)
+			return queue->wr;
+		if (queue->rd > len)
+			return 0;
+		return -1;
+	}
+	if (queue->rd - queue->wr > len)
+		return queue->wr;
+
+	return -1;
+}
+
+/*
+ * room for a sample of up to @max_len bytes at the tail, the payload is
+ * written there by the caller and [mp4_queue_commit] queues it
+ * @return: the sample, NULL on malloc fail
+ */
+static struct mp4_pending *mp4_queue_reserve(struct mp4_queue *queue,
+							uint32_t max_len)
+{
+	struct mp4_pending *samples = NULL;
+	struct mp4_pending *sample = NULL;
+	uint64_t used = 0;
+	uint32_t size;
+	int64_t off;
+	unsigned int i;
+
+	if (mp4_queue_num(queue) == queue->cap) {
+		samples = (struct mp4_pending *)calloc(queue->cap * 2,
+						sizeof(struct mp4_pending));
+		if (samples == NULL)
+			return NULL;
+		for (i = 0; i < queue->cap; i++)
+			samples[i] = *mp4_queue_at(queue, queue->head + i);
+		free(queue->samples);
+		queue->samples = samples;
+		queue->head = 0;
+		queue->tail = queue->cap;
+		queue->cap *= 2;
+	}
+
+	off = mp4_queue_alloc(queue, max_len);
+	if (off < 0) {
+		for (i = queue->head; i != queue->tail; i++)
+			used += mp4_queue_at(queue, i)->len;
+		for (size = queue->size * 2; size <= used + max_len; size *= 2)
+			;
+		if (mp4_queue_repack(queue, size) < 0)
+			return NULL;
+		off = queue->wr;
+	}
+
+	sample = mp4_queue_at(queue, queue->tail);
+	sample->off = off;
+	sample->len = 0;
+
+	return sample;
+}
+
+static void mp4_queue_commit(struct mp4_queue *queue,
+				struct mp4_pending *sample)
+{
+	queue->wr = sample->off + sample->len;
+	queue->tail++;
+}
+
+static void mp4_queue_pop(struct mp4_queue *queue)
+{
+	queue->head++;
+	if (mp4_queue_num(queue) > 0)
+		queue->rd = mp4_queue_at(queue, queue->head)->off;
+}
+
+/*
+ * write the head sample of @stream, its duration runs to the pts of the
+ * next one(the last duration again if there is none)
+ */
+static int mp4_write_head(struct mp4_muxer *mp4, struct mp4_stream *stream)
+{
+	struct mp4_queue *queue = &stream->queue;
+	struct mp4_pending *sample = mp4_queue_at(queue, queue->head);
+	struct mp4_pending *next = NULL;
+	int64_t duration = stream->last_duration;
+	int ret = 0;
+
+	if (stream->written == 0) {
+		stream->first_us = sample->us;
+		stream->end_dts = 0;
+	}
+
+	if (mp4_queue_num(queue) > 1) {
+		next = mp4_queue_at(queue, queue->head + 1);
+		duration = (next->us - stream->first_us) *
+				stream->timescale / 1000000 - stream->end_dts;
+	}
+	/* a late or duplicated timestamp still moves the track on */
+	if (duration < 1)
+		duration = 1;
+
+	ret = MP4WriteSample(mp4->file, stream->id,
+				queue->buf + sample->off, sample->len,
+				duration, 0, sample->keyframe);
+	if (!ret) {
+		printf("Pack %s frame to mp4 file fail\n",
+			stream == &mp4->stream[MP4_STREAM_VIDEO] ?
+							"h264" : "aac");
+		ret = -1;
+	} else {
+		ret = 0;
+	}
+
+	stream->end_dts += duration;
+	stream->last_duration = duration;
+	stream->written++;
+	mp4_queue_pop(queue);
+
+	return ret;
+}
+
+/*
+ * write every sample whose turn has come: the earliest head of the two
+ * tracks once its duration is known(the next sample is there), unless
+ * the other track could still bring an earlier one, which it can't once
+ * it has got beyond that head or has run @max_interleave ahead;
+ * nothing is written before the first picture whatever @max_interleave
+ * is, both tracks start at 0 and [mp4_pack_h264] drops the audio that
+ * is earlier than it
+ * @flush: write everything
  */
-static uint8_t *h264_buf;
-static int h264_buf_len;
-static int k_frame;
-static int g_sps_len;
-static int g_pps_len;
-static int g_video_time_scale;
-static int g_audio_time_scale;
+static int mp4_interleave(struct mp4_muxer *mp4, int flush)
+{
+	struct mp4_stream *s = NULL;
+	struct mp4_stream *o = NULL;
+	int64_t head_us = 0;
+	int ret = 0;
+	int k = 0;
+
+	o = &mp4->stream[MP4_STREAM_VIDEO];
+	if (!flush && o->id != MP4_INVALID_TRACK_ID && !o->started)
+		return 0;
+
+	for (;;) {
+		s = NULL;
+		for (k = 0; k < MP4_STREAM_NUM; k++) {
+			o = &mp4->stream[k];
+			if (o->id == MP4_INVALID_TRACK_ID ||
+					mp4_queue_num(&o->queue) == 0)
+				continue;
+			if (s == NULL || mp4_queue_at(&o->queue,
+					o->queue.head)->us < head_us) {
+				s = o;
+				head_us = mp4_queue_at(&o->queue,
+							o->queue.head)->us;
+			}
+		}
+		if (s == NULL)
+			break;
+		o = &mp4->stream[s == &mp4->stream[MP4_STREAM_VIDEO] ?
+					MP4_STREAM_AUDIO : MP4_STREAM_VIDEO];
+
+		if (!flush && mp4_queue_num(&s->queue) < 2) {
+			/* the earliest waits for its duration, the other
+			 * only goes if it is too far ahead to wait */
+			if (mp4_queue_num(&o->queue) < 2 ||
+				(mp4->max_interleave >= 0 &&
+				o->last_us - s->last_us <= mp4->max_interleave))
+				break;
+			s = o;
+		} else if (!flush && mp4->max_interleave >= 0 &&
+				o->id != MP4_INVALID_TRACK_ID &&
+				mp4_queue_num(&o->queue) == 0 &&
+				(!o->started || o->last_us < head_us) &&
+				s->last_us - head_us <= mp4->max_interleave) {
+			/* the other track may still bring an earlier one */
+			break;
+		}
+
+		if (mp4_write_head(mp4, s) < 0)
+			ret = -1;
+	}
 
+	return ret;
+}
 
 /*
- * @[mp4_hd][video_tk][audio_tk] output param
+ * @[mp4_hd] output param
  * @return: '0' on success, '-1' on fail
  */
-int create_mp4_muxer(MP4FileHandle *mp4_hd,
-			MP4TrackId *video_tk, MP4TrackId *audio_tk,
-			struct MP4Profile *mp4_profile)
+int create_mp4_muxer(struct mp4_muxer **mp4_hd, struct MP4Profile *mp4_profile)
 {
-	*mp4_hd = MP4_INVALID_FILE_HANDLE;
-	*video_tk = MP4_INVALID_TRACK_ID;
-	*audio_tk = MP4_INVALID_TRACK_ID;
+	struct mp4_muxer *mp4 = NULL;
+	struct mp4_stream *video = NULL;
+	struct mp4_stream *audio = NULL;
+
+	*mp4_hd = NULL;
 
-	g_sps_len = mp4_profile->sps_len;
-	g_pps_len = mp4_profile->pps_len;
-	g_video_time_scale = mp4_profile->video_time_scale;
-	g_audio_time_scale = mp4_profile->audio_time_scale;
+	mp4 = (struct mp4_muxer *)calloc(1, sizeof(struct mp4_muxer));
+	if (mp4 == NULL) {
+		printf("Malloc MP4 muxer fail\n");
+		return -1;
+	}
+	pthread_mutex_init(&mp4->mutex, NULL);
+	video = &mp4->stream[MP4_STREAM_VIDEO];
+	audio = &mp4->stream[MP4_STREAM_AUDIO];
+
+	mp4->skip_nalu = mp4_profile->skip_nalu ?
+			mp4_profile->skip_nalu : NALU_SKIP_DEFAULT;
+	mp4->max_interleave = (mp4_profile->max_interleave_ms ?
+			mp4_profile->max_interleave_ms :
+			MP4_DEFAULT_INTERLEAVE_MS) * 1000LL;
+	video->timescale = mp4_profile->video_time_scale;
+	video->last_duration = mp4_profile->video_sample_duration;
+	audio->timescale = mp4_profile->audio_time_scale;
+	audio->last_duration = mp4_profile->audio_sample_duration;
+
+	if (mp4_queue_init(&video->queue) < 0 ||
+				mp4_queue_init(&audio->queue) < 0) {
+		printf("Malloc MP4 interleave queue fail\n");
+		goto exit;
+	}
 
 	/* default setting */
-	*mp4_hd = MP4CreateEx(mp4_profile->name, 0, 1, 1, 0, 0, 0, 0);
-	if (*mp4_hd == MP4_INVALID_FILE_HANDLE)
+	mp4->file = MP4CreateEx(mp4_profile->name, 0, 1, 1, 0, 0, 0, 0);
+	if (mp4->file == MP4_INVALID_FILE_HANDLE)
 		goto exit;
 
-	MP4SetTimeScale(*mp4_hd, mp4_profile->video_time_scale);
+	MP4SetTimeScale(mp4->file, mp4_profile->video_time_scale);
 
-	*video_tk = MP4AddH264VideoTrack(*mp4_hd, mp4_profile->video_time_scale,
+	video->id = MP4AddH264VideoTrack(mp4->file,
+					mp4_profile->video_time_scale,
 					mp4_profile->video_sample_duration,
 					mp4_profile->width, mp4_profile->height,
 					mp4_profile->sps[1],// AVCProfileIndication
 					mp4_profile->sps[2],// profile_compat
 					mp4_profile->sps[3],// AVCLevelIndication
 					3); // 4 bytes length before each NALU
-	if (*video_tk == MP4_INVALID_TRACK_ID)
+	if (video->id == MP4_INVALID_TRACK_ID)
 		goto exit;
 
-	*audio_tk = MP4AddAudioTrack(*mp4_hd, mp4_profile->audio_time_scale,
+	audio->id = MP4AddAudioTrack(mp4->file, mp4_profile->audio_time_scale,
 					mp4_profile->audio_sample_duration,
 					MP4_MPEG4_AUDIO_TYPE);
-	if (*audio_tk == MP4_INVALID_TRACK_ID)
+	if (audio->id == MP4_INVALID_TRACK_ID)
 		goto exit;
 
-	MP4AddH264SequenceParameterSet(*mp4_hd, *video_tk,
+	MP4AddH264SequenceParameterSet(mp4->file, video->id,
 					mp4_profile->sps, mp4_profile->sps_len);
-	MP4AddH264PictureParameterSet(*mp4_hd, *video_tk,
+	MP4AddH264PictureParameterSet(mp4->file, video->id,
 					mp4_profile->pps, mp4_profile->pps_len);
 	/* 0x7f a reserved value, you can refer to linux man */
 	/* https://linux.die.net/man/3/mp4 */
-	MP4SetVideoProfileLevel(*mp4_hd, 0x7f);
-	MP4SetAudioProfileLevel(*mp4_hd, 0x7f);
+	MP4SetVideoProfileLevel(mp4->file, 0x7f);
+	MP4SetAudioProfileLevel(mp4->file, 0x7f);
 	/* set audio decoder configuration */
 	if (mp4_profile->aac_decoder_conf_len != 0)
-		MP4SetTrackESConfiguration(*mp4_hd, *audio_tk,
+		MP4SetTrackESConfiguration(mp4->file, audio->id,
 					mp4_profile->aac_decoder_conf,
 					mp4_profile->aac_decoder_conf_len);
 	else {
@@ -85,195 +357,143 @@ int create_mp4_muxer(MP4FileHandle *mp4_hd,
 		goto exit;
 	}
 
-//	pthread_mutex_init(&mp4_mutex, NULL);
-
+	*mp4_hd = mp4;
 	printf("Create MP4 muxer success...\n");
 
 	return 0;
 
 exit:
 	printf("Init mp4 fail\n");
-	return -1;
-}
+	if (mp4->file != MP4_INVALID_FILE_HANDLE)
+		MP4Close(mp4->file, 0);
+	mp4_queue_destroy(&video->queue);
+	mp4_queue_destroy(&audio->queue);
+	pthread_mutex_destroy(&mp4->mutex);
+	free(mp4);
 
-void destroy_mp4_muxer(MP4FileHandle mp4_hd)
-{
-	MP4Close(mp4_hd, 0);
-	if (h264_buf != NULL) {
-		free(h264_buf);
-		h264_buf = NULL;
-		h264_buf_len = 0;
-	}
-
-	printf("Destroy MP4 muxer success...\n");
+	return -1;
 }
 
-static int __cache_h264_a_frame(uint8_t *buf, int buf_len, int keyframe)
+void destroy_mp4_muxer(struct mp4_muxer *mp4)
 {
-	uint8_t *i_frame_buf = NULL;
-	int pay_load_len = 0;
-
-	if (keyframe) {
-		k_frame = 1;
-		h264_buf_len = buf_len - g_sps_len - g_pps_len - (2 * 4);
-		pay_load_len = h264_buf_len - 4;
-		h264_buf = calloc(1, h264_buf_len);
-		if (h264_buf == NULL) {
-			printf("Malloc h264 cache buf fail\n");
-			return -1;
-		}
-
+	if (mp4 == NULL)
+		return;
 
-		i_frame_buf = buf + g_sps_len + g_pps_len + 2 * 4;
-		i_frame_buf[0] = pay_load_len  >> 24;
-		i_frame_buf[1] = pay_load_len >> 16;
-		i_frame_buf[2] = pay_load_len >> 8;
-		i_frame_buf[3] = pay_load_len & 0xff;
-		memcpy(h264_buf, i_frame_buf, h264_buf_len);
-	} else {
-		k_frame = 0;
-		h264_buf_len = buf_len;
-		pay_load_len = h264_buf_len - 4;
-		h264_buf = calloc(1, h264_buf_len);
-		if (h264_buf == NULL) {
-			printf("Malloc h264 cache buf fail\n");
-			return -1;
-		}
+	pthread_mutex_lock(&mp4->mutex);
+	mp4_interleave(mp4, 1);
+	MP4Close(mp4->file, 0);
+	pthread_mutex_unlock(&mp4->mutex);
 
-		buf[0] = pay_load_len >> 24;
-		buf[1] = pay_load_len >> 16;
-		buf[2] = pay_load_len >> 8;
-		buf[3] = pay_load_len & 0xff;
-		memcpy(h264_buf, buf, h264_buf_len);
-	}
+	mp4_queue_destroy(&mp4->stream[MP4_STREAM_VIDEO].queue);
+	mp4_queue_destroy(&mp4->stream[MP4_STREAM_AUDIO].queue);
+	pthread_mutex_destroy(&mp4->mutex);
+	free(mp4);
 
-	return 0;
+	printf("Destroy MP4 muxer success...\n");
 }
 
-/* @use the current pcm frame timestamp
- * to calculate the previous aac frame's duration
- * and write the aac frame to mp4 file
- * @[mp4_pack_aac] should be called paried with [aac_encode],
- * and [mp4_pack_aac] should called before [aac_encode]
- * in order to cache timestamp to calculate duration
+/* @buf: every access unit from [aac_encode]([AAC_TT_RAW])
+ * @tv: its own pts, the duration comes from the next one
  */
-
-/* XXX: [mp4_pack_aac] share the same buf with [aac_encode] */
-int mp4_pack_aac(MP4FileHandle mp4_hd, MP4TrackId audio_tk, void *buf,
-				int buf_len, const struct timeval *tv)
+int mp4_pack_aac(struct mp4_muxer *mp4, void *buf, int buf_len,
+				const struct timeval *tv)
 {
-	static struct timeval tv_before;
-	int time_duration = 0;
-	static int first_frame = 1;
+	struct mp4_stream *stream = &mp4->stream[MP4_STREAM_AUDIO];
+	struct mp4_stream *video = &mp4->stream[MP4_STREAM_VIDEO];
+	struct mp4_pending *sample = NULL;
+	int64_t us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
 	int ret = 0;
 
-	if ((buf_len == 0) && !first_frame)
+	if (buf_len <= 0)
 		return 0;
 
-	/* actually every audio frame duration is fixed to AUDIO_SAMPLE_DURATION
-	 * cause it's pcm period time is fixed,
-	 * and usually audio will not lose any frame
-	 */
-	if (first_frame) {
-		/* first frame is a pcm frame, we just record it's timestamp */
-		first_frame = 0;
-		tv_before.tv_sec = tv->tv_sec;
-		tv_before.tv_usec = tv->tv_usec;
+	pthread_mutex_lock(&mp4->mutex);
 
-		return 0;
-	} else {
-		time_duration = (g_audio_time_scale / 1000) *
-				((tv->tv_sec * 1000 + tv->tv_usec / 1000) -
-				 (tv_before.tv_sec * 1000 + tv_before.tv_usec /1000));
-		tv_before.tv_sec = tv->tv_sec;
-		tv_before.tv_usec = tv->tv_usec;
-	}
-
-//	pthread_mutex_lock(&mp4_mutex);
+	/* late audio from before the first picture, as in [mp4_pack_h264] */
+	if (stream->written == 0 && video->started && us < video->first_us)
+		goto exit;
 
-	/* remove aac ADTS(7 bytes len) from aac buf */
-	ret = MP4WriteSample(mp4_hd, audio_tk, buf + 7, buf_len - 7,
-						time_duration, 0, 1);
-	if (!ret) {
-		printf("Pack aac frame to mp4 file fail\n");
+	/* raw access unit, the esds carries the AudioSpecificConfig */
+	sample = mp4_queue_reserve(&stream->queue, buf_len);
+	if (sample == NULL) {
+		printf("Malloc mp4 audio queue fail\n");
 		ret = -1;
+		goto exit;
 	}
+	sample->us = us;
+	sample->len = buf_len;
+	sample->keyframe = 1;
+	memcpy(stream->queue.buf + sample->off, buf, buf_len);
+	mp4_queue_commit(&stream->queue, sample);
+	stream->last_us = sample->us;
+	stream->started = 1;
 
-//	pthread_mutex_unlock(&mp4_mutex);
+	ret = mp4_interleave(mp4, 0);
+
+exit:
+	pthread_mutex_unlock(&mp4->mutex);
 
 	return ret;
 }
 
-/* @h264_data: should be h264 raw data which contains sps/pps for I frame and
- * [0x00/0x00/0x00/0x01] NALU header for each NALU
- * @mp4_pack_h264: pack the previous one frame and
- * process & cache the current frame
+/* audio earlier than @us can't be played along a picture from @us on */
+static void mp4_drop_audio_before(struct mp4_stream *audio, int64_t us)
+{
+	while (audio->written == 0 && mp4_queue_num(&audio->queue) &&
+		mp4_queue_at(&audio->queue, audio->queue.head)->us < us)
+		mp4_queue_pop(&audio->queue);
+}
+
+/* @h264_data: h264 annexb access unit, 3 or 4 bytes start code before
+ * each NALU, any number of slices, it is not modified: it is converted
+ * to avcc straight into the queue, the types in @skip_nalu are dropped
+ * frames before the first keyframe are dropped
  */
-int mp4_pack_h264(MP4FileHandle mp4_hd, MP4TrackId video_tk,
-				const struct timeval *tv,
-				uint8_t *h264_data, int h264_data_len,
+int mp4_pack_h264(struct mp4_muxer *mp4, const struct timeval *tv,
+				const uint8_t *h264_data, int h264_data_len,
 				int keyframe)
 {
-	static struct timeval tv_before;
-	int time_duration = 0;
-	static int first_frame = 1;
+	struct mp4_stream *stream = &mp4->stream[MP4_STREAM_VIDEO];
+	struct mp4_stream *audio = &mp4->stream[MP4_STREAM_AUDIO];
+	struct mp4_pending *sample = NULL;
+	int64_t us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
 	int ret = 0;
 
-	if (h264_buf == NULL && !first_frame) {
-		ret = -1;
-		goto exit;
-	}
-
-	if (first_frame) {
-		/* first frame just record it's timestamp */
-		first_frame = 0;
-		tv_before.tv_sec = tv->tv_sec;
-		tv_before.tv_usec = tv->tv_usec;
+	if (h264_data_len <= 0)
+		return 0;
 
-		ret = 0;
-		goto exit;
-	} else {
-		time_duration = (g_video_time_scale / 1000) *
-				((tv->tv_sec * 1000 + tv->tv_usec / 1000) -
-				 (tv_before.tv_sec * 1000 + tv_before.tv_usec /1000));
-		tv_before.tv_sec = tv->tv_sec;
-		tv_before.tv_usec = tv->tv_usec;
+	pthread_mutex_lock(&mp4->mutex);
+
+	if (!stream->started) {
+		/* both tracks start at 0, audio from before the first
+		 * picture would be out of sync; it is held back until
+		 * then, the first keyframe comes after this frame anyway */
+		mp4_drop_audio_before(audio, us);
+		if (!keyframe)
+			goto exit;
+		stream->first_us = us;
+		stream->started = 1;
 	}
 
-//	pthread_mutex_lock(&mp4_mutex);
-
-	/* mp4 chunk data dosen't need sps/pps nalu, but only frame data,
-	 * so you should strip sps/pps nalu from I frame
-	 */
-//	if (k_frame) {
-//		ret = MP4WriteSample(mp4_hd, video_tk, sps_buf, SPS_LEN + 4,
-//							time_duration, 0, k_frame);
-//		if (!ret)
-//			goto err;
-//		ret = MP4WriteSample(mp4_hd, video_tk, pps_buf, PPS_LEN + 4,
-//							time_duration, 0, k_frame);
-//		if (!ret)
-//			goto err;
-//		printf("~~~~~~pack sps/pps to mp4\n");
-//	}
-
-	ret = MP4WriteSample(mp4_hd, video_tk, h264_buf, h264_buf_len,
-					time_duration, 0, k_frame);
-
-//	pthread_mutex_unlock(&mp4_mutex);
-
-//err:
-	if (!ret) {
-		printf("Pack h264 frame to mp4 file fail\n");
+	/* mp4 chunk data dosen't need sps/pps nalu, but only frame data */
+	sample = mp4_queue_reserve(&stream->queue,
+				H264_AVCC_MAX_LEN(h264_data_len));
+	if (sample == NULL) {
+		printf("Malloc mp4 video queue fail\n");
 		ret = -1;
+		goto exit;
 	}
+	sample->us = us;
+	sample->keyframe = keyframe;
+	sample->len = h264_annexb_to_avcc(stream->queue.buf + sample->off,
+				h264_data, h264_data_len, mp4->skip_nalu);
+	mp4_queue_commit(&stream->queue, sample);
+	stream->last_us = us;
 
-	free(h264_buf);
-	h264_buf = NULL;
-	h264_buf_len = 0;
+	ret = mp4_interleave(mp4, 0);
 
 exit:
-	__cache_h264_a_frame(h264_data, h264_data_len, keyframe);
+	pthread_mutex_unlock(&mp4->mutex);
 
 	return ret;
 }
@@ -8,6 +8,9 @@
 #ifndef __MP4_MUXER_H
 #define __MP4_MUXER_H
 
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/time.h>
 #include <mp4v2/mp4v2.h>
 
 struct MP4Profile {
@@ -25,32 +28,96 @@ struct MP4Profile {
 	/* generated by [create_aac_encoder] */
 	uint8_t *aac_decoder_conf;
 	int aac_decoder_conf_len;
+	/* NALU_MASK() of the NALU types dropped, 0 for sps/pps/aud */
+	uint32_t skip_nalu;
+	/* how far(ms) one track may run ahead of the other before its
+	 * samples are written without waiting, 0 for the default, < 0 writes
+	 * every sample as soon as its duration is known */
+	int max_interleave_ms;
 };
 
-int create_mp4_muxer(MP4FileHandle *mp4_hd,
-			MP4TrackId *video_tk, MP4TrackId *audio_tk,
-			struct MP4Profile *mp4_profile);
-void destroy_mp4_muxer(MP4FileHandle mp4_hd);
-
-/* @use the current pcm frame timestamp
- * to calculate the previous aac frame's duration
- * and write the aac frame to mp4 file
- * @[mp4_pack_aac] should be called paried with [aac_encode],
- * and [mp4_pack_aac] should called before [aac_encode]
- * in order to cache timestamp to calculate duration
+#define MP4_DEFAULT_INTERLEAVE_MS	1000
+
+enum {
+	MP4_STREAM_VIDEO = 0,
+	MP4_STREAM_AUDIO,
+	MP4_STREAM_NUM,
+};
+
+/* a sample waiting for its duration(the next sample of its track) and
+ * for its turn, payload at @off of the queue buf */
+struct mp4_pending {
+	int64_t us;
+	uint32_t off;
+	uint32_t len;
+	int keyframe;
+};
+
+/* pending samples of one track, payloads in a byte ring @buf, both only
+ * grow when a track runs further ahead than ever before */
+struct mp4_queue {
+	struct mp4_pending *samples;
+	unsigned int cap; /* power of two */
+	unsigned int head;
+	unsigned int tail;
+	uint8_t *buf;
+	uint32_t size;
+	uint32_t rd;
+	uint32_t wr;
+};
+
+/* one track of the file, it starts at 0 with its first sample written,
+ * the dts of a sample is its pts from there, so the durations never add
+ * up to a drift */
+struct mp4_stream {
+	MP4TrackId id;
+	uint32_t timescale;
+	uint32_t last_duration; /* of the last sample written */
+	int64_t first_us;
+	int64_t end_dts; /* sum of the durations written */
+	int64_t last_us; /* newest sample queued */
+	int started; /* video: from the first keyframe */
+	uint64_t written;
+	struct mp4_queue queue;
+};
+
+/*
+ * one mp4 file, every muxer has its own state and lock, the audio and
+ * video capture callbacks could call it concurrently and several files
+ * could be recorded in one process
+ * samples of both tracks go through @stream[].queue: a sample gets its
+ * duration from the next one of its track, and they are written in dts
+ * order across the tracks
+ */
+struct mp4_muxer {
+	pthread_mutex_t mutex;
+	MP4FileHandle file;
+	uint32_t skip_nalu;
+	int64_t max_interleave; /* us, < 0 no interleaving */
+	struct mp4_stream stream[MP4_STREAM_NUM];
+};
+
+/*
+ * @[mp4_hd] output param
+ * @return: '0' on success, '-1' on fail
+ */
+int create_mp4_muxer(struct mp4_muxer **mp4_hd, struct MP4Profile *mp4_profile);
+/* writes the samples still queued and closes the file */
+void destroy_mp4_muxer(struct mp4_muxer *mp4);
+
+/* @buf: every access unit from [aac_encode]([AAC_TT_RAW])
+ * @tv: its own pts, the duration comes from the next one
  */
-/* XXX: [mp4_pack_aac] share the same buf with [aac_encode] */
-int mp4_pack_aac(MP4FileHandle mp4_hd, MP4TrackId audio_tk, void *buf,
-				int buf_len, const struct timeval *tv);
-
-/* @h264_data: should be h264 raw data which contains sps/pps for I frame and
- * [0x00/0x00/0x00/0x01] NALU header for each NALU
- * @mp4_pack_h264: pack the previous one frame and
- * process & cache the current frame
+int mp4_pack_aac(struct mp4_muxer *mp4, void *buf, int buf_len,
+				const struct timeval *tv);
+
+/* @h264_data: h264 annexb access unit, 3 or 4 bytes start code before
+ * each NALU, any number of slices, it is not modified: it is converted
+ * to avcc straight into the queue, the types in @skip_nalu are dropped
+ * frames before the first keyframe are dropped
  */
-int mp4_pack_h264(MP4FileHandle mp4_hd, MP4TrackId video_tk,
-				const struct timeval *tv,
-				uint8_t *h264_data, int h264_data_len,
+int mp4_pack_h264(struct mp4_muxer *mp4, const struct timeval *tv,
+				const uint8_t *h264_data, int h264_data_len,
 				int keyframe);
 
 #endif
@@ -0,0 +1,202 @@
+/*
+ * pi_pixfmt_bench.c
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ *
+ * check every simd version of the pixel kernels is bit-exact with the
+ * scalar reference(random data, all even widths up to 256 so every
+ * tail length is hit), then time them on 1080p frames
+ *
+ * build:
+ * gcc -O2 -Iinclude bench/pi_pixfmt_bench.c src/pi_pixfmt.c \
+ *		src/pi_pixfmt_x86.c src/pi_pixfmt_neon.c \
+ *		-lpthread -o pi_pixfmt_bench
+ * on armv7 add -mfpu=neon
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "pi_pixfmt.h"
+
+
+#define CHECK_MAX_WIDTH		256
+#define CHECK_ROUND		20
+#define BENCH_WIDTH		1920
+#define BENCH_HEIGHT		1080
+#define BENCH_LOOP		200
+
+static const char *g_level_name[PI_SIMD_NUM] = {"c", "sse2", "avx2", "neon"};
+
+static uint64_t __now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void __fill_random(uint8_t *buf, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = rand() & 0xff;
+}
+
+/* outputs get a guard byte past @n to catch overruns */
+static int __check_ops(const struct pi_pixfmt_ops *ref,
+				const struct pi_pixfmt_ops *ops)
+{
+	uint8_t s0[CHECK_MAX_WIDTH * 2], s1[CHECK_MAX_WIDTH * 2];
+	uint8_t a[4][CHECK_MAX_WIDTH * 2 + 1], b[4][CHECK_MAX_WIDTH * 2 + 1];
+	int errors = 0;
+	int round;
+	int n;
+
+#define __CMP(what, len)						\
+	do {								\
+		int k;							\
+		for (k = 0; k < 4; k++) {				\
+			if (memcmp(a[k], b[k], (len) + 1) == 0)		\
+				continue;				\
+			printf("%s %s mismatch, n=%d\n",		\
+					ops->name, what, n);		\
+			errors++;					\
+			break;						\
+		}							\
+	} while (0)
+
+	for (round = 0; round < CHECK_ROUND; round++) {
+		for (n = 2; n <= CHECK_MAX_WIDTH; n += 2) {
+			__fill_random(s0, sizeof(s0));
+			__fill_random(s1, sizeof(s1));
+
+			memset(a, 0x5a, sizeof(a));
+			memset(b, 0x5a, sizeof(b));
+			ref->split_uv(s0, a[0], a[1], n);
+			ops->split_uv(s0, b[0], b[1], n);
+			__CMP("split_uv", n);
+
+			memset(a, 0x5a, sizeof(a));
+			memset(b, 0x5a, sizeof(b));
+			ref->merge_uv(s0, s1, a[0], n);
+			ops->merge_uv(s0, s1, b[0], n);
+			__CMP("merge_uv", 2 * n);
+
+			memset(a, 0x5a, sizeof(a));
+			memset(b, 0x5a, sizeof(b));
+			ref->box_2x2(s0, s1, a[0], n);
+			ops->box_2x2(s0, s1, b[0], n);
+			__CMP("box_2x2", n);
+
+			memset(a, 0x5a, sizeof(a));
+			memset(b, 0x5a, sizeof(b));
+			ref->yuyv_to_i420(s0, s1, a[0], a[1], a[2], a[3], n);
+			ops->yuyv_to_i420(s0, s1, b[0], b[1], b[2], b[3], n);
+			__CMP("yuyv_to_i420", n);
+		}
+	}
+
+#undef __CMP
+
+	return errors;
+}
+
+/* a whole 1080p frame through each kernel, frames/sec */
+static void __bench_ops(const struct pi_pixfmt_ops *ops, uint8_t *src,
+							uint8_t *dst)
+{
+	const int w = BENCH_WIDTH;
+	const int h = BENCH_HEIGHT;
+	uint64_t begin;
+	double ns[4];
+	int loop;
+	int y;
+
+	begin = __now_ns();
+	for (loop = 0; loop < BENCH_LOOP; loop++)
+		for (y = 0; y < h / 2; y++)
+			ops->split_uv(src + y * w, dst + y * w / 2,
+				dst + w * h / 4 + y * w / 2, w / 2);
+	ns[0] = (double)(__now_ns() - begin) / BENCH_LOOP;
+
+	begin = __now_ns();
+	for (loop = 0; loop < BENCH_LOOP; loop++)
+		for (y = 0; y < h / 2; y++)
+			ops->merge_uv(src + y * w / 2,
+				src + w * h / 4 + y * w / 2,
+				dst + y * w, w / 2);
+	ns[1] = (double)(__now_ns() - begin) / BENCH_LOOP;
+
+	/* luma plus both chroma planes of an i420 frame */
+	begin = __now_ns();
+	for (loop = 0; loop < BENCH_LOOP; loop++)
+		for (y = 0; y < h / 2 + h / 4; y++)
+			ops->box_2x2(src + 2 * y * w, src + (2 * y + 1) * w,
+					dst + y * w / 2, w / 2);
+	ns[2] = (double)(__now_ns() - begin) / BENCH_LOOP;
+
+	begin = __now_ns();
+	for (loop = 0; loop < BENCH_LOOP; loop++)
+		for (y = 0; y < h; y += 2)
+			ops->yuyv_to_i420(src + y * w * 2,
+				src + (y + 1) * w * 2,
+				dst + y * w, dst + (y + 1) * w,
+				dst + w * h + y / 2 * w / 2,
+				dst + w * h * 5 / 4 + y / 2 * w / 2, w);
+	ns[3] = (double)(__now_ns() - begin) / BENCH_LOOP;
+
+	printf("%-6s nv12->i420 %7.0f  i420->nv12 %7.0f  "
+			"downscale 2x %7.0f  yuyv->i420 %7.0f\n",
+			ops->name, 1e9 / ns[0], 1e9 / ns[1],
+			1e9 / ns[2], 1e9 / ns[3]);
+}
+
+int main(int argc, char *argv[])
+{
+	const struct pi_pixfmt_ops *ref = pi_pixfmt_get_ops(PI_SIMD_C);
+	const struct pi_pixfmt_ops *ops = NULL;
+	uint8_t *src = NULL;
+	uint8_t *dst = NULL;
+	int errors = 0;
+	int level;
+	int ret;
+
+	srand(1);
+
+	printf("best: %s\n", pi_pixfmt_best_ops()->name);
+
+	for (level = PI_SIMD_SSE2; level < PI_SIMD_NUM; level++) {
+		ops = pi_pixfmt_get_ops(level);
+		if (ops == NULL) {
+			printf("%-6s not supported here\n", g_level_name[level]);
+			continue;
+		}
+		ret = __check_ops(ref, ops);
+		printf("%-6s bit-exact check %s\n", ops->name,
+						ret ? "FAIL" : "ok");
+		errors += ret;
+	}
+
+	src = (uint8_t *)malloc(BENCH_WIDTH * BENCH_HEIGHT * 2);
+	dst = (uint8_t *)malloc(BENCH_WIDTH * BENCH_HEIGHT * 2);
+	if (src == NULL || dst == NULL)
+		return 1;
+	__fill_random(src, BENCH_WIDTH * BENCH_HEIGHT * 2);
+
+	printf("1080p frames/sec\n");
+	for (level = PI_SIMD_C; level < PI_SIMD_NUM; level++) {
+		ops = pi_pixfmt_get_ops(level);
+		if (ops != NULL)
+			__bench_ops(ops, src, dst);
+	}
+
+	free(src);
+	free(dst);
+
+	return errors ? 1 : 0;
+}
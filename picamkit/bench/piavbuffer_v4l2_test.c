@@ -0,0 +1,324 @@
+/*
+ * piavbuffer_v4l2_test.c
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ *
+ * run the zero-copy v4l2 capture path on the file backed fake device
+ * with buffer counts the driver may grant(not only powers of two),
+ * a blocking consumer holds several frames at once and a drop-oldest
+ * one reads now and then, checks every frame the blocking consumer
+ * gets is the next one of the file and lives in a driver buffer;
+ * then tears the buffer queue down while a consumer still holds a
+ * frame(destroy must wait for it, build with -fsanitize=address to
+ * catch the frame being freed under it) and checks the same channel
+ * captures again once the queue is set up anew
+ *
+ * build:
+ * gcc -O2 -Iinclude -I../pistream/include bench/piavbuffer_v4l2_test.c \
+ *		src/piavbuffer.c src/piavchn.c src/piv4l2.c \
+ *		../pistream/src/piavscale.c src/pi_pixfmt.c \
+ *		src/pi_pixfmt_x86.c src/pi_pixfmt_neon.c \
+ *		-lswscale -lavformat -lavcodec -lavutil \
+ *		-lpthread -o piavbuffer_v4l2_test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <linux/videodev2.h>
+
+#include <libavformat/avformat.h>
+
+#include "pi_errno.h"
+#include "piavchn.h"
+#include "piavisp.h"
+#include "piavbuffer.h"
+#include "piv4l2.h"
+
+
+#define WIDTH			64
+#define HEIGHT			48
+#define FILE_FRAME_NUM		10
+#define FRAME_NUM		200
+#define HOLD_MS			200
+
+/* a frame a consumer keeps while the queue is destroyed */
+struct held_frame {
+	struct pi_av_buffer_ex *buffer_ex;
+	int value;
+	int recycled;
+};
+
+static int g_errors;
+
+static void __error(const char *msg, int buf_num, int value)
+{
+	g_errors++;
+	printf("ERROR %s, %d buffers, %d\n", msg, buf_num, value);
+}
+
+/* frame i of the file is filled with byte i */
+static int __make_file(char *path)
+{
+	uint8_t frame[WIDTH * HEIGHT * 3 / 2];
+	int fd;
+	int i;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return -PI_E_OPEN_FAIL;
+
+	for (i = 0; i < FILE_FRAME_NUM; i++) {
+		memset(frame, i, sizeof(frame));
+		if (write(fd, frame, sizeof(frame)) != sizeof(frame)) {
+			close(fd);
+			return -PI_FAIL;
+		}
+	}
+
+	close(fd);
+
+	return PI_OK;
+}
+
+static int __in_driver_buffer(struct pi_v4l2_dev *dev,
+				struct pi_av_buffer_ex *buffer_ex)
+{
+	AVFrame *pframe = (AVFrame *)buffer_ex->vm_addr;
+
+	if (buffer_ex->index < 0 || buffer_ex->index >= dev->buf_num)
+		return 0;
+
+	return pframe->data[0] == dev->bufs[buffer_ex->index].start;
+}
+
+static void __run(const char *path, int buf_num)
+{
+	struct pi_av_buffer_ex *held[8];
+	struct pi_av_buffer_ex *buffer_ex = NULL;
+	struct pi_av_chn_node *chn_node = NULL;
+	struct pi_frame_attr fattr;
+	struct pi_v4l2_dev *dev = NULL;
+	int block, drop;
+	int nb_held = 0;
+	int chnno;
+	int last = -1;
+	int value;
+	int ret;
+	int i;
+
+	memset(&fattr, 0, sizeof(fattr));
+	fattr.pixel_fmt = AV_PIX_FMT_YUV420P;
+	fattr.width = WIDTH;
+	fattr.height = HEIGHT;
+	fattr.fps = 500;
+	fattr.buf_num = buf_num;
+	fattr.backend = PI_ISP_BACKEND_V4L2;
+
+	dev = (struct pi_v4l2_dev *)malloc(sizeof(struct pi_v4l2_dev));
+	if (dev == NULL || pi_v4l2_open(dev, path, V4L2_PIX_FMT_YUV420,
+			WIDTH, HEIGHT, fattr.fps, &fattr.buf_num) < 0) {
+		__error("open fake device fail", buf_num, 0);
+		free(dev);
+		return;
+	}
+
+	chnno = __create_chn(PI_AV_ID_VIDEO_ISP, &fattr, dev);
+	if (chnno < 0) {
+		__error("create channel fail", buf_num, chnno);
+		pi_v4l2_close(dev);
+		free(dev);
+		return;
+	}
+
+	ret = __init_buf_queue_manager(chnno);
+	if (ret < 0) {
+		__error("init buffer queue fail", buf_num, ret);
+		__destory_chn_by_chnno(chnno);
+		return;
+	}
+
+	block = __register_consumer(chnno, PI_AV_CONSUMER_BLOCK);
+	drop = __register_consumer(chnno, PI_AV_CONSUMER_DROP_OLDEST);
+	chn_node = __get_chn_by_chnno(chnno);
+	chn_node->fanout->run = 1;
+
+	for (i = 0; i < FRAME_NUM; i++) {
+		ret = __get_consumer_frame(chnno, block, &buffer_ex, 1000);
+		if (ret < 0) {
+			__error("blocking consumer timed out", buf_num, i);
+			break;
+		}
+
+		value = ((AVFrame *)buffer_ex->vm_addr)->data[0][0];
+		if (last >= 0 && value != (last + 1) % FILE_FRAME_NUM)
+			__error("frame out of order", buf_num, value);
+		if (!__in_driver_buffer(dev, buffer_ex))
+			__error("frame not in a driver buffer", buf_num, i);
+		last = value;
+
+		/* keep all but one driver buffer, the capture thread
+		 * must still be able to fill the last one */
+		held[nb_held++] = buffer_ex;
+		if (nb_held == buf_num - 1 || i % 3 == 0) {
+			while (nb_held > 0) {
+				buffer_ex = held[--nb_held];
+				buffer_ex->recycle(buffer_ex);
+			}
+		}
+
+		if (i % 7 == 0 && __get_consumer_frame(chnno, drop,
+						&buffer_ex, 0) == PI_OK)
+			buffer_ex->recycle(buffer_ex);
+	}
+
+	while (nb_held > 0) {
+		buffer_ex = held[--nb_held];
+		buffer_ex->recycle(buffer_ex);
+	}
+
+	printf("%d buffers: ring %d, %d frames, drop-oldest lost %u\n",
+				buf_num, chn_node->fanout->size, i,
+				chn_node->fanout->consumers[drop].drop_count);
+
+	__unregister_consumer(chnno, block);
+	__unregister_consumer(chnno, drop);
+	__put_chn(chn_node);
+	__destroy_buf_queue_manager(chnno);
+	__destory_chn_by_chnno(chnno);
+}
+
+static void *__hold_thread(void *arg)
+{
+	struct held_frame *held = (struct held_frame *)arg;
+	AVFrame *pframe = NULL;
+
+	usleep(HOLD_MS * 1000);
+
+	/* destroy is waiting for us, the frame must still be intact */
+	pframe = (AVFrame *)held->buffer_ex->vm_addr;
+	if (pframe->data[0][0] != held->value)
+		__error("held frame changed under the consumer", 0,
+							pframe->data[0][0]);
+
+	__atomic_store_n(&held->recycled, 1, __ATOMIC_RELEASE);
+	held->buffer_ex->recycle(held->buffer_ex);
+
+	return NULL;
+}
+
+/* @return: the consumer registered and the queue started */
+static int __start_queue(int chnno, int policy)
+{
+	struct pi_av_chn_node *chn_node = NULL;
+	int consumer;
+
+	if (__init_buf_queue_manager(chnno) < 0)
+		return -1;
+
+	consumer = __register_consumer(chnno, policy);
+	chn_node = __get_chn_by_chnno(chnno);
+	chn_node->fanout->run = 1;
+	__put_chn(chn_node);
+
+	return consumer;
+}
+
+static void __run_destroy_held(const char *path)
+{
+	struct pi_av_buffer_ex *buffer_ex = NULL;
+	struct pi_frame_attr fattr;
+	struct pi_v4l2_dev *dev = NULL;
+	struct held_frame held;
+	pthread_t hold_thread;
+	int consumer;
+	int chnno;
+
+	memset(&fattr, 0, sizeof(fattr));
+	fattr.pixel_fmt = AV_PIX_FMT_YUV420P;
+	fattr.width = WIDTH;
+	fattr.height = HEIGHT;
+	fattr.fps = 500;
+	fattr.buf_num = 4;
+	fattr.backend = PI_ISP_BACKEND_V4L2;
+
+	dev = (struct pi_v4l2_dev *)malloc(sizeof(struct pi_v4l2_dev));
+	if (dev == NULL || pi_v4l2_open(dev, path, V4L2_PIX_FMT_YUV420,
+			WIDTH, HEIGHT, fattr.fps, &fattr.buf_num) < 0) {
+		__error("open fake device fail", fattr.buf_num, 0);
+		free(dev);
+		return;
+	}
+
+	chnno = __create_chn(PI_AV_ID_VIDEO_ISP, &fattr, dev);
+	if (chnno < 0) {
+		__error("create channel fail", fattr.buf_num, chnno);
+		pi_v4l2_close(dev);
+		free(dev);
+		return;
+	}
+
+	consumer = __start_queue(chnno, PI_AV_CONSUMER_BLOCK);
+	if (consumer < 0 || __get_consumer_frame(chnno, consumer,
+						&buffer_ex, 1000) < 0) {
+		__error("no frame to hold", fattr.buf_num, consumer);
+		__destroy_buf_queue_manager(chnno);
+		__destory_chn_by_chnno(chnno);
+		return;
+	}
+
+	memset(&held, 0, sizeof(held));
+	held.buffer_ex = buffer_ex;
+	held.value = ((AVFrame *)buffer_ex->vm_addr)->data[0][0];
+	pthread_create(&hold_thread, NULL, __hold_thread, &held);
+
+	__destroy_buf_queue_manager(chnno);
+	if (!__atomic_load_n(&held.recycled, __ATOMIC_ACQUIRE))
+		__error("queue destroyed under a held frame", fattr.buf_num,
+								held.value);
+	pthread_join(hold_thread, NULL);
+
+	/* the channel itself lives on and captures again */
+	consumer = __start_queue(chnno, PI_AV_CONSUMER_BLOCK);
+	if (consumer < 0 || __get_consumer_frame(chnno, consumer,
+						&buffer_ex, 1000) < 0)
+		__error("no frame after the queue was set up again",
+						fattr.buf_num, consumer);
+	else
+		buffer_ex->recycle(buffer_ex);
+
+	printf("destroy with a held frame: waited %s\n",
+				held.recycled ? "for it" : "NOT");
+
+	__unregister_consumer(chnno, consumer);
+	__destroy_buf_queue_manager(chnno);
+	__destory_chn_by_chnno(chnno);
+}
+
+int main(int argc, char *argv[])
+{
+	char path[] = "/tmp/piavbuffer_v4l2_XXXXXX";
+	int buf_nums[] = {2, 3, 4, 5, 7};
+	int i;
+
+	if (__make_file(path) < 0) {
+		printf("Could not write the fake device file\n");
+		return 1;
+	}
+
+	__chn_table_init();
+
+	for (i = 0; i < (int)(sizeof(buf_nums) / sizeof(buf_nums[0])); i++)
+		__run(path, buf_nums[i]);
+
+	__run_destroy_held(path);
+
+	__chn_table_destroy();
+	unlink(path);
+
+	printf("%d errors\n", g_errors);
+
+	return g_errors ? 1 : 0;
+}
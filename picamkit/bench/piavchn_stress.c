@@ -0,0 +1,201 @@
+/*
+ * piavchn_stress.c
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ *
+ * several threads create and destroy channels as fast as they can
+ * while others look random channel numbers up, checks that a channel
+ * number is never handed out twice and that a node found by a lookup
+ * stays live and owned by that number until it is put back, and
+ * reports the lookup rate(build with -fsanitize=address to also catch
+ * a node's attr being freed under a reader)
+ *
+ * build:
+ * gcc -O2 -Iinclude -I../pistream/include bench/piavchn_stress.c \
+ *		src/piavchn.c src/piavbuffer.c src/piv4l2.c \
+ *		../pistream/src/piavscale.c src/pi_pixfmt.c \
+ *		src/pi_pixfmt_x86.c src/pi_pixfmt_neon.c \
+ *		-lswscale -lavformat -lavcodec -lavutil \
+ *		-lpthread -o piavchn_stress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include <libavformat/avformat.h>
+
+#include "pi_errno.h"
+#include "piavchn.h"
+#include "piavisp.h"
+
+
+#define WRITER_NUM		4
+#define READER_NUM		4
+#define CHN_PER_WRITER		200 /* held at once by every writer */
+#define ROUND_NUM		50
+#define STRESS_FPS		31 /* every channel's attr carries it */
+#define HOLD_CHECKS		4
+
+static int g_owner[MAX_CHANNEL_NUM]; /* writer id + 1, 0 is free */
+static int g_errors;
+static int g_stop;
+
+static uint64_t __now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void __error(const char *msg, int chnno)
+{
+	__atomic_add_fetch(&g_errors, 1, __ATOMIC_RELAXED);
+	printf("ERROR %s, channel %d\n", msg, chnno);
+}
+
+static void *writer_thread(void *data)
+{
+	int id = (int)(intptr_t)data;
+	struct pi_av_chn_node *chn_node = NULL;
+	struct pi_frame_attr fattr;
+	int chnno[CHN_PER_WRITER];
+	int expect;
+	int round;
+	int i;
+
+	memset(&fattr, 0, sizeof(fattr));
+	fattr.backend = PI_ISP_BACKEND_LIBAV;
+	fattr.fps = STRESS_FPS;
+
+	for (round = 0; round < ROUND_NUM; round++) {
+		for (i = 0; i < CHN_PER_WRITER; i++) {
+			chnno[i] = __create_chn(PI_AV_ID_VIDEO_ISP, &fattr, NULL);
+			if (chnno[i] < 0) {
+				__error("create fail", chnno[i]);
+				continue;
+			}
+
+			expect = 0;
+			if (!__atomic_compare_exchange_n(&g_owner[chnno[i]],
+					&expect, id + 1, 0, __ATOMIC_ACQ_REL,
+							__ATOMIC_ACQUIRE))
+				__error("number handed out twice", chnno[i]);
+
+			chn_node = __get_chn_by_chnno(chnno[i]);
+			if (chn_node == NULL)
+				__error("own channel not found", chnno[i]);
+			else
+				__put_chn(chn_node);
+		}
+
+		for (i = 0; i < CHN_PER_WRITER; i++) {
+			if (chnno[i] < 0)
+				continue;
+
+			__atomic_store_n(&g_owner[chnno[i]], 0, __ATOMIC_RELEASE);
+			if (__destory_chn_by_chnno(chnno[i]) < 0)
+				__error("destroy fail", chnno[i]);
+		}
+	}
+
+	return NULL;
+}
+
+static void *reader_thread(void *data)
+{
+	struct pi_av_chn_node *chn_node = NULL;
+	struct pi_frame_attr *fattr = NULL;
+	unsigned int rand_seed = (unsigned int)(intptr_t)data;
+	uint64_t *lookups = (uint64_t *)data;
+	uint64_t count = 0;
+	int chnno;
+	int i;
+
+	while (!__atomic_load_n(&g_stop, __ATOMIC_ACQUIRE)) {
+		chnno = rand_r(&rand_seed) % MAX_CHANNEL_NUM;
+		chn_node = __get_chn_by_chnno(chnno);
+		count++;
+		if (chn_node == NULL)
+			continue;
+
+		/* destroy can not release the node while we hold it,
+		 * so it must stay channel chnno with its attr, look at
+		 * it a few times to give a racing destroy the chance */
+		for (i = 0; i < HOLD_CHECKS; i++) {
+			fattr = (struct pi_frame_attr *)__atomic_load_n(
+					&chn_node->attr, __ATOMIC_RELAXED);
+			if (__atomic_load_n(&chn_node->chnno,
+					__ATOMIC_RELAXED) != chnno ||
+					fattr == NULL || fattr->fps != STRESS_FPS) {
+				__error("lookup returned a dead or foreign node",
+									chnno);
+				break;
+			}
+			sched_yield();
+		}
+
+		__put_chn(chn_node);
+	}
+
+	*lookups = count;
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct pi_av_chn_node *chn_node = NULL;
+	pthread_t writers[WRITER_NUM];
+	pthread_t readers[READER_NUM];
+	uint64_t lookups[READER_NUM];
+	uint64_t total = 0;
+	uint64_t begin, end;
+	int i;
+
+	__chn_table_init();
+
+	begin = __now_ns();
+
+	for (i = 0; i < READER_NUM; i++) {
+		lookups[i] = i + 1;
+		pthread_create(&readers[i], NULL, reader_thread, &lookups[i]);
+	}
+	for (i = 0; i < WRITER_NUM; i++)
+		pthread_create(&writers[i], NULL, writer_thread,
+						(void *)(intptr_t)i);
+
+	for (i = 0; i < WRITER_NUM; i++)
+		pthread_join(writers[i], NULL);
+
+	__atomic_store_n(&g_stop, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < READER_NUM; i++) {
+		pthread_join(readers[i], NULL);
+		total += lookups[i];
+	}
+
+	end = __now_ns();
+
+	for (i = 0; i < MAX_CHANNEL_NUM; i++) {
+		chn_node = __get_chn_by_chnno(i);
+		if (chn_node != NULL) {
+			__error("channel leaked", i);
+			__put_chn(chn_node);
+		}
+	}
+
+	printf("%d writers created/destroyed %d channels, "
+		"%d readers did %llu lookups(%.1f M/sec), %d errors\n",
+		WRITER_NUM, WRITER_NUM * CHN_PER_WRITER * ROUND_NUM,
+		READER_NUM, (unsigned long long)total,
+		total * 1000.0 / (double)(end - begin), g_errors);
+
+	__chn_table_destroy();
+
+	return g_errors ? 1 : 0;
+}
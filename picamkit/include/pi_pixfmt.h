@@ -0,0 +1,80 @@
+/*
+ * pi_pixfmt.h
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ *
+ * yuv layout conversion and 2:1 downscale for the capture path,
+ * scalar reference plus SSE2/AVX2/NEON versions picked at runtime,
+ * every version gives bit-exact the same output as the scalar one
+ *
+ */
+
+#ifndef _PI_PIXFMT_H
+#define _PI_PIXFMT_H
+
+#include <stdint.h>
+
+/* planes and strides as in AVFrame.data/linesize,
+ * packed formats(yuyv, nv12 uv) only use the planes they need
+ * @width/@height: luma size, must be even
+ */
+struct pi_image {
+	uint8_t *data[3];
+	int linesize[3];
+	int width;
+	int height;
+};
+
+enum pi_simd_level {
+	PI_SIMD_C = 0,
+	PI_SIMD_SSE2,
+	PI_SIMD_AVX2,
+	PI_SIMD_NEON,
+	PI_SIMD_NUM,
+};
+
+/* row kernels, @n counts output pixels of the row
+ * split_uv/merge_uv: nv12 uv row <-> u and v rows
+ * box_2x2: dst[i] = (s0[2i] + s0[2i+1] + s1[2i] + s1[2i+1] + 2) >> 2
+ * yuyv_to_i420: two yuyv rows to two y rows and one u/v row,
+ * chroma is the rounded average of the two rows, @n is the row width
+ */
+struct pi_pixfmt_ops {
+	const char *name;
+	void (*split_uv)(const uint8_t *uv, uint8_t *u, uint8_t *v, int n);
+	void (*merge_uv)(const uint8_t *u, const uint8_t *v, uint8_t *uv,
+									int n);
+	void (*box_2x2)(const uint8_t *s0, const uint8_t *s1, uint8_t *dst,
+									int n);
+	void (*yuyv_to_i420)(const uint8_t *s0, const uint8_t *s1,
+				uint8_t *y0, uint8_t *y1,
+				uint8_t *u, uint8_t *v, int n);
+};
+
+/* @return: the kernels of @level, NULL if not built in or
+ * the cpu does not have it
+ */
+const struct pi_pixfmt_ops *pi_pixfmt_get_ops(int level);
+
+/* the fastest kernels this cpu runs, resolved on first use */
+const struct pi_pixfmt_ops *pi_pixfmt_best_ops(void);
+
+void pi_nv12_to_i420(const struct pi_image *src, struct pi_image *dst);
+void pi_i420_to_nv12(const struct pi_image *src, struct pi_image *dst);
+void pi_yuyv_to_i420(const struct pi_image *src, struct pi_image *dst);
+/* @dst: half the width and height of @src */
+void pi_i420_downscale_2x(const struct pi_image *src, struct pi_image *dst);
+
+/* scalar reference, also used by the simd versions for the row tail */
+void __pi_split_uv_c(const uint8_t *uv, uint8_t *u, uint8_t *v, int n);
+void __pi_merge_uv_c(const uint8_t *u, const uint8_t *v, uint8_t *uv, int n);
+void __pi_box_2x2_c(const uint8_t *s0, const uint8_t *s1, uint8_t *dst,
+									int n);
+void __pi_yuyv_to_i420_c(const uint8_t *s0, const uint8_t *s1,
+				uint8_t *y0, uint8_t *y1,
+				uint8_t *u, uint8_t *v, int n);
+
+const struct pi_pixfmt_ops *__pi_pixfmt_sse2_ops(void);
+const struct pi_pixfmt_ops *__pi_pixfmt_avx2_ops(void);
+const struct pi_pixfmt_ops *__pi_pixfmt_neon_ops(void);
+
+#endif
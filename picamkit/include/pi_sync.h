@@ -0,0 +1,80 @@
+/*
+ * pi_sync.h
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ *
+ * helpers shared by the lock-free queues and tables
+ */
+
+#ifndef _PI_SYNC_H
+#define _PI_SYNC_H
+
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <linux/futex.h>
+
+#define PI_CACHELINE_SIZE	64
+#define __pi_cacheline_aligned	__attribute__((aligned(PI_CACHELINE_SIZE)))
+
+/* sleep while *uaddr == val
+ * @timeout_ms: < 0 wait forever
+ */
+static inline int pi_futex_wait(unsigned int *uaddr, unsigned int val,
+							int timeout_ms)
+{
+	struct timespec ts;
+	struct timespec *pts = NULL;
+
+	if (timeout_ms >= 0) {
+		ts.tv_sec = timeout_ms / 1000;
+		ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+		pts = &ts;
+	}
+
+	return syscall(SYS_futex, uaddr, FUTEX_WAIT_PRIVATE, val, pts, NULL, 0);
+}
+
+static inline void pi_futex_wake(unsigned int *uaddr)
+{
+	syscall(SYS_futex, uaddr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/* seqlock, @seq is odd while the writer is updating the data
+ * writers must be serialized by the caller,
+ * readers retry instead of blocking the writer:
+ *	do {
+ *		seq = pi_read_seqbegin(&obj->seq);
+ *		copy what is needed out of obj;
+ *	} while (pi_read_seqretry(&obj->seq, seq));
+ */
+static inline unsigned int pi_read_seqbegin(const unsigned int *seq)
+{
+	unsigned int ret;
+
+	while ((ret = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1)
+		sched_yield();
+
+	return ret;
+}
+
+static inline int pi_read_seqretry(const unsigned int *seq, unsigned int start)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(seq, __ATOMIC_RELAXED) != start;
+}
+
+static inline void pi_write_seqbegin(unsigned int *seq)
+{
+	__atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void pi_write_seqend(unsigned int *seq)
+{
+	__atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+#endif
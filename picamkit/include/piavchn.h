@@ -7,13 +7,17 @@
 #ifndef _PIAVCHN_H
 #define _PIAVCHN_H
 
-#include "pi_circle_queue.h"
+#include <pthread.h>
+
+#include "pi_sync.h"
+#include "piavbuffer.h"
 
 enum chn_type {
 	/* video */
 	PI_AV_ID_VIDEO_ISP,
 	PI_AV_ID_VIDEO_H264,
 	PI_AV_ID_VIDEO_MJPEG,
+	PI_AV_ID_VIDEO_SCALE, /* rendition scaled from an isp channel */
 
 	/* audio */
 	PI_AV_ID_AUDIO_CAPTURE,
@@ -24,28 +28,50 @@ enum chn_type {
 	PI_AV_ID_NULL,
 };
 
+/* nodes live in the channel table for the whole process,
+ * a lookup takes a reference, attr/ctx/fanout are only released
+ * once every reference is put back
+ * @seq: seqlock, odd while create/destroy rewrites the node
+ * @users: references taken by [__get_chn_by_chnno]
+ * @wait_users: destroy sleeps on @users until it drops to this,
+ * CHN_NO_WAITER when nobody waits
+ */
 struct pi_av_chn_node {
-	struct list_head list;
+	unsigned int seq __pi_cacheline_aligned;
+	unsigned int users;
+	unsigned int wait_users;
 	int chnno;
 	enum chn_type type;
 	int stat; /* 0,disable/1,enable */
 	void *attr;
 	void *ctx;
-	struct pi_av_circle_queue *buf_queue;
+	struct pi_av_fanout *fanout;
 	pthread_t work_thread;
 };
 
-/* channel number range:0~1023, channel 1024 is null */
+#define CHN_NO_WAITER (~0U)
+
+/* channel number range:0~1023, chnno is the index into the table */
 #define MAX_CHANNEL_NUM 1024
+#define CHN_BITS_PER_WORD (8 * sizeof(unsigned long))
+#define CHN_BITMAP_WORDS (MAX_CHANNEL_NUM / CHN_BITS_PER_WORD)
 
-struct pi_chn_list {
-	struct list_head head;
-	int max_operator_num;
+/* @bitmap: a set bit means the channel number is taken,
+ * @mutex: serializes create/destroy, lookups never take it
+ */
+struct pi_chn_table {
+	pthread_mutex_t mutex;
+	unsigned long bitmap[CHN_BITMAP_WORDS];
+	struct pi_av_chn_node nodes[MAX_CHANNEL_NUM];
 };
 
-int  __chn_list_init();
-void __chn_list_destroy();
-struct pi_av_chn_node *__find_chn_by_chnno(int chnno);
+int  __chn_table_init();
+void __chn_table_destroy();
+struct pi_av_chn_node *__get_chn_by_chnno(int chnno);
+void __put_chn(struct pi_av_chn_node *chn_node);
+void __wait_chn_users(struct pi_av_chn_node *chn_node, unsigned int users);
+struct pi_av_fanout *__set_chn_fanout(struct pi_av_chn_node *chn_node,
+					struct pi_av_fanout *fanout);
 int __create_chn(int id, void *attr, void *ctx);
 int __destory_chn_by_chnno(int chnno);
 
@@ -0,0 +1,56 @@
+/*
+ * piv4l2.h
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ *
+ */
+
+#ifndef _PIV4L2_H
+#define _PIV4L2_H
+
+#include <stddef.h>
+
+/* @start/@length: kernel buffer mapped into user space
+ * @dmabuf_fd: exported dmabuf, -1 if the driver could not export it
+ */
+struct pi_v4l2_buf {
+	void *start;
+	size_t length;
+	int dmabuf_fd;
+};
+
+/* @path: a v4l2 capture node(e.g. /dev/video0 or vivid),
+ * or a regular file of raw frames which is played back in a loop
+ * with the same qbuf/dqbuf semantics, for tests without a camera
+ */
+struct pi_v4l2_dev {
+	int fd;
+	int is_file;
+	unsigned int pixfmt; /* V4L2_PIX_FMT_XXX */
+	int width;
+	int height;
+	int fps;
+	int frame_len;
+	int buf_num;
+	struct pi_v4l2_buf *bufs;
+	/* file backed device only, queued buffer indexes in order */
+	int *fifo;
+	int fifo_head;
+	int fifo_count;
+	long long next_frame_us;
+};
+
+/* @buf_num: in/out, the driver may give a different number of buffers */
+int pi_v4l2_open(struct pi_v4l2_dev *dev, const char *path,
+			unsigned int pixfmt, int width, int height,
+			int fps, int *buf_num);
+void pi_v4l2_close(struct pi_v4l2_dev *dev);
+int pi_v4l2_streamon(struct pi_v4l2_dev *dev);
+int pi_v4l2_streamoff(struct pi_v4l2_dev *dev);
+int pi_v4l2_qbuf(struct pi_v4l2_dev *dev, int index);
+
+/* @return: index of the filled buffer,
+ * -PI_E_EMPTY on timeout, other < 0 on error
+ */
+int pi_v4l2_dqbuf(struct pi_v4l2_dev *dev, int *bytesused, int timeout_ms);
+
+#endif
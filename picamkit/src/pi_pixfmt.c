@@ -0,0 +1,197 @@
+/*
+ * pi_pixfmt.c
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ *
+ * scalar kernels, runtime dispatch and the frame level helpers
+ *
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "pi_pixfmt.h"
+
+
+void __pi_split_uv_c(const uint8_t *uv, uint8_t *u, uint8_t *v, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		u[i] = uv[2 * i];
+		v[i] = uv[2 * i + 1];
+	}
+}
+
+void __pi_merge_uv_c(const uint8_t *u, const uint8_t *v, uint8_t *uv, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		uv[2 * i] = u[i];
+		uv[2 * i + 1] = v[i];
+	}
+}
+
+void __pi_box_2x2_c(const uint8_t *s0, const uint8_t *s1, uint8_t *dst,
+									int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = (s0[2 * i] + s0[2 * i + 1] +
+				s1[2 * i] + s1[2 * i + 1] + 2) >> 2;
+}
+
+void __pi_yuyv_to_i420_c(const uint8_t *s0, const uint8_t *s1,
+				uint8_t *y0, uint8_t *y1,
+				uint8_t *u, uint8_t *v, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i += 2) {
+		y0[i] = s0[2 * i];
+		y0[i + 1] = s0[2 * i + 2];
+		y1[i] = s1[2 * i];
+		y1[i + 1] = s1[2 * i + 2];
+		u[i / 2] = (s0[2 * i + 1] + s1[2 * i + 1] + 1) >> 1;
+		v[i / 2] = (s0[2 * i + 3] + s1[2 * i + 3] + 1) >> 1;
+	}
+}
+
+static const struct pi_pixfmt_ops g_c_ops = {
+	.name = "c",
+	.split_uv = __pi_split_uv_c,
+	.merge_uv = __pi_merge_uv_c,
+	.box_2x2 = __pi_box_2x2_c,
+	.yuyv_to_i420 = __pi_yuyv_to_i420_c,
+};
+
+const struct pi_pixfmt_ops *pi_pixfmt_get_ops(int level)
+{
+	switch (level) {
+		case PI_SIMD_C:
+			return &g_c_ops;
+		case PI_SIMD_SSE2:
+			return __pi_pixfmt_sse2_ops();
+		case PI_SIMD_AVX2:
+			return __pi_pixfmt_avx2_ops();
+		case PI_SIMD_NEON:
+			return __pi_pixfmt_neon_ops();
+		default:
+			return NULL;
+	}
+}
+
+static const struct pi_pixfmt_ops *g_best_ops;
+static pthread_once_t g_best_once = PTHREAD_ONCE_INIT;
+
+static void __pick_best_ops(void)
+{
+	static const int order[] = {PI_SIMD_AVX2, PI_SIMD_SSE2, PI_SIMD_NEON};
+	const struct pi_pixfmt_ops *ops = NULL;
+	unsigned int i;
+
+	g_best_ops = &g_c_ops;
+
+	for (i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+		ops = pi_pixfmt_get_ops(order[i]);
+		if (ops != NULL) {
+			g_best_ops = ops;
+			break;
+		}
+	}
+}
+
+const struct pi_pixfmt_ops *pi_pixfmt_best_ops(void)
+{
+	pthread_once(&g_best_once, __pick_best_ops);
+
+	return g_best_ops;
+}
+
+static void __copy_plane(const uint8_t *src, int src_stride,
+			uint8_t *dst, int dst_stride, int width, int height)
+{
+	int y;
+
+	if (src_stride == dst_stride && src_stride == width) {
+		memcpy(dst, src, (size_t)width * height);
+		return;
+	}
+
+	for (y = 0; y < height; y++)
+		memcpy(dst + (size_t)y * dst_stride,
+				src + (size_t)y * src_stride, width);
+}
+
+void pi_nv12_to_i420(const struct pi_image *src, struct pi_image *dst)
+{
+	const struct pi_pixfmt_ops *ops = pi_pixfmt_best_ops();
+	int y;
+
+	__copy_plane(src->data[0], src->linesize[0], dst->data[0],
+			dst->linesize[0], src->width, src->height);
+
+	for (y = 0; y < src->height / 2; y++)
+		ops->split_uv(src->data[1] + (size_t)y * src->linesize[1],
+				dst->data[1] + (size_t)y * dst->linesize[1],
+				dst->data[2] + (size_t)y * dst->linesize[2],
+							src->width / 2);
+}
+
+void pi_i420_to_nv12(const struct pi_image *src, struct pi_image *dst)
+{
+	const struct pi_pixfmt_ops *ops = pi_pixfmt_best_ops();
+	int y;
+
+	__copy_plane(src->data[0], src->linesize[0], dst->data[0],
+			dst->linesize[0], src->width, src->height);
+
+	for (y = 0; y < src->height / 2; y++)
+		ops->merge_uv(src->data[1] + (size_t)y * src->linesize[1],
+				src->data[2] + (size_t)y * src->linesize[2],
+				dst->data[1] + (size_t)y * dst->linesize[1],
+							src->width / 2);
+}
+
+void pi_yuyv_to_i420(const struct pi_image *src, struct pi_image *dst)
+{
+	const struct pi_pixfmt_ops *ops = pi_pixfmt_best_ops();
+	const uint8_t *s0 = NULL;
+	uint8_t *y0 = NULL;
+	int y;
+
+	for (y = 0; y < src->height; y += 2) {
+		s0 = src->data[0] + (size_t)y * src->linesize[0];
+		y0 = dst->data[0] + (size_t)y * dst->linesize[0];
+		ops->yuyv_to_i420(s0, s0 + src->linesize[0],
+				y0, y0 + dst->linesize[0],
+				dst->data[1] + (size_t)(y / 2) * dst->linesize[1],
+				dst->data[2] + (size_t)(y / 2) * dst->linesize[2],
+								src->width);
+	}
+}
+
+void pi_i420_downscale_2x(const struct pi_image *src, struct pi_image *dst)
+{
+	const struct pi_pixfmt_ops *ops = pi_pixfmt_best_ops();
+	const uint8_t *s0 = NULL;
+	int plane;
+	int width;
+	int height;
+	int y;
+
+	for (plane = 0; plane < 3; plane++) {
+		width = plane ? dst->width / 2 : dst->width;
+		height = plane ? dst->height / 2 : dst->height;
+
+		for (y = 0; y < height; y++) {
+			s0 = src->data[plane] +
+				(size_t)(2 * y) * src->linesize[plane];
+			ops->box_2x2(s0, s0 + src->linesize[plane],
+				dst->data[plane] +
+				(size_t)y * dst->linesize[plane], width);
+		}
+	}
+}
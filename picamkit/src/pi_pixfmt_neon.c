@@ -0,0 +1,126 @@
+/*
+ * pi_pixfmt_neon.c
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ *
+ * NEON kernels, always there on aarch64, on armv7 the file has to be
+ * built with -mfpu=neon and the cpu is still checked through hwcap
+ *
+ */
+
+#include <stddef.h>
+
+#include "pi_pixfmt.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+#if !defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+
+/* 16 output pixels per loop, vld2/vst2 do the (de)interleave */
+
+static void __split_uv_neon(const uint8_t *uv, uint8_t *u, uint8_t *v, int n)
+{
+	uint8x16x2_t c;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		c = vld2q_u8(uv + 2 * i);
+		vst1q_u8(u + i, c.val[0]);
+		vst1q_u8(v + i, c.val[1]);
+	}
+
+	__pi_split_uv_c(uv + 2 * i, u + i, v + i, n - i);
+}
+
+static void __merge_uv_neon(const uint8_t *u, const uint8_t *v,
+						uint8_t *uv, int n)
+{
+	uint8x16x2_t c;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		c.val[0] = vld1q_u8(u + i);
+		c.val[1] = vld1q_u8(v + i);
+		vst2q_u8(uv + 2 * i, c);
+	}
+
+	__pi_merge_uv_c(u + i, v + i, uv + 2 * i, n - i);
+}
+
+/* pairwise widening add of both rows, then (sum + 2) >> 2 */
+static void __box_2x2_neon(const uint8_t *s0, const uint8_t *s1,
+						uint8_t *dst, int n)
+{
+	uint16x8_t lo, hi;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		lo = vpaddlq_u8(vld1q_u8(s0 + 2 * i));
+		lo = vpadalq_u8(lo, vld1q_u8(s1 + 2 * i));
+		hi = vpaddlq_u8(vld1q_u8(s0 + 2 * i + 16));
+		hi = vpadalq_u8(hi, vld1q_u8(s1 + 2 * i + 16));
+		vst1q_u8(dst + i, vcombine_u8(vrshrn_n_u16(lo, 2),
+						vrshrn_n_u16(hi, 2)));
+	}
+
+	__pi_box_2x2_c(s0 + 2 * i, s1 + 2 * i, dst + i, n - i);
+}
+
+/* vld4 splits 32 yuyv pixels into y even/u/y odd/v */
+static void __yuyv_to_i420_neon(const uint8_t *s0, const uint8_t *s1,
+					uint8_t *y0, uint8_t *y1,
+					uint8_t *u, uint8_t *v, int n)
+{
+	uint8x16x4_t a, b;
+	uint8x16x2_t y;
+	int i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		a = vld4q_u8(s0 + 2 * i);
+		b = vld4q_u8(s1 + 2 * i);
+
+		y.val[0] = a.val[0];
+		y.val[1] = a.val[2];
+		vst2q_u8(y0 + i, y);
+		y.val[0] = b.val[0];
+		y.val[1] = b.val[2];
+		vst2q_u8(y1 + i, y);
+
+		vst1q_u8(u + i / 2, vrhaddq_u8(a.val[1], b.val[1]));
+		vst1q_u8(v + i / 2, vrhaddq_u8(a.val[3], b.val[3]));
+	}
+
+	__pi_yuyv_to_i420_c(s0 + 2 * i, s1 + 2 * i, y0 + i, y1 + i,
+					u + i / 2, v + i / 2, n - i);
+}
+
+static const struct pi_pixfmt_ops g_neon_ops = {
+	.name = "neon",
+	.split_uv = __split_uv_neon,
+	.merge_uv = __merge_uv_neon,
+	.box_2x2 = __box_2x2_neon,
+	.yuyv_to_i420 = __yuyv_to_i420_neon,
+};
+
+const struct pi_pixfmt_ops *__pi_pixfmt_neon_ops(void)
+{
+#if !defined(__aarch64__)
+	if (!(getauxval(AT_HWCAP) & HWCAP_NEON))
+		return NULL;
+#endif
+
+	return &g_neon_ops;
+}
+
+#else
+
+const struct pi_pixfmt_ops *__pi_pixfmt_neon_ops(void)
+{
+	return NULL;
+}
+
+#endif
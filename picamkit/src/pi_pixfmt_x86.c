@@ -0,0 +1,305 @@
+/*
+ * pi_pixfmt_x86.c
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ *
+ * SSE2 and AVX2 kernels, built through target attributes so the file
+ * needs no extra compiler flags, AVX2 is only used when cpuid has it
+ *
+ */
+
+#include <stddef.h>
+
+#include "pi_pixfmt.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#define __sse2	__attribute__((target("sse2")))
+#define __avx2	__attribute__((target("avx2")))
+
+
+/* SSE2, 16 output pixels per loop */
+
+static __sse2 void __split_uv_sse2(const uint8_t *uv, uint8_t *u, uint8_t *v,
+									int n)
+{
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	__m128i a, b;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		a = _mm_loadu_si128((const __m128i *)(uv + 2 * i));
+		b = _mm_loadu_si128((const __m128i *)(uv + 2 * i + 16));
+		_mm_storeu_si128((__m128i *)(u + i),
+				_mm_packus_epi16(_mm_and_si128(a, mask),
+						_mm_and_si128(b, mask)));
+		_mm_storeu_si128((__m128i *)(v + i),
+				_mm_packus_epi16(_mm_srli_epi16(a, 8),
+						_mm_srli_epi16(b, 8)));
+	}
+
+	__pi_split_uv_c(uv + 2 * i, u + i, v + i, n - i);
+}
+
+static __sse2 void __merge_uv_sse2(const uint8_t *u, const uint8_t *v,
+						uint8_t *uv, int n)
+{
+	__m128i a, b;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		a = _mm_loadu_si128((const __m128i *)(u + i));
+		b = _mm_loadu_si128((const __m128i *)(v + i));
+		_mm_storeu_si128((__m128i *)(uv + 2 * i),
+					_mm_unpacklo_epi8(a, b));
+		_mm_storeu_si128((__m128i *)(uv + 2 * i + 16),
+					_mm_unpackhi_epi8(a, b));
+	}
+
+	__pi_merge_uv_c(u + i, v + i, uv + 2 * i, n - i);
+}
+
+/* sum of the two bytes of every 16 bit lane */
+static __sse2 inline __m128i __pair_sum_sse2(__m128i a)
+{
+	return _mm_add_epi16(_mm_and_si128(a, _mm_set1_epi16(0x00ff)),
+						_mm_srli_epi16(a, 8));
+}
+
+static __sse2 void __box_2x2_sse2(const uint8_t *s0, const uint8_t *s1,
+						uint8_t *dst, int n)
+{
+	const __m128i two = _mm_set1_epi16(2);
+	__m128i lo, hi;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		lo = _mm_add_epi16(
+			__pair_sum_sse2(_mm_loadu_si128(
+				(const __m128i *)(s0 + 2 * i))),
+			__pair_sum_sse2(_mm_loadu_si128(
+				(const __m128i *)(s1 + 2 * i))));
+		hi = _mm_add_epi16(
+			__pair_sum_sse2(_mm_loadu_si128(
+				(const __m128i *)(s0 + 2 * i + 16))),
+			__pair_sum_sse2(_mm_loadu_si128(
+				(const __m128i *)(s1 + 2 * i + 16))));
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+		_mm_storeu_si128((__m128i *)(dst + i),
+					_mm_packus_epi16(lo, hi));
+	}
+
+	__pi_box_2x2_c(s0 + 2 * i, s1 + 2 * i, dst + i, n - i);
+}
+
+static __sse2 void __yuyv_to_i420_sse2(const uint8_t *s0, const uint8_t *s1,
+					uint8_t *y0, uint8_t *y1,
+					uint8_t *u, uint8_t *v, int n)
+{
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a0, a1, b0, b1, c;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		a0 = _mm_loadu_si128((const __m128i *)(s0 + 2 * i));
+		a1 = _mm_loadu_si128((const __m128i *)(s0 + 2 * i + 16));
+		b0 = _mm_loadu_si128((const __m128i *)(s1 + 2 * i));
+		b1 = _mm_loadu_si128((const __m128i *)(s1 + 2 * i + 16));
+
+		_mm_storeu_si128((__m128i *)(y0 + i),
+				_mm_packus_epi16(_mm_and_si128(a0, mask),
+						_mm_and_si128(a1, mask)));
+		_mm_storeu_si128((__m128i *)(y1 + i),
+				_mm_packus_epi16(_mm_and_si128(b0, mask),
+						_mm_and_si128(b1, mask)));
+
+		/* uvuv.. of both rows, averaged like the scalar one */
+		c = _mm_avg_epu8(
+			_mm_packus_epi16(_mm_srli_epi16(a0, 8),
+					_mm_srli_epi16(a1, 8)),
+			_mm_packus_epi16(_mm_srli_epi16(b0, 8),
+					_mm_srli_epi16(b1, 8)));
+
+		_mm_storel_epi64((__m128i *)(u + i / 2),
+			_mm_packus_epi16(_mm_and_si128(c, mask), zero));
+		_mm_storel_epi64((__m128i *)(v + i / 2),
+			_mm_packus_epi16(_mm_srli_epi16(c, 8), zero));
+	}
+
+	__pi_yuyv_to_i420_c(s0 + 2 * i, s1 + 2 * i, y0 + i, y1 + i,
+					u + i / 2, v + i / 2, n - i);
+}
+
+/* AVX2, 32 output pixels per loop,
+ * pack/unpack work per 128 bit lane, the permutes put lanes in order */
+
+static __avx2 void __split_uv_avx2(const uint8_t *uv, uint8_t *u, uint8_t *v,
+									int n)
+{
+	const __m256i mask = _mm256_set1_epi16(0x00ff);
+	__m256i a, b;
+	int i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		a = _mm256_loadu_si256((const __m256i *)(uv + 2 * i));
+		b = _mm256_loadu_si256((const __m256i *)(uv + 2 * i + 32));
+		_mm256_storeu_si256((__m256i *)(u + i),
+			_mm256_permute4x64_epi64(
+				_mm256_packus_epi16(_mm256_and_si256(a, mask),
+					_mm256_and_si256(b, mask)), 0xd8));
+		_mm256_storeu_si256((__m256i *)(v + i),
+			_mm256_permute4x64_epi64(
+				_mm256_packus_epi16(_mm256_srli_epi16(a, 8),
+					_mm256_srli_epi16(b, 8)), 0xd8));
+	}
+
+	__split_uv_sse2(uv + 2 * i, u + i, v + i, n - i);
+}
+
+static __avx2 void __merge_uv_avx2(const uint8_t *u, const uint8_t *v,
+						uint8_t *uv, int n)
+{
+	__m256i a, b, lo, hi;
+	int i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		a = _mm256_loadu_si256((const __m256i *)(u + i));
+		b = _mm256_loadu_si256((const __m256i *)(v + i));
+		lo = _mm256_unpacklo_epi8(a, b);
+		hi = _mm256_unpackhi_epi8(a, b);
+		_mm256_storeu_si256((__m256i *)(uv + 2 * i),
+				_mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i *)(uv + 2 * i + 32),
+				_mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+
+	__merge_uv_sse2(u + i, v + i, uv + 2 * i, n - i);
+}
+
+static __avx2 inline __m256i __pair_sum_avx2(__m256i a)
+{
+	return _mm256_add_epi16(_mm256_and_si256(a,
+					_mm256_set1_epi16(0x00ff)),
+						_mm256_srli_epi16(a, 8));
+}
+
+static __avx2 void __box_2x2_avx2(const uint8_t *s0, const uint8_t *s1,
+						uint8_t *dst, int n)
+{
+	const __m256i two = _mm256_set1_epi16(2);
+	__m256i lo, hi;
+	int i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		lo = _mm256_add_epi16(
+			__pair_sum_avx2(_mm256_loadu_si256(
+				(const __m256i *)(s0 + 2 * i))),
+			__pair_sum_avx2(_mm256_loadu_si256(
+				(const __m256i *)(s1 + 2 * i))));
+		hi = _mm256_add_epi16(
+			__pair_sum_avx2(_mm256_loadu_si256(
+				(const __m256i *)(s0 + 2 * i + 32))),
+			__pair_sum_avx2(_mm256_loadu_si256(
+				(const __m256i *)(s1 + 2 * i + 32))));
+		lo = _mm256_srli_epi16(_mm256_add_epi16(lo, two), 2);
+		hi = _mm256_srli_epi16(_mm256_add_epi16(hi, two), 2);
+		_mm256_storeu_si256((__m256i *)(dst + i),
+			_mm256_permute4x64_epi64(
+				_mm256_packus_epi16(lo, hi), 0xd8));
+	}
+
+	__box_2x2_sse2(s0 + 2 * i, s1 + 2 * i, dst + i, n - i);
+}
+
+static __avx2 void __yuyv_to_i420_avx2(const uint8_t *s0, const uint8_t *s1,
+					uint8_t *y0, uint8_t *y1,
+					uint8_t *u, uint8_t *v, int n)
+{
+	const __m256i mask = _mm256_set1_epi16(0x00ff);
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i a0, a1, b0, b1, c;
+	int i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		a0 = _mm256_loadu_si256((const __m256i *)(s0 + 2 * i));
+		a1 = _mm256_loadu_si256((const __m256i *)(s0 + 2 * i + 32));
+		b0 = _mm256_loadu_si256((const __m256i *)(s1 + 2 * i));
+		b1 = _mm256_loadu_si256((const __m256i *)(s1 + 2 * i + 32));
+
+		_mm256_storeu_si256((__m256i *)(y0 + i),
+			_mm256_permute4x64_epi64(
+				_mm256_packus_epi16(_mm256_and_si256(a0, mask),
+					_mm256_and_si256(a1, mask)), 0xd8));
+		_mm256_storeu_si256((__m256i *)(y1 + i),
+			_mm256_permute4x64_epi64(
+				_mm256_packus_epi16(_mm256_and_si256(b0, mask),
+					_mm256_and_si256(b1, mask)), 0xd8));
+
+		c = _mm256_avg_epu8(
+			_mm256_permute4x64_epi64(
+				_mm256_packus_epi16(_mm256_srli_epi16(a0, 8),
+					_mm256_srli_epi16(a1, 8)), 0xd8),
+			_mm256_permute4x64_epi64(
+				_mm256_packus_epi16(_mm256_srli_epi16(b0, 8),
+					_mm256_srli_epi16(b1, 8)), 0xd8));
+
+		_mm_storeu_si128((__m128i *)(u + i / 2),
+			_mm256_castsi256_si128(_mm256_permute4x64_epi64(
+				_mm256_packus_epi16(_mm256_and_si256(c, mask),
+							zero), 0xd8)));
+		_mm_storeu_si128((__m128i *)(v + i / 2),
+			_mm256_castsi256_si128(_mm256_permute4x64_epi64(
+				_mm256_packus_epi16(_mm256_srli_epi16(c, 8),
+							zero), 0xd8)));
+	}
+
+	__yuyv_to_i420_sse2(s0 + 2 * i, s1 + 2 * i, y0 + i, y1 + i,
+					u + i / 2, v + i / 2, n - i);
+}
+
+static const struct pi_pixfmt_ops g_sse2_ops = {
+	.name = "sse2",
+	.split_uv = __split_uv_sse2,
+	.merge_uv = __merge_uv_sse2,
+	.box_2x2 = __box_2x2_sse2,
+	.yuyv_to_i420 = __yuyv_to_i420_sse2,
+};
+
+static const struct pi_pixfmt_ops g_avx2_ops = {
+	.name = "avx2",
+	.split_uv = __split_uv_avx2,
+	.merge_uv = __merge_uv_avx2,
+	.box_2x2 = __box_2x2_avx2,
+	.yuyv_to_i420 = __yuyv_to_i420_avx2,
+};
+
+const struct pi_pixfmt_ops *__pi_pixfmt_sse2_ops(void)
+{
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports("sse2") ? &g_sse2_ops : NULL;
+}
+
+const struct pi_pixfmt_ops *__pi_pixfmt_avx2_ops(void)
+{
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports("avx2") ? &g_avx2_ops : NULL;
+}
+
+#else
+
+const struct pi_pixfmt_ops *__pi_pixfmt_sse2_ops(void)
+{
+	return NULL;
+}
+
+const struct pi_pixfmt_ops *__pi_pixfmt_avx2_ops(void)
+{
+	return NULL;
+}
+
+#endif
@@ -2,204 +2,706 @@
  * piavbuffer.c
  * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
  *
+ * one capture thread fans every frame out to all registered consumers,
+ * a frame is only handed back to the capture thread when the last
+ * consumer holding it calls buffer->recycle()
+ *
  */
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <libavformat/avformat.h>
 
 #include "piavchn.h"
+#include "piavisp.h"
 #include "piavbuffer.h"
+#include "piavscale.h"
+#include "piv4l2.h"
 #include "pi_errno.h"
 
+
+/* the decrement is the last access to the ring, once the count is 0
+ * destroy may free it, the wake only uses the address(private futex) */
+static void __release_buffer(struct pi_av_buffer_ex *buffer_ex)
+{
+	if (__atomic_sub_fetch(&buffer_ex->user_count, 1, __ATOMIC_SEQ_CST) ==
+							PI_AV_BUFFER_WAITING)
+		pi_futex_wake(&buffer_ex->user_count);
+}
+
+/* sleep until the consumers gave @buffer_ex back or @timeout_ms passed,
+ * only one thread at a time may wait on a buffer */
+static void __wait_buffer(struct pi_av_buffer_ex *buffer_ex, int timeout_ms)
+{
+	unsigned int user_count;
+
+	user_count = __atomic_or_fetch(&buffer_ex->user_count,
+				PI_AV_BUFFER_WAITING, __ATOMIC_SEQ_CST);
+	if (user_count != PI_AV_BUFFER_WAITING)
+		pi_futex_wait(&buffer_ex->user_count, user_count, timeout_ms);
+	__atomic_and_fetch(&buffer_ex->user_count, ~PI_AV_BUFFER_WAITING,
+							__ATOMIC_SEQ_CST);
+}
+
+/* called by consumer once it is done with the frame */
 void buffer_recycle(struct pi_av_buffer_ex *buffer_ex)
 {
-	pi_circle_queue_pop(buffer_ex->buf_queue);
+	__release_buffer(buffer_ex);
+}
+
+/* take the frame @buffer_ex back from consumer @id if it has not read it,
+ * frames older than buffer_ex->seq are already gone from the ring,
+ * so a cursor at or before it means this is its oldest unread frame
+ */
+static void __reclaim_buffer(struct pi_av_fanout *fanout, int id,
+					struct pi_av_buffer_ex *buffer_ex)
+{
+	struct pi_av_consumer *consumer = &fanout->consumers[id];
+	unsigned int seq = buffer_ex->seq;
+	unsigned int cursor;
+
+	cursor = __atomic_load_n(&consumer->cursor, __ATOMIC_ACQUIRE);
+	if ((int)(cursor - seq) > 0)
+		return;
+
+	/* lose the race means the consumer just took it */
+	if (!__atomic_compare_exchange_n(&consumer->cursor, &cursor, seq + 1,
+				0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		return;
+
+	consumer->drop_count++;
+	__release_buffer(buffer_ex);
+}
+
+/* capture thread: get the buffer for frame @seq,
+ * drop-oldest(and unregistered) consumers lose their unread frame,
+ * blocking consumers and frames being read make us wait
+ * @return: NULL once @stat is cleared
+ */
+struct pi_av_buffer_ex *__fanout_get_buffer(struct pi_av_fanout *fanout,
+						unsigned int seq, int *stat)
+{
+	struct pi_av_buffer_ex *buffer_ex = NULL;
+	struct pi_av_consumer *consumer = NULL;
+	int i;
+
+	buffer_ex = &fanout->buffers[seq & fanout->mask];
+
+	while (__atomic_load_n(&buffer_ex->user_count, __ATOMIC_ACQUIRE)) {
+		for (i = 0; i < PI_AV_MAX_CONSUMER; i++) {
+			consumer = &fanout->consumers[i];
+			if (!(buffer_ex->consumer_mask & (1U << i)))
+				continue;
+			if (consumer->active &&
+				consumer->policy == PI_AV_CONSUMER_BLOCK)
+				continue;
+			__reclaim_buffer(fanout, i, buffer_ex);
+		}
+
+		__wait_buffer(buffer_ex, 100);
+
+		if (!*stat)
+			return NULL;
+	}
+
+	return buffer_ex;
+}
+
+/* capture thread: hand the filled buffer to every registered consumer */
+void __fanout_publish(struct pi_av_fanout *fanout,
+				struct pi_av_buffer_ex *buffer_ex)
+{
+	unsigned int seq = fanout->write_seq;
+	unsigned int mask;
+
+	mask = __atomic_load_n(&fanout->consumer_mask, __ATOMIC_ACQUIRE);
+
+	buffer_ex->seq = seq;
+	buffer_ex->consumer_mask = mask;
+	__atomic_store_n(&buffer_ex->user_count,
+				__builtin_popcount(mask), __ATOMIC_RELAXED);
+
+	__atomic_store_n(&fanout->write_seq, seq + 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&fanout->read_waiting, __ATOMIC_SEQ_CST)) {
+		__atomic_add_fetch(&fanout->wake_seq, 1, __ATOMIC_SEQ_CST);
+		pi_futex_wake(&fanout->wake_seq);
+	}
+}
+
+/* capture thread: move past a frame nobody should see,
+ * e.g. while the channel is stopped or the driver flagged it bad */
+static void __fanout_skip(struct pi_av_fanout *fanout,
+				struct pi_av_buffer_ex *buffer_ex)
+{
+	unsigned int seq = fanout->write_seq;
+
+	buffer_ex->seq = seq;
+	buffer_ex->consumer_mask = 0;
+	__atomic_store_n(&buffer_ex->user_count, 0, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&fanout->write_seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/* consumer: wait for and take the next frame,
+ * give it back with buffer_ex->recycle(buffer_ex)
+ * @return: PI_OK, -PI_E_EMPTY on timeout,
+ * -PI_E_NOT_FOUND once the ring is being destroyed
+ */
+static int __fanout_get_frame(struct pi_av_fanout *fanout, int id,
+				struct pi_av_buffer_ex **buffer,
+				int timeout_ms)
+{
+	struct pi_av_consumer *consumer = &fanout->consumers[id];
+	struct pi_av_buffer_ex *buffer_ex = NULL;
+	unsigned int cursor;
+	unsigned int write_seq;
+	unsigned int wake_seq;
+
+	while (1) {
+		cursor = __atomic_load_n(&consumer->cursor, __ATOMIC_ACQUIRE);
+		write_seq = __atomic_load_n(&fanout->write_seq,
+							__ATOMIC_ACQUIRE);
+
+		/* publish and destroy bump wake_seq after they changed
+		 * what we check, so a wake up between is not lost */
+		if (cursor == write_seq) {
+			wake_seq = __atomic_load_n(&fanout->wake_seq,
+							__ATOMIC_SEQ_CST);
+			__atomic_add_fetch(&fanout->read_waiting, 1,
+							__ATOMIC_SEQ_CST);
+			write_seq = __atomic_load_n(&fanout->write_seq,
+							__ATOMIC_SEQ_CST);
+			if (cursor == write_seq && __atomic_load_n(
+					&fanout->working, __ATOMIC_SEQ_CST))
+				pi_futex_wait(&fanout->wake_seq, wake_seq,
+								timeout_ms);
+			__atomic_sub_fetch(&fanout->read_waiting, 1,
+							__ATOMIC_SEQ_CST);
+
+			write_seq = __atomic_load_n(&fanout->write_seq,
+							__ATOMIC_ACQUIRE);
+			if (cursor != write_seq)
+				continue;
+			if (!__atomic_load_n(&fanout->working, __ATOMIC_ACQUIRE))
+				return -PI_E_NOT_FOUND;
+			return -PI_E_EMPTY;
+		}
+
+		buffer_ex = &fanout->buffers[cursor & fanout->mask];
+
+		/* capture thread may have dropped it meanwhile */
+		if (!__atomic_compare_exchange_n(&consumer->cursor, &cursor,
+					cursor + 1, 0, __ATOMIC_ACQ_REL,
+							__ATOMIC_ACQUIRE))
+			continue;
+
+		/* our reference pins the buffer, so seq is stable here,
+		 * frames published before we registered are skipped */
+		if (buffer_ex->seq == cursor &&
+				(buffer_ex->consumer_mask & (1U << id))) {
+			*buffer = buffer_ex;
+			return PI_OK;
+		}
+	}
+}
+
+/* a consumer slot can be reused once no buffer still carries
+ * an unread frame published to its previous owner */
+static int __consumer_slot_is_clean(struct pi_av_fanout *fanout, int id)
+{
+	struct pi_av_buffer_ex *buffer_ex = NULL;
+	unsigned int cursor = fanout->consumers[id].cursor;
+	int i;
+
+	for (i = 0; i < fanout->size; i++) {
+		buffer_ex = &fanout->buffers[i];
+		if (!(__atomic_load_n(&buffer_ex->user_count, __ATOMIC_ACQUIRE) &
+						~PI_AV_BUFFER_WAITING))
+			continue;
+		if ((buffer_ex->consumer_mask & (1U << id)) &&
+				(int)(buffer_ex->seq - cursor) >= 0)
+			return 0;
+	}
+
+	return 1;
+}
+
+static int __fanout_add_consumer(struct pi_av_fanout *fanout, int policy)
+{
+	struct pi_av_consumer *consumer = NULL;
+	int id = -PI_E_FULL;
+	int i;
+
+	pthread_mutex_lock(&fanout->mutex);
+
+	for (i = 0; i < PI_AV_MAX_CONSUMER; i++) {
+		consumer = &fanout->consumers[i];
+		if (consumer->active || !__consumer_slot_is_clean(fanout, i))
+			continue;
+
+		consumer->policy = policy;
+		consumer->drop_count = 0;
+		consumer->active = 1;
+		/* cursor first, frames published before the bit is set
+		 * do not carry it and are skipped by get_frame */
+		__atomic_store_n(&consumer->cursor,
+				__atomic_load_n(&fanout->write_seq,
+					__ATOMIC_ACQUIRE), __ATOMIC_SEQ_CST);
+		__atomic_or_fetch(&fanout->consumer_mask, 1U << i,
+							__ATOMIC_SEQ_CST);
+		id = i;
+		break;
+	}
+
+	pthread_mutex_unlock(&fanout->mutex);
+
+	return id;
+}
+
+/* frames the consumer already got must be recycled before this,
+ * unread ones are given back here or by the capture thread */
+static void __fanout_del_consumer(struct pi_av_fanout *fanout, int id)
+{
+	struct pi_av_consumer *consumer = &fanout->consumers[id];
+	struct pi_av_buffer_ex *buffer_ex = NULL;
+	unsigned int cursor;
+
+	pthread_mutex_lock(&fanout->mutex);
+
+	__atomic_and_fetch(&fanout->consumer_mask, ~(1U << id),
+							__ATOMIC_SEQ_CST);
+	consumer->active = 0;
+
+	cursor = __atomic_load_n(&consumer->cursor, __ATOMIC_ACQUIRE);
+	while (cursor != __atomic_load_n(&fanout->write_seq, __ATOMIC_ACQUIRE)) {
+		buffer_ex = &fanout->buffers[cursor & fanout->mask];
+		if (!__atomic_compare_exchange_n(&consumer->cursor, &cursor,
+					cursor + 1, 0, __ATOMIC_ACQ_REL,
+							__ATOMIC_ACQUIRE))
+			continue;
+		if (buffer_ex->seq == cursor &&
+				(buffer_ex->consumer_mask & (1U << id)))
+			__release_buffer(buffer_ex);
+		cursor++;
+	}
+
+	pthread_mutex_unlock(&fanout->mutex);
+}
+
+static unsigned int __roundup_pow_of_two(unsigned int n)
+{
+	unsigned int size = 1;
+
+	while (size < n)
+		size <<= 1;
+
+	return size;
+}
+
+static int __fanout_create(struct pi_av_fanout **pfanout, int buf_num)
+{
+	struct pi_av_fanout *fanout = NULL;
+	int size;
+	int i;
+
+	if (buf_num <= 0)
+		return -PI_E_INVALID_PARAM;
+
+	if (posix_memalign((void **)&fanout, PI_CACHELINE_SIZE,
+					sizeof(struct pi_av_fanout)))
+		return -PI_E_NO_MEMORY;
+	memset(fanout, 0, sizeof(struct pi_av_fanout));
+
+	size = __roundup_pow_of_two(buf_num);
+	fanout->buffers = (struct pi_av_buffer_ex *)calloc(size,
+					sizeof(struct pi_av_buffer_ex));
+	if (fanout->buffers == NULL) {
+		free(fanout);
+		return -PI_E_NO_MEMORY;
+	}
+
+	fanout->size = size;
+	fanout->mask = size - 1;
+	pthread_mutex_init(&fanout->mutex, NULL);
+
+	for (i = 0; i < size; i++) {
+		fanout->buffers[i].recycle = buffer_recycle;
+		fanout->buffers[i].fanout = fanout;
+		fanout->buffers[i].dmabuf_fd = -1;
+		fanout->buffers[i].index = -1;
+	}
+
+	*pfanout = fanout;
+
+	return PI_OK;
+}
+
+/* the thread filling the ring is gone: unread frames are taken back
+ * from every consumer, the ones a consumer still holds are waited for
+ */
+static void __fanout_drain(struct pi_av_fanout *fanout)
+{
+	struct pi_av_buffer_ex *buffer_ex = NULL;
+	int i;
+
+	for (i = 0; i < PI_AV_MAX_CONSUMER; i++) {
+		if (fanout->consumers[i].active)
+			__fanout_del_consumer(fanout, i);
+	}
+
+	for (i = 0; i < fanout->size; i++) {
+		buffer_ex = &fanout->buffers[i];
+		while (__atomic_load_n(&buffer_ex->user_count, __ATOMIC_ACQUIRE))
+			__wait_buffer(buffer_ex, -1);
+	}
+}
+
+static void __fanout_destroy(struct pi_av_fanout *fanout)
+{
+	pthread_mutex_destroy(&fanout->mutex);
+	free(fanout->buffers);
+	free(fanout);
+}
+
+/* the ring stops, consumers sleeping in it are woken and let go,
+ * then lookups that still hold the old ring are waited for */
+static void __wait_fanout_users(struct pi_av_chn_node *chn_node,
+					struct pi_av_fanout *fanout)
+{
+	__atomic_store_n(&fanout->working, 0, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&fanout->wake_seq, 1, __ATOMIC_SEQ_CST);
+	pi_futex_wake(&fanout->wake_seq);
+	pi_futex_wake(&fanout->run);
+
+	__wait_chn_users(chn_node, 1);
 }
 
 void *__isp_buf_work_thread(void *arg)
 {
 	struct pi_av_chn_node *chn_node = NULL;
+	struct pi_av_fanout *fanout = NULL;
 	AVPacket *packet = NULL;
 	AVFormatContext *ctx = NULL;
 	AVFrame *pframe = NULL;
 	struct pi_av_buffer_ex *buffer_ex = NULL;
-	int run_tmp = 0;
-	int ret = 0;
 
 	chn_node = (struct pi_av_chn_node *)arg;
+	fanout = chn_node->fanout;
 	ctx = (AVFormatContext *)chn_node->ctx;
 	packet = (AVPacket *)av_malloc(sizeof(AVPacket));
 	if (packet == NULL)
 		return NULL;
 
-	while (chn_node->stat) {
-		if (!chn_node->buf_queue->run) {
-			/* clean up buffer queue once stop receive*/
-			if (run_tmp == 1)
-				pi_circle_queue_empty(chn_node->buf_queue);
-			run_tmp = 0;
-			usleep(1000);
+	while (fanout->working) {
+		/* woken by pi_av_start_recv and by destroy */
+		if (!__atomic_load_n(&fanout->run, __ATOMIC_ACQUIRE)) {
+			pi_futex_wait(&fanout->run, 0, 100);
 			continue;
 		}
 
-		run_tmp = 1;
-
-		while (av_read_frame(ctx, packet) < 0)
-			usleep(1000);
+		/* the input is opened blocking, so a failure is no frame
+		 * to come soon, try again once stopped or 100 ms later */
+		if (av_read_frame(ctx, packet) < 0) {
+			pi_futex_wait(&fanout->run, 1, 100);
+			continue;
+		}
 
-		while (pi_circle_queue_fake_push(chn_node->buf_queue, &buffer_ex) < 0)
-			usleep(1000);
+		buffer_ex = __fanout_get_buffer(fanout, fanout->write_seq,
+							&fanout->working);
+		if (buffer_ex == NULL) {
+			av_free_packet(packet);
+			break;
+		}
 
 		if (buffer_ex->length != packet->size)
 			printf("ERROR isp buffer length is wrong\n");
 
 		pframe = (AVFrame *)(buffer_ex->vm_addr);
 
-		memcpy(pframe->data, packet->data, packet->size);
+		memcpy(pframe->data[0], packet->data, packet->size);
 		av_free_packet(packet);
 
-		pi_circle_queue_push(chn_node->buf_queue, buffer_ex);
+		__fanout_publish(fanout, buffer_ex);
 	}
 
 	av_free(packet);
+
+	return NULL;
 }
 
-static int __init_isp_buf_queue(struct pi_av_chn_node *chn_node)
+/* point the ring buffer at the v4l2 buffer @index the driver filled,
+ * only the frame's data pointers change, nothing is copied */
+static void __attach_v4l2_buffer(struct pi_av_buffer_ex *buffer_ex,
+				struct pi_frame_attr *fattr,
+				struct pi_v4l2_dev *dev, int index)
 {
+	avpicture_fill((AVPicture *)buffer_ex->vm_addr,
+				(uint8_t *)dev->bufs[index].start,
+				fattr->pixel_fmt, fattr->width, fattr->height);
+	buffer_ex->dmabuf_fd = dev->bufs[index].dmabuf_fd;
+	buffer_ex->index = index;
+}
+
+/* the driver owns dev->buf_num buffers and may hand them back in any
+ * order, each one is published in place in the next ring slot; the ring
+ * is at least that large, so the frame that slot held before has
+ * already been given back to the driver, which happens in ring order
+ * once every consumer released it, the capture path copies nothing
+ */
+void *__isp_v4l2_work_thread(void *arg)
+{
+	struct pi_av_chn_node *chn_node = NULL;
+	struct pi_av_fanout *fanout = NULL;
 	struct pi_frame_attr *fattr = NULL;
-	uint8_t *frame_data = NULL;
-	AVFrame **pframe = NULL;
+	struct pi_v4l2_dev *dev = NULL;
 	struct pi_av_buffer_ex *buffer_ex = NULL;
-	int frame_len = 0;
-	int ret = 0;
+	unsigned int queued_seq;
+	int bytesused = 0;
+	int index;
+	int i;
 
-	fattr = (struct pi_frame_attr *)(chn_node->attr);	int enable;
+	chn_node = (struct pi_av_chn_node *)arg;
+	fanout = chn_node->fanout;
+	fattr = (struct pi_frame_attr *)chn_node->attr;
+	dev = (struct pi_v4l2_dev *)chn_node->ctx;
+
+	/* every buffer starts out empty and owned by the driver,
+	 * frames in [queued_seq, write_seq) still hold theirs */
+	for (i = 0; i < dev->buf_num; i++) {
+		if (pi_v4l2_qbuf(dev, i) < 0)
+			return NULL;
+	}
+	queued_seq = fanout->write_seq;
 
-	chn_node->buf_queue->size = fattr->buf_num;
+	if (pi_v4l2_streamon(dev) < 0)
+		return NULL;
 
-	ret = pi_circle_queue_create(chn_node->buf_queue);
-	if (ret < 0)
-		return ret;
+	while (fanout->working) {
+		/* hand recycled buffers back to the driver, only wait for
+		 * (or drop from) consumers when it has nothing left to fill */
+		while (queued_seq != fanout->write_seq) {
+			buffer_ex = &fanout->buffers[queued_seq & fanout->mask];
+			if (__atomic_load_n(&buffer_ex->user_count,
+						__ATOMIC_ACQUIRE)) {
+				if (fanout->write_seq - queued_seq <
+						(unsigned int)dev->buf_num)
+					break;
+				if (__fanout_get_buffer(fanout, queued_seq,
+						&fanout->working) == NULL)
+					goto exit;
+			}
+
+			if (pi_v4l2_qbuf(dev, buffer_ex->index) < 0)
+				goto exit;
+			queued_seq++;
+		}
 
-	buffer_ex = (struct pi_av_buffer_ex *)calloc(chn_node->buf_queue->size,
-						sizeof(struct pi_av_buffer_ex));
-	if (buffer_ex == NULL) {
-		ret = -PI_E_NO_MEMORY;
-		goto error;
+		index = pi_v4l2_dqbuf(dev, &bytesused, 100);
+		if (index == -PI_E_EMPTY)
+			continue;
+		if (index < 0)
+			break;
+
+		buffer_ex = &fanout->buffers[fanout->write_seq & fanout->mask];
+		__attach_v4l2_buffer(buffer_ex, fattr, dev, index);
+
+		if (!fanout->run || bytesused < buffer_ex->length) {
+			__fanout_skip(fanout, buffer_ex);
+			continue;
+		}
+
+		__fanout_publish(fanout, buffer_ex);
 	}
 
-	frame_len = avpicture_get_size(fattr->pixle_fmt, fattr->width,
+exit:
+	pi_v4l2_streamoff(dev);
+
+	return NULL;
+}
+
+/* libav: frames are read into one private data block */
+static int __fill_libav_frames(struct pi_av_fanout *fanout,
+				struct pi_frame_attr *fattr)
+{
+	uint8_t *frame_data = NULL;
+	AVFrame *pframe = NULL;
+	int frame_len = 0;
+	int i;
+
+	frame_len = avpicture_get_size(fattr->pixel_fmt, fattr->width,
 								fattr->height);
-	frame_data = (uint8_t *)calloc(chn_node->buf_queue->size, frame_len);
-	if (frame_data == NULL) {
-		ret = -PI_E_NO_MEMORY;
-		goto error;
+	frame_data = (uint8_t *)calloc(fanout->size, frame_len);
+	if (frame_data == NULL)
+		return -PI_E_NO_MEMORY;
+
+	for (i = 0; i < fanout->size; i++) {
+		pframe = (AVFrame *)fanout->buffers[i].vm_addr;
+		if (avpicture_fill((AVPicture *)pframe,
+					frame_data + i * frame_len,
+					fattr->pixel_fmt, fattr->width,
+						fattr->height) < 0) {
+			free(frame_data);
+			return -PI_E_FILL_FAIL;
+		}
 	}
 
-	pframe == (AVFrame **)calloc(chn_node->buf_queue->size,
-						sizeof (AVFrame *));
-	if (pframe == NULL) {
-		ret = -PI_E_NO_MEMORY;
-		goto error;
+	/* length set means buffer 0 owns frame_data */
+	for (i = 0; i < fanout->size; i++)
+		fanout->buffers[i].length = frame_len;
+
+	return PI_OK;
+}
+
+/* v4l2: frames point straight at the mmaped driver buffers,
+ * which buffer is only known once the driver hands one back */
+static int __fill_v4l2_frames(struct pi_av_fanout *fanout,
+				struct pi_frame_attr *fattr,
+				struct pi_v4l2_dev *dev)
+{
+	AVFrame *pframe = NULL;
+	int i;
+
+	if (dev->buf_num > fanout->size) {
+		printf("v4l2 gave %d buffers, ring only has %d\n",
+					dev->buf_num, fanout->size);
+		return -PI_E_INVALID_PARAM;
 	}
 
+	for (i = 0; i < fanout->size; i++) {
+		pframe = (AVFrame *)fanout->buffers[i].vm_addr;
+		if (avpicture_fill((AVPicture *)pframe,
+				(uint8_t *)dev->bufs[i % dev->buf_num].start,
+					fattr->pixel_fmt, fattr->width,
+						fattr->height) < 0)
+			return -PI_E_FILL_FAIL;
+		fanout->buffers[i].length = dev->frame_len;
+	}
+
+	return PI_OK;
+}
+
+static int __is_v4l2_chn(struct pi_av_chn_node *chn_node)
+{
+	struct pi_frame_attr *fattr = (struct pi_frame_attr *)(chn_node->attr);
+
+	return chn_node->type == PI_AV_ID_VIDEO_ISP &&
+			fattr->backend == PI_ISP_BACKEND_V4L2;
+}
 
-	for (i = 0; i < chn_node->buf_queue->size; i++) {
-		pframe[i] = av_frame_alloc();
-		if (pframe[i] == NULL) {
+/* isp channels are filled by the capture thread,
+ * scale channels by their scaler worker */
+static int __init_video_buf_queue(struct pi_av_chn_node *chn_node)
+{
+	struct pi_frame_attr *fattr = NULL;
+	struct pi_av_fanout *fanout = NULL;
+	AVFrame *pframe = NULL;
+	void *(*work_thread)(void *) = NULL;
+	int ret = 0;
+	int i;
+
+	fattr = (struct pi_frame_attr *)(chn_node->attr);
+
+	ret = __fanout_create(&fanout, fattr->buf_num);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < fanout->size; i++) {
+		pframe = av_frame_alloc();
+		if (pframe == NULL) {
 			ret = -PI_E_NO_MEMORY;
 			goto error;
 		}
-		ret = avpicture_fill((AVPicture *)pframe[i], (frame_data + i),
-						fattr->pixle_fmt, fattr->width,
-								fattr->height);
-		if (ret < 0) {
-			ret = -PI_E_FILL_FAIL;
-			goto error;
-		}
+		fanout->buffers[i].vm_addr = pframe;
+		fanout->buffers[i].type = ID_VIDEO_ISP;
 	}
 
-	for (i = 0; i < chn_node->buf_queue->size; i++) {
-		buffer_ex[i].vm_addr = pframe[i];
-		buffer_ex[i].length = 0;
-		buffer_ex[i].type = ID_VIDEO_ISP;
-		pthread_mutex_init(&buffer_ex[i].mutex, NULL);
-		buffer_ex[i].recycle = buffer_recycle;
-		buffer_ex[i].user_count = 0;
-		buffer_ex[i].buf_queue = chn_node->buf_queue;
-
-		pi_circle_queue_push(chn_node->buf_queue, &buffer_ex[i]);
+	if (__is_v4l2_chn(chn_node)) {
+		ret = __fill_v4l2_frames(fanout, fattr,
+				(struct pi_v4l2_dev *)chn_node->ctx);
+		work_thread = __isp_v4l2_work_thread;
+	} else {
+		ret = __fill_libav_frames(fanout, fattr);
+		if (chn_node->type == PI_AV_ID_VIDEO_SCALE)
+			work_thread = __scale_work_thread;
+		else
+			work_thread = __isp_buf_work_thread;
 	}
+	if (ret < 0)
+		goto error;
 
-	pi_circle_queue_empty(chn_node->buf_queue);
+	/* the work thread picks the ring up from the node */
+	fanout->working = 1;
+	__set_chn_fanout(chn_node, fanout);
 
 	ret = pthread_create(&(chn_node->work_thread), NULL,
-			__isp_buf_work_thread, chn_node->buf_queue);
-	if (ret < 0) {
+				work_thread, chn_node);
+	if (ret != 0) {
+		__set_chn_fanout(chn_node, NULL);
+		__wait_fanout_users(chn_node, fanout);
 		ret = -PI_E_THREAD_FAIL;
 		goto error;
 	}
 
-	free(pframe);
-
 	return PI_OK;
 
 error:
-	if (frame_data)
-		free(frame_data);
-
-	for (i = 0; i < chn_node->buf_queue->size; i++) {
-		if (pframe[i] != NULL)
-			av_frame_free(pframe[i]);
+	if (!__is_v4l2_chn(chn_node) && fanout->buffers[0].length > 0) {
+		pframe = (AVFrame *)(fanout->buffers[0].vm_addr);
+		free(pframe->data[0]);
 	}
 
-	if (pframe)
-		free(pframe);
-
-	if (buffer_ex)
-		free(buffer_ex);
+	for (i = 0; i < fanout->size; i++) {
+		pframe = (AVFrame *)fanout->buffers[i].vm_addr;
+		if (pframe != NULL)
+			av_frame_free(&pframe);
+	}
 
-	pi_circle_queue_destroy(chn_node);
+	__fanout_destroy(fanout);
 
 	printf("Init isp buffer queue fail\n");
 	return ret;
 }
 
-static void __destroy_isp_buf_queue(struct pi_av_chn_node *chn_node)
+/* @fanout: already unhooked from the node by the caller */
+static void __destroy_video_buf_queue(struct pi_av_chn_node *chn_node,
+					struct pi_av_fanout *fanout)
 {
 	AVFrame *pframe = NULL;
-	struct pi_av_buffer_ex *buffer_ex = NULL;
+	int i;
 
-	/* wait work thread exit*/
-	chn_node->buf_queue->run = 0;
-	chn_node->stat = 0;
+	/* wait work thread exit, the channel itself stays enabled */
+	fanout->run = 0;
+	fanout->working = 0;
 
 	pthread_join(chn_node->work_thread, NULL);
 
-	pi_circle_queue_full(chn_node->buf_queue);
-
-	pi_circle_queue_fake_pop(chn_node->buf_queue, &buffer_ex);
-	pframe = (AVFrame *)(buffer_ex->vm_addr);
-	/*TODO dose av_free_frame() free it's data?*/
+	/* consumers may still read a frame they got before */
+	__fanout_drain(fanout);
 
-	free(pframe->data);
+	/* libav frames share one data block, which starts at buffer 0,
+	 * v4l2 buffers are unmapped when the channel closes the device */
+	if (!__is_v4l2_chn(chn_node)) {
+		pframe = (AVFrame *)(fanout->buffers[0].vm_addr);
+		free(pframe->data[0]);
+	}
 
-	for (i = 0; i < chn_node->buf_queue->size; i++) {
-		pi_circle_queue_pop(chn_node->buf_queue, &buffer_ex);
-		pframe = (AVFrame *)(buffer_ex->vm_addr);
-		av_frame_free(pframe);
-		free(buffer_ex);
+	for (i = 0; i < fanout->size; i++) {
+		pframe = (AVFrame *)(fanout->buffers[i].vm_addr);
+		av_frame_free(&pframe);
 	}
 
+	__fanout_destroy(fanout);
 }
 
-static void __destroy_buf_queue(struct pi_av_chn_node *chn_node)
+static void __destroy_buf_queue(struct pi_av_chn_node *chn_node,
+					struct pi_av_fanout *fanout)
 {
 	switch (chn_node->type) {
 		case PI_AV_ID_VIDEO_ISP:
-			__destroy_isp_buf_queue(chn_node);
+		case PI_AV_ID_VIDEO_SCALE:
+			__destroy_video_buf_queue(chn_node, fanout);
 			break;
 		/*TODO*/
 		case PI_AV_ID_VIDEO_H264:
@@ -208,25 +710,19 @@ static void __destroy_buf_queue(struct pi_av_chn_node *chn_node)
 		case PI_AV_ID_AUDIO_PLAYBACK:
 		case PI_AV_ID_AUDIO_ENCODER:
 		case PI_AV_ID_AUDIO_DECODER:
+		default:
+			break;
 	}
-
-	free(chn_node->buf_queue);
 }
 
 static int __init_buf_queue(struct pi_av_chn_node *chn_node)
 {
-	struct pi_circle_queue *queue = NULL;
 	int ret = 0;
 
-	queue = (struct pi_circle_queue)malloc(sizeof(struct pi_circle_queue));
-	if (queue == NULL)
-		return -PI_E_NO_MEMORY;
-
-	chn_node->buf_queue = queue;
-
 	switch (chn_node->type) {
 		case PI_AV_ID_VIDEO_ISP:
-			ret = __init_isp_buf_queue(chn_node);
+		case PI_AV_ID_VIDEO_SCALE:
+			ret = __init_video_buf_queue(chn_node);
 			break;
 		/*TODO*/
 		case PI_AV_ID_VIDEO_H264:
@@ -236,25 +732,29 @@ static int __init_buf_queue(struct pi_av_chn_node *chn_node)
 		case PI_AV_ID_AUDIO_ENCODER:
 		case PI_AV_ID_AUDIO_DECODER:
 		default:
-			ret = -PI_E_UNKNOW;
+			ret = -PI_E_UNKONW;
 	}
 
-	if (ret < 0)
-		free(queue);
-
 	return ret;
 }
 
 int __destroy_buf_queue_manager(int chnno)
 {
 	struct pi_av_chn_node *chn_node = NULL;
-	int ret = 0;
+	struct pi_av_fanout *fanout = NULL;
 
-	chn_node = __find_chn_by_chnno(chnno);
+	chn_node = __get_chn_by_chnno(chnno);
 	if (chn_node == NULL)
 		return -PI_E_NOT_FOUND;
 
-	__destroy_buf_queue(chn_node);
+	/* new lookups see no ring from here */
+	fanout = __set_chn_fanout(chn_node, NULL);
+	if (fanout != NULL) {
+		__wait_fanout_users(chn_node, fanout);
+		__destroy_buf_queue(chn_node, fanout);
+	}
+
+	__put_chn(chn_node);
 
 	return PI_OK;
 }
@@ -264,11 +764,100 @@ int __init_buf_queue_manager(int chnno)
 	struct pi_av_chn_node *chn_node = NULL;
 	int ret = 0;
 
-	chn_node = __find_chn_by_chnno(chnno);
+	chn_node = __get_chn_by_chnno(chnno);
 	if (chn_node == NULL)
 		return -PI_E_NOT_FOUND;
 
 	ret = __init_buf_queue(chn_node);
 
+	__put_chn(chn_node);
+
+	return ret;
+}
+
+/* @return: the channel's ring with a reference held on the node,
+ * NULL if either is gone */
+static struct pi_av_fanout *__get_chn_fanout(int chnno,
+				struct pi_av_chn_node **pchn_node)
+{
+	struct pi_av_chn_node *chn_node = NULL;
+	struct pi_av_fanout *fanout = NULL;
+
+	chn_node = __get_chn_by_chnno(chnno);
+	if (chn_node == NULL)
+		return NULL;
+
+	fanout = __atomic_load_n(&chn_node->fanout, __ATOMIC_ACQUIRE);
+	if (fanout == NULL) {
+		__put_chn(chn_node);
+		return NULL;
+	}
+
+	*pchn_node = chn_node;
+
+	return fanout;
+}
+
+int __register_consumer(int chnno, int policy)
+{
+	struct pi_av_chn_node *chn_node = NULL;
+	struct pi_av_fanout *fanout = NULL;
+	int ret = 0;
+
+	if (policy != PI_AV_CONSUMER_DROP_OLDEST &&
+				policy != PI_AV_CONSUMER_BLOCK)
+		return -PI_E_INVALID_PARAM;
+
+	fanout = __get_chn_fanout(chnno, &chn_node);
+	if (fanout == NULL)
+		return -PI_E_NOT_FOUND;
+
+	ret = __fanout_add_consumer(fanout, policy);
+
+	__put_chn(chn_node);
+
+	return ret;
+}
+
+int __unregister_consumer(int chnno, int consumer)
+{
+	struct pi_av_chn_node *chn_node = NULL;
+	struct pi_av_fanout *fanout = NULL;
+
+	if (consumer < 0 || consumer >= PI_AV_MAX_CONSUMER)
+		return -PI_E_INVALID_PARAM;
+
+	fanout = __get_chn_fanout(chnno, &chn_node);
+	if (fanout == NULL)
+		return -PI_E_NOT_FOUND;
+
+	__fanout_del_consumer(fanout, consumer);
+
+	__put_chn(chn_node);
+
+	return PI_OK;
+}
+
+int __get_consumer_frame(int chnno, int consumer,
+			struct pi_av_buffer_ex **buffer, int timeout_ms)
+{
+	struct pi_av_chn_node *chn_node = NULL;
+	struct pi_av_fanout *fanout = NULL;
+	int ret = 0;
+
+	if (consumer < 0 || consumer >= PI_AV_MAX_CONSUMER)
+		return -PI_E_INVALID_PARAM;
+
+	fanout = __get_chn_fanout(chnno, &chn_node);
+	if (fanout == NULL)
+		return -PI_E_NOT_FOUND;
+
+	if (fanout->consumers[consumer].active)
+		ret = __fanout_get_frame(fanout, consumer, buffer, timeout_ms);
+	else
+		ret = -PI_E_NOT_EXIST;
+
+	__put_chn(chn_node);
+
 	return ret;
 }
@@ -2,206 +2,314 @@
  * piavchn.c
  * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
  *
+ * channel table, chnno indexes the node directly,
+ * create/destroy are serialized by the table mutex,
+ * lookups from the capture/consumer threads are lock free(seqlock)
+ * and hold a reference, destroy waits for them before freeing
+ *
  */
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <libavformat/avformat.h>
 
 #include "pi_errno.h"
-#include "list.h"
+#include "piavchn.h"
 #include "piavisp.h"
+#include "piavscale.h"
+#include "piv4l2.h"
 
 
-static struct pi_chn_list g_chn_list;
+static struct pi_chn_table g_chn_table = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
 
 /* TODO called when pi_av_init*/
-/* init list head & the last null list node(channel number == 1024)*/
-int  __chn_list_init()
+int  __chn_table_init()
 {
-	struct pi_av_chn_node *chn_node = NULL;
+	int i;
+
+	pthread_mutex_lock(&g_chn_table.mutex);
 
-	LIST_HEAD_INIT(g_chn_list.head);
-	g_chn_list.max_operator_num = MAX_CHANNEL_NUM;
+	memset(g_chn_table.bitmap, 0, sizeof(g_chn_table.bitmap));
 
-	chn_node = (struct pi_av_chn_node *)malloc(sizeof(struct pi_av_chn_node));
-	if (chn_node == NULL) {
-		printf("Malloc channel node fail\n");
-		return -PI_E_NO_MEMORY;
+	for (i = 0; i < MAX_CHANNEL_NUM; i++) {
+		g_chn_table.nodes[i].users = 0;
+		g_chn_table.nodes[i].wait_users = CHN_NO_WAITER;
+		g_chn_table.nodes[i].chnno = -1;
+		g_chn_table.nodes[i].type = PI_AV_ID_NULL;
+		g_chn_table.nodes[i].stat = 0;
+		g_chn_table.nodes[i].attr = NULL;
+		g_chn_table.nodes[i].ctx = NULL;
+		g_chn_table.nodes[i].fanout = NULL;
 	}
 
-	chn_node->chnno = g_chn_list.max_operator_num;
-	chn_node->type = PI_AV_ID_NULL;
-	chn_node->stat = 0;
-	chn_node->attr = NULL;
-	chn_node->ctx = NULL;
+	pthread_mutex_unlock(&g_chn_table.mutex);
 
-	list_add_tail(&chn_node->list, &g_chn_list.head);
+	return PI_OK;
 }
 
-static int __find_idle_chnno()
+/* find first zero bit and take it, table mutex held */
+static int __alloc_chnno()
 {
-	int start= 0;
-	struct pi_av_chn_node *chn_node;
+	unsigned long word;
+	int i;
 
-	list_for_each_entry(chn_node, &g_chn_list.head, list) {
-		if (start == g_chn_list.max_operator_num) {
-			printf("Channel operator is full\n");
-			return -PI_E_NOT_FOUND;
-		}
-		if (start < chn_node->chnno)
-			return start;
-		if (start == chn_node->chnno)
-			start++;
+	for (i = 0; i < (int)CHN_BITMAP_WORDS; i++) {
+		word = g_chn_table.bitmap[i];
+		if (~word == 0)
+			continue;
+
+		word = __builtin_ctzl(~word);
+		g_chn_table.bitmap[i] |= 1UL << word;
+
+		return i * CHN_BITS_PER_WORD + word;
 	}
 
-	return -PI_E_NO_FOUND;
+	printf("Channel operator is full\n");
+	return -PI_E_FULL;
 }
 
-struct pi_av_chn_node *__find_chn_by_chnno(int chnno)
+/* table mutex held */
+static void __free_chnno(int chnno)
 {
-	struct pi_av_chn_node *chn_node;
+	g_chn_table.bitmap[chnno / CHN_BITS_PER_WORD] &=
+				~(1UL << (chnno % CHN_BITS_PER_WORD));
+}
+
+/* lock free, safe to call from any thread at any time
+ * @return: the node with a reference held if channel @chnno exists,
+ * NULL otherwise, give it back with [__put_chn] once done with it
+ */
+struct pi_av_chn_node *__get_chn_by_chnno(int chnno)
+{
+	struct pi_av_chn_node *chn_node = NULL;
+	enum chn_type type;
+	unsigned int seq;
 
-	list_for_each_entry(chn_node, &g_chn_list.head, list) {
-		if (chn_node->chnno == chnno)
+	if (chnno < 0 || chnno >= MAX_CHANNEL_NUM)
+		return NULL;
+
+	chn_node = &g_chn_table.nodes[chnno];
+
+	while (1) {
+		seq = pi_read_seqbegin(&chn_node->seq);
+		type = __atomic_load_n(&chn_node->type, __ATOMIC_RELAXED);
+		if (type == PI_AV_ID_NULL) {
+			if (pi_read_seqretry(&chn_node->seq, seq))
+				continue;
+			return NULL;
+		}
+
+		/* pairs with the fence in __wait_chn_users, either destroy
+		 * sees our reference or we see its seq bump and back off */
+		__atomic_add_fetch(&chn_node->users, 1, __ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (!pi_read_seqretry(&chn_node->seq, seq))
 			return chn_node;
+
+		__put_chn(chn_node);
 	}
+}
+
+/* wakes destroy up once the count reaches what it waits for */
+void __put_chn(struct pi_av_chn_node *chn_node)
+{
+	unsigned int users;
 
-	return NULL;
+	users = __atomic_sub_fetch(&chn_node->users, 1, __ATOMIC_SEQ_CST);
+	if (users == __atomic_load_n(&chn_node->wait_users, __ATOMIC_SEQ_CST))
+		pi_futex_wake(&chn_node->users);
 }
 
-static void __add_chn(struct pi_av_chn_node *chn_node)
+/* called after the node was rewritten, sleep until no more than
+ * @users references(the caller's own) are left on it,
+ * one waiter per node at a time */
+void __wait_chn_users(struct pi_av_chn_node *chn_node, unsigned int users)
 {
-	struct pi_av_chn_node *cur_node = NULL;
+	unsigned int now;
 
-	list_for_each_entry(chn_node, &g_chn_list.head, list) {
-		if (chn_node->chnno < cur_node->chnno)
-			list_add_tail(&chn_node->list, &cur_node->list);
-	}
+	/* pairs with __put_chn, either it sees us waiting
+	 * or we see its reference gone */
+	__atomic_store_n(&chn_node->wait_users, users, __ATOMIC_SEQ_CST);
+
+	while ((now = __atomic_load_n(&chn_node->users, __ATOMIC_SEQ_CST)) >
+									users)
+		pi_futex_wait(&chn_node->users, now, -1);
+
+	__atomic_store_n(&chn_node->wait_users, CHN_NO_WAITER,
+							__ATOMIC_RELAXED);
+}
+
+/* swap the channel's buffer queue, lookups that start after this see
+ * @fanout, the ones already holding a reference may still use the old
+ * one, see [__wait_chn_users]
+ * @return: the previous fanout
+ */
+struct pi_av_fanout *__set_chn_fanout(struct pi_av_chn_node *chn_node,
+					struct pi_av_fanout *fanout)
+{
+	struct pi_av_fanout *old = NULL;
+
+	pthread_mutex_lock(&g_chn_table.mutex);
+
+	pi_write_seqbegin(&chn_node->seq);
+	old = chn_node->fanout;
+	__atomic_store_n(&chn_node->fanout, fanout, __ATOMIC_RELEASE);
+	pi_write_seqend(&chn_node->seq);
+
+	pthread_mutex_unlock(&g_chn_table.mutex);
+
+	return old;
 }
 
 int __create_chn(int id, void *attr, void *ctx)
 {
 	struct pi_av_chn_node *chn_node = NULL;
+	struct pi_frame_attr *fattr = NULL;
 	int chnno;
-	int ret = 0;
-
-	chn_node = (struct pi_av_chn_node *)malloc(sizeof(struct pi_av_chn_node));
-	if (chn_node == NULL) {
-		printf("Malloc channel node fail\n");
-		return -PI_E_NO_MEMORY;
-	}
 
-	if (id == PI_AV_ID_VIDEO_ISP) {
+	if (id == PI_AV_ID_VIDEO_ISP || id == PI_AV_ID_VIDEO_SCALE) {
 		/* backup fattr, ctx no need backup(cause is malloced)*/
-		struct pi_frame_attr *fattr == NULL;
-
+		fattr = (struct pi_frame_attr *)malloc(
+					sizeof(struct pi_frame_attr));
+		if (fattr == NULL) {
+			printf("Malloc channel attr fail\n");
+			return -PI_E_NO_MEMORY;
+		}
 		*fattr = *((struct pi_frame_attr *)attr);
+	} else {
+		/*TODO PI_AV_ID_VIDEO_H264 ... PI_AV_ID_AUDIO_DECODER*/
+		return -PI_E_INVALID_PARAM;
+	}
 
-		chnno = __find_idle_chnno();
-		if (chnno < 0) {
-			ret = -PI_E_NOT_FOUND;
-			goto error;
-		}
+	pthread_mutex_lock(&g_chn_table.mutex);
 
-		chn_node->chnno = chnno;
-		chn_node->type = PI_AV_ID_VIDEO_ISP;
-		chn_node->stat = 1;
-		chn_node->attr = fattr;
-		chn_node->ctx = ctx;
-		chn_node->buf_queue = NULL;
-		chn_node->work_thread = NULL;
+	chnno = __alloc_chnno();
+	if (chnno < 0) {
+		pthread_mutex_unlock(&g_chn_table.mutex);
+		free(fattr);
+		return chnno;
 	}
 
+	chn_node = &g_chn_table.nodes[chnno];
+
+	pi_write_seqbegin(&chn_node->seq);
+	chn_node->chnno = chnno;
+	chn_node->stat = 1;
+	chn_node->attr = fattr;
+	chn_node->ctx = ctx;
+	chn_node->fanout = NULL;
+	__atomic_store_n(&chn_node->type, id, __ATOMIC_RELAXED);
+	pi_write_seqend(&chn_node->seq);
+
+	pthread_mutex_unlock(&g_chn_table.mutex);
+
+	return chnno;
+}
+
+static void __close_chn_ctx(enum chn_type type, void *attr, void *ctx)
+{
+	if (type == PI_AV_ID_VIDEO_ISP && ctx != NULL) {
+		struct pi_frame_attr *fattr = NULL;
+
+		fattr = (struct pi_frame_attr *)attr;
+		if (fattr->backend == PI_ISP_BACKEND_V4L2) {
+			pi_v4l2_close((struct pi_v4l2_dev *)ctx);
+			free(ctx);
+		} else {
+			avformat_close_input((AVFormatContext **)&ctx);
+		}
+	}
+	if (type == PI_AV_ID_VIDEO_SCALE && ctx != NULL)
+		__destroy_scaler((struct pi_av_scaler *)ctx);
 	/*TODO*/
-	if (id == PI_AV_ID_VIDEO_H264) {
+	if (type == PI_AV_ID_VIDEO_H264) {
 	}
-	if (id == PI_AV_ID_VIDEO_MJPEG) {
+	if (type == PI_AV_ID_VIDEO_MJPEG) {
 	}
-	if (id == PI_AV_ID_AUDIO_CAPTURE_) {
+	if (type == PI_AV_ID_AUDIO_CAPTURE) {
 	}
-	if (id == PI_AV_ID_AUDIO_PLAYBACK) {
+	if (type == PI_AV_ID_AUDIO_PLAYBACK) {
 	}
-	if (id == PI_AV_ID_AUDIO_ENCODER) {
+	if (type == PI_AV_ID_AUDIO_ENCODER) {
 	}
-	if (id == PI_AV_ID_AUDIO_DECODER) {
+	if (type == PI_AV_ID_AUDIO_DECODER) {
 	}
 
-	__add_chn(chn_node);
-
-	return chnno;
-error:
-	free(chn_node);
-	return ret;
+	free(attr);
 }
 
-static void __del_chn(struct pi_av_chn_node *chn_node)
+/* the channel's buffer queue must be destroyed before this */
+int __destory_chn_by_chnno(int chnno)
 {
-	struct pi_av_chn_node *chn_node;
+	struct pi_av_chn_node *chn_node = NULL;
+	enum chn_type type;
+	void *attr = NULL;
+	void *ctx = NULL;
 
-	list_del(&chn_node->list);
+	if (chnno < 0 || chnno >= MAX_CHANNEL_NUM)
+		return -PI_E_INVALID_PARAM;
 
-	free(chn_node);
-}
+	pthread_mutex_lock(&g_chn_table.mutex);
 
-static int __destroy_chn(int chnno, struct pi_av_chn_node *chn)
-{
-	struct pi_av_chn_node *chn_node = NULL;
+	chn_node = &g_chn_table.nodes[chnno];
+	type = chn_node->type;
+	if (type == PI_AV_ID_NULL) {
+		pthread_mutex_unlock(&g_chn_table.mutex);
+		printf("Could not found channel[%d]\n", chnno);
+		return -PI_E_NOT_FOUND;
+	}
 
-	if (chn == NULL) {
-		chn_node =__find_chn_by_chnno(chnno);
-		if (chn_node == NULL) {
-			printf("Could not found channel[%]\n", chnno);
-			return -PI_E_NO_FOUND;
-		}
-	} else
-		chn_node = chn;
+	/* unpublish first, new lookups miss the channel from here */
+	pi_write_seqbegin(&chn_node->seq);
+	__atomic_store_n(&chn_node->type, PI_AV_ID_NULL, __ATOMIC_RELAXED);
+	pi_write_seqend(&chn_node->seq);
 
-	if (chn_node->type != PI_AV_ID_NULL)
-		free(chn_node->attr);
+	pthread_mutex_unlock(&g_chn_table.mutex);
 
-	if (chn_node->type == PI_AV_ID_VIDEO_ISP) {
-		avformat_close_input(&(chn_node->ctx));
-	}
-	/*TODO*/
-	if (chn_node->type == PI_AV_ID_VIDEO_H264) {
-	}
-	if (chn_node->type == PI_AV_ID_VIDEO_MJPEG) {
-	}
-	if (chn_node->type == PI_AV_ID_AUDIO_CAPTURE) {
-	}
-	if (chn_node->type == PI_AV_ID_AUDIO_PLAYBACK) {
-	}
-	if (chn_node->type == PI_AV_ID_AUDIO_ENCODER) {
-	}
-	if (chn_node->type == PI_AV_ID_AUDIO_DECODER) {
-	}
+	/* lookups still holding the node keep using attr/ctx */
+	__wait_chn_users(chn_node, 0);
 
+	attr = chn_node->attr;
+	ctx = chn_node->ctx;
 	chn_node->stat = 0;
-	chn_node->type = PI_AV_ID_NULL;
+	chn_node->attr = NULL;
+	chn_node->ctx = NULL;
 	chn_node->chnno = -1;
 
-	__del_chn(chn_node);
-
-	return PI_OK;
-}
+	__close_chn_ctx(type, attr, ctx);
 
-int __destory_chn_by_chnno(int chnno)
-{
-	return __destory_chn(chnno, NULL);
-}
+	/* only now the number and the node may be handed out again */
+	pthread_mutex_lock(&g_chn_table.mutex);
+	__free_chnno(chnno);
+	pthread_mutex_unlock(&g_chn_table.mutex);
 
-static int __destory_chn_by_chnnode(struct pi_av_chn_node * chn_node)
-{
-	return __destory_chn(-1, chn_node);
+	return PI_OK;
 }
 
 /* TODO called by pi_av_exit*/
-void __chn_list_destroy()
+void __chn_table_destroy()
 {
-	struct pi_av_chn_node *chn_node;
-	struct pi_av_chn_node *tmp_node;
-
-	list_for_each_entry_safe(chn_node, tmp_node , &g_chn_list.head, list)
-		__destory_chn_by_chnnode(chn_node);
+	struct pi_av_chn_node *chn_node = NULL;
+	enum chn_type type;
+	int pass;
+	int i;
+
+	/* channels fed by an isp channel go first, then the isp ones */
+	for (pass = 0; pass < 2; pass++) {
+		for (i = 0; i < MAX_CHANNEL_NUM; i++) {
+			chn_node = __get_chn_by_chnno(i);
+			if (chn_node == NULL)
+				continue;
+			type = chn_node->type;
+			__put_chn(chn_node);
+			if ((type == PI_AV_ID_VIDEO_ISP) != pass)
+				continue;
+			__destroy_buf_queue_manager(i);
+			__destory_chn_by_chnno(i);
+		}
+	}
 }
@@ -0,0 +1,404 @@
+/*
+ * piv4l2.c
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ *
+ * native v4l2 mmap capture, the kernel buffers are handed to the
+ * consumers as they are, no frame is copied on the capture path
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/videodev2.h>
+
+#include "pi_errno.h"
+#include "piv4l2.h"
+
+
+static int __xioctl(int fd, unsigned long request, void *arg)
+{
+	int ret;
+
+	do {
+		ret = ioctl(fd, request, arg);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret;
+}
+
+static long long __now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int __frame_len(unsigned int pixfmt, int width, int height)
+{
+	switch (pixfmt) {
+		case V4L2_PIX_FMT_YUYV:
+			return width * height * 2;
+		case V4L2_PIX_FMT_YUV420:
+		case V4L2_PIX_FMT_NV12:
+		default:
+			return width * height * 3 / 2;
+	}
+}
+
+static int __file_open(struct pi_v4l2_dev *dev, const char *path)
+{
+	int i;
+
+	dev->fd = open(path, O_RDONLY);
+	if (dev->fd < 0) {
+		printf("Open fake v4l2 file %s fail\n", path);
+		return -PI_E_OPEN_FAIL;
+	}
+
+	dev->is_file = 1;
+	dev->frame_len = __frame_len(dev->pixfmt, dev->width, dev->height);
+
+	dev->fifo = (int *)calloc(dev->buf_num, sizeof(int));
+	dev->bufs = (struct pi_v4l2_buf *)calloc(dev->buf_num,
+					sizeof(struct pi_v4l2_buf));
+	if (dev->fifo == NULL || dev->bufs == NULL)
+		return -PI_E_NO_MEMORY;
+
+	for (i = 0; i < dev->buf_num; i++) {
+		dev->bufs[i].dmabuf_fd = -1;
+		dev->bufs[i].length = dev->frame_len;
+		dev->bufs[i].start = malloc(dev->frame_len);
+		if (dev->bufs[i].start == NULL)
+			return -PI_E_NO_MEMORY;
+	}
+
+	return PI_OK;
+}
+
+static int __v4l2_set_format(struct pi_v4l2_dev *dev)
+{
+	struct v4l2_capability cap;
+	struct v4l2_format fmt;
+	struct v4l2_streamparm parm;
+
+	memset(&cap, 0, sizeof(cap));
+	if (__xioctl(dev->fd, VIDIOC_QUERYCAP, &cap) < 0) {
+		printf("VIDIOC_QUERYCAP fail\n");
+		return -PI_E_OPEN_FAIL;
+	}
+
+	if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) ||
+			!(cap.capabilities & V4L2_CAP_STREAMING)) {
+		printf("%s is not a streaming capture device\n", cap.card);
+		return -PI_E_OPEN_FAIL;
+	}
+
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	fmt.fmt.pix.width = dev->width;
+	fmt.fmt.pix.height = dev->height;
+	fmt.fmt.pix.pixelformat = dev->pixfmt;
+	fmt.fmt.pix.field = V4L2_FIELD_NONE;
+	if (__xioctl(dev->fd, VIDIOC_S_FMT, &fmt) < 0) {
+		printf("VIDIOC_S_FMT fail\n");
+		return -PI_E_INVALID_PARAM;
+	}
+
+	if (fmt.fmt.pix.pixelformat != dev->pixfmt ||
+			fmt.fmt.pix.width != (unsigned int)dev->width ||
+			fmt.fmt.pix.height != (unsigned int)dev->height) {
+		printf("v4l2 format %dx%d not supported\n",
+					dev->width, dev->height);
+		return -PI_E_INVALID_PARAM;
+	}
+	dev->frame_len = fmt.fmt.pix.sizeimage;
+
+	/* frame rate is only a hint, not every driver supports it */
+	memset(&parm, 0, sizeof(parm));
+	parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	parm.parm.capture.timeperframe.numerator = 1;
+	parm.parm.capture.timeperframe.denominator = dev->fps;
+	__xioctl(dev->fd, VIDIOC_S_PARM, &parm);
+
+	return PI_OK;
+}
+
+static int __v4l2_map_buffers(struct pi_v4l2_dev *dev)
+{
+	struct v4l2_requestbuffers req;
+	struct v4l2_buffer buf;
+	struct v4l2_exportbuffer expbuf;
+	int i;
+
+	memset(&req, 0, sizeof(req));
+	req.count = dev->buf_num;
+	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.memory = V4L2_MEMORY_MMAP;
+	if (__xioctl(dev->fd, VIDIOC_REQBUFS, &req) < 0 || req.count < 2) {
+		printf("VIDIOC_REQBUFS fail\n");
+		return -PI_E_NO_MEMORY;
+	}
+	dev->buf_num = req.count;
+
+	dev->bufs = (struct pi_v4l2_buf *)calloc(dev->buf_num,
+					sizeof(struct pi_v4l2_buf));
+	if (dev->bufs == NULL)
+		return -PI_E_NO_MEMORY;
+
+	for (i = 0; i < dev->buf_num; i++) {
+		dev->bufs[i].start = MAP_FAILED;
+		dev->bufs[i].dmabuf_fd = -1;
+	}
+
+	for (i = 0; i < dev->buf_num; i++) {
+		memset(&buf, 0, sizeof(buf));
+		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory = V4L2_MEMORY_MMAP;
+		buf.index = i;
+		if (__xioctl(dev->fd, VIDIOC_QUERYBUF, &buf) < 0) {
+			printf("VIDIOC_QUERYBUF fail\n");
+			return -PI_E_NO_MEMORY;
+		}
+
+		dev->bufs[i].length = buf.length;
+		dev->bufs[i].start = mmap(NULL, buf.length,
+					PROT_READ | PROT_WRITE, MAP_SHARED,
+					dev->fd, buf.m.offset);
+		if (dev->bufs[i].start == MAP_FAILED) {
+			printf("mmap v4l2 buffer fail\n");
+			return -PI_E_NO_MEMORY;
+		}
+
+		/* optional, lets an encoder import the frame by fd */
+		memset(&expbuf, 0, sizeof(expbuf));
+		expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		expbuf.index = i;
+		expbuf.flags = O_RDONLY | O_CLOEXEC;
+		if (__xioctl(dev->fd, VIDIOC_EXPBUF, &expbuf) == 0)
+			dev->bufs[i].dmabuf_fd = expbuf.fd;
+	}
+
+	return PI_OK;
+}
+
+int pi_v4l2_open(struct pi_v4l2_dev *dev, const char *path,
+			unsigned int pixfmt, int width, int height,
+			int fps, int *buf_num)
+{
+	struct stat st;
+	int ret = 0;
+
+	memset(dev, 0, sizeof(struct pi_v4l2_dev));
+	dev->fd = -1;
+	dev->pixfmt = pixfmt;
+	dev->width = width;
+	dev->height = height;
+	dev->fps = (fps > 0) ? fps : 25;
+	dev->buf_num = *buf_num;
+
+	if (stat(path, &st) < 0) {
+		printf("Could not find %s\n", path);
+		return -PI_E_NOT_EXIST;
+	}
+
+	if (S_ISREG(st.st_mode)) {
+		ret = __file_open(dev, path);
+		goto exit;
+	}
+
+	dev->fd = open(path, O_RDWR | O_NONBLOCK);
+	if (dev->fd < 0) {
+		printf("Open %s fail\n", path);
+		return -PI_E_OPEN_FAIL;
+	}
+
+	ret = __v4l2_set_format(dev);
+	if (ret < 0)
+		goto exit;
+
+	ret = __v4l2_map_buffers(dev);
+
+exit:
+	if (ret < 0) {
+		pi_v4l2_close(dev);
+		return ret;
+	}
+
+	*buf_num = dev->buf_num;
+
+	return PI_OK;
+}
+
+void pi_v4l2_close(struct pi_v4l2_dev *dev)
+{
+	int i;
+
+	if (dev->bufs != NULL) {
+		for (i = 0; i < dev->buf_num; i++) {
+			if (dev->bufs[i].dmabuf_fd >= 0)
+				close(dev->bufs[i].dmabuf_fd);
+			if (dev->is_file)
+				free(dev->bufs[i].start);
+			else if (dev->bufs[i].start != MAP_FAILED)
+				munmap(dev->bufs[i].start,
+						dev->bufs[i].length);
+		}
+		free(dev->bufs);
+		dev->bufs = NULL;
+	}
+
+	if (dev->fifo != NULL) {
+		free(dev->fifo);
+		dev->fifo = NULL;
+	}
+
+	if (dev->fd >= 0) {
+		close(dev->fd);
+		dev->fd = -1;
+	}
+}
+
+int pi_v4l2_streamon(struct pi_v4l2_dev *dev)
+{
+	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+	if (dev->is_file) {
+		dev->next_frame_us = __now_us();
+		return PI_OK;
+	}
+
+	if (__xioctl(dev->fd, VIDIOC_STREAMON, &type) < 0) {
+		printf("VIDIOC_STREAMON fail\n");
+		return -PI_FAIL;
+	}
+
+	return PI_OK;
+}
+
+int pi_v4l2_streamoff(struct pi_v4l2_dev *dev)
+{
+	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+	if (dev->is_file) {
+		dev->fifo_count = 0;
+		return PI_OK;
+	}
+
+	if (__xioctl(dev->fd, VIDIOC_STREAMOFF, &type) < 0) {
+		printf("VIDIOC_STREAMOFF fail\n");
+		return -PI_FAIL;
+	}
+
+	return PI_OK;
+}
+
+int pi_v4l2_qbuf(struct pi_v4l2_dev *dev, int index)
+{
+	struct v4l2_buffer buf;
+
+	if (index < 0 || index >= dev->buf_num)
+		return -PI_E_INVALID_PARAM;
+
+	if (dev->is_file) {
+		if (dev->fifo_count == dev->buf_num)
+			return -PI_E_FULL;
+		dev->fifo[(dev->fifo_head + dev->fifo_count) % dev->buf_num] =
+									index;
+		dev->fifo_count++;
+		return PI_OK;
+	}
+
+	memset(&buf, 0, sizeof(buf));
+	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = V4L2_MEMORY_MMAP;
+	buf.index = index;
+	if (__xioctl(dev->fd, VIDIOC_QBUF, &buf) < 0) {
+		printf("VIDIOC_QBUF fail\n");
+		return -PI_FAIL;
+	}
+
+	return PI_OK;
+}
+
+/* the file is read at the configured fps and rewound at the end */
+static int __file_dqbuf(struct pi_v4l2_dev *dev, int *bytesused,
+							int timeout_ms)
+{
+	long long wait_us;
+	int index;
+	int len;
+
+	if (dev->fifo_count == 0)
+		return -PI_E_EMPTY;
+
+	wait_us = dev->next_frame_us - __now_us();
+	if (wait_us > (long long)timeout_ms * 1000 && timeout_ms >= 0) {
+		usleep(timeout_ms * 1000);
+		return -PI_E_EMPTY;
+	}
+	if (wait_us > 0)
+		usleep(wait_us);
+	dev->next_frame_us += 1000000 / dev->fps;
+
+	index = dev->fifo[dev->fifo_head];
+
+	len = read(dev->fd, dev->bufs[index].start, dev->frame_len);
+	if (len < dev->frame_len) {
+		lseek(dev->fd, 0, SEEK_SET);
+		len = read(dev->fd, dev->bufs[index].start, dev->frame_len);
+		if (len < dev->frame_len) {
+			printf("Fake v4l2 file is shorter than a frame\n");
+			return -PI_FAIL;
+		}
+	}
+
+	dev->fifo_head = (dev->fifo_head + 1) % dev->buf_num;
+	dev->fifo_count--;
+	*bytesused = len;
+
+	return index;
+}
+
+int pi_v4l2_dqbuf(struct pi_v4l2_dev *dev, int *bytesused, int timeout_ms)
+{
+	struct v4l2_buffer buf;
+	struct pollfd pfd;
+	int ret;
+
+	if (dev->is_file)
+		return __file_dqbuf(dev, bytesused, timeout_ms);
+
+	pfd.fd = dev->fd;
+	pfd.events = POLLIN;
+	ret = poll(&pfd, 1, timeout_ms);
+	if (ret == 0 || (ret < 0 && errno == EINTR))
+		return -PI_E_EMPTY;
+	if (ret < 0)
+		return -PI_FAIL;
+
+	memset(&buf, 0, sizeof(buf));
+	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = V4L2_MEMORY_MMAP;
+	if (__xioctl(dev->fd, VIDIOC_DQBUF, &buf) < 0) {
+		if (errno == EAGAIN)
+			return -PI_E_EMPTY;
+		printf("VIDIOC_DQBUF fail\n");
+		return -PI_FAIL;
+	}
+
+	/* a corrupted frame still keeps its place in the queue order */
+	*bytesused = (buf.flags & V4L2_BUF_FLAG_ERROR) ? 0 : buf.bytesused;
+
+	return buf.index;
+}
@@ -9,6 +9,8 @@
 
 #include <pthread.h>
 
+#include "pi_sync.h"
+
 enum buffer_type {
 	ID_VIDEO_ISP = 0,
 	ID_VIDEO_H264,
@@ -20,6 +22,23 @@ enum buffer_type {
 	ID_AUDIO_DECODER,
 };
 
+/* what the capture thread does when a consumer lags a whole ring behind
+ * @PI_AV_CONSUMER_DROP_OLDEST: take the oldest unread frame back from it
+ * @PI_AV_CONSUMER_BLOCK: wait for it, the capture thread stalls
+ */
+enum consumer_policy {
+	PI_AV_CONSUMER_DROP_OLDEST = 0,
+	PI_AV_CONSUMER_BLOCK,
+};
+
+/* consumers per channel, one bit each in pi_av_buffer_ex.consumer_mask */
+#define PI_AV_MAX_CONSUMER	8
+
+/* the one thread that waits for a buffer to come back sleeps on its
+ * user_count with this bit set, the last consumer wakes it up */
+#define PI_AV_BUFFER_WAITING	(1U << 31)
+
+struct pi_av_buffer_ex;
 typedef void (*buffer_recycle_f)(struct pi_av_buffer_ex *buffer_ex);
 
 struct pi_av_buffer {
@@ -28,15 +47,69 @@ struct pi_av_buffer {
 	int type;
 };
 
+/* @user_count: consumers still holding this frame, the buffer goes back
+ * to the capture thread when it drops to 0, PI_AV_BUFFER_WAITING is set
+ * on top while that thread(or destroy) sleeps on it
+ * @consumer_mask: consumers the frame was published to
+ * @seq: sequence number of the frame currently in this buffer
+ * @dmabuf_fd: dmabuf the frame lives in, -1 if it is plain memory
+ * @index: v4l2 buffer the frame lives in, -1 for other backends
+ */
 struct pi_av_buffer_ex {
 	void *vm_addr;
 	int length;
 	int type;
-	pthread_mutex_t mutex;
 	buffer_recycle_f recycle;
-	int user_count;
-	struct pi_circle_queue *buf_queue;
+	unsigned int user_count;
+	unsigned int consumer_mask;
+	unsigned int seq;
+	int dmabuf_fd;
+	int index;
+	struct pi_av_fanout *fanout;
 };
 
+/* @cursor: seq of the next frame this consumer will read,
+ * moved by the consumer, or by the capture thread when it drops
+ * the oldest frame of a PI_AV_CONSUMER_DROP_OLDEST consumer
+ */
+struct pi_av_consumer {
+	unsigned int cursor __pi_cacheline_aligned;
+	int policy;
+	int active;
+	unsigned int drop_count;
+};
+
+/* one capture thread publishes into a ring of buffers,
+ * every registered consumer reads it through its own cursor,
+ * no frame is copied, the ring is a power of two at least as large
+ * as the number of frames the backend can fill
+ */
+struct pi_av_fanout {
+	unsigned int write_seq __pi_cacheline_aligned;
+	unsigned int wake_seq; /* consumers sleep on it */
+	int read_waiting;
+
+	unsigned int consumer_mask __pi_cacheline_aligned;
+	struct pi_av_buffer_ex *buffers;
+	int size;
+	unsigned int mask;
+	unsigned int run; /* 1 while started, the capture thread sleeps on it */
+	int working; /* cleared to make the thread filling the ring exit */
+	pthread_mutex_t mutex; /* register/unregister only */
+	struct pi_av_consumer consumers[PI_AV_MAX_CONSUMER];
+};
+
+/* producer side, for the thread that fills a channel's buffers */
+struct pi_av_buffer_ex *__fanout_get_buffer(struct pi_av_fanout *fanout,
+						unsigned int seq, int *stat);
+void __fanout_publish(struct pi_av_fanout *fanout,
+				struct pi_av_buffer_ex *buffer_ex);
+
+int __init_buf_queue_manager(int chnno);
+int __destroy_buf_queue_manager(int chnno);
+int __register_consumer(int chnno, int policy);
+int __unregister_consumer(int chnno, int consumer);
+int __get_consumer_frame(int chnno, int consumer,
+			struct pi_av_buffer_ex **buffer, int timeout_ms);
 
 #endif
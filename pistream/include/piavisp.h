@@ -7,13 +7,37 @@
 #define _PIAVISP_H
 
 
+/* how the isp channel reads the camera
+ * @PI_ISP_BACKEND_AUTO: native v4l2, libav if the device refuses it
+ * @PI_ISP_BACKEND_V4L2: mmap driver buffers, frames are never copied
+ * @PI_ISP_BACKEND_LIBAV: libavdevice video4linux2, one copy per frame
+ */
+enum pi_isp_backend {
+	PI_ISP_BACKEND_AUTO = 0,
+	PI_ISP_BACKEND_V4L2,
+	PI_ISP_BACKEND_LIBAV,
+};
+
+/* @dev_path: camera node, "" means /dev/video0, the v4l2 backend also
+ * takes a regular file of raw frames to run without a camera
+ */
 struct pi_frame_attr {
 	AVPixelFormat pixel_fmt;
 	int width;
 	int height;
 	int fps;
 	int buf_num;
+	int backend;
+	char dev_path[64];
 };
 
+struct pi_av_buffer_ex;
+
+int pi_av_add_consumer(int chnno, int policy);
+int pi_av_del_consumer(int chnno, int consumer);
+int pi_av_get_frame(int chnno, int consumer,
+			struct pi_av_buffer_ex **buffer, int timeout_ms);
+void pi_av_put_frame(struct pi_av_buffer_ex *buffer);
+
 
 #endif
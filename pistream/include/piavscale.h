@@ -0,0 +1,50 @@
+/*
+ * piavscale.h
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ *
+ */
+
+#ifndef _PIAVSCALE_H
+#define _PIAVSCALE_H
+
+struct SwsContext;
+struct pi_frame_attr;
+
+/* how a rendition is produced, plain layout changes and the exact
+ * half size i420 go through the simd kernels of pi_pixfmt */
+enum pi_scale_kernel {
+	PI_SCALE_SWS = 0,
+	PI_SCALE_NV12_TO_I420,
+	PI_SCALE_I420_TO_NV12,
+	PI_SCALE_YUYV_TO_I420,
+	PI_SCALE_I420_HALF,
+};
+
+/* one rendition of an isp channel, e.g. 1080p/720p/360p from one camera,
+ * every rendition is a consumer of the isp channel and has its own
+ * worker thread, so frames are captured once and each rendition costs
+ * one thread, the SwsContext and destination frames are set up once
+ * @consumer: our reader id on the isp channel
+ */
+struct pi_av_scaler {
+	int src_chnno;
+	int consumer;
+	int src_width;
+	int src_height;
+	int dst_width;
+	int dst_height;
+	int kernel;
+	struct SwsContext *sws; /* PI_SCALE_SWS only */
+};
+
+/* @fattr: pixel_fmt/width/height/buf_num of the rendition
+ * @return: chnno of the rendition, read it like an isp channel,
+ * [pi_av_start_recv]/[pi_av_add_consumer]/[pi_av_get_frame]
+ */
+int pi_av_create_scale_chn(int src_chnno, struct pi_frame_attr *fattr);
+int pi_av_destroy_scale_chn(int chnno);
+
+void *__scale_work_thread(void *arg);
+void __destroy_scaler(struct pi_av_scaler *scaler);
+
+#endif
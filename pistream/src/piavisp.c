@@ -9,6 +9,8 @@
 /* TODO one isp channel stream*/
 /* TODO multiply isp stream forked from main isp stream using pi_av_isp_scale*/
 #include <stdio.h>
+#include <stdlib.h>
+#include <linux/videodev2.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
@@ -18,6 +20,8 @@
 #include "pi_errno.h"
 #include "piavchn.h"
 #include "piavisp.h"
+#include "piavbuffer.h"
+#include "piv4l2.h"
 
 
 int pi_av_init()
@@ -28,7 +32,7 @@ int pi_av_init()
 	avdevice_register_all();
 	avformat_network_init();
 
-	ret = __chn_list_init();
+	ret = __chn_table_init();
 	if (ret < 0)
 		return ret;
 	/*TODO*/
@@ -38,37 +42,77 @@ int pi_av_init()
 
 int pi_av_exit()
 {
-	__chn_list_destroy();
+	__chn_table_destroy();
 	/*TODO*/
 }
 
-/* there's only one isp channel -- /dev/video0*/
-int pi_av_create_isp_chn(struct pi_frame_attr *fattr)
+static int __open_v4l2_isp(struct pi_frame_attr *fattr, const char *path,
+						struct pi_v4l2_dev **pdev)
 {
-	char *pixle_fmt = NULL; //convert from pixel_fmt
-	char *resolution = NULL; //convert from width height
-	int chnno = -1;
+	struct pi_v4l2_dev *dev = NULL;
+	unsigned int pixfmt;
+	int buf_num;
+	int ret = 0;
 
 	switch (fattr->pixel_fmt) {
-		case AV_PIX_FMT_YUV420P:
-			pixle_fmt = "yuv420p";
-			break;
 		case AV_PIX_FMT_NV12:
-			pixle_fmt = "nv12";
+			pixfmt = V4L2_PIX_FMT_NV12;
 			break;
+		case AV_PIX_FMT_YUYV422:
+			pixfmt = V4L2_PIX_FMT_YUYV;
+			break;
+		case AV_PIX_FMT_YUV420P:
 		default:
-			pixle_fmt = "yuv420p";
+			pixfmt = V4L2_PIX_FMT_YUV420;
 	}
 
-	sprintf(resolution, "%dx%d", fattr->width, fattr->height);
+	dev = (struct pi_v4l2_dev *)malloc(sizeof(struct pi_v4l2_dev));
+	if (dev == NULL)
+		return -PI_E_NO_MEMORY;
 
-	AVFormatContext *pFormatCtx = NULL;
-	AVFrame *pFrameRaw = NULL;
+	/* the driver may grant more or fewer, the ring is sized from that */
+	buf_num = fattr->buf_num;
+	ret = pi_v4l2_open(dev, path, pixfmt, fattr->width, fattr->height,
+						fattr->fps, &buf_num);
+	if (ret < 0) {
+		free(dev);
+		return ret;
+	}
+
+	fattr->buf_num = buf_num;
+	*pdev = dev;
+
+	return PI_OK;
+}
+
+static int __open_libav_isp(struct pi_frame_attr *fattr, const char *path,
+					AVFormatContext **pFormatCtx)
+{
+	char *pixel_fmt = NULL; //convert from pixel_fmt
+	char resolution[32]; //convert from width height
+	char framerate[16];
 	AVInputFormat *ifmt = NULL;
-	AVDicitonary *options = NULL;
+	AVDictionary *options = NULL;
 	int ret = 0;
 
-	pFormatCtx = avformat_alloc_context();
+	switch (fattr->pixel_fmt) {
+		case AV_PIX_FMT_YUV420P:
+			pixel_fmt = "yuv420p";
+			break;
+		case AV_PIX_FMT_NV12:
+			pixel_fmt = "nv12";
+			break;
+		case AV_PIX_FMT_YUYV422:
+			pixel_fmt = "yuyv422";
+			break;
+		default:
+			pixel_fmt = "yuv420p";
+	}
+
+	sprintf(resolution, "%dx%d", fattr->width, fattr->height);
+	sprintf(framerate, "%d", fattr->fps);
+
+	*pFormatCtx = avformat_alloc_context();
 
 	ifmt = av_find_input_format("video4linux2");
 	if (ifmt == NULL) {
@@ -79,36 +123,91 @@ int pi_av_create_isp_chn(struct pi_frame_attr *fattr)
 
 	av_dict_set(&options, "video_size", resolution, 0);
 	av_dict_set(&options, "pixel_format", pixel_fmt, 0);
-	av_dict_set(&options, "framerate", fattr->fps, 0);
+	av_dict_set(&options, "framerate", framerate, 0);
 
-	ret = avformat_open_input(&pFormatCtx, "/dev/video0", ifmt, &options);
+	ret = avformat_open_input(pFormatCtx, path, ifmt, &options);
+	av_dict_free(&options);
 	if(ret < 0) {
 		printf("Couldn't open input stream.\n");
 		ret = -PI_E_NOT_EXIST;
 		goto error;
 	}
 
-	ret = avformat_find_stream_info(pFormatCtx,NULL);
+	ret = avformat_find_stream_info(*pFormatCtx, NULL);
 	if(ret < 0) {
 		printf("Couldn't find stream information.\n");
 		ret = -PI_E_NOT_FOUND;
 		goto error;
 	}
 
-	chnno = __create_chn(PI_AV_ID_VIDEO_ISP, fattr, pFormatCtx);
-	if (chnno < 0)
+	return PI_OK;
+
+error:
+	avformat_close_input(pFormatCtx);
+	return ret;
+}
+
+/* there's only one isp channel -- /dev/video0 by default
+ * fattr->backend is resolved here, AUTO ends up as V4L2 or LIBAV*/
+int pi_av_create_isp_chn(struct pi_frame_attr *fattr)
+{
+	const char *path = NULL;
+	void *ctx = NULL;
+	int backend = fattr->backend;
+	int buf_num = fattr->buf_num;
+	int chnno = -1;
+	int ret = 0;
+
+	path = fattr->dev_path[0] ? fattr->dev_path : "/dev/video0";
+
+	if (fattr->backend != PI_ISP_BACKEND_LIBAV) {
+		ret = __open_v4l2_isp(fattr, path, (struct pi_v4l2_dev **)&ctx);
+		if (ret == PI_OK)
+			fattr->backend = PI_ISP_BACKEND_V4L2;
+		else if (fattr->backend == PI_ISP_BACKEND_V4L2)
+			return ret;
+		else
+			printf("Native v4l2 capture fail, fall back to libav\n");
+	}
+
+	if (fattr->backend != PI_ISP_BACKEND_V4L2) {
+		ret = __open_libav_isp(fattr, path, (AVFormatContext **)&ctx);
+		if (ret < 0)
+			return ret;
+		fattr->backend = PI_ISP_BACKEND_LIBAV;
+	}
+
+	/* the channel owns ctx from here, it is closed with the channel */
+	chnno = __create_chn(PI_AV_ID_VIDEO_ISP, fattr, ctx);
+	if (chnno < 0) {
+		ret = chnno;
 		goto error;
+	}
 
 	ret = __init_buf_queue_manager(chnno);
-	if (ret < 0)
-		goto error;
+	if (ret < 0) {
+		__destory_chn_by_chnno(chnno);
+		if (backend != PI_ISP_BACKEND_AUTO ||
+				fattr->backend != PI_ISP_BACKEND_V4L2)
+			return ret;
+
+		/* the device opened but its buffers are unusable */
+		printf("Native v4l2 capture fail, fall back to libav\n");
+		fattr->backend = PI_ISP_BACKEND_LIBAV;
+		fattr->buf_num = buf_num;
+		return pi_av_create_isp_chn(fattr);
+	}
 
 	return chnno;
 
 error:
-	if (chnno >= 0)
-		__destroy_chn_by_chnno(chnno);
-	avformat_close_input(&pFormatCtx);
+	if (fattr->backend == PI_ISP_BACKEND_V4L2) {
+		pi_v4l2_close((struct pi_v4l2_dev *)ctx);
+		free(ctx);
+	} else {
+		avformat_close_input((AVFormatContext **)&ctx);
+	}
+	return ret;
 }
 
 int pi_av_destroy_isp_chn()
@@ -125,6 +224,8 @@ int main(int argc, char* argv[])
 	fattr.height = 720;
 	fattr.fps = 20;
 	fattr.buf_num = 3;
+	fattr.backend = PI_ISP_BACKEND_AUTO;
+	fattr.dev_path[0] = '\0';
 
 	AVFrame *pFrameRaw = NULL;
 	AVPacket *packet = NULL;
@@ -175,7 +276,9 @@ error:
 
 /* scale source image size & pixle format
  * convert source image(isp data) to dest image
- * release frame use av_frame_free()*/
+ * release frame use av_frame_free()
+ * one shot, it builds a SwsContext every call, to fork a stream
+ * from the isp channel use [pi_av_create_scale_chn]*/
 int pi_av_isp_image_scale(AVFrame *pFrame_src, struct pi_frame_attr *fattr,
 						AVFrame *pFrame_dst)
 {
@@ -245,14 +348,21 @@ error:
 static int __pi_av_recv_ctrl(int chnno, int start)
 {
 	struct pi_av_chn_node *chn_node = NULL;
+	struct pi_av_fanout *fanout = NULL;
 
-	chn_node = __find_chn_by_chnno(chnno);
+	chn_node = __get_chn_by_chnno(chnno);
 	if (chn_node == NULL)
 		return -PI_E_NOT_FOUND;
 
-	chn_node->buf_queue->run = start;
+	fanout = __atomic_load_n(&chn_node->fanout, __ATOMIC_ACQUIRE);
+	if (fanout != NULL) {
+		__atomic_store_n(&fanout->run, start, __ATOMIC_RELEASE);
+		pi_futex_wake(&fanout->run);
+	}
 
-	return PI_OK;
+	__put_chn(chn_node);
+
+	return fanout != NULL ? PI_OK : -PI_E_NOT_FOUND;
 }
 
 int pi_av_start_recv(int chnno)
@@ -265,3 +375,31 @@ int pi_av_stop_recv(int chnno)
 	return __pi_av_recv_ctrl(chnnot, 0);
 }
 
+/* register a reader on the channel, every reader sees every frame
+ * @policy: PI_AV_CONSUMER_DROP_OLDEST/PI_AV_CONSUMER_BLOCK
+ * @return: consumer id on success, < 0 on error
+ */
+int pi_av_add_consumer(int chnno, int policy)
+{
+	return __register_consumer(chnno, policy);
+}
+
+int pi_av_del_consumer(int chnno, int consumer)
+{
+	return __unregister_consumer(chnno, consumer);
+}
+
+/* @buffer: output param, the frame is shared with the other consumers,
+ * don't write it and give it back with [pi_av_put_frame]
+ * @timeout_ms: < 0 wait forever
+ */
+int pi_av_get_frame(int chnno, int consumer,
+			struct pi_av_buffer_ex **buffer, int timeout_ms)
+{
+	return __get_consumer_frame(chnno, consumer, buffer, timeout_ms);
+}
+
+void pi_av_put_frame(struct pi_av_buffer_ex *buffer)
+{
+	buffer->recycle(buffer);
+}
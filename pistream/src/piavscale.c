@@ -0,0 +1,272 @@
+/*
+ * piavscale.c
+ * Copyright (C) 2018      Steve Liu<steveliu121@163.com>
+ *
+ * renditions forked from the main isp stream, each scale channel reads
+ * the isp channel as a drop-oldest consumer, so a slow rendition loses
+ * frames instead of stalling the camera
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+
+#include "pi_errno.h"
+#include "piavchn.h"
+#include "piavisp.h"
+#include "piavbuffer.h"
+#include "piavscale.h"
+#include "pi_pixfmt.h"
+
+
+static void __to_image(AVFrame *frame, int width, int height,
+					struct pi_image *image)
+{
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		image->data[i] = frame->data[i];
+		image->linesize[i] = frame->linesize[i];
+	}
+	image->width = width;
+	image->height = height;
+}
+
+static void __scale_frame(struct pi_av_scaler *scaler, AVFrame *src_frame,
+							AVFrame *dst_frame)
+{
+	struct pi_image src, dst;
+
+	if (scaler->kernel == PI_SCALE_SWS) {
+		sws_scale(scaler->sws,
+			(const unsigned char * const *)src_frame->data,
+			src_frame->linesize, 0, scaler->src_height,
+			dst_frame->data, dst_frame->linesize);
+		return;
+	}
+
+	__to_image(src_frame, scaler->src_width, scaler->src_height, &src);
+	__to_image(dst_frame, scaler->dst_width, scaler->dst_height, &dst);
+
+	switch (scaler->kernel) {
+		case PI_SCALE_NV12_TO_I420:
+			pi_nv12_to_i420(&src, &dst);
+			break;
+		case PI_SCALE_I420_TO_NV12:
+			pi_i420_to_nv12(&src, &dst);
+			break;
+		case PI_SCALE_YUYV_TO_I420:
+			pi_yuyv_to_i420(&src, &dst);
+			break;
+		case PI_SCALE_I420_HALF:
+			pi_i420_downscale_2x(&src, &dst);
+			break;
+		default:
+			break;
+	}
+}
+
+void *__scale_work_thread(void *arg)
+{
+	struct pi_av_chn_node *chn_node = NULL;
+	struct pi_av_scaler *scaler = NULL;
+	struct pi_av_fanout *fanout = NULL;
+	struct pi_av_buffer_ex *src_buf = NULL;
+	struct pi_av_buffer_ex *dst_buf = NULL;
+	AVFrame *src_frame = NULL;
+	AVFrame *dst_frame = NULL;
+	int ret = 0;
+
+	chn_node = (struct pi_av_chn_node *)arg;
+	scaler = (struct pi_av_scaler *)chn_node->ctx;
+	fanout = chn_node->fanout;
+
+	while (fanout->working) {
+		ret = __get_consumer_frame(scaler->src_chnno, scaler->consumer,
+							&src_buf, 100);
+		if (ret == -PI_E_EMPTY)
+			continue;
+		if (ret < 0)
+			break;
+
+		if (!fanout->run) {
+			src_buf->recycle(src_buf);
+			continue;
+		}
+
+		dst_buf = __fanout_get_buffer(fanout, fanout->write_seq,
+							&fanout->working);
+		if (dst_buf == NULL) {
+			src_buf->recycle(src_buf);
+			break;
+		}
+
+		src_frame = (AVFrame *)src_buf->vm_addr;
+		dst_frame = (AVFrame *)dst_buf->vm_addr;
+
+		__scale_frame(scaler, src_frame, dst_frame);
+
+		src_buf->recycle(src_buf);
+
+		__fanout_publish(fanout, dst_buf);
+	}
+
+	return NULL;
+}
+
+/* the worker thread must have exited */
+void __destroy_scaler(struct pi_av_scaler *scaler)
+{
+	if (scaler->consumer >= 0)
+		__unregister_consumer(scaler->src_chnno, scaler->consumer);
+
+	sws_freeContext(scaler->sws);
+	free(scaler);
+}
+
+static int __pick_kernel(struct pi_frame_attr *src,
+				struct pi_frame_attr *dst)
+{
+	int same_size = (src->width == dst->width &&
+				src->height == dst->height);
+
+	if ((src->width | src->height | dst->width | dst->height) & 1)
+		return PI_SCALE_SWS;
+
+	if (same_size && src->pixel_fmt == AV_PIX_FMT_NV12 &&
+				dst->pixel_fmt == AV_PIX_FMT_YUV420P)
+		return PI_SCALE_NV12_TO_I420;
+	if (same_size && src->pixel_fmt == AV_PIX_FMT_YUV420P &&
+				dst->pixel_fmt == AV_PIX_FMT_NV12)
+		return PI_SCALE_I420_TO_NV12;
+	if (same_size && src->pixel_fmt == AV_PIX_FMT_YUYV422 &&
+				dst->pixel_fmt == AV_PIX_FMT_YUV420P)
+		return PI_SCALE_YUYV_TO_I420;
+	/* the chroma planes are halved too, so keep them even */
+	if (src->pixel_fmt == AV_PIX_FMT_YUV420P &&
+			dst->pixel_fmt == AV_PIX_FMT_YUV420P &&
+			dst->width * 2 == src->width &&
+			dst->height * 2 == src->height && !(dst->width & 3) &&
+			!(dst->height & 3))
+		return PI_SCALE_I420_HALF;
+
+	return PI_SCALE_SWS;
+}
+
+static int __create_scaler(int src_chnno, struct pi_frame_attr *fattr,
+					struct pi_av_scaler **pscaler)
+{
+	struct pi_av_chn_node *src_node = NULL;
+	struct pi_frame_attr *src_attr = NULL;
+	struct pi_av_scaler *scaler = NULL;
+
+	src_node = __get_chn_by_chnno(src_chnno);
+	if (src_node == NULL)
+		goto not_found;
+	if (src_node->type != PI_AV_ID_VIDEO_ISP) {
+		__put_chn(src_node);
+		goto not_found;
+	}
+	src_attr = (struct pi_frame_attr *)(src_node->attr);
+
+	scaler = (struct pi_av_scaler *)calloc(1, sizeof(struct pi_av_scaler));
+	if (scaler == NULL) {
+		__put_chn(src_node);
+		return -PI_E_NO_MEMORY;
+	}
+
+	scaler->src_chnno = src_chnno;
+	scaler->src_width = src_attr->width;
+	scaler->src_height = src_attr->height;
+	scaler->dst_width = fattr->width;
+	scaler->dst_height = fattr->height;
+	scaler->kernel = __pick_kernel(src_attr, fattr);
+
+	/* one context per rendition, built once */
+	if (scaler->kernel == PI_SCALE_SWS) {
+		scaler->sws = sws_getContext(src_attr->width,
+					src_attr->height, src_attr->pixel_fmt,
+					fattr->width, fattr->height,
+					fattr->pixel_fmt, SWS_BILINEAR,
+							NULL, NULL, NULL);
+		if (scaler->sws == NULL) {
+			printf("Could not alloc SwsContext.\n");
+			__put_chn(src_node);
+			free(scaler);
+			return -PI_E_NO_MEMORY;
+		}
+	}
+
+	/* src_attr is not used past here */
+	__put_chn(src_node);
+
+	scaler->consumer = __register_consumer(src_chnno,
+					PI_AV_CONSUMER_DROP_OLDEST);
+	if (scaler->consumer < 0) {
+		sws_freeContext(scaler->sws);
+		free(scaler);
+		return -PI_E_FULL;
+	}
+
+	*pscaler = scaler;
+
+	return PI_OK;
+
+not_found:
+	printf("Could not found isp channel[%d]\n", src_chnno);
+	return -PI_E_NOT_FOUND;
+}
+
+int pi_av_create_scale_chn(int src_chnno, struct pi_frame_attr *fattr)
+{
+	struct pi_av_scaler *scaler = NULL;
+	int chnno = -1;
+	int ret = 0;
+
+	if (fattr->width <= 0 || fattr->height <= 0 || fattr->buf_num <= 0)
+		return -PI_E_INVALID_PARAM;
+
+	ret = __create_scaler(src_chnno, fattr, &scaler);
+	if (ret < 0)
+		return ret;
+
+	/* the channel owns the scaler from here */
+	chnno = __create_chn(PI_AV_ID_VIDEO_SCALE, fattr, scaler);
+	if (chnno < 0) {
+		__destroy_scaler(scaler);
+		return chnno;
+	}
+
+	ret = __init_buf_queue_manager(chnno);
+	if (ret < 0) {
+		__destory_chn_by_chnno(chnno);
+		return ret;
+	}
+
+	return chnno;
+}
+
+/* destroy the scale channels before the isp channel they read */
+int pi_av_destroy_scale_chn(int chnno)
+{
+	struct pi_av_chn_node *chn_node = NULL;
+	enum chn_type type;
+	int ret = 0;
+
+	chn_node = __get_chn_by_chnno(chnno);
+	if (chn_node == NULL)
+		return -PI_E_NOT_FOUND;
+	type = chn_node->type;
+	__put_chn(chn_node);
+	if (type != PI_AV_ID_VIDEO_SCALE)
+		return -PI_E_NOT_FOUND;
+
+	ret = __destroy_buf_queue_manager(chnno);
+	if (ret < 0)
+		return ret;
+
+	return __destory_chn_by_chnno(chnno);
+}
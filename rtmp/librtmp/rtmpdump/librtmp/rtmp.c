@@ -136,6 +136,11 @@ static void HandleClientBW(RTMP *r, const RTMPPacket *packet);
 
 static int ReadN(RTMP *r, char *buffer, int n);
 static int WriteN(RTMP *r, const char *buffer, int n);
+#ifdef RTMP_WRITEV
+static int WriteChunksV(RTMP *r, char *header, int hSize, char *body,
+			int nSize, int nChunkSize, char c, int cSize,
+			uint32_t t, int channel);
+#endif
 
 static void DecodeTEA(AVal *key, AVal *text);
 
@@ -1556,6 +1561,106 @@ WriteN(RTMP *r, const char *buffer, int n)
   return n == 0;
 }
 
+#ifdef RTMP_WRITEV
+static int
+WriteV(RTMP *r, struct iovec *iov, int iovcnt)
+{
+  ssize_t nBytes;
+
+  while (iovcnt > 0)
+    {
+      nBytes = writev(r->m_sb.sb_socket, iov, iovcnt);
+      if (nBytes < 0)
+	{
+	  int sockerr = GetSockError();
+	  RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d", __FUNCTION__,
+	      sockerr);
+
+	  if (sockerr == EINTR && !RTMP_ctrlC)
+	    continue;
+
+	  RTMP_Close(r);
+	  return FALSE;
+	}
+
+      if (nBytes == 0)
+	return FALSE;
+
+      /* drop what went out, a partly sent iovec is advanced in place */
+      while (iovcnt > 0 && nBytes >= (ssize_t)iov->iov_len)
+	{
+	  nBytes -= iov->iov_len;
+	  iov++;
+	  iovcnt--;
+	}
+      if (iovcnt > 0)
+	{
+	  iov->iov_base = (char *)iov->iov_base + nBytes;
+	  iov->iov_len -= nBytes;
+	}
+    }
+
+  return TRUE;
+}
+
+/* the message header, then every chunk of the body straight from where
+ * it is, the type 3 header in front of each following chunk is the same
+ * for all of them and built once; the body is left untouched, so a
+ * packet can be sent again */
+static int
+WriteChunksV(RTMP *r, char *header, int hSize, char *body, int nSize,
+	     int nChunkSize, char c, int cSize, uint32_t t, int channel)
+{
+  struct iovec iov[2 * RTMP_WRITEV_CHUNKS];
+  char chdr[1 + 2 + 4];
+  int chSize = 1;
+  int n = 0;
+  int len;
+
+  chdr[0] = (0xc0 | c);
+  if (cSize)
+    {
+      int tmp = channel - 64;
+      chdr[1] = tmp & 0xff;
+      if (cSize == 2)
+	chdr[2] = tmp >> 8;
+      chSize += cSize;
+    }
+  if (t >= 0xffffff)
+    {
+      AMF_EncodeInt32(chdr + chSize, chdr + sizeof(chdr), t);
+      chSize += 4;
+    }
+
+  iov[n].iov_base = header;
+  iov[n++].iov_len = hSize;
+  for (;;)
+    {
+      len = nSize < nChunkSize ? nSize : nChunkSize;
+      if (len > 0)
+	{
+	  iov[n].iov_base = body;
+	  iov[n++].iov_len = len;
+	  body += len;
+	  nSize -= len;
+	}
+      if (nSize == 0)
+	break;
+
+      if (n + 2 > (int)(sizeof(iov) / sizeof(iov[0])))
+	{
+	  if (!WriteV(r, iov, n))
+	    return FALSE;
+	  n = 0;
+	}
+      iov[n].iov_base = chdr;
+      iov[n++].iov_len = chSize;
+    }
+
+  return WriteV(r, iov, n);
+}
+#endif
+
 #define SAVC(x)	static const AVal av_##x = AVC(#x)
 
 SAVC(app);
@@ -3902,6 +4007,8 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
   char *header, *hptr, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
   uint32_t t;
   char *buffer, *tbuf = NULL, *toff = NULL;
+  char saved[1 + 2 + 4];
+  int nSaved = 0;
   int nChunkSize;
   int tlen;
 
@@ -4019,6 +4126,24 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
 
   RTMP_Log(RTMP_LOGDEBUG2, "%s: fd=%d, size=%d", __FUNCTION__, r->m_sb.sb_socket,
       nSize);
+#ifdef RTMP_WRITEV
+  /* plain tcp: a few writev instead of a send per chunk or a copy of the
+   * whole message into tbuf */
+  if (!(r->Link.protocol & RTMP_FEATURE_HTTP)
+#ifdef CRYPTO
+      && !r->Link.rc4keyOut
+#ifndef NO_SSL
+      && !r->m_sb.sb_ssl
+#endif
+#endif
+      )
+    {
+      if (!WriteChunksV(r, header, hSize, buffer, nSize, nChunkSize, c,
+			cSize, t, packet->m_nChannel))
+	return FALSE;
+      nSize = hSize = 0;
+    }
+#endif
   /* send all chunks in one HTTP request */
   if (r->Link.protocol & RTMP_FEATURE_HTTP)
     {
@@ -4045,13 +4170,21 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
         {
 	  memcpy(toff, header, nChunkSize + hSize);
 	  toff += nChunkSize + hSize;
+	  wrote = TRUE;
 	}
       else
         {
 	  wrote = WriteN(r, header, nChunkSize + hSize);
-	  if (!wrote)
-	    return FALSE;
 	}
+      /* the chunk header went over the end of the last chunk, put the
+       * body back so the packet can be sent again */
+      if (nSaved)
+	{
+	  memcpy(header, saved, nSaved);
+	  nSaved = 0;
+	}
+      if (!wrote)
+	return FALSE;
       nSize -= nChunkSize;
       buffer += nChunkSize;
       hSize = 0;
@@ -4070,6 +4203,8 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
               header -= 4;
               hSize += 4;
             }
+	  memcpy(saved, header, hSize);
+	  nSaved = hSize;
 	  *header = (0xc0 | c);
 	  if (cSize)
 	    {
@@ -56,6 +56,12 @@
 #define closesocket(s)	close(s)
 #define msleep(n)	usleep(n*1000)
 #define SET_RCVTIMEO(tv,s)	struct timeval tv = {s,0}
+#ifndef _DEBUG	/* _DEBUG dumps every send to netstackdump */
+#include <sys/uio.h>
+#define RTMP_WRITEV
+/* chunks of a message per writev, two iovecs each */
+#define RTMP_WRITEV_CHUNKS	64
+#endif
 #endif
 
 #include "rtmp.h"
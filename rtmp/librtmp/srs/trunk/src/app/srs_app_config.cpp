@@ -33,6 +33,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/socket.h>
 
 #include <vector>
 #include <algorithm>
@@ -46,6 +47,7 @@ using namespace std;
 #include <srs_kernel_file.hpp>
 #include <srs_app_utility.hpp>
 #include <srs_core_performance.hpp>
+#include <srs_app_worker.hpp>
 
 using namespace _srs_internal;
 
@@ -70,6 +72,7 @@ const char* _srs_version = "XCORE-"RTMP_SIG_SRS_SERVER;
 #define SRS_CONF_DEFAULT_UTC_TIME false
 
 #define SRS_CONF_DEFAULT_MAX_CONNECTIONS 1000
+#define SRS_CONF_DEFAULT_WORKERS 1
 #define SRS_CONF_DEFAULT_HLS_PATH "./objs/nginx/html"
 #define SRS_CONF_DEFAULT_HLS_M3U8_FILE "[app]/[stream].m3u8"
 #define SRS_CONF_DEFAULT_HLS_TS_FILE "[app]/[stream]-[seq].ts"
@@ -96,6 +99,11 @@ const char* _srs_version = "XCORE-"RTMP_SIG_SRS_SERVER;
 #define SRS_CONF_DEFAULT_TIME_JITTER "full"
 #define SRS_CONF_DEFAULT_ATC_AUTO true
 #define SRS_CONF_DEFAULT_MIX_CORRECT false
+// the gops to cache and the seconds before live where player starts.
+#define SRS_CONF_DEFAULT_GOP_CACHE_GOPS 1
+#define SRS_CONF_DEFAULT_GOP_CACHE_START 0
+// the max gops to cache.
+#define SRS_CONF_MAX_GOP_CACHE_GOPS 64
 // in seconds, the paused queue length.
 #define SRS_CONF_DEFAULT_PAUSED_LENGTH 10
 // the interval in seconds for bandwidth check
@@ -637,8 +645,11 @@ int SrsConfig::reload_vhost(SrsConfDirective* old_root)
                 }
                 srs_trace("vhost %s reload atc success.", vhost.c_str());
             }
-            // gop_cache, only one per vhost
-            if (!srs_directive_equals(new_vhost->get("gop_cache"), old_vhost->get("gop_cache"))) {
+            // gop_cache, gop_cache_gops and gop_cache_start, only one per vhost
+            if (!srs_directive_equals(new_vhost->get("gop_cache"), old_vhost->get("gop_cache"))
+                || !srs_directive_equals(new_vhost->get("gop_cache_gops"), old_vhost->get("gop_cache_gops"))
+                || !srs_directive_equals(new_vhost->get("gop_cache_start"), old_vhost->get("gop_cache_start"))
+            ) {
                 for (it = subscribes.begin(); it != subscribes.end(); ++it) {
                     ISrsReloadHandler* subscribe = *it;
                     if ((ret = subscribe->on_reload_vhost_gop_cache(vhost)) != ERROR_SUCCESS) {
@@ -881,7 +892,7 @@ int SrsConfig::reload_conf(SrsConfig* conf)
     std::vector<ISrsReloadHandler*>::iterator it;
 
     // never support reload:
-    //      daemon
+    //      daemon, workers
     //
     // always support reload without additional code:
     //      chunk_size, ff_log_dir,
@@ -1573,6 +1584,7 @@ int SrsConfig::check_config()
             && n != "http_api" && n != "stats" && n != "vhost" && n != "pithy_print_ms"
             && n != "http_stream" && n != "http_server" && n != "stream_caster"
             && n != "utc_time" && n != "work_dir" && n != "asprocess"
+            && n != "workers"
         ) {
             ret = ERROR_SYSTEM_CONFIG_INVALID;
             srs_error("unsupported directive %s, ret=%d", n.c_str(), ret);
@@ -1692,6 +1704,22 @@ int SrsConfig::check_config()
         }
     }
     
+    ////////////////////////////////////////////////////////////////////////
+    // check workers
+    ////////////////////////////////////////////////////////////////////////
+    if (get_workers() <= 0 || get_workers() > SRS_WORKER_MAX_WORKERS) {
+        ret = ERROR_SYSTEM_CONFIG_INVALID;
+        srs_error("directive workers invalid, workers=%d, max=%d, ret=%d", get_workers(), SRS_WORKER_MAX_WORKERS, ret);
+        return ret;
+    }
+#ifndef SO_REUSEPORT
+    if (get_workers() > 1) {
+        ret = ERROR_SYSTEM_CONFIG_INVALID;
+        srs_error("directive workers=%d requires SO_REUSEPORT, ret=%d", get_workers(), ret);
+        return ret;
+    }
+#endif
+    
     ////////////////////////////////////////////////////////////////////////
     // check heartbeat
     ////////////////////////////////////////////////////////////////////////
@@ -1814,7 +1842,8 @@ int SrsConfig::check_config()
             if (n != "enabled" && n != "chunk_size"
                 && n != "mode" && n != "origin" && n != "token_traverse" && n != "vhost"
                 && n != "dvr" && n != "ingest" && n != "hls" && n != "http_hooks"
-                && n != "gop_cache" && n != "queue_length"
+                && n != "gop_cache" && n != "gop_cache_gops" && n != "gop_cache_start"
+                && n != "queue_length"
                 && n != "refer" && n != "refer_publish" && n != "refer_play"
                 && n != "forward" && n != "transcode" && n != "bandcheck"
                 && n != "time_jitter" && n != "mix_correct"
@@ -2028,6 +2057,27 @@ int SrsConfig::check_config()
             return ret;
         }
     }
+    
+    ////////////////////////////////////////////////////////////////////////
+    // check gop cache
+    ////////////////////////////////////////////////////////////////////////
+    for (int i = 0; i < (int)vhosts.size(); i++) {
+        SrsConfDirective* vhost = vhosts[i];
+        if (get_gop_cache_gops(vhost->arg0()) <= 0
+            || get_gop_cache_gops(vhost->arg0()) > SRS_CONF_MAX_GOP_CACHE_GOPS
+        ) {
+            ret = ERROR_SYSTEM_CONFIG_INVALID;
+            srs_error("directive vhost %s gop_cache_gops invalid, gops=%d, must in [1, %d], ret=%d", 
+                vhost->arg0().c_str(), get_gop_cache_gops(vhost->arg0()), SRS_CONF_MAX_GOP_CACHE_GOPS, ret);
+            return ret;
+        }
+        if (get_gop_cache_start(vhost->arg0()) < 0) {
+            ret = ERROR_SYSTEM_CONFIG_INVALID;
+            srs_error("directive vhost %s gop_cache_start invalid, start=%.2f, ret=%d", 
+                vhost->arg0().c_str(), get_gop_cache_start(vhost->arg0()), ret);
+            return ret;
+        }
+    }
     for (int i = 0; i < (int)vhosts.size(); i++) {
         SrsConfDirective* vhost = vhosts[i];
         srs_assert(vhost != NULL);
@@ -2142,6 +2192,18 @@ int SrsConfig::get_max_connections()
     return ::atoi(conf->arg0().c_str());
 }
 
+int SrsConfig::get_workers()
+{
+    srs_assert(root);
+    
+    SrsConfDirective* conf = root->get("workers");
+    if (!conf || conf->arg0().empty()) {
+        return SRS_CONF_DEFAULT_WORKERS;
+    }
+    
+    return ::atoi(conf->arg0().c_str());
+}
+
 vector<string> SrsConfig::get_listens()
 {
     std::vector<string> ports;
@@ -2378,6 +2440,38 @@ bool SrsConfig::get_gop_cache(string vhost)
     return SRS_CONF_PERFER_TRUE(conf->arg0());
 }
 
+int SrsConfig::get_gop_cache_gops(string vhost)
+{
+    SrsConfDirective* conf = get_vhost(vhost);
+
+    if (!conf) {
+        return SRS_CONF_DEFAULT_GOP_CACHE_GOPS;
+    }
+    
+    conf = conf->get("gop_cache_gops");
+    if (!conf || conf->arg0().empty()) {
+        return SRS_CONF_DEFAULT_GOP_CACHE_GOPS;
+    }
+    
+    return ::atoi(conf->arg0().c_str());
+}
+
+double SrsConfig::get_gop_cache_start(string vhost)
+{
+    SrsConfDirective* conf = get_vhost(vhost);
+
+    if (!conf) {
+        return SRS_CONF_DEFAULT_GOP_CACHE_START;
+    }
+    
+    conf = conf->get("gop_cache_start");
+    if (!conf || conf->arg0().empty()) {
+        return SRS_CONF_DEFAULT_GOP_CACHE_START;
+    }
+    
+    return ::atof(conf->arg0().c_str());
+}
+
 bool SrsConfig::get_debug_srs_upnode(string vhost)
 {
     SrsConfDirective* conf = get_vhost(vhost);
@@ -355,6 +355,12 @@ public:
     */
     virtual int                 get_max_connections();
     /**
+    * get the number of worker processes.
+    * when more than one, the master fork the workers which listen the same
+    * ports by SO_REUSEPORT, and the stream is relayed between the workers.
+    */
+    virtual int                 get_workers();
+    /**
     * get the listen port of SRS.
     * user can specifies multiple listen ports,
     * each args of directive is a listen port.
@@ -447,6 +453,17 @@ public:
     */
     virtual bool                get_gop_cache(std::string vhost);
     /**
+    * get the max gops to cache of vhost.
+    * @remark, default 1.
+    */
+    virtual int                 get_gop_cache_gops(std::string vhost);
+    /**
+    * get the seconds before live, where the player starts from the keyframe.
+    * @return 0 to start from the latest keyframe.
+    * @remark, default 0.
+    */
+    virtual double              get_gop_cache_start(std::string vhost);
+    /**
     * whether debug_srs_upnode is enabled of vhost.
     * debug_srs_upnode is very important feature for tracable log,
     * but some server, for instance, flussonic donot support it.
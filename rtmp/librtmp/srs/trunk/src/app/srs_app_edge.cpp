@@ -42,6 +42,7 @@ using namespace std;
 #include <srs_protocol_kbps.hpp>
 #include <srs_rtmp_msg_array.hpp>
 #include <srs_app_utility.hpp>
+#include <srs_app_worker.hpp>
 #include <srs_rtmp_amf0.hpp>
 #include <srs_kernel_utility.hpp>
 
@@ -340,6 +341,11 @@ int SrsEdgeIngester::connect_server(string& ep_server, string& ep_port)
     // reopen
     close_underlayer_socket();
     
+    // relay from the worker which own the stream.
+    if (!_srs_config->get_vhost_is_edge(_req->vhost)) {
+        return connect_worker(ep_server, ep_port);
+    }
+    
     SrsConfDirective* conf = _srs_config->get_vhost_edge_origin(_req->vhost);
     
     // @see https://github.com/ossrs/srs/issues/79
@@ -392,6 +398,51 @@ int SrsEdgeIngester::connect_server(string& ep_server, string& ep_port)
     return ret;
 }
 
+int SrsEdgeIngester::connect_worker(string& ep_server, string& ep_port)
+{
+    int ret = ERROR_SUCCESS;
+    
+    SrsWorkers* workers = SrsWorkers::instance();
+    int worker = workers->relay_from(_req->get_stream_url());
+    if (worker < 0) {
+        ret = ERROR_SYSTEM_WORKER_RELAY;
+        srs_warn("stream %s not published on other workers. ret=%d", _req->get_stream_url().c_str(), ret);
+        return ret;
+    }
+    
+    // output the connected server and port,
+    // the tcUrl of relay use the local rtmp port.
+    std::string ip;
+    std::vector<std::string> ip_ports = _srs_config->get_listens();
+    srs_assert(!ip_ports.empty());
+    srs_parse_endpoint(ip_ports[0], ip, ep_port);
+    ep_server = "127.0.0.1";
+    
+    // open socket.
+    std::string path = workers->relay_path(worker);
+    int64_t timeout = SRS_EDGE_INGESTER_TIMEOUT_US;
+    if ((ret = srs_unix_connect(path, timeout, &stfd)) != ERROR_SUCCESS) {
+        srs_warn("worker relay failed, stream=%s, worker=%d, path=%s, timeout=%"PRId64", ret=%d",
+            _req->stream.c_str(), worker, path.c_str(), timeout, ret);
+        return ret;
+    }
+    
+    kbps->set_io(NULL, NULL);
+    srs_freep(client);
+    srs_freep(io);
+    
+    srs_assert(stfd);
+    io = new SrsStSocket(stfd);
+    client = new SrsRtmpClient(io);
+    
+    kbps->set_io(io, io);
+    
+    srs_trace("worker relay connected, url=%s/%s, worker=%d, path=%s",
+        _req->tcUrl.c_str(), _req->stream.c_str(), worker, path.c_str());
+    
+    return ret;
+}
+
 SrsEdgeForwarder::SrsEdgeForwarder()
 {
     io = NULL;
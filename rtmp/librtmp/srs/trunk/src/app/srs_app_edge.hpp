@@ -103,6 +103,8 @@ private:
     virtual int ingest();
     virtual void close_underlayer_socket();
     virtual int connect_server(std::string& ep_server, std::string& ep_port);
+    // for multiple workers, connect to the worker which own the stream.
+    virtual int connect_worker(std::string& ep_server, std::string& ep_port);
     virtual int connect_app(std::string ep_server, std::string ep_port);
     virtual int process_publish_message(SrsCommonMessage* msg);
 };
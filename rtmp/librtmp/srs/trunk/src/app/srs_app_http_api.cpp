@@ -205,6 +205,7 @@ int SrsGoApiV1::serve_http(ISrsHttpResponseWriter* w, ISrsHttpMessage* r)
             << SRS_JFIELD_STR("vhosts", "manage all vhosts or specified vhost") << SRS_JFIELD_CONT
             << SRS_JFIELD_STR("streams", "manage all streams or specified stream") << SRS_JFIELD_CONT
             << SRS_JFIELD_STR("clients", "manage all clients or specified client, default query top 10 clients") << SRS_JFIELD_CONT
+            << SRS_JFIELD_STR("workers", "the stat of all workers and the stream owners") << SRS_JFIELD_CONT
             << SRS_JFIELD_ORG("tests", SRS_JOBJECT_START)
                 << SRS_JFIELD_STR("requests", "show the request info") << SRS_JFIELD_CONT
                 << SRS_JFIELD_STR("errors", "always return an error 100") << SRS_JFIELD_CONT
@@ -838,6 +839,33 @@ int SrsGoApiClients::serve_http(ISrsHttpResponseWriter* w, ISrsHttpMessage* r)
     return ret;
 }
 
+SrsGoApiWorkers::SrsGoApiWorkers()
+{
+}
+
+SrsGoApiWorkers::~SrsGoApiWorkers()
+{
+}
+
+int SrsGoApiWorkers::serve_http(ISrsHttpResponseWriter* w, ISrsHttpMessage* r)
+{
+    int ret = ERROR_SUCCESS;
+    
+    SrsStatistic* stat = SrsStatistic::instance();
+    std::stringstream ss;
+    
+    std::stringstream data;
+    ret = stat->dumps_workers(data);
+    
+    ss << SRS_JOBJECT_START
+            << SRS_JFIELD_ERROR(ret) << SRS_JFIELD_CONT
+            << SRS_JFIELD_ORG("server", stat->server_id()) << SRS_JFIELD_CONT
+            << SRS_JFIELD_ORG("data", data.str())
+        << SRS_JOBJECT_END;
+    
+    return srs_api_response(w, r, ss.str());
+}
+
 SrsGoApiError::SrsGoApiError()
 {
 }
@@ -177,6 +177,15 @@ public:
     virtual int serve_http(ISrsHttpResponseWriter* w, ISrsHttpMessage* r);
 };
 
+class SrsGoApiWorkers : public ISrsHttpHandler
+{
+public:
+    SrsGoApiWorkers();
+    virtual ~SrsGoApiWorkers();
+public:
+    virtual int serve_http(ISrsHttpResponseWriter* w, ISrsHttpMessage* r);
+};
+
 class SrsGoApiError : public ISrsHttpHandler
 {
 public:
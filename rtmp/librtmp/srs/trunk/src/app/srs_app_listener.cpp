@@ -25,17 +25,21 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
 using namespace std;
 
 #include <srs_kernel_log.hpp>
 #include <srs_kernel_error.hpp>
 #include <srs_app_server.hpp>
 #include <srs_app_utility.hpp>
+#include <srs_app_config.hpp>
 
 // set the max packet size.
 #define SRS_UDP_MAX_PACKET_SIZE 65535
@@ -223,6 +227,19 @@ int SrsTcpListener::listen()
     }
     srs_verbose("setsockopt reuse-addr success. port=%d, fd=%d", port, _fd);
     
+    // for multiple workers, all workers listen the same port,
+    // and the kernel balance the clients to workers.
+#ifdef SO_REUSEPORT
+    if (_srs_config->get_workers() > 1) {
+        if (setsockopt(_fd, SOL_SOCKET, SO_REUSEPORT, &reuse_socket, sizeof(int)) == -1) {
+            ret = ERROR_SOCKET_SETREUSE;
+            srs_error("setsockopt reuse-port error. port=%d, ret=%d", port, ret);
+            return ret;
+        }
+        srs_verbose("setsockopt reuse-port success. port=%d, fd=%d", port, _fd);
+    }
+#endif
+    
     // Detect alive for TCP connection.
     // @see https://github.com/ossrs/srs/issues/1044
 #ifdef SO_KEEPALIVE
@@ -292,3 +309,107 @@ int SrsTcpListener::cycle()
     return ret;
 }
 
+SrsUnixListener::SrsUnixListener(ISrsTcpHandler* h, string p)
+{
+    handler = h;
+    path = p;
+    
+    _fd = -1;
+    _stfd = NULL;
+    
+    pthread = new SrsReusableThread("unix", this);
+}
+
+SrsUnixListener::~SrsUnixListener()
+{
+    pthread->stop();
+    srs_freep(pthread);
+    
+    srs_close_stfd(_stfd);
+    
+    if (_fd >= 0) {
+        ::unlink(path.c_str());
+    }
+}
+
+int SrsUnixListener::fd()
+{
+    return _fd;
+}
+
+int SrsUnixListener::listen()
+{
+    int ret = ERROR_SUCCESS;
+    
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    if (path.length() >= sizeof(addr.sun_path)) {
+        ret = ERROR_SYSTEM_UNIX_SOCKET;
+        srs_error("unix socket path too long. path=%s, ret=%d", path.c_str(), ret);
+        return ret;
+    }
+    strcpy(addr.sun_path, path.c_str());
+    
+    if ((_fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+        ret = ERROR_SOCKET_CREATE;
+        srs_error("create unix socket error. path=%s, ret=%d", path.c_str(), ret);
+        return ret;
+    }
+    srs_verbose("create unix socket success. path=%s, fd=%d", path.c_str(), _fd);
+    
+    // remove the socket file left by the dead process.
+    ::unlink(path.c_str());
+    
+    if (bind(_fd, (const sockaddr*)&addr, sizeof(sockaddr_un)) == -1) {
+        ret = ERROR_SOCKET_BIND;
+        srs_error("bind unix socket error. path=%s, ret=%d", path.c_str(), ret);
+        return ret;
+    }
+    srs_verbose("bind unix socket success. path=%s, fd=%d", path.c_str(), _fd);
+    
+    if (::listen(_fd, SERVER_LISTEN_BACKLOG) == -1) {
+        ret = ERROR_SOCKET_LISTEN;
+        srs_error("listen unix socket error. path=%s, ret=%d", path.c_str(), ret);
+        return ret;
+    }
+    srs_verbose("listen unix socket success. path=%s, fd=%d", path.c_str(), _fd);
+    
+    if ((_stfd = st_netfd_open_socket(_fd)) == NULL){
+        ret = ERROR_ST_OPEN_SOCKET;
+        srs_error("st_netfd_open_socket open unix socket failed. path=%s, ret=%d", path.c_str(), ret);
+        return ret;
+    }
+    srs_verbose("st open unix socket success. path=%s, fd=%d", path.c_str(), _fd);
+    
+    if ((ret = pthread->start()) != ERROR_SUCCESS) {
+        srs_error("st_thread_create unix listen thread error. path=%s, ret=%d", path.c_str(), ret);
+        return ret;
+    }
+    srs_verbose("create st unix listen thread success, path=%s", path.c_str());
+    
+    return ret;
+}
+
+int SrsUnixListener::cycle()
+{
+    int ret = ERROR_SUCCESS;
+    
+    st_netfd_t client_stfd = st_accept(_stfd, NULL, NULL, ST_UTIME_NO_TIMEOUT);
+    
+    if(client_stfd == NULL){
+        // ignore error.
+        if (errno != EINTR) {
+            srs_error("ignore accept thread stoppped for accept unix client error");
+        }
+        return ret;
+    }
+    srs_verbose("get a unix client. fd=%d", st_netfd_fileno(client_stfd));
+    
+    if ((ret = handler->on_tcp_client(client_stfd)) != ERROR_SUCCESS) {
+        srs_warn("accept unix client error. ret=%d", ret);
+        return ret;
+    }
+    
+    return ret;
+}
@@ -133,4 +133,29 @@ public:
     virtual int cycle();
 };
 
+/**
+* bind and listen unix socket, use handler to process the client,
+* for the workers to relay stream from each other.
+*/
+class SrsUnixListener : public ISrsReusableThreadHandler
+{
+private:
+    int _fd;
+    st_netfd_t _stfd;
+    SrsReusableThread* pthread;
+private:
+    ISrsTcpHandler* handler;
+    std::string path;
+public:
+    SrsUnixListener(ISrsTcpHandler* h, std::string p);
+    virtual ~SrsUnixListener();
+public:
+    virtual int fd();
+public:
+    virtual int listen();
+// interface ISrsReusableThreadHandler.
+public:
+    virtual int cycle();
+};
+
 #endif
@@ -53,6 +53,7 @@ using namespace std;
 #include <srs_kernel_utility.hpp>
 #include <srs_app_security.hpp>
 #include <srs_app_statistic.hpp>
+#include <srs_app_worker.hpp>
 #include <srs_rtmp_utility.hpp>
 
 // when stream is busy, for example, streaming is already
@@ -75,7 +76,7 @@ using namespace std;
 // when edge timeout, retry next.
 #define SRS_EDGE_TOKEN_TRAVERSE_TIMEOUT_US (int64_t)(3*1000*1000LL)
 
-SrsRtmpConn::SrsRtmpConn(SrsServer* svr, st_netfd_t c)
+SrsRtmpConn::SrsRtmpConn(SrsServer* svr, st_netfd_t c, bool r)
     : SrsConnection(svr, c)
 {
     server = svr;
@@ -83,6 +84,9 @@ SrsRtmpConn::SrsRtmpConn(SrsServer* svr, st_netfd_t c)
     res = new SrsResponse();
     skt = new SrsStSocket(c);
     rtmp = new SrsRtmpServer(skt);
+#ifdef SRS_PERF_MSG_POOL
+    rtmp->set_pooled_payload(true);
+#endif
     refer = new SrsRefer();
     bandwidth = new SrsBandwidth();
     security = new SrsSecurity();
@@ -97,6 +101,7 @@ SrsRtmpConn::SrsRtmpConn(SrsServer* svr, st_netfd_t c)
     send_min_interval = 0;
     tcp_nodelay = false;
     client_type = SrsRtmpConnUnknown;
+    relay = r;
     
     _srs_config->subscribe(this);
 }
@@ -130,6 +135,11 @@ int SrsRtmpConn::do_cycle()
 {
     int ret = ERROR_SUCCESS;
     
+    // the peer of unix socket has no ip.
+    if (relay) {
+        ip = "unix";
+    }
+    
     srs_trace("RTMP client ip=%s", ip.c_str());
 
     rtmp->set_recv_timeout(SRS_CONSTS_RTMP_RECV_TIMEOUT_US);
@@ -478,8 +488,8 @@ int SrsRtmpConn::stream_service_cycle()
         }
     }
     
-    // security check
-    if ((ret = security->check(type, ip, req)) != ERROR_SUCCESS) {
+    // security check, the relay of workers is always allowed.
+    if (!relay && (ret = security->check(type, ip, req)) != ERROR_SUCCESS) {
         srs_error("security check failed. ret=%d", ret);
         return ret;
     }
@@ -504,9 +514,10 @@ int SrsRtmpConn::stream_service_cycle()
     }
     srs_assert(source != NULL);
     
-    // update the statistic when source disconveried.
+    // update the statistic when source disconveried,
+    // the relay of workers is not a client.
     SrsStatistic* stat = SrsStatistic::instance();
-    if ((ret = stat->on_client(_srs_context->get_id(), req, this, type)) != ERROR_SUCCESS) {
+    if (!relay && (ret = stat->on_client(_srs_context->get_id(), req, this, type)) != ERROR_SUCCESS) {
         srs_error("stat client failed. ret=%d", ret);
         return ret;
     }
@@ -974,6 +985,15 @@ int SrsRtmpConn::do_publishing(SrsSource* source, SrsPublishRecvThread* trd)
 int SrsRtmpConn::acquire_publish(SrsSource* source, bool is_edge)
 {
     int ret = ERROR_SUCCESS;
+    
+    // for multiple workers, only one publisher for a stream on all workers,
+    // and stop the relay when the stream move to this worker.
+    if (!is_edge) {
+        if ((ret = SrsWorkers::instance()->acquire(req->get_stream_url())) != ERROR_SUCCESS) {
+            return ret;
+        }
+        source->stop_relay_worker();
+    }
 
     if (!source->can_publish(is_edge)) {
         ret = ERROR_SYSTEM_STREAM_BUSY;
@@ -1006,6 +1026,7 @@ void SrsRtmpConn::release_publish(SrsSource* source, bool is_edge)
         source->on_edge_proxy_unpublish();
     } else {
         source->on_unpublish();
+        SrsWorkers::instance()->release(req->get_stream_url());
     }
 }
 
@@ -1366,7 +1387,7 @@ int SrsRtmpConn::http_hooks_on_connect()
     int ret = ERROR_SUCCESS;
     
 #ifdef SRS_AUTO_HTTP_CALLBACK
-    if (!_srs_config->get_vhost_http_hooks_enabled(req->vhost)) {
+    if (relay || !_srs_config->get_vhost_http_hooks_enabled(req->vhost)) {
         return ret;
     }
     
@@ -1401,7 +1422,7 @@ int SrsRtmpConn::http_hooks_on_connect()
 void SrsRtmpConn::http_hooks_on_close()
 {
 #ifdef SRS_AUTO_HTTP_CALLBACK
-    if (!_srs_config->get_vhost_http_hooks_enabled(req->vhost)) {
+    if (relay || !_srs_config->get_vhost_http_hooks_enabled(req->vhost)) {
         return;
     }
     
@@ -1500,7 +1521,7 @@ int SrsRtmpConn::http_hooks_on_play()
     int ret = ERROR_SUCCESS;
     
 #ifdef SRS_AUTO_HTTP_CALLBACK
-    if (!_srs_config->get_vhost_http_hooks_enabled(req->vhost)) {
+    if (relay || !_srs_config->get_vhost_http_hooks_enabled(req->vhost)) {
         return ret;
     }
     
@@ -1535,7 +1556,7 @@ int SrsRtmpConn::http_hooks_on_play()
 void SrsRtmpConn::http_hooks_on_stop()
 {
 #ifdef SRS_AUTO_HTTP_CALLBACK
-    if (!_srs_config->get_vhost_http_hooks_enabled(req->vhost)) {
+    if (relay || !_srs_config->get_vhost_http_hooks_enabled(req->vhost)) {
         return;
     }
     
@@ -96,8 +96,11 @@ private:
     bool tcp_nodelay;
     // The type of client, play or publish.
     SrsRtmpConnType client_type;
+    // whether the client is another worker relaying over the unix socket,
+    // which is not checked, hooked nor counted as a client.
+    bool relay;
 public:
-    SrsRtmpConn(SrsServer* svr, st_netfd_t c);
+    SrsRtmpConn(SrsServer* svr, st_netfd_t c, bool r);
     virtual ~SrsRtmpConn();
 public:
     virtual void dispose();
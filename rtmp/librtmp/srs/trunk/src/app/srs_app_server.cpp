@@ -47,6 +47,7 @@ using namespace std;
 #include <srs_app_rtsp.hpp>
 #include <srs_app_statistic.hpp>
 #include <srs_app_caster_flv.hpp>
+#include <srs_app_worker.hpp>
 #include <srs_core_mem_watch.hpp>
 
 // signal defines.
@@ -109,6 +110,8 @@ std::string srs_listener_type2string(SrsListenerType type)
         return "RTSP";
     case SrsListenerFlv:
         return "HTTP-FLV";
+    case SrsListenerWorkerRelay:
+        return "Worker-Relay";
     default:
         return "UNKONWN";
     }
@@ -176,6 +179,46 @@ int SrsStreamListener::on_tcp_client(st_netfd_t stfd)
     return ret;
 }
 
+SrsWorkerListener::SrsWorkerListener(SrsServer* svr, SrsListenerType t, string p) : SrsListener(svr, t)
+{
+    listener = NULL;
+    path = p;
+}
+
+SrsWorkerListener::~SrsWorkerListener()
+{
+    srs_freep(listener);
+}
+
+int SrsWorkerListener::listen(string /*i*/, int /*p*/)
+{
+    int ret = ERROR_SUCCESS;
+    
+    srs_freep(listener);
+    listener = new SrsUnixListener(this, path);
+    
+    if ((ret = listener->listen()) != ERROR_SUCCESS) {
+        srs_error("unix listen failed. ret=%d", ret);
+        return ret;
+    }
+    
+    srs_trace("%s listen at unix://%s, fd=%d", srs_listener_type2string(type).c_str(), path.c_str(), listener->fd());
+    
+    return ret;
+}
+
+int SrsWorkerListener::on_tcp_client(st_netfd_t stfd)
+{
+    int ret = ERROR_SUCCESS;
+    
+    if ((ret = server->accept_client(type, stfd)) != ERROR_SUCCESS) {
+        srs_warn("accept relay client error. ret=%d", ret);
+        return ret;
+    }
+    
+    return ret;
+}
+
 #ifdef SRS_AUTO_STREAM_CASTER
 SrsRtspListener::SrsRtspListener(SrsServer* svr, SrsListenerType t, SrsConfDirective* c) : SrsListener(svr, t)
 {
@@ -553,6 +596,7 @@ void SrsServer::dispose()
     close_listeners(SrsListenerMpegTsOverUdp);
     close_listeners(SrsListenerRtsp);
     close_listeners(SrsListenerFlv);
+    close_listeners(SrsListenerWorkerRelay);
     
     // @remark don't dispose ingesters, for too slow.
     
@@ -753,6 +797,16 @@ int SrsServer::listen()
         return ret;
     }
     
+    if ((ret = listen_worker_relay()) != ERROR_SUCCESS) {
+        return ret;
+    }
+    
+    // the stream caster only run on the first worker.
+    SrsWorkers* workers = SrsWorkers::instance();
+    if (workers->enabled() && workers->worker() != 0) {
+        return ret;
+    }
+    
     if ((ret = listen_stream_caster()) != ERROR_SUCCESS) {
         return ret;
     }
@@ -814,6 +868,9 @@ int SrsServer::http_handle()
     if ((ret = http_api_mux->handle("/api/v1/clients/", new SrsGoApiClients())) != ERROR_SUCCESS) {
         return ret;
     }
+    if ((ret = http_api_mux->handle("/api/v1/workers", new SrsGoApiWorkers())) != ERROR_SUCCESS) {
+        return ret;
+    }
     
     // test the request info.
     if ((ret = http_api_mux->handle("/api/v1/tests/requests", new SrsGoApiRequests())) != ERROR_SUCCESS) {
@@ -850,6 +907,14 @@ int SrsServer::ingest()
     int ret = ERROR_SUCCESS;
     
 #ifdef SRS_AUTO_INGEST
+    // the ingest only run on the first worker,
+    // other workers ignore the reload of ingest.
+    SrsWorkers* workers = SrsWorkers::instance();
+    if (workers->enabled() && workers->worker() != 0) {
+        _srs_config->unsubscribe(ingester);
+        return ret;
+    }
+    
     if ((ret = ingester->start()) != ERROR_SUCCESS) {
         srs_error("start ingest streams failed. ret=%d", ret);
         return ret;
@@ -1200,6 +1265,28 @@ int SrsServer::listen_stream_caster()
     return ret;
 }
 
+int SrsServer::listen_worker_relay()
+{
+    int ret = ERROR_SUCCESS;
+    
+    SrsWorkers* workers = SrsWorkers::instance();
+    if (!workers->enabled()) {
+        return ret;
+    }
+    
+    close_listeners(SrsListenerWorkerRelay);
+    
+    SrsListener* listener = new SrsWorkerListener(this, SrsListenerWorkerRelay, workers->relay_path(workers->worker()));
+    listeners.push_back(listener);
+    
+    if ((ret = listener->listen("", 0)) != ERROR_SUCCESS) {
+        srs_error("worker relay listen failed. ret=%d", ret);
+        return ret;
+    }
+    
+    return ret;
+}
+
 void SrsServer::close_listeners(SrsListenerType type)
 {
     std::vector<SrsListener*>::iterator it;
@@ -1235,6 +1322,7 @@ void SrsServer::resample_kbps()
     SrsKbps* kbps = stat->kbps_sample();
     
     srs_update_rtmp_server((int)conns.size(), kbps);
+    SrsWorkers::instance()->update((int)conns.size(), kbps);
 }
 
 int SrsServer::accept_client(SrsListenerType type, st_netfd_t client_stfd)
@@ -1243,8 +1331,9 @@ int SrsServer::accept_client(SrsListenerType type, st_netfd_t client_stfd)
     
     int fd = st_netfd_fileno(client_stfd);
     
+    // the relay of workers is not limited by the max connections.
     int max_connections = _srs_config->get_max_connections();
-    if ((int)conns.size() >= max_connections) {
+    if (type != SrsListenerWorkerRelay && (int)conns.size() >= max_connections) {
         srs_error("exceed the max connections, drop client: "
             "clients=%d, max=%d, fd=%d", (int)conns.size(), max_connections, fd);
             
@@ -1273,8 +1362,8 @@ int SrsServer::accept_client(SrsListenerType type, st_netfd_t client_stfd)
     }
     
     SrsConnection* conn = NULL;
-    if (type == SrsListenerRtmpStream) {
-        conn = new SrsRtmpConn(this, client_stfd);
+    if (type == SrsListenerRtmpStream || type == SrsListenerWorkerRelay) {
+        conn = new SrsRtmpConn(this, client_stfd, type == SrsListenerWorkerRelay);
     } else if (type == SrsListenerHttpApi) {
 #ifdef SRS_AUTO_HTTP_API
         conn = new SrsHttpApi(this, client_stfd, http_api_mux);
@@ -1319,6 +1408,12 @@ int SrsServer::on_reload_listen()
 
 int SrsServer::on_reload_pid()
 {
+    // the pid file is held by master for workers.
+    if (SrsWorkers::instance()->enabled()) {
+        srs_warn("ignore reload pid for workers");
+        return ERROR_SUCCESS;
+    }
+    
     if (pid_fd > 0) {
         ::close(pid_fd);
         pid_fd = -1;
@@ -52,6 +52,7 @@ class ISrsTcpHandler;
 class ISrsUdpHandler;
 class SrsUdpListener;
 class SrsTcpListener;
+class SrsUnixListener;
 #ifdef SRS_AUTO_STREAM_CASTER
 class SrsAppCasterFlv;
 #endif
@@ -72,6 +73,8 @@ enum SrsListenerType
     SrsListenerRtsp             = 4,
     // TCP stream, FLV stream over HTTP.
     SrsListenerFlv              = 5,
+    // unix socket, RTMP relay between workers.
+    SrsListenerWorkerRelay      = 6,
 };
 
 /**
@@ -110,6 +113,27 @@ public:
     virtual int on_tcp_client(st_netfd_t stfd);
 };
 
+/**
+* the unix socket listener, for the workers to relay RTMP stream.
+*/
+class SrsWorkerListener : virtual public SrsListener, virtual public ISrsTcpHandler
+{
+private:
+    SrsUnixListener* listener;
+    std::string path;
+public:
+    SrsWorkerListener(SrsServer* svr, SrsListenerType t, std::string p);
+    virtual ~SrsWorkerListener();
+public:
+    /**
+    * listen at the unix socket path, the ip and port are ignored.
+    */
+    virtual int listen(std::string i, int p);
+// ISrsTcpHandler
+public:
+    virtual int on_tcp_client(st_netfd_t stfd);
+};
+
 #ifdef SRS_AUTO_STREAM_CASTER
 /**
 * the tcp listener, for rtsp server.
@@ -345,6 +369,10 @@ private:
     virtual int listen_http_stream();
     virtual int listen_stream_caster();
     /**
+    * listen at the unix socket for other workers to relay stream.
+    */
+    virtual int listen_worker_relay();
+    /**
     * close the listeners for specified type, 
     * remove the listen object from manager.
     */
@@ -23,6 +23,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <srs_app_source.hpp>
 
+#include <string.h>
 #include <sstream>
 #include <algorithm>
 using namespace std;
@@ -44,6 +45,7 @@ using namespace std;
 #include <srs_rtmp_msg_array.hpp>
 #include <srs_app_hds.hpp>
 #include <srs_app_statistic.hpp>
+#include <srs_app_worker.hpp>
 #include <srs_core_autofree.hpp>
 #include <srs_rtmp_utility.hpp>
 
@@ -153,93 +155,97 @@ int SrsRtmpJitter::get_time()
     return (int)last_pkt_correct_time;
 }
 
-#ifdef SRS_PERF_QUEUE_FAST_VECTOR
-SrsFastVector::SrsFastVector()
+SrsMessageDeque::SrsMessageDeque()
 {
-    count = 0;
+    head = count = 0;
     nb_msgs = SRS_PERF_MW_MSGS * 8;
     msgs = new SrsSharedPtrMessage*[nb_msgs];
 }
 
-SrsFastVector::~SrsFastVector()
+SrsMessageDeque::~SrsMessageDeque()
 {
     free();
     srs_freepa(msgs);
 }
 
-int SrsFastVector::size()
-{
-    return count;
-}
-
-int SrsFastVector::begin()
-{
-    return 0;
-}
-
-int SrsFastVector::end()
+int SrsMessageDeque::size()
 {
     return count;
 }
 
-SrsSharedPtrMessage** SrsFastVector::data()
-{
-    return msgs;
-}
-
-SrsSharedPtrMessage* SrsFastVector::at(int index)
+SrsSharedPtrMessage* SrsMessageDeque::at(int index)
 {
     srs_assert(index < count);
-    return msgs[index];
+    return msgs[(head + index) & (nb_msgs - 1)];
 }
 
-void SrsFastVector::clear()
+void SrsMessageDeque::push_back(SrsSharedPtrMessage* msg)
 {
-    count = 0;
+    if (count >= nb_msgs) {
+        grow();
+    }
+    
+    msgs[(head + count) & (nb_msgs - 1)] = msg;
+    count++;
 }
 
-void SrsFastVector::erase(int _begin, int _end)
+void SrsMessageDeque::push_front(SrsSharedPtrMessage* msg)
 {
-    srs_assert(_begin < _end);
-    
-    // move all erased to previous.
-    for (int i = 0; i < count - _end; i++) {
-        msgs[_begin + i] = msgs[_end + i];
+    if (count >= nb_msgs) {
+        grow();
     }
     
-    // update the count.
-    count -= _end - _begin;
+    head = (head - 1) & (nb_msgs - 1);
+    msgs[head] = msg;
+    count++;
 }
 
-void SrsFastVector::push_back(SrsSharedPtrMessage* msg)
+void SrsMessageDeque::pop_front(SrsSharedPtrMessage** pmsgs, int n)
 {
-    // increase vector.
-    if (count >= nb_msgs) {
-        int size = nb_msgs * 2;
-        SrsSharedPtrMessage** buf = new SrsSharedPtrMessage*[size];
-        for (int i = 0; i < nb_msgs; i++) {
-            buf[i] = msgs[i];
+    srs_assert(n <= count);
+    
+    // the msgs maybe wrap, copy in two parts.
+    if (pmsgs) {
+        int first = srs_min(n, nb_msgs - head);
+        memcpy(pmsgs, msgs + head, first * sizeof(SrsSharedPtrMessage*));
+        if (n > first) {
+            memcpy(pmsgs + first, msgs, (n - first) * sizeof(SrsSharedPtrMessage*));
         }
-        srs_warn("fast vector incrase %d=>%d", nb_msgs, size);
-        
-        // use new array.
-        srs_freepa(msgs);
-        msgs = buf;
-        nb_msgs = size;
     }
     
-    msgs[count++] = msg;
+    head = (head + n) & (nb_msgs - 1);
+    count -= n;
 }
 
-void SrsFastVector::free()
+void SrsMessageDeque::clear()
+{
+    head = count = 0;
+}
+
+void SrsMessageDeque::free()
 {
     for (int i = 0; i < count; i++) {
-        SrsSharedPtrMessage* msg = msgs[i];
+        SrsSharedPtrMessage* msg = msgs[(head + i) & (nb_msgs - 1)];
         srs_freep(msg);
     }
-    count = 0;
+    clear();
+}
+
+void SrsMessageDeque::grow()
+{
+    int size = nb_msgs * 2;
+    SrsSharedPtrMessage** buf = new SrsSharedPtrMessage*[size];
+    for (int i = 0; i < count; i++) {
+        buf[i] = msgs[(head + i) & (nb_msgs - 1)];
+    }
+    srs_warn("message deque increase %d=>%d", nb_msgs, size);
+    
+    // use new array.
+    srs_freepa(msgs);
+    msgs = buf;
+    nb_msgs = size;
+    head = 0;
 }
-#endif
 
 SrsMessageQueue::SrsMessageQueue(bool ignore_shrink)
 {
@@ -255,7 +261,7 @@ SrsMessageQueue::~SrsMessageQueue()
 
 int SrsMessageQueue::size()
 {
-    return (int)msgs.size();
+    return msgs.size();
 }
 
 int SrsMessageQueue::duration()
@@ -298,32 +304,19 @@ int SrsMessageQueue::dump_packets(int max_count, SrsSharedPtrMessage** pmsgs, in
 {
     int ret = ERROR_SUCCESS;
     
-    int nb_msgs = (int)msgs.size();
+    int nb_msgs = msgs.size();
     if (nb_msgs <= 0) {
         return ret;
     }
     
     srs_assert(max_count > 0);
     count = srs_min(max_count, nb_msgs);
-
-    SrsSharedPtrMessage** omsgs = msgs.data();
-    for (int i = 0; i < count; i++) {
-        pmsgs[i] = omsgs[i];
-    }
     
-    SrsSharedPtrMessage* last = omsgs[count - 1];
-    av_start_time = last->timestamp;
+    // pop the msgs in batch, the left msgs never move.
+    msgs.pop_front(pmsgs, count);
     
-    if (count >= nb_msgs) {
-        // the pmsgs is big enough and clear msgs at most time.
-        msgs.clear();
-    } else {
-        // erase some vector elements may cause memory copy,
-        // maybe can use more efficient vector.swap to avoid copy.
-        // @remark for the pmsgs is big enough, for instance, SRS_PERF_MW_MSGS 128,
-        //      the rtmp play client will get 128msgs once, so this branch rarely execute.
-        msgs.erase(msgs.begin(), msgs.begin() + count);
-    }
+    SrsSharedPtrMessage* last = pmsgs[count - 1];
+    av_start_time = last->timestamp;
     
     return ret;
 }
@@ -332,14 +325,9 @@ int SrsMessageQueue::dump_packets(SrsConsumer* consumer, bool atc, SrsRtmpJitter
 {
     int ret = ERROR_SUCCESS;
     
-    int nb_msgs = (int)msgs.size();
-    if (nb_msgs <= 0) {
-        return ret;
-    }
-
-    SrsSharedPtrMessage** omsgs = msgs.data();
+    int nb_msgs = msgs.size();
     for (int i = 0; i < nb_msgs; i++) {
-        SrsSharedPtrMessage* msg = omsgs[i];
+        SrsSharedPtrMessage* msg = msgs.at(i);
         if ((ret = consumer->enqueue(msg, atc, ag)) != ERROR_SUCCESS) {
             return ret;
         }
@@ -352,11 +340,45 @@ void SrsMessageQueue::shrink()
 {
     SrsSharedPtrMessage* video_sh = NULL;
     SrsSharedPtrMessage* audio_sh = NULL;
-    int msgs_size = (int)msgs.size();
+    int msgs_size = msgs.size();
+    
+    // the first keyframe in queue size, where the queue starts from.
+    int pos = -1;
+    bool has_video = false;
+    for (int i = 0; i < msgs_size; i++) {
+        SrsSharedPtrMessage* msg = msgs.at(i);
+        if (!msg->is_video() || SrsFlvCodec::video_is_sequence_header(msg->payload, msg->size)) {
+            continue;
+        }
+        has_video = true;
+        
+        if (av_end_time - msg->timestamp <= queue_size_ms
+            && SrsFlvCodec::video_is_keyframe(msg->payload, msg->size)
+        ) {
+            pos = i;
+            break;
+        }
+    }
     
-    // remove all msg
+    // for pure audio, starts from the first audio in queue size.
+    for (int i = 0; pos < 0 && !has_video && i < msgs_size; i++) {
+        SrsSharedPtrMessage* msg = msgs.at(i);
+        if (msg->is_audio() && av_end_time - msg->timestamp <= queue_size_ms
+            && !SrsFlvCodec::audio_is_sequence_header(msg->payload, msg->size)
+        ) {
+            pos = i;
+            break;
+        }
+    }
+    
+    // no keyframe, remove all msg.
+    if (pos < 0) {
+        pos = msgs_size;
+    }
+    
+    // remove the msgs before pos,
     // igone the sequence header
-    for (int i = 0; i < (int)msgs.size(); i++) {
+    for (int i = 0; i < pos; i++) {
         SrsSharedPtrMessage* msg = msgs.at(i);
 
         if (msg->is_video() && SrsFlvCodec::video_is_sequence_header(msg->payload, msg->size)) {
@@ -372,47 +394,284 @@ void SrsMessageQueue::shrink()
 
         srs_freep(msg);
     }
-    msgs.clear();  
+    msgs.pop_front(NULL, pos);
 
     // update av_start_time
     av_start_time = av_end_time;
-    //push_back secquence header and update timestamp
-    if (video_sh) {
-        video_sh->timestamp = av_end_time;
-        msgs.push_back(video_sh);
+    if (msgs.size() > 0) {
+        av_start_time = msgs.at(0)->timestamp;
     }
+    
+    //push_front secquence header and update timestamp
     if (audio_sh) {
-        audio_sh->timestamp = av_end_time;
-        msgs.push_back(audio_sh);
+        audio_sh->timestamp = av_start_time;
+        msgs.push_front(audio_sh);
+    }
+    if (video_sh) {
+        video_sh->timestamp = av_start_time;
+        msgs.push_front(video_sh);
     }
     
     if (_ignore_shrink) {
         srs_info("shrink the cache queue, size=%d, removed=%d, max=%.2f", 
-            (int)msgs.size(), msgs_size - (int)msgs.size(), queue_size_ms / 1000.0);
+            msgs.size(), msgs_size - msgs.size(), queue_size_ms / 1000.0);
     } else {
         srs_trace("shrink the cache queue, size=%d, removed=%d, max=%.2f", 
-            (int)msgs.size(), msgs_size - (int)msgs.size(), queue_size_ms / 1000.0);
+            msgs.size(), msgs_size - msgs.size(), queue_size_ms / 1000.0);
     }
 }
 
 void SrsMessageQueue::clear()
 {
-#ifndef SRS_PERF_QUEUE_FAST_VECTOR
-    std::vector<SrsSharedPtrMessage*>::iterator it;
+    msgs.free();
+    
+    av_start_time = av_end_time = -1;
+}
 
-    for (it = msgs.begin(); it != msgs.end(); ++it) {
-        SrsSharedPtrMessage* msg = *it;
-        srs_freep(msg);
+#ifdef SRS_PERF_SOURCE_RING
+SrsMessageRing::SrsMessageRing()
+{
+    nb_slots = SRS_PERF_MW_MSGS * 8;
+    slots = new SrsRingSlot[nb_slots];
+    start = end = 0;
+    keyframe = -1;
+    pinned = -1;
+    nb_bytes = 0;
+    av_end_time = -1;
+    queue_size_ms = 0;
+#ifdef SRS_PERF_QUEUE_COND_WAIT
+    wake_time = -1;
+#endif
+}
+
+SrsMessageRing::~SrsMessageRing()
+{
+    clear();
+    srs_freepa(slots);
+}
+
+void SrsMessageRing::set_queue_size(double queue_size)
+{
+    queue_size_ms = (int)(queue_size * 1000);
+}
+
+int64_t SrsMessageRing::cursor()
+{
+    return end;
+}
+
+int SrsMessageRing::size(int64_t cursor)
+{
+    return (int)(end - srs_max(cursor, start));
+}
+
+int SrsMessageRing::duration(int64_t cursor)
+{
+    if (cursor < start || cursor >= end) {
+        return 0;
+    }
+    
+    SrsRingSlot* slot = &slots[cursor & (nb_slots - 1)];
+    return (int)(av_end_time - slot->time);
+}
+
+int64_t SrsMessageRing::bytes(int64_t cursor)
+{
+    if (cursor < start || cursor >= end) {
+        return 0;
+    }
+    
+    SrsRingSlot* slot = &slots[cursor & (nb_slots - 1)];
+    return nb_bytes - slot->bytes;
+}
+
+bool SrsMessageRing::lagging(int64_t cursor)
+{
+    return cursor < start;
+}
+
+void SrsMessageRing::pin(int64_t seq)
+{
+    pinned = seq;
+}
+
+int SrsMessageRing::push(SrsSharedPtrMessage* shared_msg, bool atc, SrsRtmpJitterAlgorithm ag)
+{
+    int ret = ERROR_SUCCESS;
+    
+    SrsSharedPtrMessage* msg = shared_msg->copy();
+    
+    int64_t last_av_time = av_end_time;
+    if (msg->is_av()) {
+        av_end_time = msg->timestamp;
+    }
+    
+    // index the keyframe, for the lagging consumer to snap to.
+    if (msg->is_video() && SrsFlvCodec::video_is_keyframe(msg->payload, msg->size)
+        && !SrsFlvCodec::video_is_sequence_header(msg->payload, msg->size)) {
+        keyframe = end;
+    }
+    
+    if (end - start >= nb_slots) {
+        grow();
+    }
+    
+    SrsRingSlot* slot = &slots[end & (nb_slots - 1)];
+    slot->msg = msg;
+    slot->time = av_end_time;
+    slot->atc = atc;
+    slot->ag = ag;
+    slot->bytes = nb_bytes;
+    nb_bytes += msg->size;
+    end++;
+    
+    // drop the msgs out of the queue size, the consumers still reading
+    // them fall off and snap to the keyframe.
+    // @remark the time maybe reset when republish, drop the old msgs too.
+    while (start < end) {
+        // the gop cache keeps the msgs from pinned seq.
+        if (pinned >= 0 && start >= pinned) {
+            break;
+        }
+        
+        slot = &slots[start & (nb_slots - 1)];
+        
+        int64_t diff = av_end_time - slot->time;
+        if (diff <= queue_size_ms && diff >= -queue_size_ms) {
+            break;
+        }
+        
+        srs_freep(slot->msg);
+        start++;
+    }
+    
+#ifdef SRS_PERF_QUEUE_COND_WAIT
+    // wakeup the waiting consumers all together when the earliest got its
+    // duration, for the others it's a little earlier than they wait for.
+    if (!waiters.empty() && msg->is_av()
+        && (av_end_time >= wake_time || av_end_time < last_av_time - CONST_MAX_JITTER_MS)
+    ) {
+        std::vector<SrsConsumer*>::iterator it;
+        for (it = waiters.begin(); it != waiters.end(); ++it) {
+            SrsConsumer* consumer = *it;
+            consumer->ring_waiting = false;
+            consumer->wakeup();
+        }
+        waiters.clear();
     }
-#else
-    msgs.free();
 #endif
+    
+    return ret;
+}
 
-    msgs.clear();
+int64_t SrsMessageRing::snap(int64_t& cursor)
+{
+    if (keyframe >= start && keyframe < end) {
+        cursor = keyframe;
+        return slots[keyframe & (nb_slots - 1)].time;
+    }
     
-    av_start_time = av_end_time = -1;
+    cursor = end;
+    return av_end_time;
+}
+
+int SrsMessageRing::dump_packets(int64_t& cursor, SrsRtmpJitter* jitter, int max_count, SrsSharedPtrMessage** pmsgs, int& count)
+{
+    int ret = ERROR_SUCCESS;
+    
+    srs_assert(cursor >= start);
+    
+    int nb_msgs = (int)(end - cursor);
+    if (nb_msgs <= 0) {
+        return ret;
+    }
+    
+    srs_assert(max_count > 0);
+    nb_msgs = srs_min(max_count, nb_msgs);
+    
+    for (count = 0; count < nb_msgs; count++) {
+        SrsRingSlot* slot = &slots[(cursor + count) & (nb_slots - 1)];
+        // the payload is shared by ref count, but each consumer needs its own
+        // wrapper: the jitter rewrites the timestamp per consumer, and the send
+        // path frees every msg it sends. the wrapper comes from the msg pool.
+        SrsSharedPtrMessage* msg = slot->msg->copy();
+        
+        if (!slot->atc && (ret = jitter->correct(msg, slot->ag)) != ERROR_SUCCESS) {
+            srs_freep(msg);
+            break;
+        }
+        
+        pmsgs[count] = msg;
+    }
+    cursor += count;
+    
+    return ret;
+}
+
+void SrsMessageRing::trim(int64_t cursor)
+{
+    while (start < end && start < cursor) {
+        SrsRingSlot* slot = &slots[start & (nb_slots - 1)];
+        srs_freep(slot->msg);
+        start++;
+    }
+}
+
+#ifdef SRS_PERF_QUEUE_COND_WAIT
+void SrsMessageRing::wait(SrsConsumer* consumer, int64_t cursor, int duration)
+{
+    int64_t time = av_end_time;
+    if (cursor >= start && cursor < end) {
+        time = slots[cursor & (nb_slots - 1)].time;
+    }
+    
+    if (waiters.empty() || time + duration < wake_time) {
+        wake_time = time + duration;
+    }
+    
+    // woken by others last time, it's still in waiters.
+    if (consumer->ring_waiting) {
+        return;
+    }
+    
+    consumer->ring_waiting = true;
+    waiters.push_back(consumer);
+}
+
+void SrsMessageRing::remove(SrsConsumer* consumer)
+{
+    if (!consumer->ring_waiting) {
+        return;
+    }
+    
+    consumer->ring_waiting = false;
+    waiters.erase(std::remove(waiters.begin(), waiters.end(), consumer), waiters.end());
+}
+#endif
+
+void SrsMessageRing::clear()
+{
+    trim(end);
+    keyframe = -1;
+    pinned = -1;
 }
 
+void SrsMessageRing::grow()
+{
+    int size = nb_slots * 2;
+    SrsRingSlot* buf = new SrsRingSlot[size];
+    for (int64_t seq = start; seq < end; seq++) {
+        buf[seq & (size - 1)] = slots[seq & (nb_slots - 1)];
+    }
+    srs_warn("source ring increase %d=>%d", nb_slots, size);
+    
+    // use new array.
+    srs_freepa(slots);
+    slots = buf;
+    nb_slots = size;
+}
+#endif
+
 ISrsWakable::ISrsWakable()
 {
 }
@@ -425,11 +684,22 @@ SrsConsumer::SrsConsumer(SrsSource* s, SrsConnection* c)
 {
     source = s;
     conn = c;
+    // the cached time is too coarse for the join time.
+    join_at = srs_update_system_time_ms();
+    join_bytes = 0;
     paused = false;
     jitter = new SrsRtmpJitter();
     queue = new SrsMessageQueue();
     should_update_source_id = false;
     
+#ifdef SRS_PERF_SOURCE_RING
+    ring = s->ring;
+    ring_cursor = ring->cursor();
+#ifdef SRS_PERF_QUEUE_COND_WAIT
+    ring_waiting = false;
+#endif
+#endif
+    
 #ifdef SRS_PERF_QUEUE_COND_WAIT
     mw_wait = st_cond_new();
     mw_min_msgs = 0;
@@ -540,9 +810,107 @@ int SrsConsumer::dump_packets(SrsMessageArray* msgs, int& count)
         return ret;
     }
     
+#ifdef SRS_PERF_SOURCE_RING
+    // the consumer lagging too much, drop the gop and resend the sequence headers.
+    if (count < max && ring->lagging(ring_cursor)) {
+        if ((ret = snap()) != ERROR_SUCCESS) {
+            return ret;
+        }
+        
+        int nb_msgs = 0;
+        if ((ret = queue->dump_packets(max - count, msgs->msgs + count, nb_msgs)) != ERROR_SUCCESS) {
+            return ret;
+        }
+        count += nb_msgs;
+    }
+    
+    // then read the stream from ring.
+    if (count < max) {
+        int nb_msgs = 0;
+        ret = ring->dump_packets(ring_cursor, jitter, max - count, msgs->msgs + count, nb_msgs);
+        count += nb_msgs;
+    }
+#endif
+    
+    if (join_at >= 0) {
+        on_dump(msgs->msgs, count);
+    }
+    
     return ret;
 }
 
+#ifdef SRS_PERF_SOURCE_RING
+int64_t SrsConsumer::cursor()
+{
+    return ring_cursor;
+}
+
+void SrsConsumer::seek(int64_t cursor)
+{
+    ring_cursor = cursor;
+    join_bytes = ring->bytes(cursor);
+}
+
+int SrsConsumer::snap()
+{
+    int ret = ERROR_SUCCESS;
+    
+    int64_t cursor = ring_cursor;
+    int64_t time = ring->snap(ring_cursor);
+    
+    srs_trace("snap the ring cursor %"PRId64"=>%"PRId64", time=%"PRId64"", cursor, ring_cursor, time);
+    
+    // the sequence headers for the keyframe, audio first as create consumer.
+    SrsSharedPtrMessage* shs[] = {source->cache_sh_audio, source->cache_sh_video};
+    for (int i = 0; i < 2; i++) {
+        if (!shs[i]) {
+            continue;
+        }
+        
+        SrsSharedPtrMessage* sh = shs[i]->copy();
+        SrsAutoFree(SrsSharedPtrMessage, sh);
+        
+        sh->timestamp = time;
+        if ((ret = enqueue(sh, source->atc, source->jitter_algorithm)) != ERROR_SUCCESS) {
+            return ret;
+        }
+    }
+    
+    return ret;
+}
+#endif
+
+void SrsConsumer::on_dump(SrsSharedPtrMessage** msgs, int count)
+{
+    // for pure audio, the player starts at any audio.
+    bool pure_audio = !source->cache_sh_video;
+    
+    for (int i = 0; i < count; i++) {
+        SrsSharedPtrMessage* msg = msgs[i];
+        
+        bool joined = false;
+        if (pure_audio) {
+            joined = msg->is_audio() && !SrsFlvCodec::audio_is_sequence_header(msg->payload, msg->size);
+        } else {
+            joined = msg->is_video() && SrsFlvCodec::video_is_keyframe(msg->payload, msg->size)
+                && !SrsFlvCodec::video_is_sequence_header(msg->payload, msg->size);
+        }
+        
+        if (!joined) {
+            continue;
+        }
+        
+        int join_ms = (int)(srs_update_system_time_ms() - join_at);
+        join_at = -1;
+        
+        srs_trace("consumer joined, wait=%dms, gop=%"PRId64"B", join_ms, join_bytes);
+        
+        SrsStatistic* stat = SrsStatistic::instance();
+        stat->on_stream_join(source->_req, join_ms, join_bytes);
+        return;
+    }
+}
+
 #ifdef SRS_PERF_QUEUE_COND_WAIT
 void SrsConsumer::wait(int nb_msgs, int duration)
 {
@@ -562,6 +930,24 @@ void SrsConsumer::wait(int nb_msgs, int duration)
         return;
     }
     
+#ifdef SRS_PERF_SOURCE_RING
+    // the msgs in queue go before the ring, flush them.
+    if (queue->size() > 0 || ring->lagging(ring_cursor)) {
+        return;
+    }
+    
+    duration_ms = ring->duration(ring_cursor);
+    match_min_msgs = ring->size(ring_cursor) > mw_min_msgs;
+    
+    // the time maybe reset when republish or atc.
+    if (duration_ms < 0 || (match_min_msgs && duration_ms > mw_duration)) {
+        return;
+    }
+    
+    // the ring will wakeup this consumer.
+    ring->wait(this, ring_cursor, mw_duration);
+#endif
+    
     // the enqueue will notify this cond.
     mw_waiting = true;
     
@@ -590,8 +976,16 @@ void SrsConsumer::wakeup()
 #endif
 }
 
+#ifdef SRS_PERF_SOURCE_RING
+SrsGopCache::SrsGopCache(SrsMessageRing* r)
+{
+    ring = r;
+    max_gops = 1;
+    start_ms = 0;
+#else
 SrsGopCache::SrsGopCache()
 {
+#endif
     cached_video_count = 0;
     enable_gop_cache = true;
     audio_after_last_video_count = 0;
@@ -612,7 +1006,11 @@ void SrsGopCache::set(bool enabled)
     enable_gop_cache = enabled;
     
     if (!enabled) {
+#ifdef SRS_PERF_SOURCE_RING
+        srs_info("disable gop cache, clear %d gops.", (int)gops.size());
+#else
         srs_info("disable gop cache, clear %d packets.", (int)gop_cache.size());
+#endif
         clear();
         return;
     }
@@ -620,6 +1018,34 @@ void SrsGopCache::set(bool enabled)
     srs_info("enable gop cache");
 }
 
+bool SrsGopCache::enabled()
+{
+    return enable_gop_cache;
+}
+
+#ifdef SRS_PERF_SOURCE_RING
+void SrsGopCache::set_window(int nb_gops, double start)
+{
+    max_gops = srs_max(1, nb_gops);
+    start_ms = (int)(start * 1000);
+    
+    while ((int)gops.size() > max_gops) {
+        gops.pop_front();
+    }
+}
+
+int64_t SrsGopCache::cursor()
+{
+    shrink();
+    
+    if (gops.empty()) {
+        return ring->cursor();
+    }
+    
+    return gops.front().seq;
+}
+#endif
+
 int SrsGopCache::cache(SrsSharedPtrMessage* shared_msg)
 {
     int ret = ERROR_SUCCESS;
@@ -662,6 +1088,29 @@ int SrsGopCache::cache(SrsSharedPtrMessage* shared_msg)
         return ret;
     }
     
+#ifdef SRS_PERF_SOURCE_RING
+    // index the keyframe, the msgs of gop are already in ring.
+    if (msg->is_video() && SrsFlvCodec::video_is_keyframe(msg->payload, msg->size)) {
+        SrsGopIndex gop;
+        gop.seq = ring->cursor() - 1;
+        gop.time = msg->timestamp;
+        
+        gops.push_back(gop);
+        while ((int)gops.size() > max_gops) {
+            gops.pop_front();
+        }
+        
+        // the ring always keeps the latest gop, the older gops are
+        // kept in the queue size of ring.
+        ring->pin(gop.seq);
+        
+        srs_info("gop cache index keyframe. vcount=%d, seq=%"PRId64", gops=%d",
+            cached_video_count, gop.seq, (int)gops.size());
+        
+        // curent msg is video frame, so we set to 1.
+        cached_video_count = 1;
+    }
+#else
     // clear gop cache when got key frame
     if (msg->is_video() && SrsFlvCodec::video_is_keyframe(msg->payload, msg->size)) {
         srs_info("clear gop cache when got keyframe. vcount=%d, count=%d",
@@ -675,18 +1124,25 @@ int SrsGopCache::cache(SrsSharedPtrMessage* shared_msg)
     
     // cache the frame.
     gop_cache.push_back(msg->copy());
+#endif
     
     return ret;
 }
 
 void SrsGopCache::clear()
 {
+#ifdef SRS_PERF_SOURCE_RING
+    // the msgs are freed when ring trimmed.
+    gops.clear();
+    ring->pin(-1);
+#else
     std::vector<SrsSharedPtrMessage*>::iterator it;
     for (it = gop_cache.begin(); it != gop_cache.end(); ++it) {
         SrsSharedPtrMessage* msg = *it;
         srs_freep(msg);
     }
     gop_cache.clear();
+#endif
 
     cached_video_count = 0;
     audio_after_last_video_count = 0;
@@ -696,6 +1152,18 @@ int SrsGopCache::dump(SrsConsumer* consumer, bool atc, SrsRtmpJitterAlgorithm ji
 {
     int ret = ERROR_SUCCESS;
     
+#ifdef SRS_PERF_SOURCE_RING
+    SrsGopIndex* gop = select();
+    if (!gop) {
+        return ret;
+    }
+    
+    // hand the gop to consumer at once, which reads the msgs from ring.
+    consumer->seek(gop->seq);
+    
+    srs_trace("dispatch cached gop success. count=%d, bytes=%"PRId64", duration=%d",
+        ring->size(gop->seq), ring->bytes(gop->seq), ring->duration(gop->seq));
+#else
     std::vector<SrsSharedPtrMessage*>::iterator it;
     for (it = gop_cache.begin(); it != gop_cache.end(); ++it) {
         SrsSharedPtrMessage* msg = *it;
@@ -705,17 +1173,31 @@ int SrsGopCache::dump(SrsConsumer* consumer, bool atc, SrsRtmpJitterAlgorithm ji
         }
     }
     srs_trace("dispatch cached gop success. count=%d, duration=%d", (int)gop_cache.size(), consumer->get_time());
+#endif
     
     return ret;
 }
 
 bool SrsGopCache::empty()
 {
+#ifdef SRS_PERF_SOURCE_RING
+    shrink();
+    return gops.empty();
+#else
     return gop_cache.empty();
+#endif
 }
 
 int64_t SrsGopCache::start_time()
 {
+#ifdef SRS_PERF_SOURCE_RING
+    SrsGopIndex* gop = select();
+    if (!gop) {
+        return 0;
+    }
+    
+    return gop->time;
+#else
     if (empty()) {
         return 0;
     }
@@ -724,6 +1206,7 @@ int64_t SrsGopCache::start_time()
     srs_assert(msg);
     
     return msg->timestamp;
+#endif
 }
 
 bool SrsGopCache::pure_audio()
@@ -731,6 +1214,36 @@ bool SrsGopCache::pure_audio()
     return cached_video_count == 0;
 }
 
+#ifdef SRS_PERF_SOURCE_RING
+SrsGopCache::SrsGopIndex* SrsGopCache::select()
+{
+    shrink();
+    
+    if (gops.empty()) {
+        return NULL;
+    }
+    
+    // the latest keyframe which is start_ms before the live,
+    // or the oldest when not cached so much.
+    std::deque<SrsGopIndex>::reverse_iterator it;
+    for (it = gops.rbegin(); it != gops.rend(); ++it) {
+        SrsGopIndex* gop = &*it;
+        if (ring->duration(gop->seq) >= start_ms) {
+            return gop;
+        }
+    }
+    
+    return &gops.front();
+}
+
+void SrsGopCache::shrink()
+{
+    while (!gops.empty() && ring->lagging(gops.front().seq)) {
+        gops.pop_front();
+    }
+}
+#endif
+
 ISrsSourceHandler::ISrsSourceHandler()
 {
 }
@@ -762,6 +1275,15 @@ int SrsSource::fetch_or_create(SrsRequest* r, ISrsSourceHandler* h, SrsSource**
         srs_freep(source);
         return ret;
     }
+    
+    // the initialize maybe switch to other thread when start the hls thread,
+    // which maybe create the source meanwhile, use it to serve all clients,
+    // for instance, the players concurrently relay the stream from other worker.
+    if (pool.find(stream_url) != pool.end()) {
+        srs_freep(source);
+        *pps = pool[stream_url];
+        return ret;
+    }
         
     pool[stream_url] = source;
     srs_info("create new source for url=%s, vhost=%s", stream_url.c_str(), vhost.c_str());
@@ -957,13 +1479,19 @@ SrsSource::SrsSource()
     cache_metadata = cache_sh_video = cache_sh_audio = NULL;
     
     _can_publish = true;
+    relaying = false;
     _pre_source_id = _source_id = -1;
     die_at = -1;
     
     play_edge = new SrsPlayEdge();
     publish_edge = new SrsPublishEdge();
-    gop_cache = new SrsGopCache();
     aggregate_stream = new SrsStream();
+#ifdef SRS_PERF_SOURCE_RING
+    ring = new SrsMessageRing();
+    gop_cache = new SrsGopCache(ring);
+#else
+    gop_cache = new SrsGopCache();
+#endif
     
     is_monotonically_increase = false;
     last_packet_time = 0;
@@ -998,6 +1526,9 @@ SrsSource::~SrsSource()
     srs_freep(publish_edge);
     srs_freep(gop_cache);
     srs_freep(aggregate_stream);
+#ifdef SRS_PERF_SOURCE_RING
+    srs_freep(ring);
+#endif
     
 #ifdef SRS_AUTO_HLS
     srs_freep(hls);
@@ -1028,18 +1559,42 @@ void SrsSource::dispose()
     
     // cleanup the gop cache.
     gop_cache->dispose();
+    
+#ifdef SRS_PERF_SOURCE_RING
+    ring->clear();
+#endif
 }
 
 int SrsSource::cycle()
 {
     int ret = ERROR_SUCCESS;
     
+    // the players wait for the stream which published on other worker later.
+    if (!consumers.empty() && (ret = relay_worker()) != ERROR_SUCCESS) {
+        return ret;
+    }
+    
 #ifdef SRS_AUTO_HLS
     if ((ret = hls->cycle()) != ERROR_SUCCESS) {
         return ret;
     }
 #endif
     
+#ifdef SRS_PERF_SOURCE_RING
+    // free the msgs all consumers already read, except the gop cache.
+    if (true) {
+        int64_t cursor = gop_cache->cursor();
+        
+        std::vector<SrsConsumer*>::iterator it;
+        for (it = consumers.begin(); it != consumers.end(); ++it) {
+            SrsConsumer* consumer = *it;
+            cursor = srs_min(cursor, consumer->cursor());
+        }
+        
+        ring->trim(cursor);
+    }
+#endif
+    
     return ret;
 }
 
@@ -1100,6 +1655,10 @@ int SrsSource::initialize(SrsRequest* r, ISrsSourceHandler* h)
     
     double queue_size = _srs_config->get_queue_length(_req->vhost);
     publish_edge->set_queue_size(queue_size);
+#ifdef SRS_PERF_SOURCE_RING
+    ring->set_queue_size(queue_size);
+    gop_cache->set_window(_srs_config->get_gop_cache_gops(_req->vhost), _srs_config->get_gop_cache_start(_req->vhost));
+#endif
     
     jitter_algorithm = (SrsRtmpJitterAlgorithm)_srs_config->get_time_jitter(_req->vhost);
     mix_correct = _srs_config->get_mix_correct(_req->vhost);
@@ -1141,6 +1700,9 @@ int SrsSource::on_reload_vhost_gop_cache(string vhost)
         vhost.c_str(), enabled_cache, _req->get_stream_url().c_str());
     
     set_cache(enabled_cache);
+#ifdef SRS_PERF_SOURCE_RING
+    gop_cache->set_window(_srs_config->get_gop_cache_gops(vhost), _srs_config->get_gop_cache_start(vhost));
+#endif
     
     return ret;
 }
@@ -1166,6 +1728,13 @@ int SrsSource::on_reload_vhost_queue_length(string vhost)
         srs_trace("consumers reload queue size success.");
     }
     
+#ifdef SRS_PERF_SOURCE_RING
+    if (true) {
+        ring->set_queue_size(queue_size);
+        srs_trace("ring reload queue size success.");
+    }
+#endif
+    
     if (true) {
         std::vector<SrsForwarder*>::iterator it;
         
@@ -1228,8 +1797,9 @@ int SrsSource::on_reload_vhost_forward(string vhost)
     // forwarders
     destroy_forwarders();
     
-    // Don't start forwarders when source is not active.
-    if (_can_publish) {
+    // Don't start forwarders when source is not active,
+    // or relayed from other worker which already start them.
+    if (_can_publish || relaying) {
         return ret;
     }
     
@@ -1254,8 +1824,9 @@ int SrsSource::on_reload_vhost_hls(string vhost)
 #ifdef SRS_AUTO_HLS
     hls->on_unpublish();
     
-    // Don't start forwarders when source is not active.
-    if (_can_publish) {
+    // Don't start forwarders when source is not active,
+    // or relayed from other worker which already start them.
+    if (_can_publish || relaying) {
         return ret;
     }
     
@@ -1280,8 +1851,9 @@ int SrsSource::on_reload_vhost_hds(string vhost)
 #ifdef SRS_AUTO_HDS
     hds->on_unpublish();
     
-    // Don't start forwarders when source is not active.
-    if (_can_publish) {
+    // Don't start forwarders when source is not active,
+    // or relayed from other worker which already start them.
+    if (_can_publish || relaying) {
         return ret;
     }
     
@@ -1307,8 +1879,9 @@ int SrsSource::on_reload_vhost_dvr(string vhost)
     // cleanup dvr
     dvr->on_unpublish();
     
-    // Don't start forwarders when source is not active.
-    if (_can_publish) {
+    // Don't start forwarders when source is not active,
+    // or relayed from other worker which already start them.
+    if (_can_publish || relaying) {
         return ret;
     }
     
@@ -1340,8 +1913,9 @@ int SrsSource::on_reload_vhost_transcode(string vhost)
 #ifdef SRS_AUTO_TRANSCODE
     encoder->on_unpublish();
     
-    // Don't start forwarders when source is not active.
-    if (_can_publish) {
+    // Don't start forwarders when source is not active,
+    // or relayed from other worker which already start them.
+    if (_can_publish || relaying) {
         return ret;
     }
     
@@ -1583,6 +2157,13 @@ int SrsSource::on_meta_data(SrsCommonMessage* msg, SrsOnMetaDataPacket* metadata
     
     // copy to all consumer
     if (!drop_for_reduce) {
+#ifdef SRS_PERF_SOURCE_RING
+        // publish once to ring, where all consumers and gop cache read.
+        if ((!consumers.empty() || gop_cache->enabled()) && (ret = ring->push(cache_metadata, atc, jitter_algorithm)) != ERROR_SUCCESS) {
+            srs_error("dispatch the metadata failed. ret=%d", ret);
+            return ret;
+        }
+#else
         std::vector<SrsConsumer*>::iterator it;
         for (it = consumers.begin(); it != consumers.end(); ++it) {
             SrsConsumer* consumer = *it;
@@ -1591,6 +2172,7 @@ int SrsSource::on_meta_data(SrsCommonMessage* msg, SrsOnMetaDataPacket* metadata
                 return ret;
             }
         }
+#endif
     }
     
     // copy to all forwarders
@@ -1771,6 +2353,13 @@ int SrsSource::on_audio_imp(SrsSharedPtrMessage* msg)
     
     // copy to all consumer
     if (!drop_for_reduce) {
+#ifdef SRS_PERF_SOURCE_RING
+        // publish once to ring, where all consumers and gop cache read.
+        if ((!consumers.empty() || gop_cache->enabled()) && (ret = ring->push(msg, atc, jitter_algorithm)) != ERROR_SUCCESS) {
+            srs_error("dispatch the audio failed. ret=%d", ret);
+            return ret;
+        }
+#else
         for (int i = 0; i < (int)consumers.size(); i++) {
             SrsConsumer* consumer = consumers.at(i);
             if ((ret = consumer->enqueue(msg, atc, jitter_algorithm)) != ERROR_SUCCESS) {
@@ -1778,6 +2367,7 @@ int SrsSource::on_audio_imp(SrsSharedPtrMessage* msg)
                 return ret;
             }
         }
+#endif
         srs_info("dispatch audio success.");
     }
     
@@ -1986,6 +2576,13 @@ int SrsSource::on_video_imp(SrsSharedPtrMessage* msg)
     
     // copy to all consumer
     if (!drop_for_reduce) {
+#ifdef SRS_PERF_SOURCE_RING
+        // publish once to ring, where all consumers and gop cache read.
+        if ((!consumers.empty() || gop_cache->enabled()) && (ret = ring->push(msg, atc, jitter_algorithm)) != ERROR_SUCCESS) {
+            srs_error("dispatch the video failed. ret=%d", ret);
+            return ret;
+        }
+#else
         for (int i = 0; i < (int)consumers.size(); i++) {
             SrsConsumer* consumer = consumers.at(i);
             if ((ret = consumer->enqueue(msg, atc, jitter_algorithm)) != ERROR_SUCCESS) {
@@ -1993,6 +2590,7 @@ int SrsSource::on_video_imp(SrsSharedPtrMessage* msg)
                 return ret;
             }
         }
+#endif
         srs_info("dispatch video success.");
     }
 
@@ -2115,7 +2713,11 @@ int SrsSource::on_aggregate(SrsCommonMessage* msg)
 
         if (data_size > 0) {
             o.size = data_size;
+#ifdef SRS_PERF_MSG_POOL
+            o.create_pooled_payload(o.size);
+#else
             o.payload = new char[o.size];
+#endif
             stream->read_bytes(o.payload, o.size);
         }
         
@@ -2161,6 +2763,30 @@ int SrsSource::on_publish()
     is_monotonically_increase = true;
     last_packet_time = 0;
     
+    // the owner worker forward, transcode and deliver hls/dvr/hds,
+    // the worker relayed from it only serve the players.
+    if (!relaying) {
+        if ((ret = on_publish_services()) != ERROR_SUCCESS) {
+            return ret;
+        }
+    }
+
+    // notify the handler.
+    srs_assert(handler);
+    if ((ret = handler->on_publish(this, _req)) != ERROR_SUCCESS) {
+        srs_error("handle on publish failed. ret=%d", ret);
+        return ret;
+    }
+    SrsStatistic* stat = SrsStatistic::instance();
+    stat->on_stream_publish(_req, _source_id);
+    
+    return ret;
+}
+
+int SrsSource::on_publish_services()
+{
+    int ret = ERROR_SUCCESS;
+    
     // create forwarders
     if ((ret = create_forwarders()) != ERROR_SUCCESS) {
         srs_error("create forwarders failed. ret=%d", ret);
@@ -2196,15 +2822,6 @@ int SrsSource::on_publish()
         return ret;
     }
 #endif
-
-    // notify the handler.
-    srs_assert(handler);
-    if ((ret = handler->on_publish(this, _req)) != ERROR_SUCCESS) {
-        srs_error("handle on publish failed. ret=%d", ret);
-        return ret;
-    }
-    SrsStatistic* stat = SrsStatistic::instance();
-    stat->on_stream_publish(_req, _source_id);
     
     return ret;
 }
@@ -2322,6 +2939,8 @@ int SrsSource::create_consumer(SrsConnection* conn, SrsConsumer*& consumer, bool
             srs_error("notice edge start play stream failed. ret=%d", ret);
             return ret;
         }
+    } else if ((ret = relay_worker()) != ERROR_SUCCESS) {
+        return ret;
     }
     
     return ret;
@@ -2334,14 +2953,59 @@ void SrsSource::on_consumer_destroy(SrsConsumer* consumer)
     if (it != consumers.end()) {
         consumers.erase(it);
     }
+#if defined(SRS_PERF_SOURCE_RING) && defined(SRS_PERF_QUEUE_COND_WAIT)
+    ring->remove(consumer);
+#endif
     srs_info("handle consumer destroy success.");
     
     if (consumers.empty()) {
         play_edge->on_all_client_stop();
+        relaying = false;
         die_at = srs_get_system_time_ms();
     }
 }
 
+int SrsSource::relay_worker()
+{
+    int ret = ERROR_SUCCESS;
+    
+    // already relayed, or published on this worker.
+    if (relaying || !_can_publish) {
+        return ret;
+    }
+    
+    if (_srs_config->get_vhost_is_edge(_req->vhost)) {
+        return ret;
+    }
+    
+    int worker = SrsWorkers::instance()->relay_from(_req->get_stream_url());
+    if (worker < 0) {
+        return ret;
+    }
+    
+    // pull the stream from the owner worker, like edge pull from origin.
+    relaying = true;
+    srs_trace("relay stream %s from worker %d", _req->get_stream_url().c_str(), worker);
+    
+    if ((ret = play_edge->on_client_play()) != ERROR_SUCCESS) {
+        srs_error("start relay from worker %d failed. ret=%d", worker, ret);
+        return ret;
+    }
+    
+    return ret;
+}
+
+void SrsSource::stop_relay_worker()
+{
+    if (!relaying) {
+        return;
+    }
+    
+    srs_trace("stop relay stream %s for publish on this worker", _req->get_stream_url().c_str());
+    play_edge->on_all_client_stop();
+    relaying = false;
+}
+
 void SrsSource::set_cache(bool enabled)
 {
     gop_cache->set(enabled);
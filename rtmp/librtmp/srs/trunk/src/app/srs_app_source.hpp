@@ -31,6 +31,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <srs_core.hpp>
 
 #include <map>
+#include <deque>
 #include <vector>
 #include <string>
 
@@ -104,37 +105,50 @@ public:
     virtual int get_time();
 };
 
-#ifdef SRS_PERF_QUEUE_FAST_VECTOR
 /**
-* to alloc and increase fixed space,
-* fast remove and insert for msgs sender.
+* the circular deque of msgs, O(1) to push and to pop a batch,
+* the capacity is power of 2, grows by 2x when full.
 * @see https://github.com/ossrs/srs/issues/251
 */
-class SrsFastVector
+class SrsMessageDeque
 {
 private:
     SrsSharedPtrMessage** msgs;
+    // the capacity, power of 2.
     int nb_msgs;
+    // the msgs are from head, the index is (head + i) & (nb_msgs - 1).
+    int head;
     int count;
 public:
-    SrsFastVector();
-    virtual ~SrsFastVector();
+    SrsMessageDeque();
+    virtual ~SrsMessageDeque();
 public:
     virtual int size();
-    virtual int begin();
-    virtual int end();
-    virtual SrsSharedPtrMessage** data();
     virtual SrsSharedPtrMessage* at(int index);
-    virtual void clear();
-    virtual void erase(int _begin, int _end);
     virtual void push_back(SrsSharedPtrMessage* msg);
+    virtual void push_front(SrsSharedPtrMessage* msg);
+    /**
+    * remove the msgs from front.
+    * @param pmsgs SrsSharedPtrMessage*[], to store the msgs removed,
+    *       NULL to drop them, user must free the msgs dropped.
+    * @param n the count of msgs to remove, must not exceed the size.
+    */
+    virtual void pop_front(SrsSharedPtrMessage** pmsgs, int n);
+    /**
+    * remove all msgs, user must free them.
+    */
+    virtual void clear();
+    /**
+    * free and remove all msgs.
+    */
     virtual void free();
+private:
+    virtual void grow();
 };
-#endif
 
 /**
 * the message queue for the consumer(client), forwarder.
-* we limit the size in seconds, drop old messages(the whole gop) if full.
+* we limit the size in seconds, drop old messages to the keyframe if full.
 */
 class SrsMessageQueue
 {
@@ -143,11 +157,7 @@ private:
     int64_t av_start_time;
     int64_t av_end_time;
     int queue_size_ms;
-#ifdef SRS_PERF_QUEUE_FAST_VECTOR
-    SrsFastVector msgs;
-#else
-    std::vector<SrsSharedPtrMessage*> msgs;
-#endif
+    SrsMessageDeque msgs;
 public:
     SrsMessageQueue(bool ignore_shrink = false);
     virtual ~SrsMessageQueue();
@@ -186,8 +196,9 @@ public:
     virtual int dump_packets(SrsConsumer* consumer, bool atc, SrsRtmpJitterAlgorithm ag);
 private:
     /**
-    * remove a gop from the front.
-    * if no iframe found, clear it.
+    * remove the msgs from the front to the first keyframe in queue size,
+    * keep the sequence headers removed before the keyframe.
+    * if no such keyframe, clear it, except the sequence headers.
     */
     virtual void shrink();
 public:
@@ -197,6 +208,133 @@ public:
     virtual void clear();
 };
 
+#ifdef SRS_PERF_SOURCE_RING
+/**
+* the append-only ring of msgs of a source, shared by all its consumers,
+* each consumer only holds a cursor, the seq of the next msg it reads,
+* so the source publishes a msg once whatever the number of consumers.
+* the msgs older than the queue size are dropped, a consumer whose cursor
+* falls off the ring is snapped forward to the latest keyframe.
+* @remark the seq is 64bits and never wraps, the slot is seq & (capacity-1),
+*       the ring grows by 2x when full, for a consumer still reads it.
+* @see https://github.com/ossrs/srs/issues/251
+*/
+class SrsMessageRing
+{
+private:
+    struct SrsRingSlot
+    {
+        SrsSharedPtrMessage* msg;
+        // the av time of msg, for other msgs, the time of last av.
+        int64_t time;
+        // the atc and jitter of source when msg published.
+        bool atc;
+        SrsRtmpJitterAlgorithm ag;
+        // the bytes of msgs published before msg.
+        int64_t bytes;
+    };
+    SrsRingSlot* slots;
+    // the capacity, power of 2.
+    int nb_slots;
+    // the msgs in ring are [start, end).
+    int64_t start;
+    int64_t end;
+    // the seq of the latest video keyframe, -1 for none.
+    int64_t keyframe;
+    // the msgs from pinned seq are never dropped by queue size, -1 for none.
+    int64_t pinned;
+    // the bytes of all msgs published.
+    int64_t nb_bytes;
+    int64_t av_end_time;
+    int queue_size_ms;
+#ifdef SRS_PERF_QUEUE_COND_WAIT
+    // the consumers waiting for msgs, woken all together when the av time
+    // reaches wake_time, the earliest time they wait for.
+    std::vector<SrsConsumer*> waiters;
+    int64_t wake_time;
+#endif
+public:
+    SrsMessageRing();
+    virtual ~SrsMessageRing();
+public:
+    /**
+    * set the queue size
+    * @param queue_size the queue size in seconds.
+    */
+    virtual void set_queue_size(double queue_size);
+    /**
+    * the cursor for a new consumer, which reads the msgs published after.
+    */
+    virtual int64_t cursor();
+    /**
+    * get the count of msgs to read from cursor.
+    */
+    virtual int size(int64_t cursor);
+    /**
+    * get the duration of msgs to read from cursor.
+    */
+    virtual int duration(int64_t cursor);
+    /**
+    * get the bytes of msgs to read from cursor.
+    */
+    virtual int64_t bytes(int64_t cursor);
+    /**
+    * whether the msgs of cursor were dropped.
+    */
+    virtual bool lagging(int64_t cursor);
+    /**
+    * keep the msgs from seq whatever the queue size, for the gop cache.
+    * @param seq the seq to keep from, -1 to unpin.
+    */
+    virtual void pin(int64_t seq);
+    /**
+    * publish a msg to all consumers, O(1).
+    * @param shared_msg, directly ptr, the ring copy it.
+    * @param atc/ag, used when consumer read the msg, @see SrsConsumer.enqueue().
+    */
+    virtual int push(SrsSharedPtrMessage* shared_msg, bool atc, SrsRtmpJitterAlgorithm ag);
+    /**
+    * snap a lagging cursor forward to the latest keyframe in ring,
+    * or the end when no keyframe in ring.
+    * @return the time the cursor snapped to.
+    */
+    virtual int64_t snap(int64_t& cursor);
+    /**
+    * read msgs from cursor, and move the cursor forward.
+    * @remark each msg read is a copy sharing the payload, for the jitter
+    *       changes the timestamp of it; free it after sent.
+    * @param jitter the jitter of consumer, to correct the msgs read.
+    * @pmsgs SrsSharedPtrMessage*[], used to store the msgs, user must alloc it.
+    * @count the count in array, output param.
+    * @max_count the max count to read, must be positive.
+    */
+    virtual int dump_packets(int64_t& cursor, SrsRtmpJitter* jitter, int max_count, SrsSharedPtrMessage** pmsgs, int& count);
+    /**
+    * drop the msgs before the cursor, which all consumers already read.
+    */
+    virtual void trim(int64_t cursor);
+#ifdef SRS_PERF_QUEUE_COND_WAIT
+    /**
+    * wait for the msgs of duration from cursor, the consumer is woken
+    * by SrsConsumer.wakeup() then.
+    * @remark a consumer still in the waiters is not added again, for it
+    *       may be woken by others, for instance, the recv thread.
+    */
+    virtual void wait(SrsConsumer* consumer, int64_t cursor, int duration);
+    /**
+    * the consumer is freed, never wakeup it.
+    */
+    virtual void remove(SrsConsumer* consumer);
+#endif
+    /**
+    * clear all msgs in ring, the cursors fall off.
+    */
+    virtual void clear();
+private:
+    virtual void grow();
+};
+#endif
+
 /**
  * the wakable used for some object
  * which is waiting on cond.
@@ -220,12 +358,32 @@ public:
 */
 class SrsConsumer : public ISrsWakable
 {
+#if defined(SRS_PERF_SOURCE_RING) && defined(SRS_PERF_QUEUE_COND_WAIT)
+    friend class SrsMessageRing;
+#endif
 private:
     SrsRtmpJitter* jitter;
     SrsSource* source;
     SrsMessageQueue* queue;
+#ifdef SRS_PERF_SOURCE_RING
+    // the stream is read from the ring of source from cursor,
+    // the queue only keeps the msgs for this consumer, for instance,
+    // the sequence headers and gop cache when created, which go first.
+    SrsMessageRing* ring;
+    int64_t ring_cursor;
+#ifdef SRS_PERF_QUEUE_COND_WAIT
+    // whether in the waiters of ring, until the ring wakeup them all,
+    // whatever woke this consumer before.
+    bool ring_waiting;
+#endif
+#endif
     // the owner connection for debug, maybe NULL.
     SrsConnection* conn;
+    // the time consumer created, -1 when joined, that is,
+    // the first keyframe(or audio for pure audio) is dumped.
+    int64_t join_at;
+    // the bytes of gop cache handed to consumer when created.
+    int64_t join_bytes;
     bool paused;
     // when source id changed, notice all consumers
     bool should_update_source_id;
@@ -268,6 +426,30 @@ public:
      * @remark user can specifies the count to get specified msgs; 0 to get all if possible.
      */
     virtual int dump_packets(SrsMessageArray* msgs, int& count);
+#ifdef SRS_PERF_SOURCE_RING
+    /**
+    * the cursor of consumer in the ring of source.
+    */
+    virtual int64_t cursor();
+    /**
+    * start to read the ring from cursor, for instance, the gop cache,
+    * the msgs are not enqueued, the consumer reads them from ring.
+    */
+    virtual void seek(int64_t cursor);
+private:
+    /**
+    * when the cursor fell off the ring, snap it to the latest keyframe,
+    * and enqueue the sequence headers again, like SrsMessageQueue.shrink().
+    */
+    virtual int snap();
+public:
+#endif
+private:
+    /**
+    * update the join stat when got the first keyframe in msgs.
+    */
+    virtual void on_dump(SrsSharedPtrMessage** msgs, int count);
+public:
 #ifdef SRS_PERF_QUEUE_COND_WAIT
     /**
     * wait for messages incomming, atleast nb_msgs and in duration.
@@ -294,10 +476,22 @@ public:
 * cache a gop of video/audio data,
 * delivery at the connect of flash player,
 * to enable it to fast startup.
+* @remark for the source ring, the msgs of gops are kept in the ring,
+*       the gop cache only indexes the keyframes of the last gops,
+*       a new consumer reads the ring from the keyframe it starts.
 */
 class SrsGopCache
 {
 private:
+#ifdef SRS_PERF_SOURCE_RING
+    struct SrsGopIndex
+    {
+        // the seq of keyframe in ring.
+        int64_t seq;
+        // the timestamp of keyframe.
+        int64_t time;
+    };
+#endif
     /**
     * if disabled the gop cache,
     * the client will wait for the next keyframe for h264,
@@ -321,12 +515,36 @@ private:
     * @see: https://github.com/ossrs/srs/issues/124
     */
     int audio_after_last_video_count;
+#ifdef SRS_PERF_SOURCE_RING
+    /**
+    * the ring of source, which keeps the msgs of gops.
+    */
+    SrsMessageRing* ring;
+    /**
+    * the keyframe of cached gops, the oldest first.
+    */
+    std::deque<SrsGopIndex> gops;
+    /**
+    * the max gops to cache.
+    */
+    int max_gops;
+    /**
+    * the consumer starts from the keyframe start_ms before the live,
+    * 0 to start from the latest keyframe.
+    */
+    int start_ms;
+#else
     /**
     * cached gop.
     */
     std::vector<SrsSharedPtrMessage*> gop_cache;
+#endif
 public:
+#ifdef SRS_PERF_SOURCE_RING
+    SrsGopCache(SrsMessageRing* r);
+#else
     SrsGopCache();
+#endif
     virtual ~SrsGopCache();
 public:
     /**
@@ -337,11 +555,30 @@ public:
     * to enable or disable the gop cache.
     */
     virtual void set(bool enabled);
+    /**
+    * whether the gop cache is enabled.
+    */
+    virtual bool enabled();
+#ifdef SRS_PERF_SOURCE_RING
+    /**
+    * set the gops to cache and the keyframe where consumer starts.
+    * @param nb_gops the max gops to cache.
+    * @param start the consumer starts from the keyframe of start seconds
+    *       before the live, 0 for the latest keyframe.
+    */
+    virtual void set_window(int nb_gops, double start);
+    /**
+    * the seq of the oldest msg cached, the ring must keep the msgs after it.
+    * @return the cursor of ring when no gop cached.
+    */
+    virtual int64_t cursor();
+#endif
     /**
     * only for h264 codec
     * 1. cache the gop when got h264 video packet.
     * 2. clear gop when got keyframe.
     * @param shared_msg, directly ptr, copy it if need to save it.
+    * @remark for the source ring, the msg must be pushed to ring already.
     */
     virtual int cache(SrsSharedPtrMessage* shared_msg);
     /**
@@ -367,6 +604,17 @@ public:
     * when no video in gop cache, the stream is pure audio right now.
     */
     virtual bool pure_audio();
+#ifdef SRS_PERF_SOURCE_RING
+private:
+    /**
+    * select the gop where consumer starts, NULL when no gop.
+    */
+    virtual SrsGopIndex* select();
+    /**
+    * drop the gops whose keyframe is dropped by ring.
+    */
+    virtual void shrink();
+#endif
 };
 
 /**
@@ -413,6 +661,7 @@ public:
 */
 class SrsSource : public ISrsReloadHandler
 {
+    friend class SrsConsumer;
 private:
     static std::map<std::string, SrsSource*> pool;
 public:
@@ -456,6 +705,10 @@ private:
     SrsRequest* _req;
     // to delivery stream to clients.
     std::vector<SrsConsumer*> consumers;
+#ifdef SRS_PERF_SOURCE_RING
+    // the msgs shared by consumers.
+    SrsMessageRing* ring;
+#endif
     // the time jitter algorithm for vhost.
     SrsRtmpJitterAlgorithm jitter_algorithm;
     // whether use interlaced/mixed algorithm to correct timestamp.
@@ -496,6 +749,10 @@ private:
     */
     bool _can_publish;
     /**
+    * whether relay stream from the worker which own the stream.
+    */
+    bool relaying;
+    /**
     * atc whether atc(use absolute time and donot adjust time),
     * directly use msg time and donot adjust if atc is true,
     * otherwise, adjust msg time to start from 0 to make flash happy.
@@ -571,6 +828,11 @@ public:
     */
     virtual int on_publish();
     virtual void on_unpublish();
+private:
+    /**
+    * start the forwarders, transcode, hls, dvr and hds for publish.
+    */
+    virtual int on_publish_services();
 // consumer methods
 public:
     /**
@@ -585,6 +847,15 @@ public:
         bool ds = true, bool dm = true, bool dg = true
     );
     virtual void on_consumer_destroy(SrsConsumer* consumer);
+    /**
+    * for multiple workers, pull the stream from the worker which own it,
+    * when play it on this worker.
+    */
+    virtual int relay_worker();
+    /**
+    * stop the relay, when the stream is published on this worker.
+    */
+    virtual void stop_relay_worker();
     virtual void set_cache(bool enabled);
     virtual SrsRtmpJitterAlgorithm jitter();
 // internal
@@ -33,6 +33,7 @@ using namespace std;
 #include <srs_app_conn.hpp>
 #include <srs_app_config.hpp>
 #include <srs_kernel_utility.hpp>
+#include <srs_app_worker.hpp>
 
 int64_t srs_gvid = getpid();
 
@@ -112,6 +113,12 @@ SrsStatisticStream::SrsStatisticStream()
     
     nb_clients = 0;
     nb_frames = 0;
+    
+    nb_joins = 0;
+    join_ms = 0;
+    max_join_ms = 0;
+    burst_bytes = 0;
+    max_burst_bytes = 0;
 }
 
 SrsStatisticStream::~SrsStatisticStream()
@@ -140,6 +147,13 @@ int SrsStatisticStream::dumps(stringstream& ss)
             << SRS_JFIELD_OBJ("publish")
                 << SRS_JFIELD_BOOL("active", active) << SRS_JFIELD_CONT
                 << SRS_JFIELD_ORG("cid", connection_cid)
+            << SRS_JOBJECT_END << SRS_JFIELD_CONT
+            << SRS_JFIELD_OBJ("join")
+                << SRS_JFIELD_ORG("count", nb_joins) << SRS_JFIELD_CONT
+                << SRS_JFIELD_ORG("avg_ms", (nb_joins? join_ms / nb_joins : 0)) << SRS_JFIELD_CONT
+                << SRS_JFIELD_ORG("max_ms", max_join_ms) << SRS_JFIELD_CONT
+                << SRS_JFIELD_ORG("avg_burst", (nb_joins? burst_bytes / nb_joins : 0)) << SRS_JFIELD_CONT
+                << SRS_JFIELD_ORG("max_burst", max_burst_bytes)
             << SRS_JOBJECT_END << SRS_JFIELD_CONT;
     
     if (!has_video) {
@@ -341,6 +355,18 @@ int SrsStatistic::on_video_frames(SrsRequest* req, int nb_frames)
     return ret;
 }
 
+void SrsStatistic::on_stream_join(SrsRequest* req, int join_ms, int64_t burst_bytes)
+{
+    SrsStatisticVhost* vhost = create_vhost(req);
+    SrsStatisticStream* stream = create_stream(vhost, req);
+    
+    stream->nb_joins++;
+    stream->join_ms += join_ms;
+    stream->max_join_ms = srs_max(stream->max_join_ms, join_ms);
+    stream->burst_bytes += burst_bytes;
+    stream->max_burst_bytes = srs_max(stream->max_burst_bytes, burst_bytes);
+}
+
 void SrsStatistic::on_stream_publish(SrsRequest* req, int cid)
 {
     SrsStatisticVhost* vhost = create_vhost(req);
@@ -522,6 +548,75 @@ int SrsStatistic::dumps_clients(stringstream& ss, int start, int count)
     return ret;
 }
 
+int SrsStatistic::dumps_workers(stringstream& ss)
+{
+    int ret = ERROR_SUCCESS;
+    
+    SrsWorkers* workers = SrsWorkers::instance();
+    
+    // the total of all workers.
+    int nb_conns = 0;
+    int nb_streams = 0;
+    int recv_kbps = 0;
+    int send_kbps = 0;
+    int64_t recv_bytes = 0;
+    int64_t send_bytes = 0;
+    
+    ss << SRS_JOBJECT_START
+        << SRS_JFIELD_ORG("worker", workers->worker()) << SRS_JFIELD_CONT
+        << SRS_JFIELD_ORG("workers", SRS_JARRAY_START);
+    
+    for (int i = 0; i < workers->size(); i++) {
+        SrsWorkerInfo info = workers->info(i);
+        
+        nb_conns += info.nb_conns;
+        nb_streams += info.nb_streams;
+        recv_kbps += info.recv_kbps;
+        send_kbps += info.send_kbps;
+        recv_bytes += info.recv_bytes;
+        send_bytes += info.send_bytes;
+        
+        if (i > 0) {
+            ss << SRS_JFIELD_CONT;
+        }
+        
+        ss << SRS_JOBJECT_START
+                << SRS_JFIELD_ORG("index", i) << SRS_JFIELD_CONT
+                << SRS_JFIELD_ORG("pid", info.pid) << SRS_JFIELD_CONT
+                << SRS_JFIELD_ORG("clients", info.nb_conns) << SRS_JFIELD_CONT
+                << SRS_JFIELD_ORG("streams", info.nb_streams) << SRS_JFIELD_CONT
+                << SRS_JFIELD_ORG("recv_bytes", info.recv_bytes) << SRS_JFIELD_CONT
+                << SRS_JFIELD_ORG("send_bytes", info.send_bytes) << SRS_JFIELD_CONT
+                << SRS_JFIELD_ORG("update", info.update_time) << SRS_JFIELD_CONT
+                << SRS_JFIELD_ORG("kbps", SRS_JOBJECT_START)
+                    << SRS_JFIELD_ORG("recv_30s", info.recv_kbps) << SRS_JFIELD_CONT
+                    << SRS_JFIELD_ORG("send_30s", info.send_kbps)
+                << SRS_JOBJECT_END
+            << SRS_JOBJECT_END;
+    }
+    
+    ss << SRS_JARRAY_END << SRS_JFIELD_CONT
+        << SRS_JFIELD_ORG("total", SRS_JOBJECT_START)
+            << SRS_JFIELD_ORG("clients", nb_conns) << SRS_JFIELD_CONT
+            << SRS_JFIELD_ORG("streams", nb_streams) << SRS_JFIELD_CONT
+            << SRS_JFIELD_ORG("recv_bytes", recv_bytes) << SRS_JFIELD_CONT
+            << SRS_JFIELD_ORG("send_bytes", send_bytes) << SRS_JFIELD_CONT
+            << SRS_JFIELD_ORG("kbps", SRS_JOBJECT_START)
+                << SRS_JFIELD_ORG("recv_30s", recv_kbps) << SRS_JFIELD_CONT
+                << SRS_JFIELD_ORG("send_30s", send_kbps)
+            << SRS_JOBJECT_END
+        << SRS_JOBJECT_END << SRS_JFIELD_CONT
+        << SRS_JFIELD_NAME("streams");
+    
+    if ((ret = workers->dumps_streams(ss)) != ERROR_SUCCESS) {
+        return ret;
+    }
+    
+    ss << SRS_JOBJECT_END;
+    
+    return ret;
+}
+
 SrsStatisticVhost* SrsStatistic::create_vhost(SrsRequest* req)
 {
     SrsStatisticVhost* vhost = NULL;
@@ -71,6 +71,17 @@ public:
     int connection_cid;
     int nb_clients;
     uint64_t nb_frames;
+public:
+    /**
+    * the players joined, for the fast startup of gop cache,
+    * the join time is from play to the first keyframe sent,
+    * the burst is the bytes of gop cache sent when play.
+    */
+    int nb_joins;
+    int64_t join_ms;
+    int max_join_ms;
+    int64_t burst_bytes;
+    int64_t max_burst_bytes;
 public:
     /**
     * stream total kbps.
@@ -178,6 +189,12 @@ public:
      * We only stat the total number of video frames.
      */
     virtual int on_video_frames(SrsRequest* req, int nb_frames);
+    /**
+     * when player joined the stream, that is, got the first keyframe.
+     * @param join_ms the time from play to joined, in ms.
+     * @param burst_bytes the bytes of gop cache sent when play.
+     */
+    virtual void on_stream_join(SrsRequest* req, int join_ms, int64_t burst_bytes);
     /**
      * when publish stream.
      * @param req the request object of publish connection.
@@ -235,6 +252,11 @@ public:
      * @param count the max count of clients to dump.
      */
     virtual int dumps_clients(std::stringstream& ss, int start, int count);
+    /**
+    * dumps the workers to sstream in json,
+    * the stat of each worker, the total of all workers and the stream owners.
+    */
+    virtual int dumps_workers(std::stringstream& ss);
 private:
     virtual SrsStatisticVhost* create_vhost(SrsRequest* req);
     virtual SrsStatisticStream* create_stream(SrsStatisticVhost* vhost, SrsRequest* req);
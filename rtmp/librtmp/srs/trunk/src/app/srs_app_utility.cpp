@@ -29,6 +29,8 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <arpa/inet.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/un.h>
+#include <string.h>
 #include <math.h>
 
 #ifdef SRS_OSX
@@ -47,6 +49,7 @@ using namespace std;
 #include <srs_protocol_json.hpp>
 #include <srs_kernel_stream.hpp>
 #include <srs_kernel_utility.hpp>
+#include <srs_kernel_pool.hpp>
 
 // the longest time to wait for a process to quit.
 #define SRS_PROCESS_QUIT_TIMEOUT_MS 1000
@@ -105,6 +108,50 @@ failed:
     return ret;
 }
 
+int srs_unix_connect(string path, int64_t timeout, st_netfd_t* pstfd)
+{
+    int ret = ERROR_SUCCESS;
+    
+    *pstfd = NULL;
+    st_netfd_t stfd = NULL;
+    sockaddr_un addr;
+    
+    memset(&addr, 0, sizeof(sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    if (path.length() >= sizeof(addr.sun_path)) {
+        ret = ERROR_SYSTEM_UNIX_SOCKET;
+        srs_error("unix socket path too long. path=%s, ret=%d", path.c_str(), ret);
+        return ret;
+    }
+    strcpy(addr.sun_path, path.c_str());
+    
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(sock == -1){
+        ret = ERROR_SOCKET_CREATE;
+        srs_error("create unix socket error. ret=%d", ret);
+        return ret;
+    }
+    
+    stfd = st_netfd_open_socket(sock);
+    if(stfd == NULL){
+        ret = ERROR_ST_OPEN_SOCKET;
+        srs_error("st_netfd_open_socket failed. ret=%d", ret);
+        ::close(sock);
+        return ret;
+    }
+    
+    if (st_connect(stfd, (const struct sockaddr*)&addr, sizeof(sockaddr_un), timeout) == -1){
+        ret = ERROR_ST_CONNECT;
+        srs_error("connect to unix socket error. path=%s, ret=%d", path.c_str(), ret);
+        srs_close_stfd(stfd);
+        return ret;
+    }
+    srs_info("connect ok. path=%s", path.c_str());
+    
+    *pstfd = stfd;
+    return ret;
+}
+
 int srs_get_log_level(string level)
 {
     if ("verbose" == level) {
@@ -1445,6 +1492,7 @@ void srs_api_dump_summaries(std::stringstream& ss)
     SrsNetworkDevices* n = srs_get_network_devices();
     SrsNetworkRtmpServer* nrs = srs_get_network_rtmp_server();
     SrsDiskStat* d = srs_get_disk_stat();
+    SrsPoolStat pool = srs_pool_stat();
     
     float self_mem_percent = 0;
     if (m->MemTotal > 0) {
@@ -1501,6 +1549,10 @@ void srs_api_dump_summaries(std::stringstream& ss)
                 << SRS_JFIELD_ORG("mem_kbyte", r->r.ru_maxrss) << SRS_JFIELD_CONT
                 << SRS_JFIELD_ORG("mem_percent", self_mem_percent) << SRS_JFIELD_CONT
                 << SRS_JFIELD_ORG("cpu_percent", u->percent) << SRS_JFIELD_CONT
+                << SRS_JFIELD_ORG("pool_allocs", pool.nb_allocs) << SRS_JFIELD_CONT
+                << SRS_JFIELD_ORG("pool_reuses", pool.nb_reuses) << SRS_JFIELD_CONT
+                << SRS_JFIELD_ORG("pool_fallbacks", pool.nb_fallbacks) << SRS_JFIELD_CONT
+                << SRS_JFIELD_ORG("pool_cached_kbyte", pool.cached_bytes / 1024) << SRS_JFIELD_CONT
                 << SRS_JFIELD_ORG("srs_uptime", srs_uptime)
             << SRS_JOBJECT_END << SRS_JFIELD_CONT
             << SRS_JFIELD_ORG("system", SRS_JOBJECT_START)
@@ -44,6 +44,8 @@ class SrsStream;
 
 // client open socket and connect to server.
 extern int srs_socket_connect(std::string server, int port, int64_t timeout, st_netfd_t* pstfd);
+// client open unix socket and connect to server.
+extern int srs_unix_connect(std::string path, int64_t timeout, st_netfd_t* pstfd);
 
 /**
 * convert level in string to log level in int.
@@ -0,0 +1,508 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2013-2015 SRS(ossrs)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <srs_app_worker.hpp>
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+using namespace std;
+
+#include <srs_kernel_error.hpp>
+#include <srs_kernel_log.hpp>
+#include <srs_kernel_utility.hpp>
+#include <srs_app_config.hpp>
+#include <srs_protocol_kbps.hpp>
+#include <srs_protocol_json.hpp>
+
+// the interval in ms for master to check the workers.
+#define SRS_WORKER_CHECK_INTERVAL_MS 100
+// the interval in ms to restart the crashed worker,
+// to avoid the busy loop when worker always crash.
+#define SRS_WORKER_RESTART_INTERVAL_MS 1000
+
+// the signal got by master, to forward to the workers.
+static volatile sig_atomic_t _srs_worker_signal = 0;
+
+static void srs_worker_on_signal(int signo)
+{
+    _srs_worker_signal = signo;
+}
+
+// the signals master forward to workers.
+static int _srs_worker_signals[] = {SIGHUP, SIGINT, SIGTERM, SIGUSR2};
+
+static void srs_worker_set_signals(void (*handler)(int))
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handler;
+    sigemptyset(&sa.sa_mask);
+    
+    for (int i = 0; i < (int)(sizeof(_srs_worker_signals) / sizeof(int)); i++) {
+        sigaction(_srs_worker_signals[i], &sa, NULL);
+    }
+}
+
+SrsWorkers* SrsWorkers::_instance = new SrsWorkers();
+
+SrsWorkers::SrsWorkers()
+{
+    shm = NULL;
+    nb_workers = 0;
+    index = -1;
+}
+
+SrsWorkers::~SrsWorkers()
+{
+    if (shm) {
+        munmap(shm, sizeof(SrsWorkerShm));
+        shm = NULL;
+    }
+}
+
+SrsWorkers* SrsWorkers::instance()
+{
+    return _instance;
+}
+
+bool SrsWorkers::enabled()
+{
+    return shm != NULL;
+}
+
+int SrsWorkers::worker()
+{
+    return index;
+}
+
+int SrsWorkers::size()
+{
+    return nb_workers;
+}
+
+int SrsWorkers::initialize(int nb)
+{
+    int ret = ERROR_SUCCESS;
+    
+    srs_assert(!shm);
+    srs_assert(nb > 1 && nb <= SRS_WORKER_MAX_WORKERS);
+    
+    void* p = mmap(NULL, sizeof(SrsWorkerShm), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+    if (p == MAP_FAILED) {
+        ret = ERROR_SYSTEM_WORKER_SHM;
+        srs_error("map the shared memory for workers failed, size=%d. ret=%d", (int)sizeof(SrsWorkerShm), ret);
+        return ret;
+    }
+    
+    shm = (SrsWorkerShm*)p;
+    memset(shm, 0, sizeof(SrsWorkerShm));
+    for (int i = 0; i < SRS_WORKER_MAX_STREAMS; i++) {
+        shm->streams[i].worker = -1;
+    }
+    nb_workers = nb;
+    
+    // the workers maybe crash when hold the lock, use the robust mutex,
+    // so the master and other workers never block on the dead owner.
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    int r0 = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#ifdef __linux__
+    if (r0 == 0) {
+        r0 = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    }
+#endif
+    if (r0 == 0) {
+        r0 = pthread_mutex_init(&shm->lock, &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+    if (r0 != 0) {
+        ret = ERROR_SYSTEM_WORKER_SHM;
+        srs_error("init the registry lock for workers failed, r0=%d. ret=%d", r0, ret);
+        return ret;
+    }
+    
+    // the unix socket path must fit the sun_path.
+    std::string path = relay_path(nb_workers - 1);
+    if (path.length() >= sizeof(((sockaddr_un*)NULL)->sun_path)) {
+        ret = ERROR_SYSTEM_CONFIG_INVALID;
+        srs_error("the relay path %s of workers is too long, please change the pid file. ret=%d", path.c_str(), ret);
+        return ret;
+    }
+    
+    srs_trace("workers initialized, workers=%d, shm=%dKB", nb_workers, (int)(sizeof(SrsWorkerShm) / 1024));
+    
+    return ret;
+}
+
+int SrsWorkers::spawn()
+{
+    int ret = ERROR_SUCCESS;
+    
+    // the master forward the signals to workers.
+    srs_worker_set_signals(srs_worker_on_signal);
+    
+    for (int i = 0; i < nb_workers; i++) {
+        if ((ret = fork_worker(i)) != ERROR_SUCCESS) {
+            return ret;
+        }
+        
+        // the worker return to serve the clients.
+        if (index >= 0) {
+            return ret;
+        }
+    }
+    
+    if ((ret = cycle()) != ERROR_SUCCESS) {
+        return ret;
+    }
+    
+    // the master quit.
+    if (index < 0) {
+        for (int i = 0; i < nb_workers; i++) {
+            ::unlink(relay_path(i).c_str());
+        }
+        srs_trace("all workers quit, master quit.");
+    }
+    
+    return ret;
+}
+
+int SrsWorkers::fork_worker(int i)
+{
+    int ret = ERROR_SUCCESS;
+    
+    pid_t pid = fork();
+    
+    if (pid < 0) {
+        ret = ERROR_SYSTEM_WORKER_FORK;
+        srs_error("fork worker %d failed. ret=%d", i, ret);
+        return ret;
+    }
+    
+    // the worker.
+    if (pid == 0) {
+        index = i;
+        
+        // restore the signals, the worker will use its signal manager.
+        srs_worker_set_signals(SIG_DFL);
+        
+        // quit when master is killed.
+#ifdef __linux__
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+        
+        shm->workers[i].pid = getpid();
+        srs_trace("worker %d started, pid=%d, ppid=%d", i, getpid(), getppid());
+        return ret;
+    }
+    
+    // the master.
+    shm->workers[i].pid = pid;
+    srs_trace("master fork worker %d, pid=%d", i, pid);
+    
+    return ret;
+}
+
+int SrsWorkers::cycle()
+{
+    int ret = ERROR_SUCCESS;
+    
+    bool quit = false;
+    int nb_alive = nb_workers;
+    
+    while (nb_alive > 0) {
+        // forward the signal to workers.
+        int signo = _srs_worker_signal;
+        if (signo) {
+            _srs_worker_signal = 0;
+            
+            if (signo != SIGHUP) {
+                quit = true;
+            }
+            
+            srs_trace("master forward signal %d to workers, quit=%d", signo, quit);
+            for (int i = 0; i < nb_workers; i++) {
+                if (shm->workers[i].pid > 0) {
+                    ::kill(shm->workers[i].pid, signo);
+                }
+            }
+        }
+        
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, WNOHANG);
+        if (pid == 0 || (pid < 0 && errno == EINTR)) {
+            usleep(SRS_WORKER_CHECK_INTERVAL_MS * 1000);
+            continue;
+        }
+        if (pid < 0) {
+            ret = ERROR_SYSTEM_WAITPID;
+            srs_error("master wait workers failed. ret=%d", ret);
+            return ret;
+        }
+        
+        int i = 0;
+        for (; i < nb_workers; i++) {
+            if (shm->workers[i].pid == pid) {
+                break;
+            }
+        }
+        if (i >= nb_workers) {
+            continue;
+        }
+        
+        on_worker_quit(i);
+        nb_alive--;
+        
+        if (quit) {
+            srs_trace("worker %d quit, pid=%d, status=%d, alive=%d", i, pid, status, nb_alive);
+            continue;
+        }
+        
+        srs_warn("worker %d quit, pid=%d, status=%d, restart it", i, pid, status);
+        usleep(SRS_WORKER_RESTART_INTERVAL_MS * 1000);
+        
+        if ((ret = fork_worker(i)) != ERROR_SUCCESS) {
+            return ret;
+        }
+        if (index >= 0) {
+            return ret;
+        }
+        nb_alive++;
+    }
+    
+    return ret;
+}
+
+void SrsWorkers::on_worker_quit(int i)
+{
+    // the streams of worker are unpublished,
+    // the lock is recovered when the worker crashed when hold it.
+    lock();
+    for (int j = 0; j < SRS_WORKER_MAX_STREAMS; j++) {
+        SrsWorkerStream& stream = shm->streams[j];
+        if (stream.worker == i) {
+            srs_trace("worker %d quit, unpublish stream %s", i, stream.url);
+            stream.worker = -1;
+        }
+    }
+    memset(&shm->workers[i], 0, sizeof(SrsWorkerInfo));
+    unlock();
+}
+
+string SrsWorkers::relay_path(int i)
+{
+    std::stringstream ss;
+    ss << _srs_config->get_pid_file() << "." << i << ".sock";
+    return ss.str();
+}
+
+int SrsWorkers::acquire(string url)
+{
+    int ret = ERROR_SUCCESS;
+    
+    if (!enabled()) {
+        return ret;
+    }
+    
+    if (url.length() >= SRS_WORKER_MAX_URL) {
+        ret = ERROR_SYSTEM_WORKER_REGISTRY;
+        srs_error("stream url %s is too long for workers, max=%d. ret=%d", url.c_str(), SRS_WORKER_MAX_URL, ret);
+        return ret;
+    }
+    
+    lock();
+    
+    int free_slot = -1;
+    for (int i = 0; i < SRS_WORKER_MAX_STREAMS; i++) {
+        SrsWorkerStream& stream = shm->streams[i];
+        if (stream.worker < 0) {
+            if (free_slot < 0) {
+                free_slot = i;
+            }
+            continue;
+        }
+        
+        if (url != stream.url) {
+            continue;
+        }
+        
+        if (stream.worker != index) {
+            ret = ERROR_SYSTEM_STREAM_BUSY;
+            srs_warn("stream %s is published on worker %d. ret=%d", url.c_str(), stream.worker, ret);
+        }
+        unlock();
+        return ret;
+    }
+    
+    if (free_slot < 0) {
+        unlock();
+        ret = ERROR_SYSTEM_WORKER_REGISTRY;
+        srs_error("no slot for stream %s in registry, max=%d. ret=%d", url.c_str(), SRS_WORKER_MAX_STREAMS, ret);
+        return ret;
+    }
+    
+    SrsWorkerStream& stream = shm->streams[free_slot];
+    stream.worker = index;
+    strcpy(stream.url, url.c_str());
+    shm->workers[index].nb_streams++;
+    
+    unlock();
+    
+    srs_trace("worker %d acquire stream %s", index, url.c_str());
+    
+    return ret;
+}
+
+void SrsWorkers::release(string url)
+{
+    if (!enabled()) {
+        return;
+    }
+    
+    lock();
+    for (int i = 0; i < SRS_WORKER_MAX_STREAMS; i++) {
+        SrsWorkerStream& stream = shm->streams[i];
+        if (stream.worker == index && url == stream.url) {
+            stream.worker = -1;
+            shm->workers[index].nb_streams--;
+            break;
+        }
+    }
+    unlock();
+    
+    srs_trace("worker %d release stream %s", index, url.c_str());
+}
+
+int SrsWorkers::owner(string url)
+{
+    if (!enabled()) {
+        return -1;
+    }
+    
+    int worker = -1;
+    
+    lock();
+    for (int i = 0; i < SRS_WORKER_MAX_STREAMS; i++) {
+        SrsWorkerStream& stream = shm->streams[i];
+        if (stream.worker >= 0 && url == stream.url) {
+            worker = stream.worker;
+            break;
+        }
+    }
+    unlock();
+    
+    return worker;
+}
+
+int SrsWorkers::relay_from(string url)
+{
+    int worker = owner(url);
+    return (worker == index)? -1 : worker;
+}
+
+void SrsWorkers::update(int nb_conns, SrsKbps* kbps)
+{
+    if (!enabled() || index < 0) {
+        return;
+    }
+    
+    // only the worker itself write its stat, no lock required.
+    SrsWorkerInfo& info = shm->workers[index];
+    info.nb_conns = nb_conns;
+    info.recv_kbps = kbps->get_recv_kbps();
+    info.send_kbps = kbps->get_send_kbps();
+    info.recv_bytes = kbps->get_recv_bytes();
+    info.send_bytes = kbps->get_send_bytes();
+    info.update_time = srs_get_system_time_ms();
+}
+
+SrsWorkerInfo SrsWorkers::info(int i)
+{
+    srs_assert(enabled() && i >= 0 && i < nb_workers);
+    return shm->workers[i];
+}
+
+int SrsWorkers::dumps_streams(stringstream& ss)
+{
+    int ret = ERROR_SUCCESS;
+    
+    ss << SRS_JARRAY_START;
+    
+    if (enabled()) {
+        lock();
+        bool first = true;
+        for (int i = 0; i < SRS_WORKER_MAX_STREAMS; i++) {
+            SrsWorkerStream& stream = shm->streams[i];
+            if (stream.worker < 0) {
+                continue;
+            }
+            
+            if (!first) {
+                ss << SRS_JFIELD_CONT;
+            }
+            first = false;
+            
+            ss << SRS_JOBJECT_START
+                << SRS_JFIELD_STR("url", stream.url) << SRS_JFIELD_CONT
+                << SRS_JFIELD_ORG("worker", stream.worker)
+                << SRS_JOBJECT_END;
+        }
+        unlock();
+    }
+    
+    ss << SRS_JARRAY_END;
+    
+    return ret;
+}
+
+void SrsWorkers::lock()
+{
+    int r0 = pthread_mutex_lock(&shm->lock);
+    
+#ifdef __linux__
+    // the owner died when hold the lock, each update of registry is a slot
+    // or a counter, and the streams of the dead worker are unpublished by
+    // master when it quit, so the registry is still usable.
+    if (r0 == EOWNERDEAD) {
+        srs_warn("the owner of registry died, recover the lock");
+        r0 = pthread_mutex_consistent(&shm->lock);
+    }
+#endif
+    
+    srs_assert(r0 == 0);
+}
+
+void SrsWorkers::unlock()
+{
+    pthread_mutex_unlock(&shm->lock);
+}
+
@@ -0,0 +1,187 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2013-2015 SRS(ossrs)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef SRS_APP_WORKER_HPP
+#define SRS_APP_WORKER_HPP
+
+/*
+#include <srs_app_worker.hpp>
+*/
+
+#include <srs_core.hpp>
+
+#include <string>
+#include <sstream>
+#include <pthread.h>
+#include <sys/types.h>
+
+class SrsKbps;
+
+// the max number of worker processes.
+#define SRS_WORKER_MAX_WORKERS 64
+// the max number of published streams in the shared registry.
+#define SRS_WORKER_MAX_STREAMS 1024
+// the max size of the stream url, the vhost/app/stream.
+#define SRS_WORKER_MAX_URL 256
+
+/**
+* the stat of a worker, updated by the worker itself.
+*/
+struct SrsWorkerInfo
+{
+    // the pid of worker, 0 when not started.
+    pid_t pid;
+    // the connections of worker, include the relay connections.
+    int nb_conns;
+    // the streams published to the worker.
+    int nb_streams;
+    // the kbps and bytes of the worker.
+    int recv_kbps;
+    int send_kbps;
+    int64_t recv_bytes;
+    int64_t send_bytes;
+    // the last time in ms the worker updated the stat.
+    int64_t update_time;
+};
+
+/**
+* the stream in registry, owned by the worker which the publisher connected to.
+*/
+struct SrsWorkerStream
+{
+    // the owner worker, -1 when the slot is free.
+    int worker;
+    // the stream url, vhost/app/stream.
+    char url[SRS_WORKER_MAX_URL];
+};
+
+/**
+* the memory shared by master and workers,
+* mapped by master and inherited by the forked workers.
+*/
+struct SrsWorkerShm
+{
+    // the process-shared robust mutex for the registry, the next locker
+    // recovers it when the holder died.
+    pthread_mutex_t lock;
+    SrsWorkerInfo workers[SRS_WORKER_MAX_WORKERS];
+    SrsWorkerStream streams[SRS_WORKER_MAX_STREAMS];
+};
+
+/**
+* the multiple workers mode, to use all cpus of the box.
+* the master process fork the workers and watch them, restart the crashed one,
+* and forward the signals to workers. each worker is a st process, which listen
+* the same ports by SO_REUSEPORT, so the kernel balance the clients to workers.
+* 
+* the workers share the stream registry, which map the stream to the worker of
+* publisher, only one publisher is allowed for a stream for all workers.
+* when play a stream on other worker, the worker pull the stream from the unix
+* socket of owner, like the edge pull stream from origin, so all players on a
+* worker share the one relay connection.
+*/
+class SrsWorkers
+{
+private:
+    static SrsWorkers* _instance;
+private:
+    SrsWorkerShm* shm;
+    int nb_workers;
+    // the index of current worker, -1 for master.
+    int index;
+public:
+    SrsWorkers();
+    virtual ~SrsWorkers();
+public:
+    static SrsWorkers* instance();
+public:
+    /**
+    * whether serve by multiple workers.
+    */
+    virtual bool enabled();
+    /**
+    * the index of current worker, -1 for master or single process.
+    */
+    virtual int worker();
+    /**
+    * the number of workers, 0 for single process.
+    */
+    virtual int size();
+public:
+    /**
+    * create the shared registry for workers.
+    * @param nb the number of workers, [2, SRS_WORKER_MAX_WORKERS].
+    */
+    virtual int initialize(int nb);
+    /**
+    * fork the workers, then watch them until quit.
+    * @remark only the worker return, the master exit when all workers quit.
+    */
+    virtual int spawn();
+private:
+    virtual int fork_worker(int i);
+    virtual int cycle();
+    virtual void on_worker_quit(int i);
+public:
+    /**
+    * get the unix socket path of worker, to relay the stream.
+    */
+    virtual std::string relay_path(int i);
+    /**
+    * the publisher acquire the stream for current worker.
+    * @return ERROR_SYSTEM_STREAM_BUSY when published on other worker.
+    */
+    virtual int acquire(std::string url);
+    /**
+    * the publisher release the stream of current worker.
+    */
+    virtual void release(std::string url);
+    /**
+    * get the owner of stream.
+    * @return the worker index, -1 when not published.
+    */
+    virtual int owner(std::string url);
+    /**
+    * get the stream to relay from other worker.
+    * @return the worker to pull from, -1 when not published or owned by current worker.
+    */
+    virtual int relay_from(std::string url);
+    /**
+    * update the stat of current worker.
+    */
+    virtual void update(int nb_conns, SrsKbps* kbps);
+    /**
+    * get the snapshot of the stat of worker.
+    */
+    virtual SrsWorkerInfo info(int i);
+    /**
+    * dumps the streams in registry to sstream in json.
+    */
+    virtual int dumps_streams(std::stringstream& ss);
+private:
+    virtual void lock();
+    virtual void unlock();
+};
+
+#endif
+
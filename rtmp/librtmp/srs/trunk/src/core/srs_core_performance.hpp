@@ -116,11 +116,6 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #undef SRS_PERF_MW_SO_RCVBUF
 /**
-* whether enable the fast vector for qeueue.
-* @see https://github.com/ossrs/srs/issues/251
-*/
-#define SRS_PERF_QUEUE_FAST_VECTOR
-/**
 * whether use cond wait to send messages.
 * @remark this improve performance for large connectios.
 * @see https://github.com/ossrs/srs/issues/251
@@ -130,6 +125,20 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
     #define SRS_PERF_MW_MIN_MSGS 8
 #endif
 /**
+* whether the source delivers the stream through a shared ring of msgs,
+* where each consumer only holds a read cursor, so a msg is published
+* once in O(1) whatever the number of consumers.
+* undef it to copy each msg to the queue of each consumer.
+*/
+#define SRS_PERF_SOURCE_RING
+/**
+* whether alloc the msg wrappers and the received payloads from the size class pool,
+* which reuse the freed blocks to avoid the malloc/free of each msg for each consumer.
+* @remark the pool cache at most SRS_PERF_POOL_CACHE_SIZE bytes of blocks for each class.
+*/
+#define SRS_PERF_MSG_POOL
+#define SRS_PERF_POOL_CACHE_SIZE 4194304
+/**
 * the default value of vhost for
 * SRS whether use the min latency mode.
 * for min latence mode:
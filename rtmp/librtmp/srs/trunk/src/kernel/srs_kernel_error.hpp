@@ -99,6 +99,11 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define ERROR_SYSTEM_KILL                   1058
 #define ERROR_SYSTEM_DNS_RESOLVE            1059
 #define ERROR_SOCKET_SETKEEPALIVE           1060
+#define ERROR_SYSTEM_WORKER_SHM             1061
+#define ERROR_SYSTEM_WORKER_FORK            1062
+#define ERROR_SYSTEM_WORKER_REGISTRY        1063
+#define ERROR_SYSTEM_UNIX_SOCKET            1064
+#define ERROR_SYSTEM_WORKER_RELAY           1065
 
 ///////////////////////////////////////////////////////
 // RTMP protocol error.
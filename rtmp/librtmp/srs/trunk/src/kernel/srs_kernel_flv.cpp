@@ -38,6 +38,7 @@ using namespace std;
 #include <srs_kernel_file.hpp>
 #include <srs_kernel_codec.hpp>
 #include <srs_kernel_utility.hpp>
+#include <srs_kernel_pool.hpp>
 #include <srs_core_mem_watch.hpp>
 
 SrsMessageHeader::SrsMessageHeader()
@@ -156,19 +157,29 @@ SrsCommonMessage::SrsCommonMessage()
 {
     payload = NULL;
     size = 0;
+    pooled = false;
 }
 
 SrsCommonMessage::~SrsCommonMessage()
 {
-#ifdef SRS_AUTO_MEM_WATCH
-    srs_memory_unwatch(payload);
-#endif
-    srs_freepa(payload);
+    free_payload();
+}
+
+#ifdef SRS_PERF_MSG_POOL
+void* SrsCommonMessage::operator new(size_t size)
+{
+    return srs_pool_alloc(size);
 }
 
+void SrsCommonMessage::operator delete(void* p)
+{
+    srs_pool_free(p);
+}
+#endif
+
 void SrsCommonMessage::create_payload(int size)
 {
-    srs_freepa(payload);
+    free_payload();
     
     payload = new char[size];
     srs_verbose("create payload for RTMP message. size=%d", size);
@@ -178,11 +189,39 @@ void SrsCommonMessage::create_payload(int size)
 #endif
 }
 
+void SrsCommonMessage::create_pooled_payload(int size)
+{
+    free_payload();
+    
+    payload = (char*)srs_pool_alloc(size);
+    pooled = true;
+    srs_verbose("create pooled payload for RTMP message. size=%d", size);
+    
+#ifdef SRS_AUTO_MEM_WATCH
+    srs_memory_watch(payload, "RTMP.msg.payload", size);
+#endif
+}
+
+void SrsCommonMessage::free_payload()
+{
+#ifdef SRS_AUTO_MEM_WATCH
+    srs_memory_unwatch(payload);
+#endif
+    if (pooled) {
+        srs_pool_free(payload);
+        payload = NULL;
+        pooled = false;
+    } else {
+        srs_freepa(payload);
+    }
+}
+
 SrsSharedPtrMessage::SrsSharedPtrPayload::SrsSharedPtrPayload()
 {
     payload = NULL;
     size = 0;
     shared_count = 0;
+    pooled = false;
 }
 
 SrsSharedPtrMessage::SrsSharedPtrPayload::~SrsSharedPtrPayload()
@@ -190,9 +229,25 @@ SrsSharedPtrMessage::SrsSharedPtrPayload::~SrsSharedPtrPayload()
 #ifdef SRS_AUTO_MEM_WATCH
     srs_memory_unwatch(payload);
 #endif
-    srs_freepa(payload);
+    if (pooled) {
+        srs_pool_free(payload);
+    } else {
+        srs_freepa(payload);
+    }
 }
 
+#ifdef SRS_PERF_MSG_POOL
+void* SrsSharedPtrMessage::SrsSharedPtrPayload::operator new(size_t size)
+{
+    return srs_pool_alloc(size);
+}
+
+void SrsSharedPtrMessage::SrsSharedPtrPayload::operator delete(void* p)
+{
+    srs_pool_free(p);
+}
+#endif
+
 SrsSharedPtrMessage::SrsSharedPtrMessage()
 {
     ptr = NULL;
@@ -209,6 +264,18 @@ SrsSharedPtrMessage::~SrsSharedPtrMessage()
     }
 }
 
+#ifdef SRS_PERF_MSG_POOL
+void* SrsSharedPtrMessage::operator new(size_t size)
+{
+    return srs_pool_alloc(size);
+}
+
+void SrsSharedPtrMessage::operator delete(void* p)
+{
+    srs_pool_free(p);
+}
+#endif
+
 int SrsSharedPtrMessage::create(SrsCommonMessage* msg)
 {
     int ret = ERROR_SUCCESS;
@@ -220,8 +287,10 @@ int SrsSharedPtrMessage::create(SrsCommonMessage* msg)
     // to prevent double free of payload:
     // initialize already attach the payload of msg,
     // detach the payload to transfer the owner to shared ptr.
+    ptr->pooled = msg->pooled;
     msg->payload = NULL;
     msg->size = 0;
+    msg->pooled = false;
     
     return ret;
 }
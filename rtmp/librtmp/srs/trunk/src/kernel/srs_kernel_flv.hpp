@@ -31,6 +31,8 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <string>
 
+#include <srs_core_performance.hpp>
+
 // for srs-librtmp, @see https://github.com/ossrs/srs/issues/213
 #ifndef _WIN32
 #include <sys/uio.h>
@@ -281,14 +283,32 @@ public:
      *       video/audio packet use raw bytes, no video/audio packet.
      */
     char* payload;
+    /**
+     * whether the payload is alloced from the pool, which is freed by srs_pool_free.
+     * @remark the pooled payload can only transfer to the SrsSharedPtrMessage,
+     *       user should never detach and delete it.
+     */
+    bool pooled;
 public:
     SrsCommonMessage();
     virtual ~SrsCommonMessage();
+#ifdef SRS_PERF_MSG_POOL
+public:
+    static void* operator new(size_t size);
+    static void operator delete(void* p);
+#endif
 public:
     /**
      * alloc the payload to specified size of bytes.
      */
     virtual void create_payload(int size);
+    /**
+     * alloc the payload to specified size of bytes from the pool.
+     * @see srs_pool_alloc
+     */
+    virtual void create_pooled_payload(int size);
+private:
+    virtual void free_payload();
 };
 
 /**
@@ -374,20 +394,33 @@ private:
         int size;
         // the reference count
         int shared_count;
+        // whether the payload is alloced from the pool.
+        bool pooled;
     public:
         SrsSharedPtrPayload();
         virtual ~SrsSharedPtrPayload();
+#ifdef SRS_PERF_MSG_POOL
+    public:
+        static void* operator new(size_t size);
+        static void operator delete(void* p);
+#endif
     };
     SrsSharedPtrPayload* ptr;
 public:
     SrsSharedPtrMessage();
     virtual ~SrsSharedPtrMessage();
+#ifdef SRS_PERF_MSG_POOL
+public:
+    static void* operator new(size_t size);
+    static void operator delete(void* p);
+#endif
 public:
     /**
      * create shared ptr message,
      * copy header, manage the payload of msg,
      * set the payload to NULL to prevent double free.
      * @remark payload of msg set to NULL if success.
+     * @remark the pooled payload of msg is freed to the pool.
      */
     virtual int create(SrsCommonMessage* msg);
     /**
@@ -0,0 +1,119 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2013-2015 SRS(ossrs)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <srs_kernel_pool.hpp>
+
+#include <stdlib.h>
+
+#include <srs_core_performance.hpp>
+
+// the header before each block, keep the block aligned at 16B.
+#define SRS_POOL_HEADER_SIZE 16
+// the class of the fallback blocks, which are freed to heap.
+#define SRS_POOL_FALLBACK -1
+
+/**
+* the free list of a size class.
+* @remark use POD for the thread local storage.
+*/
+struct SrsPoolSlab
+{
+    // the cached blocks, linked by the first pointer of block.
+    void* blocks;
+    // the number of cached blocks.
+    int nb_blocks;
+};
+
+// the block size of each class.
+static const int _srs_pool_classes[SRS_POOL_NB_CLASSES] = {
+    64, 256, 1024, 4096, 16384, SRS_POOL_MAX_BLOCK
+};
+
+static __thread SrsPoolSlab _srs_pool_slabs[SRS_POOL_NB_CLASSES];
+static __thread SrsPoolStat _srs_pool_stat;
+
+void* srs_pool_alloc(size_t size)
+{
+    int klass = SRS_POOL_FALLBACK;
+    for (int i = 0; i < SRS_POOL_NB_CLASSES; i++) {
+        if (size <= (size_t)_srs_pool_classes[i]) {
+            klass = i;
+            break;
+        }
+    }
+    
+    char* block = NULL;
+    if (klass == SRS_POOL_FALLBACK) {
+        block = (char*)malloc(SRS_POOL_HEADER_SIZE + size);
+        _srs_pool_stat.nb_fallbacks++;
+        _srs_pool_stat.nb_allocs++;
+    } else {
+        SrsPoolSlab& slab = _srs_pool_slabs[klass];
+        if (slab.blocks) {
+            block = (char*)slab.blocks;
+            slab.blocks = *(void**)block;
+            slab.nb_blocks--;
+            _srs_pool_stat.cached_bytes -= _srs_pool_classes[klass];
+            _srs_pool_stat.nb_reuses++;
+        } else {
+            block = (char*)malloc(SRS_POOL_HEADER_SIZE + _srs_pool_classes[klass]);
+            _srs_pool_stat.nb_allocs++;
+        }
+    }
+    
+    // always abort when out of memory, like the operator new.
+    srs_assert(block);
+    
+    *(int*)block = klass;
+    return block + SRS_POOL_HEADER_SIZE;
+}
+
+void srs_pool_free(void* block)
+{
+    if (!block) {
+        return;
+    }
+    
+    char* p = (char*)block - SRS_POOL_HEADER_SIZE;
+    int klass = *(int*)p;
+    
+    // cache the block when the free list not full.
+    if (klass != SRS_POOL_FALLBACK) {
+        SrsPoolSlab& slab = _srs_pool_slabs[klass];
+        if (slab.nb_blocks * _srs_pool_classes[klass] < SRS_PERF_POOL_CACHE_SIZE) {
+            *(void**)p = slab.blocks;
+            slab.blocks = p;
+            slab.nb_blocks++;
+            _srs_pool_stat.cached_bytes += _srs_pool_classes[klass];
+            return;
+        }
+    }
+    
+    free(p);
+}
+
+SrsPoolStat srs_pool_stat()
+{
+    return _srs_pool_stat;
+}
+
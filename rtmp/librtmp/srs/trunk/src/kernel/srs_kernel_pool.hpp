@@ -0,0 +1,77 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2013-2015 SRS(ossrs)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef SRS_KERNEL_POOL_HPP
+#define SRS_KERNEL_POOL_HPP
+
+/*
+#include <srs_kernel_pool.hpp>
+*/
+
+#include <srs_core.hpp>
+
+#include <sys/types.h>
+
+/**
+* the size classes of the pool, in bytes.
+* the small classes are for the msg wrappers, the 1KB class for audio
+* and the larger ones for video frames, bigger blocks go to the heap.
+*/
+#define SRS_POOL_NB_CLASSES 6
+#define SRS_POOL_MAX_BLOCK 65536
+
+/**
+* the stat of the pool of current thread.
+*/
+struct SrsPoolStat
+{
+    // the blocks alloced from heap, include the fallback ones.
+    int64_t nb_allocs;
+    // the blocks reused from the free list.
+    int64_t nb_reuses;
+    // the fallback blocks larger than the largest class.
+    int64_t nb_fallbacks;
+    // the bytes kept in the free lists.
+    int64_t cached_bytes;
+};
+
+/**
+* alloc a block of size from the size class pool,
+* the freed blocks are kept in a free list per class and reused,
+* so the stream in steady state never hit the malloc.
+* @remark the block must be freed by srs_pool_free, never delete it.
+* @remark each thread use its own free lists, for librtmp is multiple threads.
+*/
+extern void* srs_pool_alloc(size_t size);
+/**
+* free the block alloced by srs_pool_alloc, ignore NULL.
+* @remark the block is cached when its free list not full, or free to heap.
+*/
+extern void srs_pool_free(void* block);
+/**
+* get the stat of the pool of current thread.
+*/
+extern SrsPoolStat srs_pool_stat();
+
+#endif
+
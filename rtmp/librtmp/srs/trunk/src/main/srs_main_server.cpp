@@ -42,6 +42,7 @@ using namespace std;
 #include <srs_app_log.hpp>
 #include <srs_kernel_utility.hpp>
 #include <srs_core_performance.hpp>
+#include <srs_app_worker.hpp>
 
 // pre-declare
 int run();
@@ -383,6 +384,28 @@ int run_master()
 {
     int ret = ERROR_SUCCESS;
     
+    // for multiple workers, the master hold the pid file then fork the workers,
+    // only the worker continue to serve the clients.
+    SrsWorkers* workers = SrsWorkers::instance();
+    if (_srs_config->get_workers() > 1) {
+        if ((ret = _srs_server->acquire_pid_file()) != ERROR_SUCCESS) {
+            return ret;
+        }
+        
+        if ((ret = workers->initialize(_srs_config->get_workers())) != ERROR_SUCCESS) {
+            return ret;
+        }
+        
+        if ((ret = workers->spawn()) != ERROR_SUCCESS) {
+            return ret;
+        }
+        
+        // the master quit.
+        if (workers->worker() < 0) {
+            return 0;
+        }
+    }
+    
     if ((ret = _srs_server->initialize_st()) != ERROR_SUCCESS) {
         return ret;
     }
@@ -391,8 +414,10 @@ int run_master()
         return ret;
     }
     
-    if ((ret = _srs_server->acquire_pid_file()) != ERROR_SUCCESS) {
-        return ret;
+    if (!workers->enabled()) {
+        if ((ret = _srs_server->acquire_pid_file()) != ERROR_SUCCESS) {
+            return ret;
+        }
     }
     
     if ((ret = _srs_server->listen()) != ERROR_SUCCESS) {
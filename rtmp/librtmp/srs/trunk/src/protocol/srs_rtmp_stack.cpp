@@ -229,6 +229,7 @@ SrsProtocol::SrsProtocol(ISrsProtocolReaderWriter* io)
     
     warned_c0c3_cache_dry = false;
     auto_response_when_recv = true;
+    pooled_payload = false;
     show_debug_info = true;
     in_buffer_length = 0;
     
@@ -313,6 +314,13 @@ int SrsProtocol::manual_response_flush()
     return ret;
 }
 
+#ifdef SRS_PERF_MSG_POOL
+void SrsProtocol::set_pooled_payload(bool v)
+{
+    pooled_payload = v;
+}
+#endif
+
 #ifdef SRS_PERF_MERGED_READ
 void SrsProtocol::set_merge_read(bool v, IMergeReadHandler* handler)
 {
@@ -1422,7 +1430,11 @@ int SrsProtocol::read_message_payload(SrsChunkStream* chunk, SrsCommonMessage**
 
     // create msg payload if not initialized
     if (!chunk->msg->payload) {
-        chunk->msg->create_payload(chunk->header.payload_length);
+        if (pooled_payload) {
+            chunk->msg->create_pooled_payload(chunk->header.payload_length);
+        } else {
+            chunk->msg->create_payload(chunk->header.payload_length);
+        }
     }
     
     // read payload to buffer
@@ -2389,6 +2401,13 @@ void SrsRtmpServer::set_auto_response(bool v)
     protocol->set_auto_response(v);
 }
 
+#ifdef SRS_PERF_MSG_POOL
+void SrsRtmpServer::set_pooled_payload(bool v)
+{
+    protocol->set_pooled_payload(v);
+}
+#endif
+
 #ifdef SRS_PERF_MERGED_READ
 void SrsRtmpServer::set_merge_read(bool v, IMergeReadHandler* handler)
 {
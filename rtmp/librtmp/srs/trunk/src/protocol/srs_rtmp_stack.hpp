@@ -248,6 +248,11 @@ private:
     */
     bool auto_response_when_recv;
     /**
+    * whether alloc the payload of received messages from the pool.
+    * default to false for the user of srs-librtmp detach and delete the payload.
+    */
+    bool pooled_payload;
+    /**
     * when not auto response message, manual flush the messages in queue.
     */
     std::vector<SrsPacket*> manual_response_queue;
@@ -292,6 +297,15 @@ public:
     * @see the auto_response_when_recv and manual_response_queue.
     */
     virtual int manual_response_flush();
+#ifdef SRS_PERF_MSG_POOL
+    /**
+    * alloc the payload of received messages from the pool.
+    * @param v, whether use the pooled payload.
+    * @remark only enable it when user never detach the payload from the message.
+    * @see SrsCommonMessage.create_pooled_payload
+    */
+    virtual void set_pooled_payload(bool v);
+#endif
 public:
 #ifdef SRS_PERF_MERGED_READ
     /**
@@ -842,6 +856,13 @@ public:
      * @see: https://github.com/ossrs/srs/issues/217
      */
     virtual void set_auto_response(bool v);
+#ifdef SRS_PERF_MSG_POOL
+    /**
+     * alloc the payload of received messages from the pool,
+     * the server never detach the payload, so it's safe.
+     */
+    virtual void set_pooled_payload(bool v);
+#endif
 #ifdef SRS_PERF_MERGED_READ
     /**
      * to improve read performance, merge some packets then read,
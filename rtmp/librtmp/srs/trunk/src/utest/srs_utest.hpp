@@ -44,6 +44,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
     #define ENABLE_UTEST_KERNEL
     #define ENABLE_UTEST_PROTOCOL
     #define ENABLE_UTEST_RELOAD
+    #define ENABLE_UTEST_SOURCE
 #endif
 
 // disable some for fast dev, compile and startup.
@@ -54,6 +55,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
     #undef ENABLE_UTEST_KERNEL
     #undef ENABLE_UTEST_PROTOCOL
     #undef ENABLE_UTEST_RELOAD
+    #undef ENABLE_UTEST_SOURCE
 #endif
 
 #ifdef SRS_UTEST_DEV
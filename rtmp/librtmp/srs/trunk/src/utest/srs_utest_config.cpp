@@ -857,6 +857,36 @@ VOID TEST(ConfigMainTest, CheckConf_max_connections)
     }
 }
 
+VOID TEST(ConfigMainTest, CheckConf_workers)
+{
+    if (true) {
+        MockSrsConfig conf;
+        EXPECT_TRUE(ERROR_SUCCESS == conf.parse(_MIN_OK_CONF));
+        EXPECT_EQ(1, conf.get_workers());
+    }
+    
+    if (true) {
+        MockSrsConfig conf;
+        EXPECT_TRUE(ERROR_SUCCESS == conf.parse(_MIN_OK_CONF"workers 4;"));
+        EXPECT_EQ(4, conf.get_workers());
+    }
+    
+    if (true) {
+        MockSrsConfig conf;
+        EXPECT_TRUE(ERROR_SUCCESS != conf.parse(_MIN_OK_CONF"workerss 4;"));
+    }
+    
+    if (true) {
+        MockSrsConfig conf;
+        EXPECT_TRUE(ERROR_SUCCESS != conf.parse(_MIN_OK_CONF"workers 0;"));
+    }
+    
+    if (true) {
+        MockSrsConfig conf;
+        EXPECT_TRUE(ERROR_SUCCESS != conf.parse(_MIN_OK_CONF"workers 65;"));
+    }
+}
+
 VOID TEST(ConfigMainTest, CheckConf_daemon)
 {
     if (true) {
@@ -1399,6 +1429,30 @@ VOID TEST(ConfigMainTest, CheckConf_gop_cache)
         MockSrsConfig conf;
         EXPECT_TRUE(ERROR_SUCCESS != conf.parse(_MIN_OK_CONF"vhost v{queue_lengths 10;}"));
     }
+    
+    if (true) {
+        MockSrsConfig conf;
+        EXPECT_TRUE(ERROR_SUCCESS == conf.parse(_MIN_OK_CONF"vhost v{gop_cache_gops 3; gop_cache_start 2.5;}"));
+        EXPECT_EQ(3, conf.get_gop_cache_gops("v"));
+        EXPECT_EQ(2.5, conf.get_gop_cache_start("v"));
+        EXPECT_EQ(1, conf.get_gop_cache_gops("__defaultVhost__"));
+        EXPECT_EQ(0, conf.get_gop_cache_start("__defaultVhost__"));
+    }
+    
+    if (true) {
+        MockSrsConfig conf;
+        EXPECT_TRUE(ERROR_SUCCESS != conf.parse(_MIN_OK_CONF"vhost v{gop_cache_gops 0;}"));
+    }
+    
+    if (true) {
+        MockSrsConfig conf;
+        EXPECT_TRUE(ERROR_SUCCESS != conf.parse(_MIN_OK_CONF"vhost v{gop_cache_gops 65;}"));
+    }
+    
+    if (true) {
+        MockSrsConfig conf;
+        EXPECT_TRUE(ERROR_SUCCESS != conf.parse(_MIN_OK_CONF"vhost v{gop_cache_start -1;}"));
+    }
 }
 
 VOID TEST(ConfigMainTest, CheckConf_debug_srs_upnode)
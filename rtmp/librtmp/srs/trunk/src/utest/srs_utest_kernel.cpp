@@ -30,6 +30,7 @@ using namespace std;
 #include <srs_kernel_utility.hpp>
 #include <srs_rtmp_utility.hpp>
 #include <srs_kernel_stream.hpp>
+#include <srs_kernel_pool.hpp>
 
 #define MAX_MOCK_DATA_SIZE 1024 * 1024
 
@@ -282,6 +283,104 @@ VOID TEST(KernelFastBufferTest, Grow)
     EXPECT_EQ('w', b.read_1byte());
 }
 
+/**
+* test the pool,
+* the freed blocks are reused by the alloc of same class.
+*/
+VOID TEST(KernelPoolTest, ReuseBlock)
+{
+    SrsPoolStat s0 = srs_pool_stat();
+    
+    char* a = (char*)srs_pool_alloc(300);
+    ASSERT_TRUE(NULL != a);
+    memset(a, 0x0f, 300);
+    srs_pool_free(a);
+    
+    // same class, reuse the freed block.
+    char* b = (char*)srs_pool_alloc(1000);
+    EXPECT_TRUE(a == b);
+    
+    // another class, alloc from heap.
+    char* c = (char*)srs_pool_alloc(1025);
+    EXPECT_TRUE(b != c);
+    memset(c, 0x0f, 1025);
+    
+    SrsPoolStat s1 = srs_pool_stat();
+    EXPECT_EQ(1, s1.nb_reuses - s0.nb_reuses);
+    
+    srs_pool_free(b);
+    srs_pool_free(c);
+    srs_pool_free(NULL);
+    
+    SrsPoolStat s2 = srs_pool_stat();
+    EXPECT_EQ(1024 + 4096, s2.cached_bytes - s1.cached_bytes);
+}
+
+/**
+* test the pool,
+* the block larger than the largest class is freed to heap.
+*/
+VOID TEST(KernelPoolTest, Fallback)
+{
+    SrsPoolStat s0 = srs_pool_stat();
+    
+    char* a = (char*)srs_pool_alloc(SRS_POOL_MAX_BLOCK);
+    char* b = (char*)srs_pool_alloc(SRS_POOL_MAX_BLOCK + 1);
+    ASSERT_TRUE(NULL != a);
+    ASSERT_TRUE(NULL != b);
+    memset(a, 0x0f, SRS_POOL_MAX_BLOCK);
+    memset(b, 0x0f, SRS_POOL_MAX_BLOCK + 1);
+    
+    SrsPoolStat s1 = srs_pool_stat();
+    EXPECT_EQ(1, s1.nb_fallbacks - s0.nb_fallbacks);
+    
+    srs_pool_free(a);
+    srs_pool_free(b);
+    
+    // only the class block is cached.
+    SrsPoolStat s2 = srs_pool_stat();
+    EXPECT_EQ(SRS_POOL_MAX_BLOCK, s2.cached_bytes - s1.cached_bytes);
+}
+
+/**
+* test the pooled payload,
+* which transfer to the shared ptr message and freed with its last copy.
+*/
+VOID TEST(KernelPoolTest, PooledPayload)
+{
+    SrsCommonMessage* msg = new SrsCommonMessage();
+    msg->header.initialize_video(4, 0, 1);
+    msg->create_pooled_payload(4);
+    msg->size = 4;
+    memcpy(msg->payload, "\x17\x01\x00\x00", 4);
+    EXPECT_TRUE(msg->pooled);
+    
+    // recreate the payload from heap, the pooled one is freed.
+    msg->create_payload(4);
+    EXPECT_FALSE(msg->pooled);
+    msg->create_pooled_payload(4);
+    memcpy(msg->payload, "\x17\x01\x00\x00", 4);
+    
+    SrsSharedPtrMessage* shared = new SrsSharedPtrMessage();
+    EXPECT_EQ(ERROR_SUCCESS, shared->create(msg));
+    EXPECT_TRUE(NULL == msg->payload);
+    EXPECT_FALSE(msg->pooled);
+    srs_freep(msg);
+    
+    SrsPoolStat s0 = srs_pool_stat();
+    SrsSharedPtrMessage* copy = shared->copy();
+    EXPECT_TRUE(copy->is_video());
+    EXPECT_EQ(0x17, (uint8_t)copy->payload[0]);
+    srs_freep(shared);
+    
+    // the payload is still alive for the copy.
+    EXPECT_EQ(0x01, (uint8_t)copy->payload[1]);
+    srs_freep(copy);
+    
+    SrsPoolStat s1 = srs_pool_stat();
+    EXPECT_LT(s0.cached_bytes, s1.cached_bytes);
+}
+
 /**
 * test the codec,
 * whether H.264 keyframe
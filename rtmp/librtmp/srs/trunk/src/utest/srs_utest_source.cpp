@@ -0,0 +1,511 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2013-2015 SRS(ossrs)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include <srs_utest_source.hpp>
+
+using namespace std;
+
+#include <srs_kernel_error.hpp>
+#include <srs_kernel_flv.hpp>
+#include <srs_kernel_codec.hpp>
+#include <srs_kernel_utility.hpp>
+#include <srs_core_autofree.hpp>
+
+#ifdef ENABLE_UTEST_SOURCE
+
+/**
+* create a av message, the video is keyframe or interframe,
+* none of them is sequence header.
+*/
+SrsSharedPtrMessage* mock_av_message(bool video, int64_t time, bool keyframe)
+{
+    SrsMessageHeader header;
+    if (video) {
+        header.initialize_video(2, (u_int32_t)time, 1);
+    } else {
+        header.initialize_audio(2, (u_int32_t)time, 1);
+    }
+    
+    char* payload = new char[2];
+    payload[0] = video? (keyframe? 0x17 : 0x27) : (char)0xaf;
+    payload[1] = 0x01;
+    
+    SrsSharedPtrMessage* msg = new SrsSharedPtrMessage();
+    msg->create(&header, payload, 2);
+    return msg;
+}
+
+/**
+* create a sequence header of video or audio.
+*/
+SrsSharedPtrMessage* mock_sh_message(bool video, int64_t time)
+{
+    SrsSharedPtrMessage* msg = mock_av_message(video, time, true);
+    msg->payload[1] = 0x00;
+    return msg;
+}
+
+/**
+* the deque keeps the msgs in order when wrap and grow.
+*/
+VOID TEST(MessageQueueTest, DequeWrapAndGrow)
+{
+    SrsMessageDeque deque;
+    SrsSharedPtrMessage* msgs[SRS_PERF_MW_MSGS];
+    
+    int64_t head = 0;
+    int64_t tail = 0;
+    
+    // wrap the deque many times.
+    for (int i = 0; i < 100; i++) {
+        for (int j = 0; j < 100; j++) {
+            deque.push_back(mock_av_message(false, tail++, false));
+        }
+        
+        deque.pop_front(msgs, 90);
+        for (int j = 0; j < 90; j++) {
+            EXPECT_EQ(head++, msgs[j]->timestamp);
+            srs_freep(msgs[j]);
+        }
+    }
+    EXPECT_EQ(1000, deque.size());
+    EXPECT_EQ(head, deque.at(0)->timestamp);
+    EXPECT_EQ(tail - 1, deque.at(999)->timestamp);
+    
+    // grow when wrapped, then push front.
+    for (int i = 0; i < 10000; i++) {
+        deque.push_back(mock_av_message(false, tail++, false));
+    }
+    deque.push_front(mock_av_message(true, 0, true));
+    EXPECT_EQ(11001, deque.size());
+    EXPECT_TRUE(deque.at(0)->is_video());
+    EXPECT_EQ(head, deque.at(1)->timestamp);
+    EXPECT_EQ(tail - 1, deque.at(11000)->timestamp);
+    
+    deque.free();
+    EXPECT_EQ(0, deque.size());
+}
+
+/**
+* dump the msgs in batch, the left msgs keep in order.
+*/
+VOID TEST(MessageQueueTest, DumpInBatch)
+{
+    SrsMessageQueue queue;
+    queue.set_queue_size(30);
+    SrsSharedPtrMessage* msgs[SRS_PERF_MW_MSGS];
+    
+    for (int i = 0; i < 100; i++) {
+        EXPECT_TRUE(ERROR_SUCCESS == queue.enqueue(mock_av_message(true, i * 40, i % 25 == 0)));
+    }
+    EXPECT_EQ(100, queue.size());
+    EXPECT_EQ(3960, queue.duration());
+    
+    int64_t time = 0;
+    while (queue.size() > 0) {
+        int count = 0;
+        EXPECT_TRUE(ERROR_SUCCESS == queue.dump_packets(30, msgs, count));
+        EXPECT_TRUE(count > 0 && count <= 30);
+        for (int i = 0; i < count; i++) {
+            EXPECT_EQ(time, msgs[i]->timestamp);
+            time += 40;
+            srs_freep(msgs[i]);
+        }
+    }
+    EXPECT_EQ(4000, time);
+    EXPECT_EQ(0, queue.duration());
+}
+
+/**
+* the overflow queue drops to the first keyframe in queue size,
+* the sequence headers go before the keyframe.
+*/
+VOID TEST(MessageQueueTest, ShrinkToKeyframe)
+{
+    SrsMessageQueue queue;
+    queue.set_queue_size(1);
+    
+    queue.enqueue(mock_sh_message(true, 0));
+    queue.enqueue(mock_sh_message(false, 0));
+    
+    // the keyframe every 1s, the frame every 100ms.
+    bool overflow = false;
+    for (int i = 0; i <= 15; i++) {
+        queue.enqueue(mock_av_message(true, i * 100, i % 10 == 0), &overflow);
+    }
+    
+    // the gop from 1000ms is kept.
+    EXPECT_TRUE(overflow);
+    EXPECT_EQ(8, queue.size());
+    EXPECT_EQ(500, queue.duration());
+    
+    SrsSharedPtrMessage* msgs[8];
+    int count = 0;
+    EXPECT_TRUE(ERROR_SUCCESS == queue.dump_packets(8, msgs, count));
+    EXPECT_EQ(8, count);
+    
+    EXPECT_TRUE(SrsFlvCodec::video_is_sequence_header(msgs[0]->payload, msgs[0]->size));
+    EXPECT_TRUE(SrsFlvCodec::audio_is_sequence_header(msgs[1]->payload, msgs[1]->size));
+    EXPECT_EQ(1000, msgs[0]->timestamp);
+    EXPECT_EQ(1000, msgs[1]->timestamp);
+    EXPECT_TRUE(SrsFlvCodec::video_is_keyframe(msgs[2]->payload, msgs[2]->size));
+    for (int i = 2; i < count; i++) {
+        EXPECT_EQ(1000 + (i - 2) * 100, msgs[i]->timestamp);
+    }
+    
+    for (int i = 0; i < count; i++) {
+        srs_freep(msgs[i]);
+    }
+}
+
+/**
+* the overflow queue without keyframe drops all except the sequence headers,
+* while the pure audio drops to the first audio in queue size.
+*/
+VOID TEST(MessageQueueTest, ShrinkWithoutKeyframe)
+{
+    if (true) {
+        SrsMessageQueue queue;
+        queue.set_queue_size(1);
+        
+        queue.enqueue(mock_sh_message(true, 0));
+        for (int i = 0; i <= 15; i++) {
+            queue.enqueue(mock_av_message(true, i * 100, false));
+        }
+        
+        // overflow at 1100ms, drop all, the sh and frames after kept.
+        EXPECT_EQ(5, queue.size());
+        EXPECT_EQ(400, queue.duration());
+    }
+    
+    if (true) {
+        SrsMessageQueue queue;
+        queue.set_queue_size(1);
+        
+        queue.enqueue(mock_sh_message(false, 0));
+        for (int i = 0; i < 100; i++) {
+            queue.enqueue(mock_av_message(false, i * 20, false));
+        }
+        
+        // the sh and the audios in [980, 1980].
+        EXPECT_EQ(52, queue.size());
+        EXPECT_EQ(1000, queue.duration());
+    }
+}
+
+#ifdef SRS_PERF_SOURCE_RING
+
+/**
+* push a av message to ring, the ring copy it.
+*/
+void mock_ring_push(SrsMessageRing* ring, bool video, int64_t time, bool keyframe)
+{
+    SrsSharedPtrMessage* msg = mock_av_message(video, time, keyframe);
+    SrsAutoFree(SrsSharedPtrMessage, msg);
+    ring->push(msg, false, SrsRtmpJitterAlgorithmOFF);
+}
+
+/**
+* the consumers read the same msgs by their own cursor.
+*/
+VOID TEST(SourceRingTest, PushAndDump)
+{
+    SrsMessageRing ring;
+    ring.set_queue_size(30);
+    SrsRtmpJitter jitter;
+    SrsSharedPtrMessage* msgs[4];
+    
+    int64_t c0 = ring.cursor();
+    for (int i = 0; i < 10; i++) {
+        mock_ring_push(&ring, true, i * 40, i == 0);
+    }
+    int64_t c1 = ring.cursor();
+    mock_ring_push(&ring, false, 400, false);
+    
+    EXPECT_EQ(11, ring.size(c0));
+    EXPECT_EQ(1, ring.size(c1));
+    EXPECT_EQ(400, ring.duration(c0));
+    
+    int count = 0;
+    EXPECT_TRUE(ERROR_SUCCESS == ring.dump_packets(c0, &jitter, 4, msgs, count));
+    EXPECT_EQ(4, count);
+    EXPECT_EQ(7, ring.size(c0));
+    for (int i = 0; i < count; i++) {
+        EXPECT_EQ(i * 40, msgs[i]->timestamp);
+        EXPECT_TRUE(msgs[i]->is_video());
+        srs_freep(msgs[i]);
+    }
+    
+    count = 0;
+    EXPECT_TRUE(ERROR_SUCCESS == ring.dump_packets(c1, &jitter, 4, msgs, count));
+    EXPECT_EQ(1, count);
+    EXPECT_EQ(400, msgs[0]->timestamp);
+    EXPECT_TRUE(msgs[0]->is_audio());
+    srs_freep(msgs[0]);
+    
+    // c0 still reads the msgs dumped by c1.
+    ring.trim(srs_min(c0, c1));
+    EXPECT_FALSE(ring.lagging(c0));
+    EXPECT_EQ(7, ring.size(c0));
+    EXPECT_EQ(0, ring.size(c1));
+    
+    ring.clear();
+    EXPECT_TRUE(ring.lagging(c0));
+}
+
+/**
+* the msgs out of queue size are dropped,
+* the lagging cursor snaps to the latest keyframe.
+*/
+VOID TEST(SourceRingTest, DropAndSnap)
+{
+    SrsMessageRing ring;
+    ring.set_queue_size(1);
+    SrsRtmpJitter jitter;
+    SrsSharedPtrMessage* msgs[4];
+    
+    int64_t cursor = ring.cursor();
+    for (int i = 0; i <= 20; i++) {
+        mock_ring_push(&ring, true, i * 100, i % 10 == 0);
+    }
+    
+    // [1000, 2000] in ring, the keyframe 1000 and 2000.
+    EXPECT_TRUE(ring.lagging(cursor));
+    EXPECT_EQ(2000, ring.snap(cursor));
+    EXPECT_FALSE(ring.lagging(cursor));
+    EXPECT_EQ(1, ring.size(cursor));
+    
+    int count = 0;
+    EXPECT_TRUE(ERROR_SUCCESS == ring.dump_packets(cursor, &jitter, 4, msgs, count));
+    EXPECT_EQ(1, count);
+    EXPECT_EQ(2000, msgs[0]->timestamp);
+    EXPECT_TRUE(SrsFlvCodec::video_is_keyframe(msgs[0]->payload, msgs[0]->size));
+    srs_freep(msgs[0]);
+    
+    // no keyframe in ring, snap to the end.
+    cursor = 0;
+    for (int i = 21; i <= 40; i++) {
+        mock_ring_push(&ring, false, i * 100, false);
+    }
+    EXPECT_TRUE(ring.lagging(cursor));
+    EXPECT_EQ(4000, ring.snap(cursor));
+    EXPECT_EQ(ring.cursor(), cursor);
+    EXPECT_EQ(0, ring.size(cursor));
+}
+
+/**
+* the time reset when republish, drop the msgs of last publish.
+*/
+VOID TEST(SourceRingTest, TimeReset)
+{
+    SrsMessageRing ring;
+    ring.set_queue_size(30);
+    
+    int64_t cursor = ring.cursor();
+    mock_ring_push(&ring, true, 100000, true);
+    mock_ring_push(&ring, true, 100040, false);
+    EXPECT_EQ(2, ring.size(cursor));
+    
+    mock_ring_push(&ring, true, 0, true);
+    EXPECT_TRUE(ring.lagging(cursor));
+    EXPECT_EQ(0, ring.snap(cursor));
+    EXPECT_EQ(1, ring.size(cursor));
+}
+
+/**
+* the ring grows when full, the msgs keep in order.
+*/
+VOID TEST(SourceRingTest, Grow)
+{
+    SrsMessageRing ring;
+    ring.set_queue_size(30);
+    SrsRtmpJitter jitter;
+    SrsSharedPtrMessage* msgs[128];
+    
+    int64_t cursor = ring.cursor();
+    for (int i = 0; i < 100; i++) {
+        mock_ring_push(&ring, true, i, i == 0);
+    }
+    
+    int count = 0;
+    EXPECT_TRUE(ERROR_SUCCESS == ring.dump_packets(cursor, &jitter, 50, msgs, count));
+    EXPECT_EQ(50, count);
+    for (int i = 0; i < count; i++) {
+        srs_freep(msgs[i]);
+    }
+    ring.trim(cursor);
+    
+    // wrap the slots then grow.
+    for (int i = 100; i < 5000; i++) {
+        mock_ring_push(&ring, i % 2 == 0, i, false);
+    }
+    EXPECT_EQ(4950, ring.size(cursor));
+    
+    int64_t time = 50;
+    while (ring.size(cursor) > 0) {
+        count = 0;
+        EXPECT_TRUE(ERROR_SUCCESS == ring.dump_packets(cursor, &jitter, 128, msgs, count));
+        EXPECT_TRUE(count > 0);
+        for (int i = 0; i < count; i++) {
+            EXPECT_EQ(time++, msgs[i]->timestamp);
+            srs_freep(msgs[i]);
+        }
+    }
+    EXPECT_EQ(5000, time);
+}
+
+/**
+* the bytes to read from cursor.
+*/
+VOID TEST(SourceRingTest, Bytes)
+{
+    SrsMessageRing ring;
+    ring.set_queue_size(30);
+    
+    int64_t cursor = ring.cursor();
+    EXPECT_EQ(0, ring.bytes(cursor));
+    
+    for (int i = 0; i < 10; i++) {
+        mock_ring_push(&ring, true, i * 40, i == 0);
+    }
+    EXPECT_EQ(20, ring.bytes(cursor));
+    EXPECT_EQ(2, ring.bytes(cursor + 9));
+    EXPECT_EQ(0, ring.bytes(ring.cursor()));
+    
+    ring.trim(cursor + 5);
+    EXPECT_EQ(0, ring.bytes(cursor));
+    EXPECT_EQ(10, ring.bytes(cursor + 5));
+}
+
+/**
+* push a av message to ring then the gop cache, like the source.
+*/
+void mock_gop_push(SrsMessageRing* ring, SrsGopCache* cache, bool video, int64_t time, bool keyframe)
+{
+    SrsSharedPtrMessage* msg = mock_av_message(video, time, keyframe);
+    SrsAutoFree(SrsSharedPtrMessage, msg);
+    ring->push(msg, false, SrsRtmpJitterAlgorithmOFF);
+    cache->cache(msg);
+}
+
+/**
+* the gop cache indexes the last gops in ring,
+* the consumer starts from the keyframe before the live.
+*/
+VOID TEST(GopCacheTest, IndexAndStart)
+{
+    SrsMessageRing ring;
+    ring.set_queue_size(30);
+    SrsGopCache cache(&ring);
+    cache.set_window(3, 0);
+    
+    EXPECT_TRUE(cache.empty());
+    EXPECT_EQ(ring.cursor(), cache.cursor());
+    
+    // 4 gops, the keyframe at 0, 400, 800, 1200.
+    for (int i = 0; i < 40; i++) {
+        mock_gop_push(&ring, &cache, true, i * 40, i % 10 == 0);
+    }
+    
+    // the last 3 gops cached, the oldest from seq 10.
+    EXPECT_FALSE(cache.empty());
+    EXPECT_EQ(10, cache.cursor());
+    EXPECT_EQ(1200, cache.start_time());
+    
+    // the latest keyframe 1s before the live 1560.
+    cache.set_window(3, 1);
+    EXPECT_EQ(400, cache.start_time());
+    
+    cache.set_window(3, 0.5);
+    EXPECT_EQ(800, cache.start_time());
+    
+    // not cache so much, start from the oldest.
+    cache.set_window(3, 10);
+    EXPECT_EQ(400, cache.start_time());
+    
+    // shrink the gops.
+    cache.set_window(1, 10);
+    EXPECT_EQ(30, cache.cursor());
+    EXPECT_EQ(1200, cache.start_time());
+    
+    cache.clear();
+    EXPECT_TRUE(cache.empty());
+    EXPECT_EQ(ring.cursor(), cache.cursor());
+}
+
+/**
+* the latest gop is kept whatever the queue size,
+* the older gops are dropped out of queue size.
+*/
+VOID TEST(GopCacheTest, KeepLatestGop)
+{
+    SrsMessageRing ring;
+    ring.set_queue_size(1);
+    SrsGopCache cache(&ring);
+    cache.set_window(2, 0);
+    
+    // a gop of 4s, longer than queue size.
+    for (int i = 0; i < 100; i++) {
+        mock_gop_push(&ring, &cache, true, i * 40, i == 0);
+    }
+    EXPECT_EQ(0, cache.cursor());
+    EXPECT_FALSE(ring.lagging(0));
+    EXPECT_EQ(100, ring.size(0));
+    EXPECT_EQ(3960, ring.duration(0));
+    
+    // the second gop, the first is out of queue size.
+    for (int i = 100; i < 200; i++) {
+        mock_gop_push(&ring, &cache, true, i * 40, i == 100);
+    }
+    EXPECT_TRUE(ring.lagging(0));
+    EXPECT_EQ(100, cache.cursor());
+    EXPECT_EQ(4000, cache.start_time());
+    EXPECT_EQ(100, ring.size(100));
+    
+    // disable the gop cache, the ring drops out of queue size.
+    cache.set(false);
+    mock_ring_push(&ring, true, 8000, false);
+    EXPECT_TRUE(ring.lagging(100));
+    EXPECT_EQ(ring.cursor(), cache.cursor());
+}
+
+/**
+* the gop cache ignores the pure audio stream.
+*/
+VOID TEST(GopCacheTest, PureAudio)
+{
+    SrsMessageRing ring;
+    ring.set_queue_size(30);
+    SrsGopCache cache(&ring);
+    
+    for (int i = 0; i < 10; i++) {
+        mock_gop_push(&ring, &cache, false, i * 20, false);
+    }
+    EXPECT_TRUE(cache.pure_audio());
+    EXPECT_TRUE(cache.empty());
+    EXPECT_EQ(0, cache.start_time());
+}
+
+#endif
+
+#endif
+
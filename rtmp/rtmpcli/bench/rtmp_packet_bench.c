@@ -0,0 +1,376 @@
+/*
+ * rtmp_packet_bench.c
+ * Copyright (C) 2019      Steve Liu<steveliu121@163.com>
+ *
+ * build a synthetic h264 stream(30fps, gop 30) into rtmp packets and
+ * send them with librtmp over a socketpair drained by another thread,
+ * at the chunk size given([rtmp_set_chunk_size]), print frames/sec,
+ * allocations per frame, syscalls and cpu time of the sending thread per
+ * MB of:
+ *	legacy: rtmppacket_alloc + a temp buffer in the tag writer
+ *	alloc:  rtmppacket_alloc + [rtmp_write_avc_data_tag]
+ *	pooled: the body in a [rtmp_pool_alloc] buffer behind the chunk
+ *		header room, the frame lands behind
+ *		[rtmp_put_avc_data_header], as in [rtmppublisher]
+ * the reader parses the chunk stream back and checks every body
+ *
+ * build(librtmp.a from ../librtmp/rtmpdump, make CRYPTO=):
+ * gcc -O2 -I. -I../librtmp/rtmpdump bench/rtmp_packet_bench.c myrtmp.c \
+ *	../librtmp/rtmpdump/librtmp/librtmp.a -lpthread \
+ *	-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc \
+ *	-Wl,--wrap=send,--wrap=writev -o rtmp_packet_bench
+ * ./rtmp_packet_bench [frames] [chunk size|nosend]
+ */
+
+#define _GNU_SOURCE	/* RUSAGE_THREAD */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+
+#include "myrtmp.h"
+
+
+#define VIDEO_FPS		30
+#define VIDEO_GOP		30
+#define VIDEO_I_SIZE		(80 * 1024)
+#define VIDEO_P_SIZE		(8 * 1024)
+#define DRAIN_BUF_SIZE		(256 * 1024)
+
+static unsigned long g_allocs;
+static unsigned long g_syscalls;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+ssize_t __real_send(int fd, const void *buf, size_t len, int flags);
+ssize_t __real_writev(int fd, const struct iovec *iov, int iovcnt);
+
+void *__wrap_malloc(size_t size)
+{
+	__atomic_fetch_add(&g_allocs, 1, __ATOMIC_RELAXED);
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	__atomic_fetch_add(&g_allocs, 1, __ATOMIC_RELAXED);
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	__atomic_fetch_add(&g_allocs, 1, __ATOMIC_RELAXED);
+	return __real_realloc(ptr, size);
+}
+
+ssize_t __wrap_send(int fd, const void *buf, size_t len, int flags)
+{
+	__atomic_fetch_add(&g_syscalls, 1, __ATOMIC_RELAXED);
+	return __real_send(fd, buf, len, flags);
+}
+
+ssize_t __wrap_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+	__atomic_fetch_add(&g_syscalls, 1, __ATOMIC_RELAXED);
+	return __real_writev(fd, iov, iovcnt);
+}
+
+/* user + system time of the calling thread */
+static uint64_t __cpu_ns(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_THREAD, &ru);
+
+	return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) *
+				1000000000ULL +
+		(uint64_t)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000;
+}
+
+static uint64_t __now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* the tag writer as it was: the tag is built in a temp buffer and copied
+ * into the body */
+static void __legacy_write_avc_data_tag(uint8_t *body, const uint8_t *data,
+				uint32_t data_len, int keyframe)
+{
+	uint8_t *buf = (uint8_t *)malloc(data_len + 5);
+	uint8_t *pbuf = buf;
+
+	pbuf = rtmp_put_avc_data_header(pbuf, keyframe);
+	memcpy(pbuf, data, data_len);
+	pbuf += data_len;
+	memcpy(body, buf, pbuf - buf);
+	free(buf);
+}
+
+/* an encoded frame: 4 bytes length prefixed slice, payload byte = frame
+ * number, what an encoder would hand over */
+static uint32_t __build(uint8_t *f, long n)
+{
+	int key = n % VIDEO_GOP == 0;
+	uint32_t len = key ? VIDEO_I_SIZE : VIDEO_P_SIZE;
+
+	f[0] = (len - 4) >> 24;
+	f[1] = (len - 4) >> 16;
+	f[2] = (len - 4) >> 8;
+	f[3] = len - 4;
+	f[4] = key ? 0x65 : 0x41;
+	memset(f + 5, (uint8_t)n, len - 5);
+
+	return len;
+}
+
+static int g_reader_fd;
+static int g_bad;
+
+struct chunk_parser {
+	uint32_t chunk_size;
+	uint8_t hdr[12];
+	int hdr_have;
+	int hdr_need;
+	uint32_t msg_left;
+	uint32_t chunk_left;
+	uint32_t body_off;
+	uint8_t fill;
+	long msgs;
+};
+
+/* the chunk stream: type 0 header in front of a message, type 3 in front
+ * of the other chunks, set chunk size on csid 2, the video on csid 4,
+ * every body starts with a VIDEODATA header and its slice is filled with
+ * one byte */
+static void __parse(struct chunk_parser *cp, const uint8_t *p, size_t n)
+{
+	uint32_t len = 0;
+	uint32_t i = 0;
+
+	while (n > 0) {
+		if (cp->hdr_have < cp->hdr_need) {
+			cp->hdr[cp->hdr_have++] = *p++;
+			n--;
+			if (cp->hdr_have < cp->hdr_need)
+				continue;
+			if (cp->hdr_need == 12 && cp->hdr[0] == 0x02 &&
+					cp->hdr[7] == 0x01 && n >= 4) {
+				cp->chunk_size = (p[0] << 24) | (p[1] << 16) |
+							(p[2] << 8) | p[3];
+				p += 4;
+				n -= 4;
+				cp->hdr_have = 0;
+				continue;
+			}
+			if (cp->hdr[0] != (cp->hdr_need == 12 ? 0x04 : 0xc4)) {
+				g_bad++;
+				return;
+			}
+			if (cp->hdr_need == 12) {
+				cp->msg_left = (cp->hdr[4] << 16) |
+						(cp->hdr[5] << 8) | cp->hdr[6];
+				cp->body_off = 0;
+			}
+			cp->chunk_left = cp->msg_left < cp->chunk_size ?
+					cp->msg_left : cp->chunk_size;
+			continue;
+		}
+
+		len = n < cp->chunk_left ? n : cp->chunk_left;
+		for (i = 0; i < len; i++, cp->body_off++) {
+			if (cp->body_off == 0 && p[i] != 0x17 && p[i] != 0x27)
+				g_bad++;
+			else if (cp->body_off == 10)
+				cp->fill = p[i];
+			else if (cp->body_off > 10) {
+				/* the rest of the chunk in one go */
+				if (p[i] != cp->fill ||
+					p[len - 1] != cp->fill)
+					g_bad++;
+				cp->body_off += len - i;
+				break;
+			}
+		}
+		p += len;
+		n -= len;
+		cp->chunk_left -= len;
+		cp->msg_left -= len;
+		if (cp->chunk_left == 0) {
+			cp->hdr_have = 0;
+			cp->hdr_need = cp->msg_left ? 1 : 12;
+			if (cp->msg_left == 0)
+				cp->msgs++;
+		}
+	}
+}
+
+static void *__reader(void *arg)
+{
+	uint8_t *buf = (uint8_t *)__real_malloc(DRAIN_BUF_SIZE);
+	struct chunk_parser cp;
+	ssize_t n = 0;
+
+	memset(&cp, 0, sizeof(cp));
+	cp.hdr_need = 12;
+	cp.chunk_size = RTMP_DEFAULT_CHUNKSIZE;
+	while ((n = read(g_reader_fd, buf, DRAIN_BUF_SIZE)) > 0)
+		__parse(&cp, buf, n);
+	free(buf);
+
+	return (void *)cp.msgs;
+}
+
+static int __run(RTMP *rtmp, struct rtmp_pool *pool, int mode, long frames,
+					int send, const uint8_t *enc)
+{
+	const char *name[] = {"legacy", "alloc", "pooled"};
+	RTMPPacket packet;
+	unsigned long allocs = 0;
+	unsigned long syscalls = 0;
+	uint64_t cpu = 0;
+	uint64_t begin = 0;
+	uint64_t bytes = 0;
+	uint8_t *p = NULL;
+	uint32_t len = 0;
+	double sec = 0;
+	long i = 0;
+	int key = 0;
+
+	rtmppacket_reset(&packet);
+	packet.m_packetType = RTMP_PACKET_TYPE_VIDEO;
+	packet.m_nChannel = 0x04;
+	packet.m_nInfoField2 = 1;
+	packet.m_hasAbsTimestamp = false;
+	packet.m_headerType = RTMP_PACKET_SIZE_LARGE;
+
+	allocs = __atomic_load_n(&g_allocs, __ATOMIC_RELAXED);
+	syscalls = __atomic_load_n(&g_syscalls, __ATOMIC_RELAXED);
+	cpu = __cpu_ns();
+	begin = __now_ns();
+	for (i = 0; i < frames; i++) {
+		const uint8_t *f = enc + (i % VIDEO_GOP) * VIDEO_I_SIZE;
+
+		key = i % VIDEO_GOP == 0;
+		len = key ? VIDEO_I_SIZE : VIDEO_P_SIZE;
+		packet.m_nTimeStamp = i * 1000 / VIDEO_FPS;
+		packet.m_nBodySize = len + 5;
+
+		if (mode == 2) {
+			p = (uint8_t *)rtmp_pool_alloc(pool,
+					RTMP_MAX_HEADER_SIZE + len + 5);
+			if (p == NULL)
+				return -1;
+			packet.m_body = (char *)p + RTMP_MAX_HEADER_SIZE;
+			/* the encoder writes right here */
+			p = rtmp_put_avc_data_header((uint8_t *)packet.m_body,
+									key);
+			memcpy(p, f, len);
+		} else {
+			if (!rtmppacket_alloc(&packet, len + 5))
+				return -1;
+			if (mode == 0)
+				__legacy_write_avc_data_tag(
+					(uint8_t *)packet.m_body, f, len, key);
+			else
+				rtmp_write_avc_data_tag((uint8_t *)packet.m_body,
+								f, len, key);
+		}
+
+		if (send && !rtmp_sendpacket(rtmp, &packet, false))
+			return -1;
+
+		if (mode == 2) {
+			rtmp_pool_free(packet.m_body - RTMP_MAX_HEADER_SIZE);
+			packet.m_body = NULL;
+		} else
+			rtmppacket_free(&packet);
+		bytes += len;
+	}
+	sec = (double)(__now_ns() - begin) / 1e9;
+	cpu = __cpu_ns() - cpu;
+	allocs = __atomic_load_n(&g_allocs, __ATOMIC_RELAXED) - allocs;
+	syscalls = __atomic_load_n(&g_syscalls, __ATOMIC_RELAXED) - syscalls;
+
+	printf("%-7s %ld frames %.1f MB in %.3fs: %.0f frames/s, "
+		"%.0f MB/s, %.2f allocs/frame, %.1f syscalls/MB, "
+		"%.2f cpu ms/MB\n",
+		name[mode], frames, bytes / 1e6, sec, frames / sec,
+		bytes / 1e6 / sec, (double)allocs / frames,
+		syscalls / (bytes / 1e6), cpu / 1e6 / (bytes / 1e6));
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	long frames = argc > 1 ? atol(argv[1]) : 3000;
+	int send = !(argc > 2 && strcmp(argv[2], "nosend") == 0);
+	int chunk_size = send && argc > 2 ? atoi(argv[2]) : 0;
+	struct rtmp_pool *pool = NULL;
+	pthread_t reader;
+	void *msgs = NULL;
+	uint8_t *enc = NULL;
+	RTMP *rtmp = NULL;
+	int sv[2];
+	int mode = 0;
+	long i = 0;
+
+	enc = (uint8_t *)malloc(VIDEO_GOP * VIDEO_I_SIZE);
+	if (enc == NULL || rtmp_pool_create(&pool) < 0)
+		return 1;
+	for (i = 0; i < VIDEO_GOP; i++)
+		__build(enc + i * VIDEO_I_SIZE, i);
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+		perror("socketpair");
+		return 1;
+	}
+	rtmp_logsetlevel(RTMP_LOGCRIT);
+	rtmp = rtmp_alloc();
+	rtmp_init(rtmp);
+	rtmp->m_sb.sb_socket = sv[0];
+	rtmp->m_stream_id = 1;
+	g_reader_fd = sv[1];
+	pthread_create(&reader, NULL, __reader, NULL);
+	if (chunk_size > 0 && !rtmp_set_chunk_size(rtmp, chunk_size)) {
+		printf("set chunk size fail\n");
+		return 1;
+	}
+	printf("chunk size %d\n", rtmp->m_outChunkSize);
+
+	for (mode = 0; mode < 3; mode++) {
+		if (__run(rtmp, pool, mode, frames, send, enc) < 0) {
+			printf("send fail\n");
+			return 1;
+		}
+	}
+
+	shutdown(sv[0], SHUT_WR);
+	pthread_join(reader, &msgs);
+	if (send)
+		printf("%ld packets read back, chunks %s\n", (long)msgs,
+							g_bad ? "BAD" : "ok");
+
+	/* closed below, rtmp_close only frees the channels */
+	rtmp->m_sb.sb_socket = -1;
+	rtmp_close(rtmp);
+	rtmp_free(rtmp);
+	close(sv[0]);
+	close(sv[1]);
+	rtmp_pool_destroy(pool);
+	free(enc);
+
+	return g_bad != 0;
+}
@@ -74,6 +74,107 @@ void rtmppacket_free(RTMPPacket *packet)
 	RTMPPacket_Free(packet);
 }
 
+static uint32_t rtmp_pool_class(uint32_t size)
+{
+	uint32_t cls = 0;
+
+	while (cls < RTMP_POOL_CLASSES &&
+			((size_t)1 << (cls + RTMP_POOL_MIN_SHIFT)) < size)
+		cls++;
+
+	return cls;
+}
+
+static void rtmp_pool_free_list(struct rtmp_pool_buf *buf)
+{
+	struct rtmp_pool_buf *next = NULL;
+
+	while (buf) {
+		next = buf->next;
+		free(buf);
+		buf = next;
+	}
+}
+
+int rtmp_pool_create(struct rtmp_pool **pool)
+{
+	*pool = (struct rtmp_pool *)calloc(1, sizeof(struct rtmp_pool));
+	if (*pool == NULL) {
+		printf("Malloc RTMP buffer pool fail\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+void rtmp_pool_destroy(struct rtmp_pool *pool)
+{
+	int i = 0;
+
+	if (pool == NULL)
+		return;
+
+	for (i = 0; i < RTMP_POOL_CLASSES; i++) {
+		rtmp_pool_free_list(pool->local[i]);
+		rtmp_pool_free_list(pool->remote[i]);
+	}
+	free(pool);
+}
+
+void *rtmp_pool_alloc(struct rtmp_pool *pool, uint32_t size)
+{
+	struct rtmp_pool_buf *buf = NULL;
+	uint32_t cls = rtmp_pool_class(size);
+
+	if (pool && cls < RTMP_POOL_CLASSES) {
+		buf = pool->local[cls];
+		if (buf == NULL)
+			buf = __atomic_exchange_n(&pool->remote[cls], NULL,
+							__ATOMIC_ACQUIRE);
+		if (buf) {
+			pool->local[cls] = buf->next;
+			__atomic_fetch_add(&pool->reuses, 1, __ATOMIC_RELAXED);
+			return buf + 1;
+		}
+		size = 1U << (cls + RTMP_POOL_MIN_SHIFT);
+	} else {
+		pool = NULL;
+	}
+
+	buf = (struct rtmp_pool_buf *)malloc(sizeof(struct rtmp_pool_buf) +
+									size);
+	if (buf == NULL)
+		return NULL;
+	buf->pool = pool;
+	buf->cls = cls;
+	if (pool)
+		__atomic_fetch_add(&pool->allocs, 1, __ATOMIC_RELAXED);
+
+	return buf + 1;
+}
+
+void rtmp_pool_free(void *ptr)
+{
+	struct rtmp_pool_buf *buf = NULL;
+	struct rtmp_pool_buf **head = NULL;
+
+	if (ptr == NULL)
+		return;
+
+	buf = (struct rtmp_pool_buf *)ptr - 1;
+	if (buf->pool == NULL) {
+		free(buf);
+		return;
+	}
+
+	/* push only, the owner takes the whole list at once */
+	head = &buf->pool->remote[buf->cls];
+	buf->next = __atomic_load_n(head, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(head, &buf->next, buf, true,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+}
+
 int rtmp_setupurl(RTMP *rtmp, char *url)
 {
 	return RTMP_SetupURL(rtmp, url);
@@ -104,6 +205,91 @@ int rtmp_sendpacket(RTMP *rtmp, RTMPPacket *packet, int queue)
 	return RTMP_SendPacket(rtmp, packet, queue);
 }
 
+int rtmp_set_chunk_size(RTMP *rtmp, int size)
+{
+	char buf[RTMP_MAX_HEADER_SIZE + 4];
+	RTMPPacket packet;
+	int ret = 0;
+
+	if (size < RTMP_DEFAULT_CHUNKSIZE)
+		return false;
+
+	rtmppacket_reset(&packet);
+	packet.m_headerType = RTMP_PACKET_SIZE_LARGE;
+	packet.m_packetType = RTMP_PACKET_TYPE_CHUNK_SIZE;
+	packet.m_nChannel = 0x02;	/* protocol control */
+	packet.m_nInfoField2 = 0;
+	packet.m_hasAbsTimestamp = false;
+	packet.m_nBodySize = 4;
+	packet.m_body = buf + RTMP_MAX_HEADER_SIZE;
+	packet.m_body[0] = (size >> 24) & 0x7f;
+	packet.m_body[1] = (size >> 16) & 0xff;
+	packet.m_body[2] = (size >> 8) & 0xff;
+	packet.m_body[3] = size & 0xff;
+
+	ret = RTMP_SendPacket(rtmp, &packet, false);
+	if (ret)
+		rtmp->m_outChunkSize = size;
+
+	return ret;
+}
+
+int rtmp_connect_publish(RTMP *rtmp, char *url, int timeout, int chunk_size)
+{
+	int ret = 0;
+
+	/* frees what the last connection left in @rtmp */
+	RTMP_Close(rtmp);
+	RTMP_Init(rtmp);
+	if (timeout > 0)
+		rtmp->Link.timeout = timeout;
+
+	ret = RTMP_SetupURL(rtmp, url);
+	if (ret == false) {
+		printf("rtmp setup url fail\n");
+		return false;
+	}
+
+	RTMP_EnableWrite(rtmp);
+
+	ret = RTMP_Connect(rtmp, NULL);
+	if (ret == false) {
+		printf("rtmp connect fail\n");
+		goto exit;
+	}
+
+	ret = RTMP_ConnectStream(rtmp, 0);
+	if (ret == false) {
+		printf("rtmp connect stream fail\n");
+		goto exit;
+	}
+
+	if (chunk_size > 0) {
+		ret = rtmp_set_chunk_size(rtmp, chunk_size);
+		if (ret == false) {
+			printf("rtmp set chunk size fail\n");
+			goto exit;
+		}
+	}
+
+	return true;
+
+exit:
+	RTMP_Close(rtmp);
+	return false;
+}
+
+uint8_t *rtmp_put_avc_data_header(uint8_t *body, int keyframe)
+{
+	uint8_t *pbuf = body;
+
+	// (FrameType << 4) | CodecID, 1 - keyframe, 2 - inner frame, 7 - AVC(h264)
+	pbuf = ui08_to_bytes(pbuf, keyframe ? 0x17 : 0x27);
+	pbuf = ui08_to_bytes(pbuf, 1);	  // AVCPacketType: 0x00 - AVC sequence header; 0x01 - AVC NALU
+	pbuf = ui24_to_bytes(pbuf, 0);	  // composition time
+
+	return pbuf;
+}
 
 /*
  * @brief write video(H264/AVC) tag data
@@ -114,27 +300,9 @@ void rtmp_write_avc_data_tag(const uint8_t *body,
 					uint32_t data_len,
 					int keyframe)
 {
-	uint8_t *buf = (uint8_t *) malloc(data_len + 5);
-	uint8_t *pbuf = buf;
-
-	uint8_t flag = 0;
-	// (FrameType << 4) | CodecID, 1 - keyframe, 2 - inner frame, 7 - AVC(h264)
-	if (keyframe)
-		flag = 0x17;
-	else
-		flag = 0x27;
-
-	pbuf = ui08_to_bytes(pbuf, flag);
-
-	pbuf = ui08_to_bytes(pbuf, 1);	  // AVCPacketType: 0x00 - AVC sequence header; 0x01 - AVC NALU
-	pbuf = ui24_to_bytes(pbuf, 0);	  // composition time
+	uint8_t *pbuf = rtmp_put_avc_data_header((uint8_t *)body, keyframe);
 
 	memcpy(pbuf, data, data_len);
-	pbuf += data_len;
-
-	memcpy(body, buf, (pbuf - buf));
-
-	free(buf);
 
 	return;
 }
@@ -146,28 +314,13 @@ void rtmp_write_avc_data_tag(const uint8_t *body,
 void rtmp_write_aac_data_tag(const uint8_t *body,
 					const uint8_t *data, uint32_t data_len)
 {
-	uint8_t *buf = NULL;
-	uint8_t *pbuf = NULL;
-	uint32_t payload_len = 0;
-	uint8_t *payload = NULL;
-
-	/* strip ADTS from frame */
-	payload = (uint8_t *)(data + 7);
-	payload_len = data_len - 7;
-
-	buf = (uint8_t *)malloc(payload_len + 2);
-	pbuf = buf;
+	uint8_t *pbuf = (uint8_t *)body;
 
 	/* SoundFormat|SoundRate|SoundSize|SoundType:0xa0|0x0c|0x02|0x01*/
 	pbuf = ui08_to_bytes(pbuf, 0xaf);
 	pbuf = ui08_to_bytes(pbuf, 1); // AACPacketType: 0x01 - AAC frame data
 
-	memcpy(pbuf, payload, payload_len);
-	pbuf += payload_len;
-
-	memcpy(body, buf, (pbuf - buf));
-
-	free(buf);
+	memcpy(pbuf, data, data_len);
 
 	return;
 }
@@ -192,8 +345,7 @@ void rtmp_write_avc_sequence_header_tag(const uint8_t *body,
 					const uint8_t *sps, uint32_t sps_len,
 					const uint8_t *pps, uint32_t pps_len)
 {
-	uint8_t *buf = (uint8_t *) malloc(sps_len + pps_len + 16);
-	uint8_t *pbuf = buf;
+	uint8_t *pbuf = (uint8_t *)body;
 
 	uint8_t flag = 0;
 
@@ -227,11 +379,6 @@ void rtmp_write_avc_sequence_header_tag(const uint8_t *body,
 	pbuf = ui08_to_bytes(pbuf, 1); // number of pps
 	pbuf = ui16_to_bytes(pbuf, (uint16_t)pps_len);
 	memcpy(pbuf, pps, pps_len);
-	pbuf += pps_len;
-
-	memcpy(body, buf, (pbuf - buf));
-
-	free(buf);
 
 	return;
 }
@@ -241,21 +388,15 @@ void rtmp_write_avc_sequence_header_tag(const uint8_t *body,
  * AudioSpecificConfig
  */
 void rtmp_write_aac_sequence_header_tag(const uint8_t *body,
-						int sample_rate, int channels)
+					const uint8_t *asc, uint32_t asc_len)
 {
-	uint8_t *buf = (uint8_t *) malloc(4);
-	uint8_t *pbuf = buf;
+	uint8_t *pbuf = (uint8_t *)body;
 
 	/* SoundFormat|SoundRate|SoundSize|SoundType:0xa0|0x0c|0x02|0x01*/
 	pbuf = ui08_to_bytes(pbuf, 0xaf);
 	pbuf = ui08_to_bytes(pbuf, 0); // AACPacketType: 0x00 - AAC sequence header
 
-	/* TODO FIXME */
-	pbuf = ui16_to_bytes(pbuf, 0x1590); // AudioSpecificConfig: 0x1590(AAC-LC;8000samplerate;stereo_out) //TODO FIXME
-
-	memcpy(body, buf, (pbuf - buf));
-
-	free(buf);
+	memcpy(pbuf, asc, asc_len);
 
 	return;
 }
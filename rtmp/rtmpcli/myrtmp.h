@@ -12,6 +12,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <librtmp/rtmp.h>
 #include <librtmp/log.h>
 
@@ -24,22 +25,76 @@ void rtmp_free(RTMP *rtmp);
 int rtmppacket_alloc(RTMPPacket *packet, uint32_t size);
 void rtmppacket_reset(RTMPPacket *packet);
 void rtmppacket_free(RTMPPacket *packet);
+
+/* size classes of a pool, 512B to 4MB, bigger buffers are not kept */
+#define RTMP_POOL_MIN_SHIFT	9
+#define RTMP_POOL_MAX_SHIFT	22
+#define RTMP_POOL_CLASSES	(RTMP_POOL_MAX_SHIFT - RTMP_POOL_MIN_SHIFT + 1)
+
+/* in front of every buffer of [rtmp_pool_alloc] */
+struct rtmp_pool_buf {
+	struct rtmp_pool_buf *next;
+	struct rtmp_pool *pool;	/* NULL: not kept, freed */
+	uint32_t cls;
+	uint32_t pad;
+};
+
+/*
+ * packet buffers recycled instead of malloc'd for every frame
+ * one thread allocates from a pool, any thread frees back to it: the
+ * owner pops @local, the others push onto @remote, which the owner takes
+ * over with one exchange once a @local list runs dry, so nobody locks
+ * and the ABA problem of a shared lock-free stack never arises
+ */
+struct rtmp_pool {
+	struct rtmp_pool_buf *local[RTMP_POOL_CLASSES];	/* owner only */
+	struct rtmp_pool_buf *remote[RTMP_POOL_CLASSES];	/* atomic */
+	uint64_t allocs;	/* atomic, buffers malloc'd */
+	uint64_t reuses;	/* atomic, buffers recycled */
+};
+
+int rtmp_pool_create(struct rtmp_pool **pool);
+/* every buffer must have been freed */
+void rtmp_pool_destroy(struct rtmp_pool *pool);
+/* owner thread only, @pool NULL for a buffer that is freed as usual */
+void *rtmp_pool_alloc(struct rtmp_pool *pool, uint32_t size);
+/* any thread */
+void rtmp_pool_free(void *ptr);
+
 int rtmp_setupurl(RTMP *rtmp, char *url);
 int rtmp_connect(RTMP *rtmp, RTMPPacket *packet);
 int rtmp_connectstream(RTMP *rtmp, int seekTime);
 int rtmp_isconnected(RTMP *rtmp);
 void rtmp_enablewrite(RTMP *rtmp);
 int rtmp_sendpacket(RTMP *rtmp, RTMPPacket *packet, int queue);
+/* tell the peer the chunk size of everything sent from now on and use it,
+ * fewer chunk headers and writes per frame than the default 128 bytes
+ * @size: 128 ~ 0x7fffffff
+ * @return: true on success */
+int rtmp_set_chunk_size(RTMP *rtmp, int size);
+/*
+ * (re)connect @rtmp from scratch and get it ready to publish @url
+ * @rtmp: went through [rtmp_init] at least once
+ * @url: librtmp points into it, it must stay untouched while connected
+ * @timeout: seconds, 0 for librtmp's 30
+ * @chunk_size: [rtmp_set_chunk_size], 0 keeps the default 128
+ * @return: true on success, @rtmp is closed on fail
+ */
+int rtmp_connect_publish(RTMP *rtmp, char *url, int timeout, int chunk_size);
+/* the VIDEODATA header at @body,
+ * @return: where the 4 bytes length prefixed NALUs go */
+uint8_t *rtmp_put_avc_data_header(uint8_t *body, int keyframe);
 void rtmp_write_avc_data_tag(const uint8_t *body,
 					const uint8_t *data,
 					uint32_t data_len,
 					int keyframe);
+/* @data: raw aac access unit, no ADTS([AAC_TT_RAW] of the encoder) */
 void rtmp_write_aac_data_tag(const uint8_t *body,
 					const uint8_t *data, uint32_t data_len);
 void rtmp_write_avc_sequence_header_tag(const uint8_t *body,
 					const uint8_t *sps, uint32_t sps_len,
 					const uint8_t *pps, uint32_t pps_len);
 void rtmp_write_aac_sequence_header_tag(const uint8_t *body,
-						int sample_rate, int channels);
+					const uint8_t *asc, uint32_t asc_len);
 
 #endif // MYRTMP_H_
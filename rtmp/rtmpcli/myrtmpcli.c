@@ -8,18 +8,12 @@
 #include <errno.h>
 
 #include "myrtmp.h"
+#include "rtmppublisher.h"
 #include "aacenc.h"
 #include "my_middle_media.h"
 #include <my_video_input.h>
 
 
-/* XXX:WARNING the pcm period buf length should be the common factor of
- * the aac input pcm frame length, or the aac timestamp will be wrong
- * here the pcm period buf length == 1024 bytes,
- * and the aac input pcm frame length == 2048
- */
-
-
 #define SPS_LEN		28
 #define PPS_LEN		6
 
@@ -40,6 +34,10 @@
 /* (AUDIO_TIME_SCALE / AUDIO_FPS)audio_period_time = 64ms, fps = 15.625 */
 #define AUDIO_SAMPLE_DURATION	512
 #define AAC_BITRATE		16000
+/* chunk size negotiated for publishing, a P frame in one or two chunks */
+#define RTMP_CHUNK_SIZE		4096
+/* lag the send queue may build up before frames are dropped */
+#define RTMP_LATENCY_MS		1000
 
 
 static const uint8_t sps_buf[SPS_LEN] = {0x27, 0x64, 0x00, 0x29, 0xac, 0x1a, 0xd0, 0x0a,
@@ -57,14 +55,12 @@ static const uint8_t pps_buf[PPS_LEN + 4] = {0x00, 0x00, 0x00, 0x06, 0x28, 0xee,
 			0x01, 0x04, 0x92, 0x24};
 			*/
 static int g_exit;
-static HANDLE_AACENCODER aac_enc_hd;
+static struct aac_encoder *aac_enc_hd;
 static uint8_t aac_decoder_conf[64];
 static int aac_decoder_conf_len;
 uint32_t g_timestamp_begin;
 RTMP *rtmp;
-RTMPPacket video_pkt;
-RTMPPacket audio_pkt;
-pthread_mutex_t av_mutex;
+struct rtmp_publisher *rtmp_pub;
 
 void sig_handle(int sig)
 {
@@ -74,8 +70,8 @@ void sig_handle(int sig)
 void h264_cb(const struct timeval *tv, const void *data,
 	const int len, const int keyframe)
 {
-	int ret = 0;
-	uint8_t *buf = NULL;
+	const uint8_t *buf = NULL;
+	uint8_t *nalus = NULL;
 	int buf_len = 0;
 	uint32_t timestamp = 0;
 	int buf_payload_len = 0;
@@ -87,174 +83,87 @@ void h264_cb(const struct timeval *tv, const void *data,
 
 	/* strip sps/pps from I frame and
 	 * replace NALU start flag '0x00/0x00/0x00/0x01' with
-	 * the length of NALU in BIGENDIAN
+	 * the length of NALU in BIGENDIAN, straight into the packet
 	 */
 	if (keyframe) {
-		buf = (uint8_t *)data + SPS_LEN + PPS_LEN + 2 * 4;
+		buf = (const uint8_t *)data + SPS_LEN + PPS_LEN + 2 * 4;
 		buf_len = len - SPS_LEN - PPS_LEN - 2 * 4;
 	} else {
-		buf = (uint8_t *)data;
+		buf = (const uint8_t *)data;
 		buf_len = len;
 	}
 	buf_payload_len = buf_len - 4;
-	buf[0] = buf_payload_len >> 24;
-	buf[1] = buf_payload_len >> 16;
-	buf[2] = buf_payload_len >> 8;
-	buf[3] = buf_payload_len & 0xff;
-
-	video_pkt.m_headerType = RTMP_PACKET_SIZE_LARGE;
-	video_pkt.m_nTimeStamp = (timestamp - g_timestamp_begin);
-	video_pkt.m_nBodySize = buf_len + 5;//5bytes VIDEODATA tag header
-	rtmppacket_alloc(&video_pkt, video_pkt.m_nBodySize);
-	rtmp_write_avc_data_tag(video_pkt.m_body, buf, buf_len, keyframe);
-
-	ret = rtmp_isconnected(rtmp);
-	if (ret == true) {
-		/* true: send to outqueue;false: send directly */
-		pthread_mutex_lock(&av_mutex);
-		ret = rtmp_sendpacket(rtmp, &video_pkt, true);
-		if (ret == false)
-			printf("rtmp send video packet fail\n");
-		pthread_mutex_unlock(&av_mutex);
-	}
 
-	rtmppacket_free(&video_pkt);
+	nalus = rtmp_publisher_reserve_avc(rtmp_pub, buf_len);
+	if (nalus == NULL)
+		return;
+	nalus[0] = buf_payload_len >> 24;
+	nalus[1] = buf_payload_len >> 16;
+	nalus[2] = buf_payload_len >> 8;
+	nalus[3] = buf_payload_len & 0xff;
+	memcpy(nalus + 4, buf + 4, buf_payload_len);
+
+	/* queued for the sender thread, never blocks on the network */
+	rtmp_publisher_commit_avc(rtmp_pub, buf_len,
+				timestamp - g_timestamp_begin, keyframe);
 }
 
 void audio_cb(const struct timeval *tv, const void *pcm_buf,
 	const int pcm_len, const void *spk_buf)
 {
-	int ret = 0;
-	uint8_t *aac_buf = NULL;
-	int aac_buf_len = 0;
+	struct aac_au *aus = NULL;
 	uint32_t timestamp = 0;
+	int au_num = 0;
+	int i;
 
 	timestamp = (tv->tv_sec * 1000) + (tv->tv_usec / 1000);
 
 	if (g_timestamp_begin == 0)
 		g_timestamp_begin = timestamp;
 
-	aac_buf_len = aac_encode(aac_enc_hd, pcm_buf, pcm_len, &aac_buf);
-	if (aac_buf_len == 0)
-		return;
-
-	audio_pkt.m_headerType = RTMP_PACKET_SIZE_LARGE;
-	audio_pkt.m_nTimeStamp = (timestamp - g_timestamp_begin);
-	audio_pkt.m_nBodySize = aac_buf_len - 7 + 2;//7bytes ADTS header & 2bytes AUDIODATA tag header
-	rtmppacket_alloc(&audio_pkt, audio_pkt.m_nBodySize);
-	rtmp_write_aac_data_tag(audio_pkt.m_body, aac_buf, aac_buf_len);
-
-	ret = rtmp_isconnected(rtmp);
-	if (ret == true) {
-		/* true: send to outqueue;false: send directly */
-		pthread_mutex_lock(&av_mutex);
-		ret = rtmp_sendpacket(rtmp, &audio_pkt, true);
-		if (ret == false)
-			printf("rtmp send audio packet fail\n");
-		pthread_mutex_unlock(&av_mutex);
-	}
+	au_num = aac_encode(aac_enc_hd, pcm_buf, pcm_len,
+		(int64_t)tv->tv_sec * 1000000 + tv->tv_usec, &aus);
 
-	rtmppacket_free(&audio_pkt);
-}
+	for (i = 0; i < au_num; i++) {
+		timestamp = (uint32_t)(aus[i].pts / 1000);
 
-static int __connect2rtmpsvr(char *url)
-{
-	int ret = 0;
-
-	rtmp = rtmp_alloc();
-	rtmp_init(rtmp);
-
-	rtmp->Link.timeout=5;	//default 30s
-	ret = rtmp_setupurl(rtmp, url);
-	if (ret == false) {
-		printf("rtmp setup url fail\n");
-		goto exit;
+		rtmp_publisher_send_aac(rtmp_pub, aus[i].data, aus[i].len,
+					timestamp - g_timestamp_begin);
 	}
-
-	rtmp_enablewrite(rtmp);
-
-	ret = rtmp_connect(rtmp, NULL);
-	if (ret == false) {
-		printf("rtmp connect fail\n");
-		goto exit;
-	}
-
-	ret = rtmp_connectstream(rtmp, 0);
-	if (ret == false) {
-		printf("rtmp connect stream fail\n");
-		rtmp_close(rtmp);
-		goto exit;
-	}
-
-	return 0;
-
-exit:
-	return -1;
 }
 
-static void __rtmp_send_sequence_header(void)
+static int __rtmp_send_sequence_header(void)
 {
 	int ret = 0;
 
-/* rtmp send audio/video sequence header frame */
-	rtmppacket_reset(&video_pkt);
-	rtmppacket_reset(&audio_pkt);
-
-	video_pkt.m_packetType = RTMP_PACKET_TYPE_VIDEO;
-	video_pkt.m_nChannel = 0x04;
-	video_pkt.m_nInfoField2 = rtmp->m_stream_id;
-	video_pkt.m_hasAbsTimestamp = false;
-
-	audio_pkt.m_packetType = RTMP_PACKET_TYPE_AUDIO;
-	audio_pkt.m_nChannel = 0x04;
-	audio_pkt.m_nInfoField2 = rtmp->m_stream_id;
-	audio_pkt.m_hasAbsTimestamp = false;
-
-	video_pkt.m_headerType = RTMP_PACKET_SIZE_LARGE;
-	video_pkt.m_nTimeStamp = 0;
-	video_pkt.m_nBodySize = SPS_LEN + PPS_LEN + 16;
-	rtmppacket_alloc(&video_pkt, video_pkt.m_nBodySize);
-	rtmp_write_avc_sequence_header_tag(video_pkt.m_body,
+	ret = rtmp_publisher_send_avc_sequence_header(rtmp_pub,
 						sps_buf, SPS_LEN,
 						pps_buf, PPS_LEN);
+	if (ret < 0)
+		return -1;
 
-	ret = rtmp_isconnected(rtmp);
-	if (ret == true) {
-		/* true: send to outqueue;false: send directly */
-		pthread_mutex_lock(&av_mutex);
-		ret = rtmp_sendpacket(rtmp, &video_pkt, true);
-		if (ret == false)
-			printf("rtmp send video packet fail\n");
-		pthread_mutex_unlock(&av_mutex);
-	}
-
-	rtmppacket_free(&video_pkt);
-
-
-	audio_pkt.m_headerType = RTMP_PACKET_SIZE_LARGE;
-	audio_pkt.m_nTimeStamp = 0;
-	audio_pkt.m_nBodySize = 4;
-	rtmppacket_alloc(&audio_pkt, audio_pkt.m_nBodySize);
-	rtmp_write_aac_sequence_header_tag(audio_pkt.m_body,
-					AUDIO_SAMPLERATE, AUDIO_CHANNELS);
-
-	ret = rtmp_isconnected(rtmp);
-	if (ret == true) {
-		/* true: send to outqueue;false: send directly */
-		pthread_mutex_lock(&av_mutex);
-		ret = rtmp_sendpacket(rtmp, &audio_pkt, true);
-		if (ret == false)
-			printf("rtmp send audio packet fail\n");
-		pthread_mutex_unlock(&av_mutex);
-	}
-
-	rtmppacket_free(&audio_pkt);/* rtmp send audio/video sequence header frame */
+	return rtmp_publisher_send_aac_sequence_header(rtmp_pub,
+				aac_decoder_conf, aac_decoder_conf_len);
 }
 
 int main(int argc, char *argv[])
 {
 	int ret = 0;
 
+	struct aac_enc_attr aac_attr = {
+		.channels = AUDIO_CHANNELS,
+		.samplerate = AUDIO_SAMPLERATE,
+		.bitrate = AAC_BITRATE,
+		.transport = AAC_TT_RAW,
+	};
+
+	struct rtmp_publisher_attr pub_attr = {
+		.latency_ms = RTMP_LATENCY_MS,
+		.max_queue_bytes = 0,
+		.timeout = 5,	//default 30s
+		.chunk_size = RTMP_CHUNK_SIZE,
+	};
+
 	MYVideoInputChannel chn = {
 		.channelId = 0,
 		.res = RESOLUTION_720P,
@@ -286,8 +195,6 @@ int main(int argc, char *argv[])
 	signal(SIGTERM, sig_handle);
 	signal(SIGINT, sig_handle);
 
-	pthread_mutex_init(&av_mutex, NULL);
-
 	rtmp_logsetlevel(RTMP_LOGINFO);
 
 	if (argc <= 1) {
@@ -300,18 +207,24 @@ int main(int argc, char *argv[])
 	}
 
 
-	ret = __connect2rtmpsvr(argv[1]);
+	/* the publisher connects, and reconnects, on its own thread */
+	rtmp = rtmp_alloc();
+	rtmp_init(rtmp);
+	pub_attr.url = argv[1];
+
+	ret = create_rtmp_publisher(&rtmp_pub, rtmp, &pub_attr);
 	if (ret < 0)
 		goto exit;
 
 /* create aacencoder */
-	ret = create_aac_encoder(&aac_enc_hd,
-				AUDIO_CHANNELS, AUDIO_SAMPLERATE, AAC_BITRATE,
+	ret = create_aac_encoder_ex(&aac_enc_hd, &aac_attr,
 				aac_decoder_conf, &aac_decoder_conf_len);
 	if (ret < 0)
 		goto exit;/* create aacencoder */
 
-	__rtmp_send_sequence_header();
+	ret = __rtmp_send_sequence_header();
+	if (ret < 0)
+		goto exit;
 
 /* start audio&video device and receive buffers, do muxer in callback */
 	MYAV_Context_Init();
@@ -351,7 +264,9 @@ out:
 	MYAV_Context_Release();
 
 exit:
-	pthread_mutex_destroy(&av_mutex);
+	destroy_rtmp_publisher(rtmp_pub);
+	rtmp_pub = NULL;
+	destroy_aac_encoder(&aac_enc_hd);
 	rtmp_close(rtmp);
 	rtmp_free(rtmp);
 	rtmp = NULL;
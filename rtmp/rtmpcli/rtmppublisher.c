@@ -0,0 +1,685 @@
+/*
+ * @file rtmppublisher.c
+ * asynchronous rtmp publishing on top of [myrtmp]
+ *
+ * Copyright (C) 2019      Steve Liu<steveliu121@163.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "rtmppublisher.h"
+
+#define STAT_ADD(pub, field, n) \
+	__atomic_fetch_add(&(pub)->stat.field, (n), __ATOMIC_RELAXED)
+#define STAT_GET(pub, field) \
+	__atomic_load_n(&(pub)->stat.field, __ATOMIC_RELAXED)
+
+static struct rtmp_pub_frame *rtmp_pub_frame_alloc(struct rtmp_pool *pool,
+							uint32_t size)
+{
+	struct rtmp_pub_frame *frame = NULL;
+
+	frame = (struct rtmp_pub_frame *)rtmp_pool_alloc(pool,
+				sizeof(struct rtmp_pub_frame) +
+				RTMP_MAX_HEADER_SIZE + size);
+	if (frame == NULL)
+		return NULL;
+
+	memset(frame, 0, sizeof(struct rtmp_pub_frame));
+	frame->size = size;
+	frame->body = frame->data + RTMP_MAX_HEADER_SIZE;
+
+	return frame;
+}
+
+static void rtmp_pub_push(struct rtmp_publisher *pub,
+				struct rtmp_pub_frame *frame)
+{
+	struct rtmp_pub_frame *prev = NULL;
+
+	__atomic_store_n(&frame->next, NULL, __ATOMIC_RELAXED);
+	prev = __atomic_exchange_n(&pub->head, frame, __ATOMIC_ACQ_REL);
+	/* the sender can not get past @prev until this store */
+	__atomic_store_n(&prev->next, frame, __ATOMIC_RELEASE);
+}
+
+/* NULL when empty, or when a producer has swapped @head but not linked
+ * its frame yet, it checks @waiting after that so the sender is woken
+ * again */
+static struct rtmp_pub_frame *rtmp_pub_pop(struct rtmp_publisher *pub)
+{
+	struct rtmp_pub_frame *tail = pub->tail;
+	struct rtmp_pub_frame *next = NULL;
+
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (tail == &pub->stub) {
+		if (next == NULL)
+			return NULL;
+		pub->tail = next;
+		tail = next;
+		next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	}
+	if (next) {
+		pub->tail = next;
+		return tail;
+	}
+
+	if (tail != __atomic_load_n(&pub->head, __ATOMIC_ACQUIRE))
+		return NULL;
+
+	/* @tail is the last one, put @stub behind it to take it out */
+	rtmp_pub_push(pub, &pub->stub);
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next) {
+		pub->tail = next;
+		return tail;
+	}
+
+	return NULL;
+}
+
+static int rtmp_pub_queue(struct rtmp_publisher *pub,
+				struct rtmp_pub_frame *frame)
+{
+	uint32_t queued = 0;
+
+	queued = __atomic_add_fetch(&pub->queued_bytes, frame->size,
+							__ATOMIC_RELAXED);
+	if (!frame->header && queued > pub->max_queue_bytes) {
+		__atomic_sub_fetch(&pub->queued_bytes, frame->size,
+							__ATOMIC_RELAXED);
+		STAT_ADD(pub, dropped_full, 1);
+		rtmp_pool_free(frame);
+		return -1;
+	}
+
+	if (!frame->header)
+		__atomic_store_n(&pub->newest_ts, frame->timestamp,
+							__ATOMIC_RELAXED);
+	rtmp_pub_push(pub, frame);
+	/* one post per sleep, not per frame, else the sender would go round
+	 * once for every stale post; pairs with [rtmp_pub_next] */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&pub->waiting, __ATOMIC_RELAXED) &&
+			__atomic_exchange_n(&pub->waiting, 0, __ATOMIC_ACQ_REL))
+		sem_post(&pub->sem);
+
+	return 0;
+}
+
+/* the sequence header frames are kept for the sender to send again */
+static void rtmp_pub_keep_header(struct rtmp_publisher *pub,
+				struct rtmp_pub_frame *frame)
+{
+	struct rtmp_pub_frame **keep = frame->type == RTMP_PUB_FRAME_VIDEO ?
+					&pub->avc_header : &pub->aac_header;
+
+	rtmp_pool_free(*keep);
+	*keep = frame;
+}
+
+static void rtmp_pub_gop_reset(struct rtmp_publisher *pub)
+{
+	struct rtmp_pub_frame *frame = NULL;
+
+	while (pub->gop) {
+		frame = pub->gop;
+		pub->gop = frame->next;
+		rtmp_pool_free(frame);
+	}
+	pub->gop_tail = &pub->gop;
+	pub->gop_bytes = 0;
+	pub->gop_valid = 0;
+}
+
+/* a frame that was sent(or failed to) joins the gop kept for replay, a
+ * keyframe starts a new one, without reconnect nothing is kept */
+static void rtmp_pub_gop_keep(struct rtmp_publisher *pub,
+				struct rtmp_pub_frame *frame)
+{
+	if (pub->url[0] == '\0') {
+		rtmp_pool_free(frame);
+		return;
+	}
+
+	if (frame->type == RTMP_PUB_FRAME_VIDEO && frame->keyframe) {
+		rtmp_pub_gop_reset(pub);
+		pub->gop_valid = 1;
+	}
+	if (!pub->gop_valid ||
+			pub->gop_bytes + frame->size > pub->max_gop_bytes) {
+		rtmp_pub_gop_reset(pub);
+		rtmp_pool_free(frame);
+		return;
+	}
+
+	frame->next = NULL;
+	*pub->gop_tail = frame;
+	pub->gop_tail = &frame->next;
+	pub->gop_bytes += frame->size;
+}
+
+/*
+ * @lag: how far @frame is behind the newest frame queued
+ * up to @latency_ms everything goes, past it the non-reference video
+ * frames are dropped, past twice that the rest of the gop(and the audio
+ * as old) is given up, the video resumes with the next keyframe that is
+ * not that late
+ * @return: 1 send it, 0 drop it
+ */
+static int rtmp_pub_admit(struct rtmp_publisher *pub,
+				const struct rtmp_pub_frame *frame, int32_t lag)
+{
+	if (frame->header)
+		return 1;
+
+	if (frame->type == RTMP_PUB_FRAME_AUDIO) {
+		if (lag > 2 * pub->latency_ms) {
+			STAT_ADD(pub, dropped_audio, 1);
+			return 0;
+		}
+		return 1;
+	}
+
+	if (lag > 2 * pub->latency_ms) {
+		pub->skip_gop = 1;
+		STAT_ADD(pub, dropped_gop, 1);
+		return 0;
+	}
+	if (pub->skip_gop) {
+		if (!frame->keyframe) {
+			STAT_ADD(pub, dropped_gop, 1);
+			return 0;
+		}
+		pub->skip_gop = 0;
+	}
+	if (lag > pub->latency_ms && !frame->ref) {
+		STAT_ADD(pub, dropped_nonref, 1);
+		return 0;
+	}
+
+	return 1;
+}
+
+static int rtmp_pub_send(struct rtmp_publisher *pub,
+				struct rtmp_pub_frame *frame)
+{
+	RTMPPacket *packet = &pub->packet;
+	int ret = 0;
+
+	packet->m_headerType = RTMP_PACKET_SIZE_LARGE;
+	packet->m_packetType = frame->type == RTMP_PUB_FRAME_VIDEO ?
+				RTMP_PACKET_TYPE_VIDEO : RTMP_PACKET_TYPE_AUDIO;
+	packet->m_nChannel = 0x04;
+	packet->m_nInfoField2 = pub->rtmp->m_stream_id;
+	packet->m_hasAbsTimestamp = false;
+	packet->m_nTimeStamp = frame->timestamp;
+	packet->m_nBodySize = frame->size;
+	packet->m_body = (char *)frame->body;
+
+	ret = rtmp_isconnected(pub->rtmp);
+	if (ret == true)
+		/* only invokes are tracked by the outqueue */
+		ret = rtmp_sendpacket(pub->rtmp, packet, false);
+	packet->m_body = NULL;
+	if (ret == false) {
+		if (STAT_ADD(pub, send_errors, 1) == 0 ||
+				__atomic_load_n(&pub->connected, __ATOMIC_RELAXED))
+			printf("rtmp send packet fail\n");
+		__atomic_store_n(&pub->connected, 0, __ATOMIC_RELAXED);
+		return -1;
+	}
+
+	__atomic_store_n(&pub->connected, 1, __ATOMIC_RELAXED);
+	STAT_ADD(pub, sent, 1);
+	STAT_ADD(pub, sent_bytes, frame->size);
+
+	return 0;
+}
+
+/* sleep @ms unless destroyed meanwhile, @return: 1 destroyed */
+static int rtmp_pub_wait(struct rtmp_publisher *pub, int ms)
+{
+	struct timespec ts;
+	int ret = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (ms % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&pub->exit_mutex);
+	while (!pub->exit && ret != ETIMEDOUT)
+		ret = pthread_cond_timedwait(&pub->exit_cond, &pub->exit_mutex,
+									&ts);
+	ret = pub->exit;
+	pthread_mutex_unlock(&pub->exit_mutex);
+
+	return ret;
+}
+
+/* a new stream for the server: the sequence headers, then the gop kept
+ * from its keyframe as far as it is still in time, else the video waits
+ * for the next keyframe; the bodies are sent as they are, librtmp(ours,
+ * ../librtmp) puts back what its chunk headers overwrite on every
+ * transport */
+static int rtmp_pub_replay(struct rtmp_publisher *pub)
+{
+	struct rtmp_pub_frame *frame = NULL;
+	int32_t lag = 0;
+
+	if (pub->avc_header && rtmp_pub_send(pub, pub->avc_header) < 0)
+		return -1;
+	if (pub->aac_header && rtmp_pub_send(pub, pub->aac_header) < 0)
+		return -1;
+
+	if (!pub->gop_valid) {
+		pub->skip_gop = 1;
+		return 0;
+	}
+
+	for (frame = pub->gop; frame; frame = frame->next) {
+		lag = (int32_t)(__atomic_load_n(&pub->newest_ts,
+					__ATOMIC_RELAXED) - frame->timestamp);
+		if (!rtmp_pub_admit(pub, frame, lag))
+			continue;
+		if (rtmp_pub_send(pub, frame) < 0)
+			return -1;
+		STAT_ADD(pub, replayed, 1);
+	}
+	/* its keyframe came too late, nothing of it is any use */
+	if (pub->skip_gop)
+		rtmp_pub_gop_reset(pub);
+
+	return 0;
+}
+
+/* connect to @url until it works, the backoff doubles after each failed
+ * attempt, then replay; frames keep queueing meanwhile and the stale
+ * ones are dropped once sending resumes */
+static void rtmp_pub_reconnect(struct rtmp_publisher *pub)
+{
+	int delay = pub->retry_min_ms;
+	int ret = 0;
+
+	for (;;) {
+		if (__atomic_load_n(&pub->exit, __ATOMIC_ACQUIRE))
+			return;
+
+		/* librtmp points into it for as long as it is connected */
+		strcpy(pub->link_url, pub->url);
+		ret = rtmp_connect_publish(pub->rtmp, pub->link_url,
+					pub->timeout, pub->chunk_size);
+		if (ret == true)
+			break;
+
+		printf("rtmp connect %s fail, retry in %d ms\n",
+							pub->url, delay);
+		if (rtmp_pub_wait(pub, delay))
+			return;
+		delay = delay < pub->retry_max_ms / 2 ?
+					delay * 2 : pub->retry_max_ms;
+	}
+
+	__atomic_store_n(&pub->connected, 1, __ATOMIC_RELAXED);
+	if (pub->sessions++ > 0) {
+		STAT_ADD(pub, reconnects, 1);
+		printf("rtmp reconnected to %s\n", pub->url);
+	}
+
+	rtmp_pub_replay(pub);
+}
+
+/* the next frame, or NULL after a sleep on @sem: a frame was queued or
+ * the publisher is destroyed */
+static struct rtmp_pub_frame *rtmp_pub_next(struct rtmp_publisher *pub)
+{
+	struct rtmp_pub_frame *frame = NULL;
+
+	frame = rtmp_pub_pop(pub);
+	if (frame)
+		return frame;
+
+	/* tell the producers, then look again: one that linked its frame
+	 * before it could see @waiting is found here */
+	__atomic_store_n(&pub->waiting, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	frame = rtmp_pub_pop(pub);
+	if (frame && __atomic_exchange_n(&pub->waiting, 0, __ATOMIC_ACQ_REL))
+		return frame;
+
+	/* a producer took @waiting, its post is coming, take it */
+	while (sem_wait(&pub->sem) < 0 && errno == EINTR)
+		;
+
+	return frame;
+}
+
+static void *rtmp_pub_send_thread(void *arg)
+{
+	struct rtmp_publisher *pub = (struct rtmp_publisher *)arg;
+	struct rtmp_pub_frame *frame = NULL;
+	int32_t lag = 0;
+
+	while (!__atomic_load_n(&pub->exit, __ATOMIC_ACQUIRE)) {
+		if (pub->url[0] && !__atomic_load_n(&pub->connected,
+							__ATOMIC_RELAXED)) {
+			rtmp_pub_reconnect(pub);
+			continue;
+		}
+
+		frame = rtmp_pub_next(pub);
+		if (frame == NULL)
+			continue;
+
+		__atomic_sub_fetch(&pub->queued_bytes, frame->size,
+							__ATOMIC_RELAXED);
+		lag = (int32_t)(__atomic_load_n(&pub->newest_ts,
+					__ATOMIC_RELAXED) - frame->timestamp);
+		if (!frame->header)
+			__atomic_store_n(&pub->stat.lag_ms, lag > 0 ? lag : 0,
+							__ATOMIC_RELAXED);
+
+		if (frame->header) {
+			rtmp_pub_send(pub, frame);
+			rtmp_pub_keep_header(pub, frame);
+		} else if (rtmp_pub_admit(pub, frame, lag)) {
+			/* kept even if it failed, to go again after the
+			 * reconnect */
+			rtmp_pub_send(pub, frame);
+			rtmp_pub_gop_keep(pub, frame);
+		} else {
+			if (pub->skip_gop)
+				rtmp_pub_gop_reset(pub);
+			rtmp_pool_free(frame);
+		}
+	}
+
+	return NULL;
+}
+
+int create_rtmp_publisher(struct rtmp_publisher **pub_hd, RTMP *rtmp,
+				const struct rtmp_publisher_attr *attr)
+{
+	struct rtmp_publisher *pub = NULL;
+	pthread_condattr_t cond_attr;
+	int ret = 0;
+
+	pub = (struct rtmp_publisher *)calloc(1, sizeof(struct rtmp_publisher));
+	if (pub == NULL) {
+		printf("Malloc RTMP publisher fail\n");
+		return -1;
+	}
+
+	pub->rtmp = rtmp;
+	pub->latency_ms = RTMP_PUB_DEFAULT_LATENCY_MS;
+	pub->max_queue_bytes = RTMP_PUB_DEFAULT_QUEUE_BYTES;
+	if (attr && attr->latency_ms > 0)
+		pub->latency_ms = attr->latency_ms;
+	if (attr && attr->max_queue_bytes > 0)
+		pub->max_queue_bytes = attr->max_queue_bytes;
+	pub->retry_min_ms = RTMP_PUB_DEFAULT_RETRY_MIN_MS;
+	pub->retry_max_ms = RTMP_PUB_DEFAULT_RETRY_MAX_MS;
+	pub->max_gop_bytes = RTMP_PUB_DEFAULT_GOP_BYTES;
+	if (attr && attr->url) {
+		if (strlen(attr->url) >= sizeof(pub->url)) {
+			printf("RTMP url too long: %s\n", attr->url);
+			free(pub);
+			return -1;
+		}
+		strcpy(pub->url, attr->url);
+		pub->timeout = attr->timeout;
+		pub->chunk_size = attr->chunk_size;
+		if (attr->retry_min_ms > 0)
+			pub->retry_min_ms = attr->retry_min_ms;
+		if (attr->retry_max_ms > 0)
+			pub->retry_max_ms = attr->retry_max_ms;
+		if (attr->max_gop_bytes > 0)
+			pub->max_gop_bytes = attr->max_gop_bytes;
+	} else {
+		/* the caller's connection */
+		pub->connected = 1;
+		pub->sessions = 1;
+	}
+	if (pub->retry_max_ms < pub->retry_min_ms)
+		pub->retry_max_ms = pub->retry_min_ms;
+	pub->head = &pub->stub;
+	pub->tail = &pub->stub;
+	pub->gop_tail = &pub->gop;
+	rtmppacket_reset(&pub->packet);
+
+	if (rtmp_pool_create(&pub->pool[RTMP_PUB_FRAME_VIDEO]) < 0 ||
+			rtmp_pool_create(&pub->pool[RTMP_PUB_FRAME_AUDIO]) < 0)
+		goto exit;
+
+	ret = sem_init(&pub->sem, 0, 0);
+	if (ret < 0) {
+		printf("Init RTMP publisher semaphore fail: %s\n",
+							strerror(errno));
+		goto exit;
+	}
+
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&pub->exit_cond, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+	pthread_mutex_init(&pub->exit_mutex, NULL);
+
+	ret = pthread_create(&pub->send_thread, NULL, rtmp_pub_send_thread,
+									pub);
+	if (ret) {
+		printf("Create RTMP publisher thread fail: %s\n",
+							strerror(ret));
+		pthread_mutex_destroy(&pub->exit_mutex);
+		pthread_cond_destroy(&pub->exit_cond);
+		sem_destroy(&pub->sem);
+		goto exit;
+	}
+
+	*pub_hd = pub;
+
+	return 0;
+
+exit:
+	rtmp_pool_destroy(pub->pool[RTMP_PUB_FRAME_VIDEO]);
+	rtmp_pool_destroy(pub->pool[RTMP_PUB_FRAME_AUDIO]);
+	free(pub);
+
+	return -1;
+}
+
+void destroy_rtmp_publisher(struct rtmp_publisher *pub)
+{
+	struct rtmp_pub_frame *frame = NULL;
+
+	if (pub == NULL)
+		return;
+
+	pthread_mutex_lock(&pub->exit_mutex);
+	__atomic_store_n(&pub->exit, 1, __ATOMIC_RELEASE);
+	pthread_cond_signal(&pub->exit_cond);
+	pthread_mutex_unlock(&pub->exit_mutex);
+	sem_post(&pub->sem);
+	pthread_join(pub->send_thread, NULL);
+
+	/* the producers are gone too */
+	while ((frame = rtmp_pub_pop(pub)) != NULL)
+		rtmp_pool_free(frame);
+
+	rtmp_pub_gop_reset(pub);
+	rtmp_pool_free(pub->reserved);
+	rtmp_pool_free(pub->avc_header);
+	rtmp_pool_free(pub->aac_header);
+	rtmp_pool_destroy(pub->pool[RTMP_PUB_FRAME_VIDEO]);
+	rtmp_pool_destroy(pub->pool[RTMP_PUB_FRAME_AUDIO]);
+	pthread_mutex_destroy(&pub->exit_mutex);
+	pthread_cond_destroy(&pub->exit_cond);
+	sem_destroy(&pub->sem);
+	free(pub);
+}
+
+int rtmp_publisher_send_avc_sequence_header(struct rtmp_publisher *pub,
+				const uint8_t *sps, uint32_t sps_len,
+				const uint8_t *pps, uint32_t pps_len)
+{
+	struct rtmp_pub_frame *frame = NULL;
+
+	frame = rtmp_pub_frame_alloc(NULL, sps_len + pps_len + 16);
+	if (frame == NULL) {
+		printf("Malloc AVC sequence header fail\n");
+		return -1;
+	}
+	frame->type = RTMP_PUB_FRAME_VIDEO;
+	frame->keyframe = 1;
+	frame->ref = 1;
+	frame->header = 1;
+	rtmp_write_avc_sequence_header_tag(frame->body, sps, sps_len,
+							pps, pps_len);
+
+	return rtmp_pub_queue(pub, frame);
+}
+
+int rtmp_publisher_send_aac_sequence_header(struct rtmp_publisher *pub,
+				const uint8_t *asc, uint32_t asc_len)
+{
+	struct rtmp_pub_frame *frame = NULL;
+
+	frame = rtmp_pub_frame_alloc(NULL, asc_len + 2);
+	if (frame == NULL) {
+		printf("Malloc AAC sequence header fail\n");
+		return -1;
+	}
+	frame->type = RTMP_PUB_FRAME_AUDIO;
+	frame->header = 1;
+	rtmp_write_aac_sequence_header_tag(frame->body, asc, asc_len);
+
+	return rtmp_pub_queue(pub, frame);
+}
+
+uint8_t *rtmp_publisher_reserve_avc(struct rtmp_publisher *pub,
+				uint32_t max_len)
+{
+	struct rtmp_pub_frame *frame = pub->reserved;
+
+	if (frame == NULL || frame->size < max_len + 5) {
+		rtmp_pool_free(frame);
+		frame = rtmp_pub_frame_alloc(pub->pool[RTMP_PUB_FRAME_VIDEO],
+								max_len + 5);
+		pub->reserved = frame;
+		if (frame == NULL) {
+			printf("Malloc AVC frame fail\n");
+			return NULL;
+		}
+	}
+
+	return frame->body + 5;
+}
+
+int rtmp_publisher_commit_avc(struct rtmp_publisher *pub,
+				uint32_t data_len, uint32_t timestamp,
+				int keyframe)
+{
+	struct rtmp_pub_frame *frame = pub->reserved;
+	const uint8_t *data = NULL;
+	int ret = 0;
+
+	if (frame == NULL)
+		return -1;
+
+	/* a frame lost to a full queue breaks the rest of its gop, the
+	 * buffer is kept for the next one */
+	if (pub->wait_keyframe && !keyframe) {
+		STAT_ADD(pub, dropped_full, 1);
+		return -1;
+	}
+
+	pub->reserved = NULL;
+	data = rtmp_put_avc_data_header(frame->body, keyframe);
+	frame->type = RTMP_PUB_FRAME_VIDEO;
+	frame->timestamp = timestamp;
+	frame->size = data_len + 5;
+	frame->keyframe = !!keyframe;
+	/* nal_ref_idc of the first NALU */
+	frame->ref = data_len > 4 ? (data[4] >> 5) & 0x03 : 1;
+	frame->ref = keyframe || frame->ref;
+
+	ret = rtmp_pub_queue(pub, frame);
+	pub->wait_keyframe = ret < 0;
+
+	return ret;
+}
+
+int rtmp_publisher_send_avc(struct rtmp_publisher *pub,
+				const uint8_t *data, uint32_t data_len,
+				uint32_t timestamp, int keyframe)
+{
+	uint8_t *nalus = NULL;
+
+	if (pub->wait_keyframe && !keyframe) {
+		STAT_ADD(pub, dropped_full, 1);
+		return -1;
+	}
+
+	nalus = rtmp_publisher_reserve_avc(pub, data_len);
+	if (nalus == NULL) {
+		pub->wait_keyframe = 1;
+		return -1;
+	}
+	memcpy(nalus, data, data_len);
+
+	return rtmp_publisher_commit_avc(pub, data_len, timestamp, keyframe);
+}
+
+int rtmp_publisher_send_aac(struct rtmp_publisher *pub,
+				const uint8_t *data, uint32_t data_len,
+				uint32_t timestamp)
+{
+	struct rtmp_pub_frame *frame = NULL;
+
+	frame = rtmp_pub_frame_alloc(pub->pool[RTMP_PUB_FRAME_AUDIO],
+								data_len + 2);
+	if (frame == NULL) {
+		printf("Malloc AAC frame fail\n");
+		return -1;
+	}
+	frame->type = RTMP_PUB_FRAME_AUDIO;
+	frame->timestamp = timestamp;
+	frame->keyframe = 1;
+	frame->ref = 1;
+	rtmp_write_aac_data_tag(frame->body, data, data_len);
+
+	return rtmp_pub_queue(pub, frame);
+}
+
+void rtmp_publisher_get_stat(struct rtmp_publisher *pub,
+				struct rtmp_publisher_stat *stat)
+{
+	stat->sent = STAT_GET(pub, sent);
+	stat->sent_bytes = STAT_GET(pub, sent_bytes);
+	stat->dropped_full = STAT_GET(pub, dropped_full);
+	stat->dropped_nonref = STAT_GET(pub, dropped_nonref);
+	stat->dropped_gop = STAT_GET(pub, dropped_gop);
+	stat->dropped_audio = STAT_GET(pub, dropped_audio);
+	stat->send_errors = STAT_GET(pub, send_errors);
+	stat->reconnects = STAT_GET(pub, reconnects);
+	stat->replayed = STAT_GET(pub, replayed);
+	stat->allocs = __atomic_load_n(&pub->pool[RTMP_PUB_FRAME_VIDEO]->allocs,
+					__ATOMIC_RELAXED) +
+			__atomic_load_n(&pub->pool[RTMP_PUB_FRAME_AUDIO]->allocs,
+					__ATOMIC_RELAXED);
+	stat->lag_ms = STAT_GET(pub, lag_ms);
+	stat->connected = __atomic_load_n(&pub->connected, __ATOMIC_RELAXED);
+	stat->queued_bytes = __atomic_load_n(&pub->queued_bytes,
+							__ATOMIC_RELAXED);
+}
@@ -0,0 +1,199 @@
+/*
+ * @file rtmppublisher.h
+ * asynchronous rtmp publishing on top of [myrtmp]
+ *
+ * Copyright (C) 2019      Steve Liu<steveliu121@163.com>
+ */
+
+#ifndef RTMP_PUBLISHER_H_
+#define RTMP_PUBLISHER_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "myrtmp.h"
+
+/* lag(ms) of the send queue before frames get dropped */
+#define RTMP_PUB_DEFAULT_LATENCY_MS	1000
+/* bytes queued before the capture side drops frames itself */
+#define RTMP_PUB_DEFAULT_QUEUE_BYTES	(4 * 1024 * 1024)
+/* first and longest wait between two reconnects */
+#define RTMP_PUB_DEFAULT_RETRY_MIN_MS	500
+#define RTMP_PUB_DEFAULT_RETRY_MAX_MS	30000
+/* a longer gop is not kept for replay */
+#define RTMP_PUB_DEFAULT_GOP_BYTES	(2 * 1024 * 1024)
+#define RTMP_PUB_URL_LEN		512
+
+/*
+ * @latency_ms: once the oldest frame queued is that much older than the
+ * newest one, non-reference video frames are dropped, at twice that the
+ * rest of the gop and the stale audio go too, 0 for the default
+ * @max_queue_bytes: hard bound of the queue, a frame that does not fit is
+ * dropped by the capture thread(video then waits for a keyframe), 0 for
+ * the default
+ * @url: NULL: the caller connects @rtmp and a lost connection is only
+ * counted; else the publisher connects to it itself, and after a send
+ * fails it reconnects, resends the sequence headers and replays the
+ * current gop from its keyframe
+ * @timeout/@chunk_size: as for [rtmp_connect_publish]
+ * @retry_min_ms/@retry_max_ms: reconnect backoff, doubled after each
+ * failed attempt, 0 for the defaults
+ * @max_gop_bytes: the gop kept for replay, 0 for the default
+ */
+struct rtmp_publisher_attr {
+	int latency_ms;
+	uint32_t max_queue_bytes;
+	const char *url;
+	int timeout;
+	int chunk_size;
+	int retry_min_ms;
+	int retry_max_ms;
+	uint32_t max_gop_bytes;
+};
+
+enum {
+	RTMP_PUB_FRAME_VIDEO = 0,
+	RTMP_PUB_FRAME_AUDIO,
+};
+
+/* one packet body with the chunk header room [rtmp_sendpacket] needs in
+ * front of it, @body = @data + RTMP_MAX_HEADER_SIZE, in a buffer of the
+ * pool of its type(the sequence headers are malloc'd) */
+struct rtmp_pub_frame {
+	struct rtmp_pub_frame *next;
+	uint32_t timestamp;
+	uint32_t size;		/* of @body */
+	uint8_t type;
+	uint8_t keyframe;
+	uint8_t ref;		/* nal_ref_idc != 0 */
+	uint8_t header;		/* sequence header, never dropped */
+	uint8_t *body;
+	uint8_t data[];
+};
+
+struct rtmp_publisher_stat {
+	uint64_t sent;
+	uint64_t sent_bytes;
+	uint64_t dropped_full;	/* by the capture side, queue full */
+	uint64_t dropped_nonref;
+	uint64_t dropped_gop;	/* video of the gops given up */
+	uint64_t dropped_audio;	/* stale audio while catching up */
+	uint64_t send_errors;
+	uint64_t reconnects;	/* successful ones */
+	uint64_t replayed;	/* frames sent again after a reconnect */
+	uint64_t allocs;	/* frame buffers malloc'd, not recycled */
+	uint32_t queued_bytes;
+	uint32_t lag_ms;	/* of the last frame taken by the sender */
+	int connected;
+};
+
+/*
+ * capture threads only copy a frame, link it into @head and post @sem
+ * if the sender is asleep(@waiting), they never take a lock nor touch
+ * the socket; @send_thread is the only one that chunks and writes to
+ * @rtmp
+ * the queue is an intrusive mpsc list(Vyukov): producers swap @head, the
+ * sender walks from @tail, @stub keeps it from ever being empty
+ * with an url the sender also owns the connection: it reconnects on its
+ * own while the capture side goes on queueing
+ */
+struct rtmp_publisher {
+	RTMP *rtmp;
+	int latency_ms;
+	uint32_t max_queue_bytes;
+
+	struct rtmp_pub_frame *head;	/* producers, atomic */
+	struct rtmp_pub_frame *tail;	/* sender only */
+	struct rtmp_pub_frame stub;
+	sem_t sem;
+	int waiting;			/* atomic, sender on @sem */
+	uint32_t queued_bytes;		/* atomic */
+	uint32_t newest_ts;		/* atomic, of the last frame queued */
+	int wait_keyframe;		/* video producer only */
+	/* allocated by the producer of each type, freed by the sender */
+	struct rtmp_pool *pool[2];
+	struct rtmp_pub_frame *reserved;	/* video producer only */
+	int exit;			/* atomic */
+	pthread_t send_thread;
+
+	/* sender only */
+	int skip_gop;
+	struct rtmp_pub_frame *avc_header;
+	struct rtmp_pub_frame *aac_header;
+	RTMPPacket packet;
+
+	/* reconnect, sender only but @exit_cond, which cuts the backoff short
+	 * when destroyed */
+	char url[RTMP_PUB_URL_LEN];
+	char link_url[RTMP_PUB_URL_LEN]; /* librtmp's while connected */
+	int timeout;
+	int chunk_size;
+	int retry_min_ms;
+	int retry_max_ms;
+	int connected;			/* atomic, stat */
+	unsigned int sessions;
+	pthread_mutex_t exit_mutex;
+	pthread_cond_t exit_cond;
+	/* frames sent since the last keyframe, video and audio in order,
+	 * @gop_valid: it starts with that keyframe and was not cut short by
+	 * @max_gop_bytes */
+	struct rtmp_pub_frame *gop;
+	struct rtmp_pub_frame **gop_tail;
+	uint32_t gop_bytes;
+	uint32_t max_gop_bytes;
+	int gop_valid;
+
+	struct rtmp_publisher_stat stat; /* atomic counters */
+};
+
+/*
+ * @rtmp: owned by the caller, connected and ready to publish, or just
+ * through [rtmp_init] when @attr->url is given, only the publisher's
+ * thread touches it until [destroy_rtmp_publisher]
+ * @attr: NULL for the defaults
+ * @return: '0' on success, '-1' on fail
+ */
+int create_rtmp_publisher(struct rtmp_publisher **pub_hd, RTMP *rtmp,
+				const struct rtmp_publisher_attr *attr);
+/* stops the sender, frames still queued are dropped */
+void destroy_rtmp_publisher(struct rtmp_publisher *pub);
+
+/* sequence headers go ahead of the frames queued after them and are
+ * never dropped */
+int rtmp_publisher_send_avc_sequence_header(struct rtmp_publisher *pub,
+				const uint8_t *sps, uint32_t sps_len,
+				const uint8_t *pps, uint32_t pps_len);
+int rtmp_publisher_send_aac_sequence_header(struct rtmp_publisher *pub,
+				const uint8_t *asc, uint32_t asc_len);
+
+/*
+ * the frame is copied, none of these block on the network
+ * one thread per media type, @timestamp(ms) of both on the same clock
+ * @data: avc: 4 bytes length prefixed NALUs of one access unit
+ *	  aac: raw access unit, no ADTS
+ * @return: '0' queued, '-1' dropped
+ */
+int rtmp_publisher_send_avc(struct rtmp_publisher *pub,
+				const uint8_t *data, uint32_t data_len,
+				uint32_t timestamp, int keyframe);
+/*
+ * zero copy [rtmp_publisher_send_avc]: the access unit is written as
+ * 4 bytes length prefixed NALUs straight into the packet at the address
+ * returned(behind the VIDEODATA header), at most @max_len bytes, then
+ * queued by [rtmp_publisher_commit_avc] with the length written
+ * @return: NULL on fail
+ */
+uint8_t *rtmp_publisher_reserve_avc(struct rtmp_publisher *pub,
+				uint32_t max_len);
+int rtmp_publisher_commit_avc(struct rtmp_publisher *pub,
+				uint32_t data_len, uint32_t timestamp,
+				int keyframe);
+int rtmp_publisher_send_aac(struct rtmp_publisher *pub,
+				const uint8_t *data, uint32_t data_len,
+				uint32_t timestamp);
+
+void rtmp_publisher_get_stat(struct rtmp_publisher *pub,
+				struct rtmp_publisher_stat *stat);
+
+#endif // RTMP_PUBLISHER_H_